@@ -3,6 +3,7 @@
 #include "assetmanagerfilehandle.h"
 #include "assetmanagerfileistream.h"
 #include "../common/utils.h"
+#include "../nekodata/nekodatapreloader.h"
 
 #include <android/asset_manager.h>
 #include <cstring>
@@ -63,6 +64,10 @@ namespace nekofs {
 	{
 		return FileSystemType::AssetManager;
 	}
+	std::shared_ptr<Prefetch> AssetManagerFileSystem::prefetch(const std::vector<std::string>& filepaths, int32_t priority, bool decompress)
+	{
+		return NekodataPreloader::prefetch(shared_from_this(), filepaths, priority, decompress);
+	}
 
 
 	std::vector<std::string> AssetManagerFileSystem::getFiles(const std::string& dirpath) const
@@ -26,6 +26,7 @@ namespace nekofs {
 		FileType getFileType(const std::string& path) const override;
 		int64_t getSize(const std::string& filepath) const override;
 		FileSystemType getFSType() const override;
+		std::shared_ptr<Prefetch> prefetch(const std::vector<std::string>& filepaths, int32_t priority, bool decompress) override;
 
 	public:
 		AssetManagerFileSystem() = default;
@@ -0,0 +1,420 @@
+﻿#include "accesstrace.h"
+#include "env.h"
+#include "utils.h"
+#ifdef _WIN32
+#include "../native_win/nativefilesystem.h"
+#else
+#include "../native_posix/nativefilesystem.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+namespace nekofs {
+	namespace {
+		constexpr uint8_t kTag_Path = 1;
+		constexpr uint8_t kTag_Record = 2;
+		constexpr uint8_t kTag_Dropped = 3;
+		constexpr uint64_t kVersion = 1;
+		thread_local bool t_ignored = false;
+
+		void writeVarint(std::vector<uint8_t>& data, uint64_t value)
+		{
+			while (value >= 0x80)
+			{
+				data.push_back(static_cast<uint8_t>(value) | 0x80);
+				value >>= 7;
+			}
+			data.push_back(static_cast<uint8_t>(value));
+		}
+		bool readVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value)
+		{
+			value = 0;
+			for (int shift = 0; p < end && shift < 64; shift += 7)
+			{
+				const uint8_t byte = *p++;
+				value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+				if ((byte & 0x80) == 0)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+		uint64_t zigzag(int64_t value)
+		{
+			return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+		}
+		int64_t unzigzag(uint64_t value)
+		{
+			return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+		}
+	}
+
+	/*
+	* 单生产者单消费者的环形缓冲区，所属线程写入head，flush读取到head后更新tail。
+	*/
+	struct AccessTrace::ThreadBuffer final
+	{
+		static constexpr uint32_t kSize = 8192;
+		std::array<AccessTraceRecord, kSize> records;
+		std::atomic<uint32_t> head = 0;
+		std::atomic<uint32_t> tail = 0;
+		std::atomic<uint64_t> dropped = 0;
+		uint64_t flushedDropped = 0;
+		uint32_t session = 0;
+		uint32_t threadId = 0;
+		std::unordered_map<std::string, uint32_t> pathIds; // 线程内缓存，命中时不需要加锁
+	};
+
+	void AccessTrace::ignoreCurrentThread()
+	{
+		t_ignored = true;
+	}
+	AccessTrace& AccessTrace::getInstance()
+	{
+		// 不析构，见类的说明
+		static AccessTrace* instance = new AccessTrace();
+		return *instance;
+	}
+	int64_t AccessTrace::now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	bool AccessTrace::start(const std::string& filepath)
+	{
+		std::lock_guard lock(mtx_);
+		if (isEnabled() || flushThread_.joinable())
+		{
+			logerr(u8"AccessTrace::start error ! already started.");
+			return false;
+		}
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		if (nativefs->getFileType(filepath) != FileType::None && !nativefs->removeFile(filepath))
+		{
+			logerr(u8"AccessTrace::start error ! can not remove " + filepath);
+			return false;
+		}
+		os_ = nativefs->openOStream(filepath);
+		if (!os_)
+		{
+			logerr(u8"AccessTrace::start error ! can not open " + filepath);
+			return false;
+		}
+		std::vector<uint8_t> data(nekofs_kAccessTrace_FileHeader.begin(), nekofs_kAccessTrace_FileHeader.end());
+		writeVarint(data, kVersion);
+		writeVarint(data, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count()));
+		if (ostream_write(os_, data.data(), static_cast<int32_t>(data.size())) != static_cast<int32_t>(data.size()))
+		{
+			logerr(u8"AccessTrace::start error ! can not write " + filepath);
+			os_.reset();
+			return false;
+		}
+		beginTime_ = now();
+		stopping_ = false;
+		session_.fetch_add(1, std::memory_order_release);
+		enabled_.store(true, std::memory_order_release);
+		flushThread_ = std::thread(&AccessTrace::flushfunction, this);
+		return true;
+	}
+	bool AccessTrace::stop()
+	{
+		{
+			std::lock_guard lock(mtx_);
+			if (!flushThread_.joinable())
+			{
+				return false;
+			}
+			enabled_.store(false, std::memory_order_release);
+			stopping_ = true;
+		}
+		cond_.notify_all();
+		flushThread_.join();
+		// 还在记录中的线程可能在最后一次flush之后才写入，这些记录会被丢弃
+		bool success = flush();
+		std::lock_guard lock(mtx_);
+		os_.reset();
+		buffers_.clear();
+		paths_.clear();
+		pathIds_.clear();
+		flushedPaths_ = 0;
+		threadNum_ = 0;
+		return success;
+	}
+	void AccessTrace::record(AccessTraceEvent event, const std::string& path, int64_t index, int64_t size, int64_t beginTime, bool cacheHit)
+	{
+		if (t_ignored)
+		{
+			return;
+		}
+		ThreadBuffer* buffer = getThreadBuffer();
+		if (buffer == nullptr)
+		{
+			return;
+		}
+		const int64_t endTime = now();
+		const uint32_t head = buffer->head.load(std::memory_order_relaxed);
+		if (head - buffer->tail.load(std::memory_order_acquire) >= ThreadBuffer::kSize)
+		{
+			buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		AccessTraceRecord& record = buffer->records[head % ThreadBuffer::kSize];
+		record.timestamp = beginTime - beginTime_;
+		record.latency = endTime - beginTime;
+		record.index = index;
+		record.size = size;
+		record.pathId = getPathId(*buffer, path);
+		record.threadId = buffer->threadId;
+		record.event = event;
+		record.cacheHit = cacheHit;
+		buffer->head.store(head + 1, std::memory_order_release);
+	}
+	AccessTrace::ThreadBuffer* AccessTrace::getThreadBuffer()
+	{
+		thread_local std::shared_ptr<ThreadBuffer> buffer;
+		const uint32_t session = session_.load(std::memory_order_acquire);
+		if (!buffer || buffer->session != session)
+		{
+			// 第一次记录，或者是上一次开启时的缓冲区
+			auto newBuffer = std::make_shared<ThreadBuffer>();
+			std::lock_guard lock(mtx_);
+			if (!isEnabled() || session_.load(std::memory_order_relaxed) != session)
+			{
+				return nullptr;
+			}
+			newBuffer->session = session;
+			newBuffer->threadId = threadNum_++;
+			buffers_.push_back(newBuffer);
+			buffer = newBuffer;
+		}
+		return buffer.get();
+	}
+	uint32_t AccessTrace::getPathId(ThreadBuffer& buffer, const std::string& path)
+	{
+		auto it = buffer.pathIds.find(path);
+		if (it != buffer.pathIds.end())
+		{
+			return it->second;
+		}
+		uint32_t id = 0;
+		{
+			std::lock_guard lock(mtx_);
+			auto pit = pathIds_.find(path);
+			if (pit == pathIds_.end())
+			{
+				pit = pathIds_.emplace(path, static_cast<uint32_t>(paths_.size())).first;
+				paths_.push_back(path);
+			}
+			id = pit->second;
+		}
+		buffer.pathIds.emplace(path, id);
+		return id;
+	}
+	void AccessTrace::flushfunction()
+	{
+		std::unique_lock lock(mtx_);
+		while (!stopping_)
+		{
+			cond_.wait_for(lock, std::chrono::milliseconds(100));
+			lock.unlock();
+			flush();
+			lock.lock();
+		}
+	}
+	/*
+	* 先取出所有线程的记录，再写出新增的路径，记录中用到的路径一定已经登记过。路径写在记录之前。
+	*/
+	bool AccessTrace::flush()
+	{
+		std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+		{
+			std::lock_guard lock(mtx_);
+			buffers = buffers_;
+		}
+		std::vector<uint8_t> records;
+		for (const auto& buffer : buffers)
+		{
+			uint32_t tail = buffer->tail.load(std::memory_order_relaxed);
+			const uint32_t head = buffer->head.load(std::memory_order_acquire);
+			for (; tail != head; tail++)
+			{
+				const AccessTraceRecord& record = buffer->records[tail % ThreadBuffer::kSize];
+				records.push_back(kTag_Record);
+				records.push_back(static_cast<uint8_t>(record.event) | (record.cacheHit ? 0x80 : 0));
+				writeVarint(records, record.threadId);
+				writeVarint(records, record.pathId);
+				writeVarint(records, static_cast<uint64_t>(record.timestamp));
+				writeVarint(records, static_cast<uint64_t>(record.latency));
+				writeVarint(records, zigzag(record.index));
+				writeVarint(records, zigzag(record.size));
+			}
+			buffer->tail.store(tail, std::memory_order_release);
+			const uint64_t dropped = buffer->dropped.load(std::memory_order_relaxed);
+			if (dropped != buffer->flushedDropped)
+			{
+				records.push_back(kTag_Dropped);
+				writeVarint(records, buffer->threadId);
+				writeVarint(records, dropped - buffer->flushedDropped);
+				buffer->flushedDropped = dropped;
+			}
+		}
+		std::vector<uint8_t> data;
+		{
+			std::lock_guard lock(mtx_);
+			for (; flushedPaths_ < paths_.size(); flushedPaths_++)
+			{
+				const std::string& path = paths_[flushedPaths_];
+				data.push_back(kTag_Path);
+				writeVarint(data, flushedPaths_);
+				writeVarint(data, path.size());
+				data.insert(data.end(), path.begin(), path.end());
+			}
+			// 线程已经退出（只剩这里的引用）且记录都已取出的缓冲区不再需要
+			buffers.clear();
+			for (auto it = buffers_.begin(); it != buffers_.end();)
+			{
+				if (it->use_count() == 1 && (*it)->head.load(std::memory_order_acquire) == (*it)->tail.load(std::memory_order_relaxed))
+				{
+					it = buffers_.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+		}
+		data.insert(data.end(), records.begin(), records.end());
+		if (data.empty())
+		{
+			return true;
+		}
+		if (!os_ || ostream_write(os_, data.data(), static_cast<int32_t>(data.size())) != static_cast<int32_t>(data.size()))
+		{
+			std::stringstream ss;
+			ss << u8"AccessTrace::flush error ! size = " << data.size();
+			logerr(ss.str());
+			return false;
+		}
+		return true;
+	}
+	std::vector<std::string> AccessTrace::getFirstTouchOrder(const std::vector<std::string>& paths, const std::vector<AccessTraceRecord>& records)
+	{
+		// 每个线程的记录是有序的，不同线程之间的顺序要按时间重新排列
+		std::vector<const AccessTraceRecord*> sorted;
+		for (const auto& record : records)
+		{
+			if (record.event == AccessTraceEvent::OverlayOpen && record.pathId < paths.size())
+			{
+				sorted.push_back(&record);
+			}
+		}
+		std::stable_sort(sorted.begin(), sorted.end(), [](const AccessTraceRecord* left, const AccessTraceRecord* right) { return left->timestamp < right->timestamp; });
+		std::vector<std::string> order;
+		std::vector<bool> touched(paths.size(), false);
+		for (const auto* record : sorted)
+		{
+			if (!touched[record->pathId])
+			{
+				touched[record->pathId] = true;
+				order.push_back(paths[record->pathId]);
+			}
+		}
+		return order;
+	}
+	bool AccessTrace::load(std::shared_ptr<IStream> is, std::vector<std::string>& paths, std::vector<AccessTraceRecord>& records)
+	{
+		if (!is)
+		{
+			return false;
+		}
+		std::vector<uint8_t> data(static_cast<size_t>(is->getLength()));
+		for (size_t pos = 0; pos < data.size();)
+		{
+			const int32_t size = static_cast<int32_t>(std::min<size_t>(data.size() - pos, 4 * 1024 * 1024));
+			if (istream_read(is, data.data() + pos, size) != size)
+			{
+				logerr(u8"AccessTrace::load read error !");
+				return false;
+			}
+			pos += size;
+		}
+		const uint8_t* p = data.data();
+		const uint8_t* end = data.data() + data.size();
+		uint64_t version = 0;
+		uint64_t startTime = 0;
+		if (data.size() < nekofs_kAccessTrace_FileHeader.size() || std::memcmp(p, nekofs_kAccessTrace_FileHeader.data(), nekofs_kAccessTrace_FileHeader.size()) != 0)
+		{
+			logerr(u8"AccessTrace::load error ! invalid header.");
+			return false;
+		}
+		p += nekofs_kAccessTrace_FileHeader.size();
+		if (!readVarint(p, end, version) || version != kVersion || !readVarint(p, end, startTime))
+		{
+			logerr(u8"AccessTrace::load error ! unsupported version.");
+			return false;
+		}
+		paths.clear();
+		records.clear();
+		bool success = true;
+		while (success && p < end)
+		{
+			const uint8_t tag = *p++;
+			if (tag == kTag_Path)
+			{
+				uint64_t id = 0;
+				uint64_t length = 0;
+				success = readVarint(p, end, id) && id == paths.size() && readVarint(p, end, length) && length <= static_cast<uint64_t>(end - p);
+				if (success)
+				{
+					paths.emplace_back(reinterpret_cast<const char*>(p), static_cast<size_t>(length));
+					p += length;
+				}
+			}
+			else if (tag == kTag_Record)
+			{
+				AccessTraceRecord record;
+				uint64_t threadId = 0, pathId = 0, timestamp = 0, latency = 0, index = 0, size = 0;
+				success = p < end;
+				if (success)
+				{
+					record.event = static_cast<AccessTraceEvent>(*p & 0x7f);
+					record.cacheHit = (*p & 0x80) != 0;
+					p++;
+				}
+				success = success && readVarint(p, end, threadId) && readVarint(p, end, pathId) && readVarint(p, end, timestamp)
+					&& readVarint(p, end, latency) && readVarint(p, end, index) && readVarint(p, end, size);
+				success = success && pathId < paths.size();
+				if (success)
+				{
+					record.threadId = static_cast<uint32_t>(threadId);
+					record.pathId = static_cast<uint32_t>(pathId);
+					record.timestamp = static_cast<int64_t>(timestamp);
+					record.latency = static_cast<int64_t>(latency);
+					record.index = unzigzag(index);
+					record.size = unzigzag(size);
+					records.push_back(record);
+				}
+			}
+			else if (tag == kTag_Dropped)
+			{
+				uint64_t threadId = 0;
+				uint64_t dropped = 0;
+				success = readVarint(p, end, threadId) && readVarint(p, end, dropped);
+			}
+			else
+			{
+				success = false;
+			}
+		}
+		if (!success)
+		{
+			std::stringstream ss;
+			ss << u8"AccessTrace::load error ! invalid data at " << (p - data.data());
+			logerr(ss.str());
+		}
+		return success;
+	}
+}
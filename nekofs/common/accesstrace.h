@@ -0,0 +1,94 @@
+﻿#pragma once
+#include "typedef.h"
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+
+namespace nekofs {
+	enum class AccessTraceEvent : uint8_t
+	{
+		OverlayOpen = 1,   // OverlayFileSystem::openIStream，index为-1，size为文件大小
+		NekodataBlock = 2, // NekodataFile::getBlock，路径加上NekodataFileSystem的前缀，与OverlayOpen的路径一致。index为块序号，size为解压后大小
+		NativeRead = 3     // NativeIStream::read，index为读取位置，size为读到的大小
+	};
+	struct AccessTraceRecord final
+	{
+		int64_t timestamp = 0; // 相对开始记录时的纳秒数
+		int64_t latency = 0;   // 纳秒
+		int64_t index = 0;
+		int64_t size = 0;
+		uint32_t pathId = 0;
+		uint32_t threadId = 0;
+		AccessTraceEvent event = AccessTraceEvent::OverlayOpen;
+		bool cacheHit = false;
+	};
+
+	/*
+	* 访问记录。开启后记录文件打开、nekodata块解压和本地文件读取，写到二进制的trace文件中，用于调整文件布局和预热。
+	* 每个线程写入自己的环形缓冲区，不加锁；后台线程定期取出写到文件。缓冲区满时丢弃，并在文件中记录丢弃的数量。
+	* 实例不会析构，退出前需要显式调用stop：静态析构时等待后台线程可能死锁（Windows上持有loader lock）。
+	*/
+	class AccessTrace final
+	{
+		AccessTrace(const AccessTrace&) = delete;
+		AccessTrace(AccessTrace&&) = delete;
+		AccessTrace& operator=(const AccessTrace&) = delete;
+		AccessTrace& operator=(AccessTrace&&) = delete;
+	private:
+		struct ThreadBuffer;
+		AccessTrace() = default;
+		~AccessTrace() = default;
+
+	public:
+		static AccessTrace& getInstance();
+		static int64_t now();
+		bool start(const std::string& filepath);
+		bool stop();
+		bool isEnabled() const
+		{
+			return enabled_.load(std::memory_order_relaxed);
+		}
+		/*
+		* beginTime是操作开始时now()的值，延迟为从beginTime到调用时。
+		*/
+		void record(AccessTraceEvent event, const std::string& path, int64_t index, int64_t size, int64_t beginTime, bool cacheHit);
+		/*
+		* 当前线程之后的访问都不记录，用于预加载等后台线程，记录中只保留应用自己的访问。
+		*/
+		static void ignoreCurrentThread();
+		static bool load(std::shared_ptr<IStream> is, std::vector<std::string>& paths, std::vector<AccessTraceRecord>& records);
+		/*
+		* 按第一次打开的时间排列overlay中的文件路径，只统计文件打开的记录（未压缩的文件没有块的记录，本地文件读取的是分卷）。
+		*/
+		static std::vector<std::string> getFirstTouchOrder(const std::vector<std::string>& paths, const std::vector<AccessTraceRecord>& records);
+
+	private:
+		ThreadBuffer* getThreadBuffer();
+		uint32_t getPathId(ThreadBuffer& buffer, const std::string& path);
+		void flushfunction();
+		bool flush();
+
+	private:
+		std::atomic<bool> enabled_ = false;
+		std::atomic<uint32_t> session_ = 0;
+		int64_t beginTime_ = 0;
+		std::shared_ptr<OStream> os_;
+		std::thread flushThread_;
+		bool stopping_ = false;
+		std::mutex mtx_;
+		std::condition_variable cond_;
+		std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+		std::vector<std::string> paths_;
+		std::unordered_map<std::string, uint32_t> pathIds_;
+		size_t flushedPaths_ = 0;
+		uint32_t threadNum_ = 0;
+	};
+}
@@ -0,0 +1,100 @@
+﻿#include "bufferedostream.h"
+#include "env.h"
+#include "utils.h"
+
+#include <cstring>
+#include <sstream>
+
+namespace nekofs {
+	BufferedOStream::BufferedOStream(std::shared_ptr<OStream> os)
+	{
+		os_ = os;
+		buffer_ = env::getInstance().newBuffer64K();
+	}
+	BufferedOStream::~BufferedOStream()
+	{
+		flush();
+	}
+	bool BufferedOStream::flush()
+	{
+		if (size_ == 0)
+		{
+			return true;
+		}
+		int32_t size = size_;
+		size_ = 0;
+		if (ostream_write(os_, buffer_->data(), size) != size)
+		{
+			std::stringstream ss;
+			ss << u8"BufferedOStream::flush error ! size = ";
+			ss << size;
+			logerr(ss.str());
+			return false;
+		}
+		return true;
+	}
+	int64_t BufferedOStream::copyRange(std::shared_ptr<NativeIStream> is, int64_t size)
+	{
+		auto target = std::dynamic_pointer_cast<NativeCopyTarget>(os_);
+		if (!target || !flush())
+		{
+			return 0;
+		}
+		return target->copyRange(is, size);
+	}
+	int32_t BufferedOStream::read(void* buf, int32_t size)
+	{
+		if (!flush())
+		{
+			return -1;
+		}
+		return os_->read(buf, size);
+	}
+	int32_t BufferedOStream::write(const void* buf, int32_t size)
+	{
+		if (size < 0)
+		{
+			return -1;
+		}
+		const int32_t capacity = static_cast<int32_t>(buffer_->size());
+		if (size_ + size > capacity && !flush())
+		{
+			return -1;
+		}
+		if (size >= capacity)
+		{
+			// 大块数据不需要合并
+			return os_->write(buf, size);
+		}
+		::memcpy(buffer_->data() + size_, buf, size);
+		size_ += size;
+		return size;
+	}
+	int64_t BufferedOStream::seek(int64_t offset, const SeekOrigin& origin)
+	{
+		if (!flush())
+		{
+			return -1;
+		}
+		return os_->seek(offset, origin);
+	}
+	int64_t BufferedOStream::getPosition() const
+	{
+		int64_t pos = os_->getPosition();
+		if (pos < 0)
+		{
+			return pos;
+		}
+		return pos + size_;
+	}
+	int64_t BufferedOStream::getLength() const
+	{
+		int64_t length = os_->getLength();
+		int64_t pos = os_->getPosition();
+		if (length < 0 || pos < 0)
+		{
+			return -1;
+		}
+		return std::max(length, pos + size_);
+	}
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include "typedef.h"
+
+#include <cstdint>
+#include <array>
+#include <memory>
+
+namespace nekofs {
+	/*
+	* 写合并的OStream。小块写入先放进缓冲区，攒满后再一次性写给下层。
+	* 读、seek之前会先把缓冲区写出。析构时也会写出，但无法返回错误，需要结果时请调用flush。
+	*/
+	class BufferedOStream final : public OStream, public NativeCopyTarget, public std::enable_shared_from_this<BufferedOStream>
+	{
+		BufferedOStream(const BufferedOStream&) = delete;
+		BufferedOStream& operator=(const BufferedOStream&) = delete;
+		BufferedOStream(BufferedOStream&&) = delete;
+		BufferedOStream& operator=(BufferedOStream&&) = delete;
+	public:
+		BufferedOStream(std::shared_ptr<OStream> os);
+		~BufferedOStream();
+		bool flush();
+
+	public:
+		int32_t read(void* buf, int32_t size) override;
+		int32_t write(const void* buf, int32_t size) override;
+		int64_t seek(int64_t offset, const SeekOrigin& origin) override;
+		int64_t getPosition() const override;
+		int64_t getLength() const override;
+		int64_t copyRange(std::shared_ptr<NativeIStream> is, int64_t size) override;
+
+	private:
+		std::shared_ptr<OStream> os_;
+		std::shared_ptr<std::array<uint8_t, 64 * 1024>> buffer_;
+		int32_t size_ = 0;
+	};
+}
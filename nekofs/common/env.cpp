@@ -134,6 +134,23 @@ namespace nekofs {
 		}
 		return std::shared_ptr<std::array<uint8_t, 4 * 1024 * 1024>>(rawPtr, std::bind(&env::deleteBuffer4M, this, std::placeholders::_1));
 	}
+	std::shared_ptr<std::array<uint8_t, 64 * 1024>> env::newBuffer64K()
+	{
+		std::array<uint8_t, 64 * 1024>* rawPtr = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mutex_Buffer_64K_);
+			if (!buffer_64K_.empty())
+			{
+				rawPtr = buffer_64K_.front();
+				buffer_64K_.pop();
+			}
+		}
+		if (rawPtr == nullptr)
+		{
+			rawPtr = new std::array<uint8_t, 64 * 1024>();
+		}
+		return std::shared_ptr<std::array<uint8_t, 64 * 1024>>(rawPtr, std::bind(&env::deleteBuffer64K, this, std::placeholders::_1));
+	}
 	void env::deleteBufferBlockSize(std::array<uint8_t, nekofs_kNekoData_LZ4_Buffer_Size>* buffer)
 	{
 		{
@@ -170,6 +187,18 @@ namespace nekofs {
 		}
 		delete buffer;
 	}
+	void env::deleteBuffer64K(std::array<uint8_t, 64 * 1024>* buffer)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_Buffer_64K_);
+			if (buffer_64K_.size() < 16)
+			{
+				buffer_64K_.push(buffer);
+				return;
+			}
+		}
+		delete buffer;
+	}
 
 
 #ifdef ANDROID
@@ -39,10 +39,12 @@ namespace nekofs {
 		std::shared_ptr<std::array<uint8_t, nekofs_kNekoData_LZ4_Buffer_Size>> newBufferBlockSize();
 		std::shared_ptr<std::array<uint8_t, nekofs_kNekoData_LZ4_Compress_Buffer_Size>> newBufferCompressSize();
 		std::shared_ptr<std::array<uint8_t, 4 * 1024 * 1024>> newBuffer4M();
+		std::shared_ptr<std::array<uint8_t, 64 * 1024>> newBuffer64K();
 	private:
 		void deleteBufferBlockSize(std::array<uint8_t, nekofs_kNekoData_LZ4_Buffer_Size>* buffer);
 		void deleteBufferCompressSize(std::array<uint8_t, nekofs_kNekoData_LZ4_Compress_Buffer_Size>* buffer);
 		void deleteBuffer4M(std::array<uint8_t, 4 * 1024 * 1024>* buffer);
+		void deleteBuffer64K(std::array<uint8_t, 64 * 1024>* buffer);
 
 	private:
 		std::atomic<logdelegate*> log_;
@@ -56,6 +58,8 @@ namespace nekofs {
 		std::queue<std::array<uint8_t, nekofs_kNekoData_LZ4_Compress_Buffer_Size>*> buffer_CompressSize_;
 		std::mutex mutex_Buffer_4M_;
 		std::queue<std::array<uint8_t, 4 * 1024 * 1024>*> buffer_4M_;
+		std::mutex mutex_Buffer_64K_;
+		std::queue<std::array<uint8_t, 64 * 1024>*> buffer_64K_;
 
 
 #ifdef ANDROID
@@ -8,4 +8,8 @@ namespace nekofs {
 	constexpr int32_t nekofs_kNekoData_LZ4_Buffer_Lsh = 15;
 	constexpr int32_t nekofs_kNekoData_LZ4_Buffer_Size = 1 << nekofs_kNekoData_LZ4_Buffer_Lsh;
 	constexpr int32_t nekofs_kNekoData_LZ4_Compress_Buffer_Size = LZ4_COMPRESSBOUND(nekofs_kNekoData_LZ4_Buffer_Size);
+	// 按内容分块时默认的块大小范围，最大不能超过nekofs_kNekoData_LZ4_Buffer_Size
+	constexpr int32_t nekofs_kNekoData_CDC_MinSize = 8 * 1024;
+	constexpr int32_t nekofs_kNekoData_CDC_AvgSize = 16 * 1024;
+	constexpr int32_t nekofs_kNekoData_CDC_MaxSize = nekofs_kNekoData_LZ4_Buffer_Size;
 }
@@ -1,6 +1,28 @@
 ﻿#include "sha256.h"
+#include "sha256impl.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define NEKOFS_SHA256_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define NEKOFS_SHA256_ARM64
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)
+#endif
+#endif
+#endif
 
 namespace nekofs {
 	static const std::array<uint32_t, 8> h = {
@@ -13,7 +35,7 @@ namespace nekofs {
 		0x1f83d9ab,
 		0x5be0cd19
 	};
-	static const std::array<uint32_t, 64> k = {
+	const std::array<uint32_t, 64> sha256impl::kRoundConstants = {
 		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
 		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
 		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
@@ -32,10 +54,11 @@ namespace nekofs {
 	{
 		return value >> offset;
 	}
-	static inline void sha256_calc(const std::array<uint32_t, 16>& message, std::array<uint32_t, 8>& h_result)
+	static inline void sha256_calc(const uint32_t message[16], uint32_t h_result[8])
 	{
+		const auto& k = sha256impl::kRoundConstants;
 		uint32_t w[64];
-		std::copy(message.begin(), message.end(), w);
+		std::copy(message, message + 16, w);
 		for (size_t i = 16; i < 64; i++)
 		{
 			uint32_t s0 = rightrotate(w[i - 15], 7) ^ rightrotate(w[i - 15], 18) ^ rightshift(w[i - 15], 3);
@@ -77,101 +100,236 @@ namespace nekofs {
 		h_result[7] += h;
 	}
 
+	void sha256impl::blocksScalar(uint32_t state[8], const uint8_t* data, size_t blocks)
+	{
+		uint32_t message[16];
+		for (size_t i = 0; i < blocks; i++, data += 64)
+		{
+			for (size_t j = 0; j < 16; j++)
+			{
+				const uint8_t* p = data + (j << 2);
+				message[j] = static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 | static_cast<uint32_t>(p[3]);
+			}
+			sha256_calc(message, state);
+		}
+	}
+
+	static bool cpuSupportSHANI()
+	{
+#ifdef NEKOFS_SHA256_X86
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+		__cpuid(info, 1);
+		const bool ssse3 = (info[2] & (1 << 9)) != 0;
+		const bool sse41 = (info[2] & (1 << 19)) != 0;
+		__cpuidex(info, 7, 0);
+		const bool sha = (info[1] & (1 << 29)) != 0;
+#else
+		unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+		if (__get_cpuid_max(0, nullptr) < 7 || !__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		{
+			return false;
+		}
+		const bool ssse3 = (ecx & (1 << 9)) != 0;
+		const bool sse41 = (ecx & (1 << 19)) != 0;
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		const bool sha = (ebx & (1 << 29)) != 0;
+#endif
+		return ssse3 && sse41 && sha;
+#else
+		return false;
+#endif
+	}
+	static bool cpuSupportARMv8()
+	{
+#if defined(NEKOFS_SHA256_ARM64) && defined(__APPLE__)
+		return true;
+#elif defined(NEKOFS_SHA256_ARM64) && defined(_WIN32)
+		return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE) != FALSE;
+#elif defined(NEKOFS_SHA256_ARM64) && defined(__linux__)
+		return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#else
+		return false;
+#endif
+	}
+	static sha256impl::BlockFunction getBlockFunction(SHA256Kernel kernel)
+	{
+		switch (kernel)
+		{
+		case SHA256Kernel::SHANI:
+			return sha256impl::blocksSHANI;
+		case SHA256Kernel::ARMv8:
+			return sha256impl::blocksARMv8;
+		default:
+			return sha256impl::blocksScalar;
+		}
+	}
+	static std::atomic<SHA256Kernel>& currentKernel()
+	{
+		static std::atomic<SHA256Kernel> kernel(sha256sum::isKernelSupported(SHA256Kernel::SHANI) ? SHA256Kernel::SHANI
+			: sha256sum::isKernelSupported(SHA256Kernel::ARMv8) ? SHA256Kernel::ARMv8 : SHA256Kernel::Scalar);
+		return kernel;
+	}
+	static std::atomic<sha256impl::BlockFunction>& currentBlockFunction()
+	{
+		static std::atomic<sha256impl::BlockFunction> function(getBlockFunction(currentKernel()));
+		return function;
+	}
+
+	SHA256Kernel sha256sum::getKernel()
+	{
+		return currentKernel();
+	}
+	bool sha256sum::setKernel(SHA256Kernel kernel)
+	{
+		if (!isKernelSupported(kernel))
+		{
+			return false;
+		}
+		currentKernel() = kernel;
+		currentBlockFunction() = getBlockFunction(kernel);
+		return true;
+	}
+	bool sha256sum::isKernelSupported(SHA256Kernel kernel)
+	{
+		switch (kernel)
+		{
+		case SHA256Kernel::Scalar:
+			return true;
+		case SHA256Kernel::SHANI:
+			return sha256impl::isSHANICompiled() && cpuSupportSHANI();
+		case SHA256Kernel::ARMv8:
+			return sha256impl::isARMv8Compiled() && cpuSupportARMv8();
+		default:
+			return false;
+		}
+	}
+
+	static bool cpuSupportAVX(bool avx512)
+	{
+#ifdef NEKOFS_SHA256_X86
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		__cpuidex(info, 7, 0);
+		const bool avx2 = (info[1] & (1 << 5)) != 0;
+		const bool avx512f = (info[1] & (1 << 16)) != 0;
+		const uint64_t xcr0 = osxsave ? _xgetbv(0) : 0;
+#else
+		unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+		if (__get_cpuid_max(0, nullptr) < 7 || !__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		{
+			return false;
+		}
+		const bool osxsave = (ecx & (1 << 27)) != 0;
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		const bool avx2 = (ebx & (1 << 5)) != 0;
+		const bool avx512f = (ebx & (1 << 16)) != 0;
+		uint64_t xcr0 = 0;
+		if (osxsave)
+		{
+			uint32_t lo = 0, hi = 0;
+			__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+			xcr0 = (static_cast<uint64_t>(hi) << 32) | lo;
+		}
+#endif
+		// 需要操作系统保存ymm/zmm寄存器
+		if (avx512)
+		{
+			return avx512f && (xcr0 & 0xE6) == 0xE6;
+		}
+		return avx2 && (xcr0 & 0x06) == 0x06;
+#else
+		return false;
+#endif
+	}
+	/*
+	* 只在比单路硬件实现快时才使用多路实现：AVX2 8路和NEON 4路都不如SHA扩展，AVX-512 16路比SHA-NI快。
+	*/
+	static std::pair<sha256impl::MultiBlockFunction, size_t> detectMultiBlockFunction()
+	{
+		if (sha256impl::isAVX512Compiled() && cpuSupportAVX(true))
+		{
+			return { sha256impl::blocksAVX512x16, 16 };
+		}
+		if (sha256impl::isAVX2Compiled() && cpuSupportAVX(false) && !sha256sum::isKernelSupported(SHA256Kernel::SHANI))
+		{
+			return { sha256impl::blocksAVX2x8, 8 };
+		}
+		if (sha256impl::isNEONCompiled() && !sha256sum::isKernelSupported(SHA256Kernel::ARMv8))
+		{
+			return { sha256impl::blocksNEONx4, 4 };
+		}
+		return { nullptr, 0 };
+	}
+	static std::atomic<bool>& multiBufferEnabled()
+	{
+		static std::atomic<bool> enabled(true);
+		return enabled;
+	}
+	static std::pair<sha256impl::MultiBlockFunction, size_t> currentMultiBlockFunction()
+	{
+		static const std::pair<sha256impl::MultiBlockFunction, size_t> function = detectMultiBlockFunction();
+		if (!multiBufferEnabled().load(std::memory_order_relaxed))
+		{
+			return { nullptr, 0 };
+		}
+		return function;
+	}
+
 	sha256sum::sha256sum()
 	{
-		message_.fill(0);
+		buffer_.fill(0);
 		h_ = h;
 	}
+	/*
+	* 凑满64字节的块交给当前的实现处理，连续的整块直接从data读取，不经过buffer_。
+	*/
 	void sha256sum::update(const void* data, size_t count)
 	{
+		if (count == 0)
+		{
+			return;
+		}
 		const uint8_t* pBuf = static_cast<const uint8_t*>(data);
-		size_t msg_index = messageLength_ >> 2;
-		size_t head_count = (4 - (messageLength_ & 0x03)) & 0x03;
-		if (head_count > 0)
+		auto blocks = currentBlockFunction().load(std::memory_order_relaxed);
+		bitLength_ += static_cast<uint64_t>(count) << 3;
+		if (bufferLength_ > 0)
 		{
-			if (head_count <= count)
+			size_t length = std::min(count, buffer_.size() - bufferLength_);
+			std::memcpy(buffer_.data() + bufferLength_, pBuf, length);
+			bufferLength_ += length;
+			pBuf += length;
+			count -= length;
+			if (bufferLength_ < buffer_.size())
 			{
-				for (size_t i = 0; i < head_count; i++) {
-					message_[msg_index] = message_[msg_index] << 8 | pBuf[i];
-				}
-				pBuf += head_count;
-				count -= head_count;
-				bitLength_ += head_count << 3;
-				messageLength_ += head_count;
-				if (messageLength_ == 64) {
-					sha256_calc(message_, h_);
-					messageLength_ = 0;
-				}
-			}
-			else
-			{
-				for (size_t i = 0; i < count; i++) {
-					message_[msg_index] = message_[msg_index] << 8 | pBuf[i];
-				}
-				pBuf += count;
-				bitLength_ += count << 3;
-				messageLength_ += count;
-				count = 0;
+				return;
 			}
+			blocks(h_.data(), buffer_.data(), 1);
+			bufferLength_ = 0;
+		}
+		if (count >= buffer_.size())
+		{
+			size_t blockNum = count >> 6;
+			blocks(h_.data(), pBuf, blockNum);
+			pBuf += blockNum << 6;
+			count -= blockNum << 6;
 		}
 		if (count > 0)
 		{
-			msg_index = messageLength_ >> 2;
-			size_t max_count = (count + messageLength_) >> 6;
-			if (max_count > 0)
-			{
-				size_t length = max_count * 64 - messageLength_;
-				count -= length;
-				bitLength_ += length << 3;
-				messageLength_ = 0;
-				for (size_t i = 0; i < max_count; i++)
-				{
-					do
-					{
-						uint32_t a = static_cast<uint32_t>(pBuf[0]) << 24;
-						uint32_t b = static_cast<uint32_t>(pBuf[1]) << 16;
-						uint32_t c = static_cast<uint32_t>(pBuf[2]) << 8;
-						uint32_t d = static_cast<uint32_t>(pBuf[3]) << 0;
-						message_[msg_index] = a | b | c | d;
-						msg_index++;
-						pBuf += 4;
-					} while (msg_index < 16);
-					msg_index = 0;
-					sha256_calc(message_, h_);
-				}
-			}
-
-			if (count > 0)
-			{
-				max_count = count >> 2;
-				msg_index = messageLength_ >> 2;
-				if (max_count > 0)
-				{
-					size_t length = max_count << 2;
-					count -= length;
-					bitLength_ += length << 3;
-					messageLength_ += length;
-					for (size_t i = 0; i < max_count; i++) {
-						uint32_t a = static_cast<uint32_t>(pBuf[0]) << 24;
-						uint32_t b = static_cast<uint32_t>(pBuf[1]) << 16;
-						uint32_t c = static_cast<uint32_t>(pBuf[2]) << 8;
-						uint32_t d = static_cast<uint32_t>(pBuf[3]) << 0;
-						message_[msg_index] = a | b | c | d;
-						pBuf += 4;
-						msg_index++;
-					}
-				}
-
-				if (count > 0)
-				{
-					msg_index = messageLength_ >> 2;
-					messageLength_ += count;
-					bitLength_ += count << 3;
-					for (size_t i = 0; i < count; i++) {
-						message_[msg_index] = message_[msg_index] << 8 | pBuf[i];
-					}
-				}
-			}
+			std::memcpy(buffer_.data(), pBuf, count);
+			bufferLength_ = count;
 		}
 	}
 	void sha256sum::final(const void* data, size_t count)
@@ -179,33 +337,21 @@ namespace nekofs {
 		update(data, count);
 		{
 			// padding
-			if (messageLength_ < 56)
+			auto blocks = currentBlockFunction().load(std::memory_order_relaxed);
+			buffer_[bufferLength_++] = 0x80;
+			if (bufferLength_ > 56)
 			{
-				message_[messageLength_ >> 2] = message_[messageLength_ >> 2] << 8 | 0x080;
-				messageLength_++;
+				std::fill(buffer_.begin() + bufferLength_, buffer_.end(), 0);
+				blocks(h_.data(), buffer_.data(), 1);
+				bufferLength_ = 0;
 			}
-			else
+			std::fill(buffer_.begin() + bufferLength_, buffer_.begin() + 56, 0);
+			for (size_t i = 0; i < 8; i++)
 			{
-				message_[messageLength_ >> 2] = message_[messageLength_ >> 2] << 8 | 0x080;
-				messageLength_++;
-				while (messageLength_ < 64)
-				{
-					message_[messageLength_ >> 2] = message_[messageLength_ >> 2] << 8 | 0x00;
-					messageLength_++;
-				}
-				sha256_calc(message_, h_);
-				messageLength_ = 0;
-			}
-			while (messageLength_ < 56)
-			{
-				message_[messageLength_ >> 2] = message_[messageLength_ >> 2] << 8 | 0x00;
-				messageLength_++;
+				buffer_[56 + i] = static_cast<uint8_t>(bitLength_ >> (56 - i * 8));
 			}
-			message_[14] = bitLength_ >> 32;
-			message_[15] = static_cast<uint32_t>(bitLength_);
-			messageLength_ += 8;
-			sha256_calc(message_, h_);
-			messageLength_ = 0;
+			blocks(h_.data(), buffer_.data(), 1);
+			bufferLength_ = 0;
 		}
 	}
 	void sha256sum::readHash(std::array<uint8_t, 32>& result) const
@@ -239,4 +385,158 @@ namespace nekofs {
 		}
 		return str;
 	}
+
+	size_t sha256batch::add(const void* data, size_t count)
+	{
+		messages_.emplace_back(static_cast<const uint8_t*>(data), count);
+		return messages_.size() - 1;
+	}
+	namespace {
+		struct BatchLane final
+		{
+			bool active = false;
+			size_t message = 0;
+			const uint8_t* data = nullptr;
+			size_t block = 0;
+			size_t fullBlocks = 0;
+			size_t totalBlocks = 0;
+			std::array<uint8_t, 128> tail;
+
+			const uint8_t* blockData() const
+			{
+				return block < fullBlocks ? data + (block << 6) : tail.data() + ((block - fullBlocks) << 6);
+			}
+		};
+	}
+	/*
+	* 每路保存消息剩余的整块和补齐后的尾块，空闲的路读取全0块，结果丢弃。
+	*/
+	void sha256batch::compute()
+	{
+		hashes_.resize(messages_.size());
+		auto [multiBlocks, lanes] = currentMultiBlockFunction();
+		if (multiBlocks == nullptr || messages_.size() * 2 <= lanes)
+		{
+			for (size_t i = 0; i < messages_.size(); i++)
+			{
+				sha256sum sha256;
+				sha256.final(messages_[i].first, messages_[i].second);
+				hashes_[i] = sha256.readHash();
+			}
+			return;
+		}
+		static const std::array<uint8_t, 64> zero = {};
+		auto blocks = currentBlockFunction().load(std::memory_order_relaxed);
+		std::vector<BatchLane> lane(lanes);
+		std::vector<uint32_t> state(lanes * 8);
+		std::vector<const uint8_t*> data(lanes);
+		size_t next = 0;
+		auto assign = [&](size_t i) {
+			auto& l = lane[i];
+			if (next >= messages_.size())
+			{
+				l.active = false;
+				return;
+			}
+			const auto& [p, count] = messages_[next];
+			l.active = true;
+			l.message = next++;
+			l.data = p;
+			l.block = 0;
+			l.fullBlocks = count >> 6;
+			size_t tailLength = count & 63;
+			l.tail.fill(0);
+			if (tailLength > 0)
+			{
+				std::memcpy(l.tail.data(), p + (l.fullBlocks << 6), tailLength);
+			}
+			l.tail[tailLength] = 0x80;
+			size_t tailBlocks = tailLength + 9 > 64 ? 2 : 1;
+			uint64_t bitLength = static_cast<uint64_t>(count) << 3;
+			for (size_t j = 0; j < 8; j++)
+			{
+				l.tail[(tailBlocks << 6) - 8 + j] = static_cast<uint8_t>(bitLength >> (56 - j * 8));
+			}
+			l.totalBlocks = l.fullBlocks + tailBlocks;
+			for (size_t j = 0; j < 8; j++)
+			{
+				state[j * lanes + i] = h[j];
+			}
+		};
+		size_t active = 0;
+		for (size_t i = 0; i < lanes; i++)
+		{
+			assign(i);
+			active += lane[i].active ? 1 : 0;
+		}
+		while (active > 0)
+		{
+			if (next >= messages_.size() && active * 2 <= lanes)
+			{
+				// 剩下的用单路实现接着算
+				for (size_t i = 0; i < lanes; i++)
+				{
+					auto& l = lane[i];
+					if (!l.active)
+					{
+						continue;
+					}
+					auto& result = hashes_[l.message];
+					for (size_t j = 0; j < 8; j++)
+					{
+						result[j] = state[j * lanes + i];
+					}
+					if (l.block < l.fullBlocks)
+					{
+						blocks(result.data(), l.data + (l.block << 6), l.fullBlocks - l.block);
+						l.block = l.fullBlocks;
+					}
+					blocks(result.data(), l.blockData(), l.totalBlocks - l.block);
+				}
+				break;
+			}
+			for (size_t i = 0; i < lanes; i++)
+			{
+				data[i] = lane[i].active ? lane[i].blockData() : zero.data();
+			}
+			multiBlocks(state.data(), data.data());
+			for (size_t i = 0; i < lanes; i++)
+			{
+				auto& l = lane[i];
+				if (!l.active || ++l.block < l.totalBlocks)
+				{
+					continue;
+				}
+				auto& result = hashes_[l.message];
+				for (size_t j = 0; j < 8; j++)
+				{
+					result[j] = state[j * lanes + i];
+				}
+				assign(i);
+				active -= l.active ? 0 : 1;
+			}
+		}
+	}
+	const std::array<uint32_t, 8>& sha256batch::readHash(size_t index) const
+	{
+		return hashes_[index];
+	}
+	size_t sha256batch::size() const
+	{
+		return messages_.size();
+	}
+	void sha256batch::clear()
+	{
+		messages_.clear();
+		hashes_.clear();
+	}
+	size_t sha256batch::getLanes()
+	{
+		return currentMultiBlockFunction().second;
+	}
+	bool sha256batch::setMultiBufferEnabled(bool enabled)
+	{
+		multiBufferEnabled() = enabled;
+		return detectMultiBlockFunction().first != nullptr;
+	}
 }
@@ -3,10 +3,19 @@
 #include <cstddef>
 #include <array>
 #include <string>
+#include <vector>
+#include <utility>
 
 namespace nekofs {
 	class NativeFileSystem;
 
+	enum class SHA256Kernel : int32_t
+	{
+		Scalar = 0,
+		SHANI = 1,  // x86 SHA扩展
+		ARMv8 = 2   // ARMv8 crypto扩展
+	};
+
 	class sha256sum final
 	{
 	private:
@@ -23,10 +32,51 @@ namespace nekofs {
 		const std::array<uint32_t, 8>& readHash() const;
 		std::string readHashHexString() const;
 
+	public:
+		/*
+		* 默认使用当前CPU支持的最快实现，setKernel用于测试和对比。
+		*/
+		static SHA256Kernel getKernel();
+		static bool setKernel(SHA256Kernel kernel);
+		static bool isKernelSupported(SHA256Kernel kernel);
+
 	private:
-		std::array<uint32_t, 16> message_;
+		std::array<uint8_t, 64> buffer_;
 		std::array<uint32_t, 8> h_;
-		size_t messageLength_ = 0;
+		size_t bufferLength_ = 0;
 		uint64_t bitLength_ = 0;
 	};
+
+	/*
+	* 同时计算多个消息的sha256，用于大量小文件。消息轮流分配到SIMD的各路中，一路算完立刻换下一个消息。
+	* 剩下的消息不足以填满一半的路时，改用单路实现算完。
+	* add只保存指针，compute之前调用方需要保证数据有效。
+	*/
+	class sha256batch final
+	{
+	private:
+		sha256batch(const sha256batch&) = delete;
+		sha256batch(sha256batch&&) = delete;
+		sha256batch& operator=(const sha256batch&) = delete;
+		sha256batch& operator=(sha256batch&&) = delete;
+
+	public:
+		sha256batch() = default;
+		size_t add(const void* data, size_t count);
+		void compute();
+		const std::array<uint32_t, 8>& readHash(size_t index) const;
+		size_t size() const;
+		void clear();
+
+	public:
+		/*
+		* 当前CPU上多路实现的路数，为0表示没有可用的多路实现，compute会逐个使用sha256sum。
+		*/
+		static size_t getLanes();
+		static bool setMultiBufferEnabled(bool enabled);
+
+	private:
+		std::vector<std::pair<const uint8_t*, size_t>> messages_;
+		std::vector<std::array<uint32_t, 8>> hashes_;
+	};
 }
@@ -0,0 +1,76 @@
+﻿#include "sha256impl.h"
+
+/*
+* ARMv8 crypto扩展实现。非MSVC编译器需要用-march=armv8-a+crypto编译这个文件，这里不能放别的代码。
+*/
+#if (defined(__aarch64__) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))) || defined(_M_ARM64)
+#include <arm_neon.h>
+#include <utility>
+
+namespace nekofs::sha256impl {
+	namespace {
+		/*
+		* 每组4轮，msg保存16个消息字，G组用msg[G%4]，前12组同时计算后面要用的消息字。
+		*/
+		template <size_t G>
+		inline void rounds(uint32x4_t(&msg)[4], uint32x4_t& state0, uint32x4_t& state1)
+		{
+			constexpr size_t cur = G % 4;
+			uint32x4_t tmp = vaddq_u32(msg[cur], vld1q_u32(&kRoundConstants[G * 4]));
+			if constexpr (G < 12)
+			{
+				msg[cur] = vsha256su0q_u32(msg[cur], msg[(G + 1) % 4]);
+			}
+			const uint32x4_t abcd = state0;
+			state0 = vsha256hq_u32(state0, state1, tmp);
+			state1 = vsha256h2q_u32(state1, abcd, tmp);
+			if constexpr (G < 12)
+			{
+				msg[cur] = vsha256su1q_u32(msg[cur], msg[(G + 2) % 4], msg[(G + 3) % 4]);
+			}
+		}
+		template <size_t... G>
+		inline void block(uint32x4_t& state0, uint32x4_t& state1, const uint8_t* data, std::index_sequence<G...>)
+		{
+			uint32x4_t msg[4] = {
+				vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 0))),
+				vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16))),
+				vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32))),
+				vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)))
+			};
+			(rounds<G>(msg, state0, state1), ...);
+		}
+	}
+
+	bool isARMv8Compiled()
+	{
+		return true;
+	}
+	void blocksARMv8(uint32_t state[8], const uint8_t* data, size_t blocks)
+	{
+		uint32x4_t state0 = vld1q_u32(&state[0]);
+		uint32x4_t state1 = vld1q_u32(&state[4]);
+		for (size_t i = 0; i < blocks; i++, data += 64)
+		{
+			const uint32x4_t abcd = state0;
+			const uint32x4_t efgh = state1;
+			block(state0, state1, data, std::make_index_sequence<16>());
+			state0 = vaddq_u32(state0, abcd);
+			state1 = vaddq_u32(state1, efgh);
+		}
+		vst1q_u32(&state[0], state0);
+		vst1q_u32(&state[4], state1);
+	}
+}
+#else
+namespace nekofs::sha256impl {
+	bool isARMv8Compiled()
+	{
+		return false;
+	}
+	void blocksARMv8(uint32_t state[8], const uint8_t* data, size_t blocks)
+	{
+		blocksScalar(state, data, blocks);
+	}
+}
+#endif
@@ -0,0 +1,76 @@
+﻿#include "sha256impl.h"
+
+/*
+* AVX2 8路实现。非MSVC编译器需要用-mavx2编译这个文件，这里不能放别的代码。
+*/
+#if defined(__AVX2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#include "sha256mb.h"
+#include <immintrin.h>
+
+namespace nekofs::sha256impl {
+	namespace {
+		struct AVX2 final
+		{
+			using T = __m256i;
+			static constexpr size_t kLanes = 8;
+			static T load(const uint32_t* p)
+			{
+				return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+			}
+			static void store(uint32_t* p, T v)
+			{
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+			}
+			static T set1(uint32_t v)
+			{
+				return _mm256_set1_epi32(static_cast<int>(v));
+			}
+			static T add(T a, T b)
+			{
+				return _mm256_add_epi32(a, b);
+			}
+			template <int N>
+			static T ror(T x)
+			{
+				return _mm256_or_si256(_mm256_srli_epi32(x, N), _mm256_slli_epi32(x, 32 - N));
+			}
+			template <int N>
+			static T shr(T x)
+			{
+				return _mm256_srli_epi32(x, N);
+			}
+			static T xor3(T a, T b, T c)
+			{
+				return _mm256_xor_si256(_mm256_xor_si256(a, b), c);
+			}
+			static T ch(T e, T f, T g)
+			{
+				return _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+			}
+			static T maj(T a, T b, T c)
+			{
+				return _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+			}
+		};
+	}
+
+	bool isAVX2Compiled()
+	{
+		return true;
+	}
+	void blocksAVX2x8(uint32_t* state, const uint8_t* const* data)
+	{
+		blocksMultiBuffer<AVX2>(state, data);
+	}
+}
+#else
+namespace nekofs::sha256impl {
+	bool isAVX2Compiled()
+	{
+		return false;
+	}
+	void blocksAVX2x8(uint32_t* state, const uint8_t* const* data)
+	{
+	}
+}
+#endif
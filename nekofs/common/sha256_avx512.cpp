@@ -0,0 +1,76 @@
+﻿#include "sha256impl.h"
+
+/*
+* AVX-512 16路实现。非MSVC编译器需要用-mavx512f编译这个文件，这里不能放别的代码。
+*/
+#if defined(__AVX512F__) || (defined(_MSC_VER) && defined(_M_X64))
+#include "sha256mb.h"
+#include <immintrin.h>
+
+namespace nekofs::sha256impl {
+	namespace {
+		struct AVX512 final
+		{
+			using T = __m512i;
+			static constexpr size_t kLanes = 16;
+			static T load(const uint32_t* p)
+			{
+				return _mm512_loadu_si512(p);
+			}
+			static void store(uint32_t* p, T v)
+			{
+				_mm512_storeu_si512(p, v);
+			}
+			static T set1(uint32_t v)
+			{
+				return _mm512_set1_epi32(static_cast<int>(v));
+			}
+			static T add(T a, T b)
+			{
+				return _mm512_add_epi32(a, b);
+			}
+			template <int N>
+			static T ror(T x)
+			{
+				return _mm512_ror_epi32(x, N);
+			}
+			template <int N>
+			static T shr(T x)
+			{
+				return _mm512_srli_epi32(x, N);
+			}
+			static T xor3(T a, T b, T c)
+			{
+				return _mm512_ternarylogic_epi32(a, b, c, 0x96);
+			}
+			static T ch(T e, T f, T g)
+			{
+				return _mm512_ternarylogic_epi32(e, f, g, 0xCA);
+			}
+			static T maj(T a, T b, T c)
+			{
+				return _mm512_ternarylogic_epi32(a, b, c, 0xE8);
+			}
+		};
+	}
+
+	bool isAVX512Compiled()
+	{
+		return true;
+	}
+	void blocksAVX512x16(uint32_t* state, const uint8_t* const* data)
+	{
+		blocksMultiBuffer<AVX512>(state, data);
+	}
+}
+#else
+namespace nekofs::sha256impl {
+	bool isAVX512Compiled()
+	{
+		return false;
+	}
+	void blocksAVX512x16(uint32_t* state, const uint8_t* const* data)
+	{
+	}
+}
+#endif
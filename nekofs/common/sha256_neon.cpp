@@ -0,0 +1,76 @@
+﻿#include "sha256impl.h"
+
+/*
+* NEON 4路实现，arm64上NEON总是可用。
+*/
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include "sha256mb.h"
+#include <arm_neon.h>
+
+namespace nekofs::sha256impl {
+	namespace {
+		struct NEON final
+		{
+			using T = uint32x4_t;
+			static constexpr size_t kLanes = 4;
+			static T load(const uint32_t* p)
+			{
+				return vld1q_u32(p);
+			}
+			static void store(uint32_t* p, T v)
+			{
+				vst1q_u32(p, v);
+			}
+			static T set1(uint32_t v)
+			{
+				return vdupq_n_u32(v);
+			}
+			static T add(T a, T b)
+			{
+				return vaddq_u32(a, b);
+			}
+			template <int N>
+			static T ror(T x)
+			{
+				return vorrq_u32(vshrq_n_u32(x, N), vshlq_n_u32(x, 32 - N));
+			}
+			template <int N>
+			static T shr(T x)
+			{
+				return vshrq_n_u32(x, N);
+			}
+			static T xor3(T a, T b, T c)
+			{
+				return veorq_u32(veorq_u32(a, b), c);
+			}
+			static T ch(T e, T f, T g)
+			{
+				return vbslq_u32(e, f, g);
+			}
+			static T maj(T a, T b, T c)
+			{
+				return vbslq_u32(veorq_u32(a, b), c, b);
+			}
+		};
+	}
+
+	bool isNEONCompiled()
+	{
+		return true;
+	}
+	void blocksNEONx4(uint32_t* state, const uint8_t* const* data)
+	{
+		blocksMultiBuffer<NEON>(state, data);
+	}
+}
+#else
+namespace nekofs::sha256impl {
+	bool isNEONCompiled()
+	{
+		return false;
+	}
+	void blocksNEONx4(uint32_t* state, const uint8_t* const* data)
+	{
+	}
+}
+#endif
@@ -0,0 +1,86 @@
+﻿#include "sha256impl.h"
+
+/*
+* x86 SHA-NI实现。非MSVC编译器需要用-msse4.1 -msha编译这个文件，这里不能放别的代码。
+*/
+#if (defined(__SHA__) && defined(__SSE4_1__)) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#include <immintrin.h>
+#include <utility>
+
+namespace nekofs::sha256impl {
+	namespace {
+		/*
+		* 每组4轮，msg保存16个消息字，G组用msg[G%4]，同时计算后面要用的消息字。
+		*/
+		template <size_t G>
+		inline void rounds(__m128i(&msg)[4], __m128i& state0, __m128i& state1, const uint8_t* data, const __m128i& mask)
+		{
+			constexpr size_t cur = G % 4;
+			constexpr size_t next = (G + 1) % 4;
+			constexpr size_t prev = (G + 3) % 4;
+			if constexpr (G < 4)
+			{
+				msg[cur] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + G * 16)), mask);
+			}
+			__m128i tmp = _mm_add_epi32(msg[cur], _mm_loadu_si128(reinterpret_cast<const __m128i*>(&kRoundConstants[G * 4])));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);
+			if constexpr (G >= 3 && G <= 14)
+			{
+				msg[next] = _mm_add_epi32(msg[next], _mm_alignr_epi8(msg[cur], msg[prev], 4));
+				msg[next] = _mm_sha256msg2_epu32(msg[next], msg[cur]);
+			}
+			tmp = _mm_shuffle_epi32(tmp, 0x0E);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, tmp);
+			if constexpr (G >= 1 && G <= 12)
+			{
+				msg[prev] = _mm_sha256msg1_epu32(msg[prev], msg[cur]);
+			}
+		}
+		template <size_t... G>
+		inline void block(__m128i& state0, __m128i& state1, const uint8_t* data, const __m128i& mask, std::index_sequence<G...>)
+		{
+			__m128i msg[4];
+			(rounds<G>(msg, state0, state1, data, mask), ...);
+		}
+	}
+
+	bool isSHANICompiled()
+	{
+		return true;
+	}
+	void blocksSHANI(uint32_t state[8], const uint8_t* data, size_t blocks)
+	{
+		const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+		// state按ABEF/CDGH排列
+		__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xB1);
+		__m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1B);
+		__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+		state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+		for (size_t i = 0; i < blocks; i++, data += 64)
+		{
+			const __m128i abef = state0;
+			const __m128i cdgh = state1;
+			block(state0, state1, data, mask, std::make_index_sequence<16>());
+			state0 = _mm_add_epi32(state0, abef);
+			state1 = _mm_add_epi32(state1, cdgh);
+		}
+		tmp = _mm_shuffle_epi32(state0, 0x1B);
+		state1 = _mm_shuffle_epi32(state1, 0xB1);
+		state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+		state1 = _mm_alignr_epi8(state1, tmp, 8);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+	}
+}
+#else
+namespace nekofs::sha256impl {
+	bool isSHANICompiled()
+	{
+		return false;
+	}
+	void blocksSHANI(uint32_t state[8], const uint8_t* data, size_t blocks)
+	{
+		blocksScalar(state, data, blocks);
+	}
+}
+#endif
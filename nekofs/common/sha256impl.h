@@ -0,0 +1,36 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+/*
+* sha256压缩函数的各个实现，一次处理若干个连续的64字节块。
+* 硬件实现在各自的源文件中用对应的编译参数编译，没有编译进来时isXXXCompiled()返回false。
+*/
+namespace nekofs::sha256impl {
+	using BlockFunction = void (*)(uint32_t state[8], const uint8_t* data, size_t blocks);
+
+	extern const std::array<uint32_t, 64> kRoundConstants;
+
+	void blocksScalar(uint32_t state[8], const uint8_t* data, size_t blocks);
+
+	bool isSHANICompiled();
+	void blocksSHANI(uint32_t state[8], const uint8_t* data, size_t blocks);
+
+	bool isARMv8Compiled();
+	void blocksARMv8(uint32_t state[8], const uint8_t* data, size_t blocks);
+
+	/*
+	* 多路实现，同时处理kLanes个互不相关的消息，每路各一个64字节块，state按[字][路]排列。
+	*/
+	using MultiBlockFunction = void (*)(uint32_t* state, const uint8_t* const* data);
+
+	bool isAVX512Compiled();
+	void blocksAVX512x16(uint32_t* state, const uint8_t* const* data);
+
+	bool isAVX2Compiled();
+	void blocksAVX2x8(uint32_t* state, const uint8_t* const* data);
+
+	bool isNEONCompiled();
+	void blocksNEONx4(uint32_t* state, const uint8_t* const* data);
+}
@@ -0,0 +1,92 @@
+﻿#pragma once
+#include "sha256impl.h"
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+* 多路sha256的通用实现，V提供具体指令集的向量操作。
+* state按[字][路]排列，每一路从data[i]读取一个64字节的块，各路之间互不相关。
+* 只能在用对应指令集参数编译的源文件中包含。
+*/
+namespace nekofs::sha256impl {
+	/*
+	* 一轮计算，I是轮数对16取余，调用方轮换a~h的位置，展开后w和状态都可以留在寄存器中。
+	*/
+	template <typename V, size_t I>
+	inline void roundMultiBuffer(typename V::T (&w)[16], size_t t, const typename V::T& a, const typename V::T& b, const typename V::T& c, typename V::T& d,
+		const typename V::T& e, const typename V::T& f, const typename V::T& g, typename V::T& h)
+	{
+		using T = typename V::T;
+		if (t > 0)
+		{
+			const T w15 = w[(I + 1) & 15];
+			const T w2 = w[(I + 14) & 15];
+			const T s0 = V::xor3(V::template ror<7>(w15), V::template ror<18>(w15), V::template shr<3>(w15));
+			const T s1 = V::xor3(V::template ror<17>(w2), V::template ror<19>(w2), V::template shr<10>(w2));
+			w[I] = V::add(V::add(w[I], s0), V::add(w[(I + 9) & 15], s1));
+		}
+		const T s1 = V::xor3(V::template ror<6>(e), V::template ror<11>(e), V::template ror<25>(e));
+		const T t1 = V::add(V::add(h, s1), V::add(V::ch(e, f, g), V::add(V::set1(kRoundConstants[t + I]), w[I])));
+		const T s0 = V::xor3(V::template ror<2>(a), V::template ror<13>(a), V::template ror<22>(a));
+		d = V::add(d, t1);
+		h = V::add(t1, V::add(s0, V::maj(a, b, c)));
+	}
+
+	template <typename V>
+	inline void blocksMultiBuffer(uint32_t* state, const uint8_t* const* data)
+	{
+		using T = typename V::T;
+		constexpr size_t N = V::kLanes;
+		// 先全部转置到word中再读入向量，避免刚写入就读取
+		alignas(64) uint32_t word[16][N];
+		for (size_t i = 0; i < N; i++)
+		{
+			const uint8_t* p = data[i];
+			for (size_t t = 0; t < 16; t++, p += 4)
+			{
+				word[t][i] = static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 | static_cast<uint32_t>(p[3]);
+			}
+		}
+		T w[16];
+		for (size_t t = 0; t < 16; t++)
+		{
+			w[t] = V::load(word[t]);
+		}
+		T a = V::load(state + 0 * N);
+		T b = V::load(state + 1 * N);
+		T c = V::load(state + 2 * N);
+		T d = V::load(state + 3 * N);
+		T e = V::load(state + 4 * N);
+		T f = V::load(state + 5 * N);
+		T g = V::load(state + 6 * N);
+		T h = V::load(state + 7 * N);
+		for (size_t t = 0; t < 64; t += 16)
+		{
+			roundMultiBuffer<V, 0>(w, t, a, b, c, d, e, f, g, h);
+			roundMultiBuffer<V, 1>(w, t, h, a, b, c, d, e, f, g);
+			roundMultiBuffer<V, 2>(w, t, g, h, a, b, c, d, e, f);
+			roundMultiBuffer<V, 3>(w, t, f, g, h, a, b, c, d, e);
+			roundMultiBuffer<V, 4>(w, t, e, f, g, h, a, b, c, d);
+			roundMultiBuffer<V, 5>(w, t, d, e, f, g, h, a, b, c);
+			roundMultiBuffer<V, 6>(w, t, c, d, e, f, g, h, a, b);
+			roundMultiBuffer<V, 7>(w, t, b, c, d, e, f, g, h, a);
+			roundMultiBuffer<V, 8>(w, t, a, b, c, d, e, f, g, h);
+			roundMultiBuffer<V, 9>(w, t, h, a, b, c, d, e, f, g);
+			roundMultiBuffer<V, 10>(w, t, g, h, a, b, c, d, e, f);
+			roundMultiBuffer<V, 11>(w, t, f, g, h, a, b, c, d, e);
+			roundMultiBuffer<V, 12>(w, t, e, f, g, h, a, b, c, d);
+			roundMultiBuffer<V, 13>(w, t, d, e, f, g, h, a, b, c);
+			roundMultiBuffer<V, 14>(w, t, c, d, e, f, g, h, a, b);
+			roundMultiBuffer<V, 15>(w, t, b, c, d, e, f, g, h, a);
+		}
+		V::store(state + 0 * N, V::add(a, V::load(state + 0 * N)));
+		V::store(state + 1 * N, V::add(b, V::load(state + 1 * N)));
+		V::store(state + 2 * N, V::add(c, V::load(state + 2 * N)));
+		V::store(state + 3 * N, V::add(d, V::load(state + 3 * N)));
+		V::store(state + 4 * N, V::add(e, V::load(state + 4 * N)));
+		V::store(state + 5 * N, V::add(f, V::load(state + 5 * N)));
+		V::store(state + 6 * N, V::add(g, V::load(state + 6 * N)));
+		V::store(state + 7 * N, V::add(h, V::load(state + 7 * N)));
+	}
+}
@@ -22,6 +22,17 @@ namespace nekofs {
 		AssetManager,
 		Nekodata,
 	};
+	/*
+	* 本地文件流的访问方式，决定对映射内存的madvise。Auto时按读取的位置自动判断顺序或随机。
+	*/
+	enum class AccessHint : int32_t
+	{
+		Auto = NEKOFS_ACCESS_AUTO,
+		Sequential = NEKOFS_ACCESS_SEQUENTIAL,
+		Random = NEKOFS_ACCESS_RANDOM,
+		WillNeed = NEKOFS_ACCESS_WILLNEED, // 映射后异步读入整个映射块
+		Populate = NEKOFS_ACCESS_POPULATE, // 映射时同步读入整个映射块
+	};
 	enum class FileType : int32_t
 	{
 		None = NEKOFS_FT_NONE,
@@ -34,6 +45,7 @@ namespace nekofs {
 	class IStream;
 	class OStream;
 	class FileSystem;
+	class NativeIStream;
 
 	class FileHandle
 	{
@@ -58,6 +70,30 @@ namespace nekofs {
 		virtual int64_t getPosition() const = 0;
 		virtual int64_t getLength() const = 0;
 	};
+	/*
+	* 数据直接来自本地文件的流。拷贝时可以由内核完成（copy_file_range等），不经过用户态缓冲区。
+	*/
+	class NativeCopySource {
+	public:
+		// 返回当前位置对应的本地文件流（已移到对应位置），size为可以连续拷贝的长度。不支持时返回nullptr
+		virtual std::shared_ptr<NativeIStream> getNativeRange(int64_t& size) = 0;
+	};
+	class NativeCopyTarget {
+	public:
+		// 从is的当前位置拷贝最多size字节到当前位置，返回实际拷贝的长度。返回0时调用方改用普通的读写
+		virtual int64_t copyRange(std::shared_ptr<NativeIStream> is, int64_t size) = 0;
+	};
+	/*
+	* 异步预取请求。释放时取消，预取时解压的数据也一起释放。
+	*/
+	class Prefetch
+	{
+	public:
+		virtual ~Prefetch() = default;
+		virtual void cancel() = 0;
+		// 所有数据都已读入（需要解压的已解压）时返回true，取消后不会再变为true
+		virtual bool isFinished() const = 0;
+	};
 	class FileSystem
 	{
 	public:
@@ -68,6 +104,10 @@ namespace nekofs {
 		virtual FileType getFileType(const std::string& path) const = 0;
 		virtual int64_t getSize(const std::string& filepath) const = 0;
 		virtual FileSystemType getFSType() const = 0;
+		/*
+		* 在后台把文件的数据读入内存，decompress为true时把nekodata的块解压并保留。优先级高的请求先处理。
+		*/
+		virtual std::shared_ptr<Prefetch> prefetch(const std::vector<std::string>& filepaths, int32_t priority, bool decompress) = 0;
 	};
 }
 
@@ -77,6 +117,10 @@ constexpr const char* nekofs_kURIPrefix_Nekodata = u8"Nekodata:";
 
 constexpr int32_t nekofs_MapBlockSizeBitOffset = 25;
 constexpr int32_t nekofs_MapBlockSize = 1 << nekofs_MapBlockSizeBitOffset;
+// 连续这么多次读取都紧接上次（或都不是）时判断为顺序（随机）读取
+constexpr int32_t nekofs_kNative_AccessPatternThreshold = 3;
+// 顺序读取时提前预读的长度
+constexpr int64_t nekofs_kNative_SequentialReadahead = 8LL << 20;
 
 constexpr const char* nekofs_kLayerVersion = u8"version.json";
 constexpr const char* nekofs_kLayerVersion_Name = u8"name";
@@ -95,9 +139,16 @@ constexpr const char* nekofs_kLayerFiles_Files = u8"files";
 constexpr const char* nekofs_kLayerFiles_FilesVersion = u8"version";
 constexpr const char* nekofs_kLayerFiles_FilesSHA256 = u8"sha256";
 constexpr const char* nekofs_kLayerFiles_FilesSize = u8"size";
+constexpr const char* nekofs_kLayerFiles_FilesDeltaBase = u8"deltaBase";
 constexpr const char* nekofs_kLayerFiles_Nekodatas = u8"nekodatas";
 constexpr const char* nekofs_kLayerFiles_Deletes = u8"deletes";
 
+constexpr const std::string_view nekofs_kAccessTrace_FileHeader = u8".nekotrace";
+
+constexpr const char* nekofs_kWarmSet_Files = u8"files";
+constexpr const char* nekofs_kWarmSet_Priority = u8"priority";
+constexpr const char* nekofs_kWarmSet_Blocks = u8"blocks";
+
 constexpr const std::string_view nekofs_kNekodata_FileExtension = u8".nekodata";
 constexpr const std::string_view nekofs_kNekodata_FileHeader = u8".nekodata";
 constexpr const int32_t nekofs_kNekodata_FileHeaderSize = static_cast<int32_t>(nekofs_kNekodata_FileHeader.size());
@@ -105,3 +156,10 @@ constexpr const int32_t nekofs_kNekodata_FileFooterSize = 12;
 constexpr const int32_t nekofs_kNekodata_VolumeFormatSize = nekofs_kNekodata_FileHeaderSize + nekofs_kNekodata_FileFooterSize;
 constexpr const int64_t nekofs_kNekodata_MaxVolumeSize = 1LL << (20 + 31);
 constexpr const int64_t nekofs_kNekodata_DefalutVolumeSize = 1LL << 20;
+// 目录中块信息的扩展标记：记录每块解压后的大小、记录每块在数据区中的位置
+constexpr const uint32_t nekofs_kNekodata_BlockFlag_OriginalSize = 1;
+constexpr const uint32_t nekofs_kNekodata_BlockFlag_Position = 2;
+// 预加载时最多保留的解压数据
+constexpr const int64_t nekofs_kNekodata_PreloadMemoryLimit = 64LL << 20;
+// 前台解压块之后预加载暂停的时间（纳秒）
+constexpr const int64_t nekofs_kNekodata_PreloadYieldTime = 5LL * 1000 * 1000;
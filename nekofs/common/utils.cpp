@@ -138,6 +138,33 @@ namespace nekofs {
 		{
 			return false;
 		}
+		// 两端都是本地文件时由内核直接拷贝，剩余的部分再走缓冲区
+		auto source = std::dynamic_pointer_cast<NativeCopySource>(is);
+		auto target = std::dynamic_pointer_cast<NativeCopyTarget>(os);
+		while (source && target && is->getPosition() < is->getLength())
+		{
+			int64_t size = 0;
+			int64_t pos = is->getPosition();
+			auto nis = source->getNativeRange(size);
+			if (!nis || size <= 0)
+			{
+				break;
+			}
+			int64_t copied = target->copyRange(nis, size);
+			if (copied < 0)
+			{
+				return false;
+			}
+			if (copied == 0)
+			{
+				break;
+			}
+			// is本身就是本地文件时，拷贝后位置已经后移
+			if (is->getPosition() == pos && is->seek(copied, SeekOrigin::Current) < 0)
+			{
+				return false;
+			}
+		}
 		auto buffer = env::getInstance().newBuffer4M();
 		int32_t actualRead = 0;
 		int32_t actualWrite = 0;
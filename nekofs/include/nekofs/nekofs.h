@@ -21,6 +21,11 @@ extern "C" {
 	NEKOFS_API NekoFSBool nekofs_native_RemoveDirectory(const char* u8dirpath);
 	NEKOFS_API NekoFSBool nekofs_native_CleanEmptyDirectory(const char* u8dirpath);
 	NEKOFS_API NekoFSHandle nekofs_native_OpenIStream(const char* u8filepath);
+	/*
+	* 指定访问方式打开本地文件流：顺序读取时加大预读，随机读取时不预读，WILLNEED/POPULATE提前读入映射的数据。
+	* NEKOFS_ACCESS_AUTO时根据读取的位置自动判断。
+	*/
+	NEKOFS_API NekoFSHandle nekofs_native_OpenIStreamWithHint(const char* u8filepath, NekoFSAccessHint hint);
 	NEKOFS_API NekoFSHandle nekofs_native_OpenOStream(const char* u8filepath);
 	NEKOFS_API int32_t nekofs_native_GetAllFiles(const char* u8dirpath, char** u8jsonPtr);
 
@@ -38,6 +43,21 @@ extern "C" {
 	NEKOFS_API int64_t nekofs_ostream_GetLength(NekoFSHandle oshandle);
 
 	NEKOFS_API NekoFSBool nekofs_sha256_sumistream32(NekoFSHandle isHandle, uint32_t result[8]);
+	NEKOFS_API NekoFSBool nekofs_sha256_sum32(const void* data, int64_t size, uint32_t result[8]);
+	NEKOFS_API NekoFSSHA256Kernel nekofs_sha256_GetKernel();
+	NEKOFS_API NekoFSBool nekofs_sha256_SetKernel(NekoFSSHA256Kernel kernel);
+	/*
+	* 同时计算num个消息的sha256，results依次存放每个消息的结果，共num * 8个。
+	*/
+	NEKOFS_API NekoFSBool nekofs_sha256_sumbatch32(const void* const* datas, const int64_t* sizes, int32_t num, uint32_t* results);
+	NEKOFS_API int32_t nekofs_sha256_GetBatchLanes();
+	NEKOFS_API NekoFSBool nekofs_sha256_SetMultiBuffer(NekoFSBool enabled);
+	/*
+	* 开始记录文件访问（打开、nekodata块解压、本地文件读取），写到u8filepath。记录在后台线程定期写出，Stop时写完剩余的记录。
+	* 退出前需要调用nekofs_trace_Stop，进程退出时不会等待后台线程，没有写出的记录会丢失。
+	*/
+	NEKOFS_API NekoFSBool nekofs_trace_Start(const char* u8filepath);
+	NEKOFS_API NekoFSBool nekofs_trace_Stop();
 	NEKOFS_API NekoFSHandle nekofs_nekodata_CreateFromNative(const char* u8filepath);
 	NEKOFS_API NekoFSBool nekofs_nekodata_Verify(NekoFSHandle fsHandle);
 
@@ -45,14 +65,30 @@ extern "C" {
 	NEKOFS_API NekoFSFileType nekofs_filesystem_GetFileType(NekoFSHandle fsHandle, const char* u8filepath);
 	NEKOFS_API NekoFSHandle nekofs_filesystem_OpenIStream(NekoFSHandle fsHandle, const char* u8filepath);
 	NEKOFS_API int32_t nekofs_filesystem_GetAllFiles(NekoFSHandle fsHandle, const char* u8dirpath, char** u8jsonPtr);
+	/*
+	* 在后台把文件的数据读入内存，decompress为真时同时解压nekodata的块并保留，直到Close。priority高的请求先处理。
+	* 返回的句柄用nekofs_prefetch_IsFinished查询是否完成，不再需要时（包括取消后）用nekofs_prefetch_Close释放。
+	*/
+	NEKOFS_API NekoFSHandle nekofs_filesystem_Prefetch(NekoFSHandle fsHandle, const char** u8filepaths, int32_t filenum, int32_t priority, NekoFSBool decompress);
+	NEKOFS_API NekoFSBool nekofs_prefetch_IsFinished(NekoFSHandle prefetchHandle);
+	NEKOFS_API void nekofs_prefetch_Cancel(NekoFSHandle prefetchHandle);
+	NEKOFS_API void nekofs_prefetch_Close(NekoFSHandle prefetchHandle);
 
 	NEKOFS_API NekoFSHandle nekofs_overlay_Create();
 	NEKOFS_API int32_t nekofs_overlay_GetLayerVersion(NekoFSHandle olfsHandle, char** u8jsonPtr);
 	NEKOFS_API int32_t nekofs_overlay_GetLayerFiles(NekoFSHandle olfsHandle, char** u8jsonPtr);
+	/*
+	* 文件所在层的原始路径。以差异（deltaBase）保存的文件没有可以直接使用的原始文件，返回0，只能通过nekofs_filesystem_OpenIStream读取。
+	*/
 	NEKOFS_API int32_t nekofs_overlay_GetFileURI(NekoFSHandle olfsHandle, const char* u8filepath, char** u8pathPtr);
 	NEKOFS_API NekoFSBool nekofs_overlay_AddLayerFromNaitve(NekoFSHandle olfsHandle, const char* u8dirpath);
 	NEKOFS_API NekoFSBool nekofs_overlay_AddLayer(NekoFSHandle olfsHandle, NekoFSHandle fsHandle, const char* u8dirpath);
 	NEKOFS_API NekoFSBool nekofs_overlay_RefreshFileList(NekoFSHandle olfsHandle);
+	/*
+	* 按overlay中u8filepath的预热清单（json）在后台预读并解压文件，前台读取时让出。解压的数据最多保留memoryLimit字节（<=0时使用默认值），直到ReleasePreload。
+	*/
+	NEKOFS_API NekoFSBool nekofs_overlay_Preload(NekoFSHandle olfsHandle, const char* u8filepath, int64_t memoryLimit);
+	NEKOFS_API void nekofs_overlay_ReleasePreload(NekoFSHandle olfsHandle);
 
 #ifdef ANDROID
 	NEKOFS_API NekoFSHandle nekofs_assetmanager_OpenIStream(const char* u8filepath);
@@ -62,11 +98,29 @@ extern "C" {
 
 #ifdef NEKOFS_TOOLS
 	NEKOFS_API NekoFSBool nekofs_tools_prepare(const char* u8path, const char* u8versionpath, uint32_t offset);
+	NEKOFS_API NekoFSBool nekofs_tools_prepareWithCache(const char* u8path, const char* u8versionpath, uint32_t offset, const char* u8cachepath, NekoFSBool paranoid);
 	NEKOFS_API NekoFSBool nekofs_tools_pack(const char* u8dirpath, const char* u8filepath, int64_t volumeSize);
+	NEKOFS_API NekoFSBool nekofs_tools_packWithChunking(const char* u8dirpath, const char* u8filepath, int64_t volumeSize, NekoFSBool contentDefined);
+	NEKOFS_API NekoFSBool nekofs_tools_packWithOptions(const char* u8dirpath, const char* u8filepath, int64_t volumeSize, NekoFSBool contentDefined, NekoFSBool blockDedup);
+	/*
+	* u8orderpath是访问顺序（.nekotrace访问记录或每行一个路径的文本），文件按此顺序写入。为空时按路径排序。
+	* 顺序中是overlay中的路径，去掉u8orderprefix后与nekodata中的路径对应，为空时使用u8filepath去掉扩展名的文件名。
+	*/
+	NEKOFS_API NekoFSBool nekofs_tools_packWithOrder(const char* u8dirpath, const char* u8filepath, int64_t volumeSize, NekoFSBool contentDefined, NekoFSBool blockDedup, const char* u8orderpath);
+	NEKOFS_API NekoFSBool nekofs_tools_packWithOrderPrefix(const char* u8dirpath, const char* u8filepath, int64_t volumeSize, NekoFSBool contentDefined, NekoFSBool blockDedup, const char* u8orderpath, const char* u8orderprefix);
+	NEKOFS_API NekoFSBool nekofs_tools_packToStream(const char* u8dirpath, const char* u8tmppath, writedelegate* writer, void* userdata);
 	NEKOFS_API NekoFSBool nekofs_tools_unpack(const char* u8filepath, const char* u8dirpath);
 	NEKOFS_API NekoFSBool nekofs_tools_mkldiff(const char* u8earlierfile, const char* u8latestfile, const char* u8filepath, int64_t volumeSize);
+	NEKOFS_API NekoFSBool nekofs_tools_mkldiffWithVerify(const char* u8earlierfile, const char* u8latestfile, const char* u8filepath, int64_t volumeSize, NekoFSDiffVerify verify);
+	NEKOFS_API NekoFSBool nekofs_tools_mkldiffWithDelta(const char* u8earlierfile, const char* u8latestfile, const char* u8filepath, int64_t volumeSize, NekoFSDiffVerify verify, NekoFSBool delta);
 	NEKOFS_API NekoFSBool nekofs_tools_mergeToNekodata(const char* u8outpath, int64_t volumeSize, const char** u8filepaths, int32_t filenum, NekoFSBool verify);
+	NEKOFS_API NekoFSBool nekofs_tools_mergeToNekodataReuseBase(const char* u8outpath, const char** u8filepaths, int32_t filenum, NekoFSBool verify, NekoFSBool hardlink);
 	NEKOFS_API NekoFSBool nekofs_tools_mergeToDir(const char* u8outpath, int64_t volumeSize, const char** u8filepaths, int32_t filenum, NekoFSBool verify);
+	NEKOFS_API NekoFSBool nekofs_tools_compact(const char* u8filepath, const char* u8outpath, int64_t volumeSize);
+	/*
+	* 从u8tracepath的访问记录生成预热清单，只使用开始后durationMs毫秒内的访问，为0时使用全部。
+	*/
+	NEKOFS_API NekoFSBool nekofs_tools_mkwarmset(const char* u8tracepath, const char* u8outpath, int64_t durationMs);
 #endif // NEKOFS_TOOLS
 
 #ifdef __cplusplus
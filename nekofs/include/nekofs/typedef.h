@@ -13,7 +13,11 @@ extern "C" {
 	typedef int32_t NekoFSBool;
 	typedef int32_t NekoFSFileType;
 	typedef int32_t NekoFSHandle;
+	typedef int32_t NekoFSSHA256Kernel;
+	typedef int32_t NekoFSDiffVerify;
+	typedef int32_t NekoFSAccessHint;
 	typedef void logdelegate(NEKOFSLogLevel level, const char* u8message);
+	typedef int32_t writedelegate(void* userdata, const void* buf, int32_t size);
 
 #ifdef __cplusplus
 }
@@ -32,6 +36,20 @@ extern "C" {
 #define NEKOFS_FT_DIRECTORY  ((NekoFSFileType)2)
 #define NEKOFS_FT_UNKONWN    ((NekoFSFileType)-1)
 
+#define NEKOFS_SHA256_SCALAR ((NekoFSSHA256Kernel)0)
+#define NEKOFS_SHA256_SHANI  ((NekoFSSHA256Kernel)1)
+#define NEKOFS_SHA256_ARMV8  ((NekoFSSHA256Kernel)2)
+
+#define NEKOFS_DIFFVERIFY_ALL   ((NekoFSDiffVerify)0)
+#define NEKOFS_DIFFVERIFY_NONE  ((NekoFSDiffVerify)1)
+#define NEKOFS_DIFFVERIFY_PATCH ((NekoFSDiffVerify)2)
+
+#define NEKOFS_ACCESS_AUTO       ((NekoFSAccessHint)0)
+#define NEKOFS_ACCESS_SEQUENTIAL ((NekoFSAccessHint)1)
+#define NEKOFS_ACCESS_RANDOM     ((NekoFSAccessHint)2)
+#define NEKOFS_ACCESS_WILLNEED   ((NekoFSAccessHint)3)
+#define NEKOFS_ACCESS_POPULATE   ((NekoFSAccessHint)4)
+
 #define INVALID_NEKOFSHANDLE ((NekoFSHandle)-1)
 #define NEKOFS_TRUE ((NekoFSBool)1)
 #define NEKOFS_FALSE ((NekoFSBool)0)
@@ -0,0 +1,419 @@
+﻿#include "layerdelta.h"
+#include "../common/utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <unordered_map>
+
+namespace nekofs {
+	constexpr const char kDeltaMagic[8] = { 'N', 'E', 'K', 'O', 'D', 'L', 'T', '1' };
+	constexpr uint64_t kLiteral = std::numeric_limits<uint64_t>::max();
+	constexpr int64_t kDeltaBlockSize = 4096;
+	constexpr int64_t kDeltaHeaderSize = 8 + 8 + 8 + 32 + 8;
+	constexpr int64_t kDeltaOpSize = 16;
+	constexpr uint32_t kRollingPrime = 0x01000193;
+
+	static inline void putUint64(std::vector<uint8_t>& out, uint64_t value)
+	{
+		for (int32_t i = 7; i >= 0; i--)
+		{
+			out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+		}
+	}
+	static inline uint64_t getUint64(const uint8_t* p)
+	{
+		uint64_t value = 0;
+		for (int32_t i = 0; i < 8; i++)
+		{
+			value = (value << 8) | p[i];
+		}
+		return value;
+	}
+	static inline uint32_t blockHash(const uint8_t* data)
+	{
+		uint32_t h = 0;
+		for (int64_t i = 0; i < kDeltaBlockSize; i++)
+		{
+			h = h * kRollingPrime + data[i];
+		}
+		return h;
+	}
+
+	bool LayerDelta::encode(const uint8_t* base, int64_t baseSize, const std::array<uint32_t, 8>& baseSHA256, const uint8_t* target, int64_t targetSize, std::vector<uint8_t>& delta)
+	{
+		delta.clear();
+		if (baseSize < kDeltaBlockSize || targetSize < kDeltaBlockSize)
+		{
+			return false;
+		}
+		// 旧版本按块对齐建立索引，相同哈希只保留第一个
+		std::unordered_map<uint32_t, int64_t> index;
+		index.reserve(static_cast<size_t>(baseSize / kDeltaBlockSize));
+		for (int64_t pos = 0; pos + kDeltaBlockSize <= baseSize; pos += kDeltaBlockSize)
+		{
+			index.emplace(blockHash(base + pos), pos);
+		}
+		uint32_t outFactor = 1; // kRollingPrime ^ (kDeltaBlockSize - 1)
+		for (int64_t i = 1; i < kDeltaBlockSize; i++)
+		{
+			outFactor *= kRollingPrime;
+		}
+
+		std::vector<Op> ops;
+		int64_t literalSize = 0;
+		auto addLiteral = [&ops, &literalSize](int64_t begin, int64_t end) {
+			if (end > begin)
+			{
+				ops.push_back(Op{ begin, end - begin, literalSize, false });
+				literalSize += end - begin;
+			}
+		};
+		int64_t literalBegin = 0;
+		int64_t pos = 0;
+		uint32_t h = blockHash(target);
+		while (pos + kDeltaBlockSize <= targetSize)
+		{
+			auto it = index.find(h);
+			if (it != index.end() && std::memcmp(base + it->second, target + pos, kDeltaBlockSize) == 0)
+			{
+				int64_t basePos = it->second;
+				int64_t begin = pos;
+				while (begin > literalBegin && basePos > 0 && base[basePos - 1] == target[begin - 1])
+				{
+					begin--;
+					basePos--;
+				}
+				int64_t end = pos + kDeltaBlockSize;
+				while (end < targetSize && basePos + (end - begin) < baseSize && base[basePos + (end - begin)] == target[end])
+				{
+					end++;
+				}
+				addLiteral(literalBegin, begin);
+				ops.push_back(Op{ begin, end - begin, basePos, true });
+				pos = end;
+				literalBegin = end;
+				if (pos + kDeltaBlockSize <= targetSize)
+				{
+					h = blockHash(target + pos);
+				}
+				continue;
+			}
+			if (pos + kDeltaBlockSize < targetSize)
+			{
+				h = (h - target[pos] * outFactor) * kRollingPrime + target[pos + kDeltaBlockSize];
+			}
+			pos++;
+		}
+		addLiteral(literalBegin, targetSize);
+		const int64_t deltaSize = kDeltaHeaderSize + static_cast<int64_t>(ops.size()) * kDeltaOpSize + literalSize;
+		if (deltaSize > targetSize / 2)
+		{
+			// 差异太大，直接使用完整文件
+			return false;
+		}
+
+		delta.reserve(static_cast<size_t>(deltaSize));
+		writeHeader(targetSize, baseSize, baseSHA256, ops, delta);
+		for (const auto& op : ops)
+		{
+			if (!op.fromBase)
+			{
+				delta.insert(delta.end(), target + op.targetOffset, target + op.targetOffset + op.length);
+			}
+		}
+		return true;
+	}
+	bool LayerDelta::compose(const std::vector<std::shared_ptr<IStream>>& chain, std::vector<uint8_t>& delta)
+	{
+		delta.clear();
+		// 合并中的片段：source为-1时从最早的版本拷贝，否则是chain[source]中的字面数据，sourceOffset为在对应流中的位置
+		struct Piece final
+		{
+			int64_t length = 0;
+			int64_t sourceOffset = 0;
+			int32_t source = -1;
+		};
+		std::vector<Piece> pieces;
+		std::vector<int64_t> offsets; // 每个片段在当前版本中的位置
+		auto addPiece = [&pieces](int32_t source, int64_t sourceOffset, int64_t length) {
+			if (!pieces.empty() && pieces.back().source == source && pieces.back().sourceOffset + pieces.back().length == sourceOffset)
+			{
+				pieces.back().length += length;
+			}
+			else
+			{
+				pieces.push_back(Piece{ length, sourceOffset, source });
+			}
+		};
+		std::shared_ptr<const Header> first;
+		std::shared_ptr<const Header> last;
+		for (size_t i = 0; i < chain.size(); i++)
+		{
+			auto header = loadHeader(chain[i]);
+			if (!header)
+			{
+				return false;
+			}
+			if (last && header->baseSize != last->targetSize)
+			{
+				std::stringstream ss;
+				ss << u8"LayerDelta::compose error ! base size mismatch. expected = " << last->targetSize << u8", actual = " << header->baseSize;
+				logerr(ss.str());
+				return false;
+			}
+			std::vector<Piece> prev;
+			prev.swap(pieces);
+			for (const auto& op : header->ops)
+			{
+				if (!op.fromBase)
+				{
+					addPiece(static_cast<int32_t>(i), header->literalPos + op.sourceOffset, op.length);
+					continue;
+				}
+				if (!last)
+				{
+					addPiece(-1, op.sourceOffset, op.length);
+					continue;
+				}
+				// 从上一版本拷贝的区间可能跨过多个片段
+				int64_t pos = op.sourceOffset;
+				const int64_t end = op.sourceOffset + op.length;
+				size_t index = static_cast<size_t>(std::upper_bound(offsets.begin(), offsets.end(), pos) - offsets.begin()) - 1;
+				while (pos < end)
+				{
+					const auto& piece = prev[index];
+					const int64_t offset = pos - offsets[index];
+					const int64_t length = std::min(piece.length - offset, end - pos);
+					addPiece(piece.source, piece.sourceOffset + offset, length);
+					pos += length;
+					index++;
+				}
+			}
+			offsets.resize(pieces.size());
+			int64_t targetOffset = 0;
+			for (size_t j = 0; j < pieces.size(); j++)
+			{
+				offsets[j] = targetOffset;
+				targetOffset += pieces[j].length;
+			}
+			if (!first)
+			{
+				first = header;
+			}
+			last = header;
+		}
+		if (!first)
+		{
+			return false;
+		}
+
+		std::vector<Op> ops;
+		int64_t literalSize = 0;
+		for (size_t i = 0; i < pieces.size(); i++)
+		{
+			const bool fromBase = pieces[i].source < 0;
+			ops.push_back(Op{ offsets[i], pieces[i].length, fromBase ? pieces[i].sourceOffset : literalSize, fromBase });
+			literalSize += fromBase ? 0 : pieces[i].length;
+		}
+		writeHeader(last->targetSize, first->baseSize, first->baseSHA256, ops, delta);
+		size_t pos = delta.size();
+		delta.resize(pos + static_cast<size_t>(literalSize));
+		for (const auto& piece : pieces)
+		{
+			if (piece.source < 0)
+			{
+				continue;
+			}
+			auto is = chain[static_cast<size_t>(piece.source)];
+			if (is->seek(piece.sourceOffset, SeekOrigin::Begin) != piece.sourceOffset || istream_read(is, delta.data() + pos, static_cast<int32_t>(piece.length)) != piece.length)
+			{
+				logerr(u8"LayerDelta::compose error ! read literal failed.");
+				delta.clear();
+				return false;
+			}
+			pos += static_cast<size_t>(piece.length);
+		}
+		return true;
+	}
+	void LayerDelta::writeHeader(int64_t targetSize, int64_t baseSize, const std::array<uint32_t, 8>& baseSHA256, const std::vector<Op>& ops, std::vector<uint8_t>& delta)
+	{
+		delta.insert(delta.end(), kDeltaMagic, kDeltaMagic + sizeof(kDeltaMagic));
+		putUint64(delta, static_cast<uint64_t>(targetSize));
+		putUint64(delta, static_cast<uint64_t>(baseSize));
+		for (const auto& word : baseSHA256)
+		{
+			for (int32_t i = 3; i >= 0; i--)
+			{
+				delta.push_back(static_cast<uint8_t>(word >> (i * 8)));
+			}
+		}
+		putUint64(delta, ops.size());
+		for (const auto& op : ops)
+		{
+			putUint64(delta, static_cast<uint64_t>(op.length));
+			putUint64(delta, op.fromBase ? static_cast<uint64_t>(op.sourceOffset) : kLiteral);
+		}
+	}
+	std::shared_ptr<const LayerDelta::Header> LayerDelta::loadHeader(std::shared_ptr<IStream> delta)
+	{
+		if (!delta || delta->seek(0, SeekOrigin::Begin) != 0)
+		{
+			return nullptr;
+		}
+		uint8_t buffer[kDeltaHeaderSize];
+		if (istream_read(delta, buffer, static_cast<int32_t>(kDeltaHeaderSize)) != kDeltaHeaderSize || std::memcmp(buffer, kDeltaMagic, sizeof(kDeltaMagic)) != 0)
+		{
+			logerr(u8"LayerDelta::loadHeader error ! invalid header.");
+			return nullptr;
+		}
+		auto header = std::make_shared<Header>();
+		header->targetSize = static_cast<int64_t>(getUint64(buffer + 8));
+		header->baseSize = static_cast<int64_t>(getUint64(buffer + 16));
+		for (size_t i = 0; i < header->baseSHA256.size(); i++)
+		{
+			const uint8_t* p = buffer + 24 + i * 4;
+			header->baseSHA256[i] = static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 | static_cast<uint32_t>(p[3]);
+		}
+		const uint64_t opNum = getUint64(buffer + 56);
+		if (header->targetSize < 0 || header->baseSize < 0 || opNum > static_cast<uint64_t>(delta->getLength() / kDeltaOpSize))
+		{
+			logerr(u8"LayerDelta::loadHeader error ! invalid header.");
+			return nullptr;
+		}
+		std::vector<uint8_t> opBuffer(static_cast<size_t>(opNum * kDeltaOpSize));
+		if (!opBuffer.empty() && istream_read(delta, opBuffer.data(), static_cast<int32_t>(opBuffer.size())) != static_cast<int32_t>(opBuffer.size()))
+		{
+			logerr(u8"LayerDelta::loadHeader error ! read ops failed.");
+			return nullptr;
+		}
+		header->ops.resize(static_cast<size_t>(opNum));
+		int64_t targetOffset = 0;
+		int64_t literalSize = 0;
+		for (size_t i = 0; i < header->ops.size(); i++)
+		{
+			auto& op = header->ops[i];
+			op.targetOffset = targetOffset;
+			op.length = static_cast<int64_t>(getUint64(opBuffer.data() + i * kDeltaOpSize));
+			const uint64_t source = getUint64(opBuffer.data() + i * kDeltaOpSize + 8);
+			op.fromBase = source != kLiteral;
+			op.sourceOffset = op.fromBase ? static_cast<int64_t>(source) : literalSize;
+			if (op.length <= 0 || (op.fromBase && (op.sourceOffset < 0 || op.sourceOffset + op.length > header->baseSize)))
+			{
+				logerr(u8"LayerDelta::loadHeader error ! invalid op.");
+				return nullptr;
+			}
+			literalSize += op.fromBase ? 0 : op.length;
+			targetOffset += op.length;
+		}
+		header->literalPos = kDeltaHeaderSize + static_cast<int64_t>(opNum) * kDeltaOpSize;
+		if (targetOffset != header->targetSize || header->literalPos + literalSize != delta->getLength())
+		{
+			logerr(u8"LayerDelta::loadHeader error ! size mismatch.");
+			return nullptr;
+		}
+		return header;
+	}
+
+	LayerDeltaIStream::LayerDeltaIStream(std::shared_ptr<IStream> base, std::shared_ptr<IStream> delta, std::shared_ptr<const LayerDelta::Header> header)
+	{
+		base_ = base;
+		delta_ = delta;
+		header_ = header;
+	}
+	std::shared_ptr<LayerDeltaIStream> LayerDeltaIStream::create(std::shared_ptr<IStream> base, std::shared_ptr<IStream> delta)
+	{
+		if (!base || !delta)
+		{
+			return nullptr;
+		}
+		auto header = LayerDelta::loadHeader(delta);
+		if (!header)
+		{
+			return nullptr;
+		}
+		if (base->getLength() != header->baseSize)
+		{
+			std::stringstream ss;
+			ss << u8"LayerDeltaIStream::create error ! base size mismatch. expected = " << header->baseSize << u8", actual = " << base->getLength();
+			logerr(ss.str());
+			return nullptr;
+		}
+		return std::make_shared<LayerDeltaIStream>(base, delta, header);
+	}
+	int32_t LayerDeltaIStream::read(void* buf, int32_t size)
+	{
+		int32_t total = 0;
+		uint8_t* out = static_cast<uint8_t*>(buf);
+		const auto& ops = header_->ops;
+		while (total < size && position_ < header_->targetSize)
+		{
+			auto it = std::upper_bound(ops.begin(), ops.end(), position_, [](int64_t pos, const LayerDelta::Op& op) {
+				return pos < op.targetOffset;
+			});
+			const auto& op = *(it - 1);
+			const int64_t offset = position_ - op.targetOffset;
+			const int32_t length = static_cast<int32_t>(std::min<int64_t>(op.length - offset, size - total));
+			auto is = op.fromBase ? base_ : delta_;
+			const int64_t sourcePos = op.fromBase ? op.sourceOffset + offset : header_->literalPos + op.sourceOffset + offset;
+			if (is->getPosition() != sourcePos && is->seek(sourcePos, SeekOrigin::Begin) != sourcePos)
+			{
+				return -1;
+			}
+			if (istream_read(is, out + total, length) != length)
+			{
+				return -1;
+			}
+			total += length;
+			position_ += length;
+		}
+		return total;
+	}
+	int64_t LayerDeltaIStream::seek(int64_t offset, const SeekOrigin& origin)
+	{
+		int64_t pos = 0;
+		switch (origin)
+		{
+		case SeekOrigin::Begin:
+			pos = offset;
+			break;
+		case SeekOrigin::Current:
+			pos = position_ + offset;
+			break;
+		case SeekOrigin::End:
+			pos = header_->targetSize + offset;
+			break;
+		default:
+			return -1;
+		}
+		if (pos < 0 || pos > header_->targetSize)
+		{
+			std::stringstream ss;
+			ss << u8"LayerDeltaIStream::seek error ! offset = ";
+			ss << offset;
+			logerr(ss.str());
+			return -1;
+		}
+		position_ = pos;
+		return position_;
+	}
+	int64_t LayerDeltaIStream::getPosition() const
+	{
+		return position_;
+	}
+	int64_t LayerDeltaIStream::getLength() const
+	{
+		return header_->targetSize;
+	}
+	std::shared_ptr<IStream> LayerDeltaIStream::createNew()
+	{
+		auto base = base_->createNew();
+		auto delta = delta_->createNew();
+		if (!base || !delta)
+		{
+			return nullptr;
+		}
+		return std::make_shared<LayerDeltaIStream>(base, delta, header_);
+	}
+}
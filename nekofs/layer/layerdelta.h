@@ -0,0 +1,78 @@
+﻿#pragma once
+
+#include "../common/typedef.h"
+
+#include <cstdint>
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace nekofs {
+	/*
+	* 文件的块级差异。差异由一组连续的片段组成，每个片段从旧版本的某个位置拷贝，或者直接使用差异中保存的数据。
+	* 格式：
+	* magic(8) | targetSize(8) | baseSize(8) | baseSHA256(32) | opNum(8) | op[opNum]: length(8) baseOffset(8) | 字面数据
+	* baseOffset为kLiteral时片段数据按顺序保存在字面数据中。整数都是大端。
+	*/
+	class LayerDelta final
+	{
+	public:
+		struct Op final
+		{
+			int64_t targetOffset = 0;
+			int64_t length = 0;
+			int64_t sourceOffset = 0; // 旧版本中的位置，或字面数据中的位置
+			bool fromBase = false;
+		};
+		struct Header final
+		{
+			int64_t targetSize = 0;
+			int64_t baseSize = 0;
+			std::array<uint32_t, 8> baseSHA256 = { 0 };
+			std::vector<Op> ops;
+			int64_t literalPos = 0; // 字面数据在差异中的起始位置
+		};
+
+	public:
+		/*
+		* 按块滚动哈希在旧版本中查找相同的数据，匹配后向前后扩展。差异不比完整文件小很多时返回false。
+		*/
+		static bool encode(const uint8_t* base, int64_t baseSize, const std::array<uint32_t, 8>& baseSHA256, const uint8_t* target, int64_t targetSize, std::vector<uint8_t>& delta);
+		/*
+		* 把连续的差异合并成一个：chain[0]把A变成B，chain[1]把B变成C……结果直接把A变成最后的版本。
+		* 后面的差异中从上一版本拷贝的片段换成前面的差异中对应的片段，不需要中间的版本。
+		*/
+		static bool compose(const std::vector<std::shared_ptr<IStream>>& chain, std::vector<uint8_t>& delta);
+		static std::shared_ptr<const Header> loadHeader(std::shared_ptr<IStream> delta);
+
+	private:
+		static void writeHeader(int64_t targetSize, int64_t baseSize, const std::array<uint32_t, 8>& baseSHA256, const std::vector<Op>& ops, std::vector<uint8_t>& delta);
+	};
+
+	/*
+	* 由旧版本和差异还原出的新版本数据流，按需读取，不需要先生成完整文件。
+	*/
+	class LayerDeltaIStream final : public IStream, public std::enable_shared_from_this<LayerDeltaIStream>
+	{
+		LayerDeltaIStream(const LayerDeltaIStream&) = delete;
+		LayerDeltaIStream(LayerDeltaIStream&&) = delete;
+		LayerDeltaIStream& operator=(const LayerDeltaIStream&) = delete;
+		LayerDeltaIStream& operator=(LayerDeltaIStream&&) = delete;
+	public:
+		LayerDeltaIStream(std::shared_ptr<IStream> base, std::shared_ptr<IStream> delta, std::shared_ptr<const LayerDelta::Header> header);
+		static std::shared_ptr<LayerDeltaIStream> create(std::shared_ptr<IStream> base, std::shared_ptr<IStream> delta);
+
+	public:
+		int32_t read(void* buf, int32_t size) override;
+		int64_t seek(int64_t offset, const SeekOrigin& origin) override;
+		int64_t getPosition() const override;
+		int64_t getLength() const override;
+		std::shared_ptr<IStream> createNew() override;
+
+	private:
+		std::shared_ptr<IStream> base_;
+		std::shared_ptr<IStream> delta_;
+		std::shared_ptr<const LayerDelta::Header> header_;
+		int64_t position_ = 0;
+	};
+}
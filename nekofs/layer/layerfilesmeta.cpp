@@ -1,6 +1,7 @@
 ﻿#include "layerfilesmeta.h"
 #include "../common/error.h"
 #include "../common/utils.h"
+#include "../common/bufferedostream.h"
 
 #include <algorithm>
 #include <sstream>
@@ -52,6 +53,11 @@ namespace nekofs {
 					{
 						meta.setSize(sizeIt->value.GetInt64());
 					}
+					auto deltaBaseIt = itr->value.FindMember(nekofs_kLayerFiles_FilesDeltaBase);
+					if (deltaBaseIt != itr->value.MemberEnd())
+					{
+						meta.setDeltaBase(str_to_sha256(deltaBaseIt->value.GetString()));
+					}
 					lfmeta.files_[filename] = meta;
 				}
 			}
@@ -178,7 +184,9 @@ namespace nekofs {
 		{
 			return false;
 		}
-		JsonOutputStream jos(os);
+		// JsonOutputStream每次只写1个字节，需要合并后再写入
+		auto bos = std::make_shared<BufferedOStream>(os);
+		JsonOutputStream jos(bos);
 		JSONFileWriter writer(jos);
 		JSONDocument d(rapidjson::kObjectType);
 		if (!save(&d, d.GetAllocator()))
@@ -187,7 +195,7 @@ namespace nekofs {
 		}
 		try
 		{
-			return d.Accept(writer);
+			return d.Accept(writer) && bos->flush();
 		}
 		catch (const FSException& ex)
 		{
@@ -214,6 +222,11 @@ namespace nekofs {
 				meta.AddMember(rapidjson::StringRef(nekofs_kLayerFiles_FilesVersion), version, allocator);
 				meta.AddMember(rapidjson::StringRef(nekofs_kLayerFiles_FilesSHA256), sha256, allocator);
 				meta.AddMember(rapidjson::StringRef(nekofs_kLayerFiles_FilesSize), size, allocator);
+				if (item.second.getDeltaBase().has_value())
+				{
+					JSONValue deltaBase(sha256_to_str(item.second.getDeltaBase().value()), allocator);
+					meta.AddMember(rapidjson::StringRef(nekofs_kLayerFiles_FilesDeltaBase), deltaBase, allocator);
+				}
 				files.AddMember(rapidjson::StringRef(item.first.c_str()), meta, allocator);
 			}
 			jsondoc->AddMember(rapidjson::StringRef(nekofs_kLayerFiles_Files), files, allocator);
@@ -336,4 +349,12 @@ namespace nekofs {
 	{
 		return size_;
 	}
+	void LayerFilesMeta::FileMeta::setDeltaBase(const std::optional<std::array<uint32_t, 8>>& sha256)
+	{
+		deltaBase_ = sha256;
+	}
+	const std::optional<std::array<uint32_t, 8>>& LayerFilesMeta::FileMeta::getDeltaBase() const
+	{
+		return deltaBase_;
+	}
 }
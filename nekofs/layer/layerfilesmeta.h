@@ -51,10 +51,16 @@ namespace nekofs {
 		const std::array<uint32_t, 8>& getSHA256() const;
 		void setSize(const int64_t& size);
 		int64_t getSize() const;
+		/*
+		* 不为空时，保存的是相对sha256为deltaBase的旧版本的差异（LayerDelta），sha256和size仍是还原后的文件的。
+		*/
+		void setDeltaBase(const std::optional<std::array<uint32_t, 8>>& sha256);
+		const std::optional<std::array<uint32_t, 8>>& getDeltaBase() const;
 
 	private:
 		uint32_t version_ = 0;
 		std::array<uint32_t, 8> sha256_ = { 0 };
 		int64_t size_ = 0;
+		std::optional<std::array<uint32_t, 8>> deltaBase_;
 	};
 }
@@ -1,6 +1,7 @@
 ﻿#include "layerversionmeta.h"
 #include "../common/error.h"
 #include "../common/utils.h"
+#include "../common/bufferedostream.h"
 
 #include <algorithm>
 #include <sstream>
@@ -156,7 +157,9 @@ namespace nekofs {
 		{
 			return false;
 		}
-		JsonOutputStream jos(os);
+		// JsonOutputStream每次只写1个字节，需要合并后再写入
+		auto bos = std::make_shared<BufferedOStream>(os);
+		JsonOutputStream jos(bos);
 		JSONFileWriter writer(jos);
 		JSONDocument d(rapidjson::kObjectType);
 		if (!save(&d, d.GetAllocator()))
@@ -165,7 +168,7 @@ namespace nekofs {
 		}
 		try
 		{
-			return d.Accept(writer);
+			return d.Accept(writer) && bos->flush();
 		}
 		catch (const FSException& ex)
 		{
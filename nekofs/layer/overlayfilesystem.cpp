@@ -1,12 +1,15 @@
 ﻿#include "overlayfilesystem.h"
 #include "../common/env.h"
 #include "../common/utils.h"
+#include "../common/accesstrace.h"
 #ifdef _WIN32
 #include "../native_win/nativefilesystem.h"
 #else
 #include "../native_posix/nativefilesystem.h"
 #endif
 #include "../nekodata/nekodatafilesystem.h"
+#include "../nekodata/nekodatapreloader.h"
+#include "layerdelta.h"
 
 #include <sstream>
 
@@ -29,20 +32,28 @@ namespace nekofs {
 	std::unique_ptr<FileHandle> OverlayFileSystem::getFileHandle(const std::string& filepath)
 	{
 		auto it = files_.find(filepath);
-		if (it != files_.end())
+		if (it != files_.end() && !it->second.base)
 		{
-			return  it->second.first->getFileHandle(it->second.second);
+			return  it->second.fs->getFileHandle(it->second.filepath);
 		}
 		return nullptr;
 	}
 	std::shared_ptr<IStream> OverlayFileSystem::openIStream(const std::string& filepath)
 	{
+		auto& trace = AccessTrace::getInstance();
+		const bool tracing = trace.isEnabled();
+		const int64_t beginTime = tracing ? AccessTrace::now() : 0;
+		std::shared_ptr<IStream> is;
 		auto it = files_.find(filepath);
 		if (it != files_.end())
 		{
-			return  it->second.first->openIStream(it->second.second);
+			is = openFileIStream(it->second);
 		}
-		return nullptr;
+		if (tracing)
+		{
+			trace.record(AccessTraceEvent::OverlayOpen, filepath, -1, is ? is->getLength() : -1, beginTime, false);
+		}
+		return is;
 	}
 	FileType OverlayFileSystem::getFileType(const std::string& path) const
 	{
@@ -58,7 +69,11 @@ namespace nekofs {
 		auto it = files_.find(filepath);
 		if (it != files_.end())
 		{
-			return  it->second.first->getSize(it->second.second);
+			if (it->second.base)
+			{
+				return lfm_->getFileMeta(filepath)->getSize();
+			}
+			return  it->second.fs->getSize(it->second.filepath);
 		}
 		return -1;
 	}
@@ -66,6 +81,20 @@ namespace nekofs {
 	{
 		return FileSystemType::Overlay;
 	}
+	std::shared_ptr<Prefetch> OverlayFileSystem::prefetch(const std::vector<std::string>& filepaths, int32_t priority, bool decompress)
+	{
+		auto preloader = std::make_shared<NekodataPreloader>(priority, decompress);
+		for (const auto& filepath : filepaths)
+		{
+			auto it = files_.find(filepath);
+			if (it != files_.end())
+			{
+				addPreloadFile(*preloader, it->second, 0, std::vector<int64_t>());
+			}
+		}
+		preloader->start();
+		return preloader;
+	}
 
 	bool OverlayFileSystem::addLayer(std::shared_ptr<FileSystem> fs, const std::string& dirpath)
 	{
@@ -131,7 +160,7 @@ namespace nekofs {
 		lfm_.reset();
 		files_.clear();
 		LayerFilesMeta tmp_lfm;
-		std::map<std::string, std::pair<std::shared_ptr<FileSystem>, std::string>> tmp_files;
+		FileMap tmp_files;
 		if (layers_.empty())
 		{
 			return false;
@@ -144,8 +173,10 @@ namespace nekofs {
 			const auto& files = lfm.getFiles();
 			for (const auto& f : files)
 			{
-				tmp_files[f.first] = std::make_pair(fs, parentDir + f.first);
-				tmp_lfm.setFileMeta(f.first, lfm.getFileMeta(f.first).value());
+				if (!addFile(tmp_files, tmp_lfm, f.first, OverlayFile{ fs, parentDir + f.first, nullptr }, f.second))
+				{
+					return false;
+				}
 			}
 			const auto& deletes = lfm.getDeletes();
 			for (const auto& f : deletes)
@@ -167,6 +198,7 @@ namespace nekofs {
 					return false;
 				}
 				auto prefixPath = nekodata.substr(0, nekodata.size() - nekofs_kNekodata_FileExtension.size()) + nekofs_PathSeparator;
+				nekodatafs->setTracePrefix(prefixPath);
 				if (!refreshFileList(tmp_files, tmp_lfm, nekodatafs, prefixPath))
 				{
 					return false;
@@ -193,8 +225,10 @@ namespace nekofs {
 		const auto& files = lfm->getFiles();
 		for (const auto& f : files)
 		{
-			tmp_files[prefixPath + f.first] = std::make_pair(fs, f.first);
-			tmp_lfm.setFileMeta(prefixPath + f.first, lfm->getFileMeta(f.first).value());
+			if (!addFile(tmp_files, tmp_lfm, prefixPath + f.first, OverlayFile{ fs, f.first, nullptr }, f.second))
+			{
+				return false;
+			}
 		}
 		const auto& deletes = lfm->getDeletes();
 		for (const auto& f : deletes)
@@ -216,6 +250,7 @@ namespace nekofs {
 				return false;
 			}
 			auto tmp_prefixPath = nekodata.substr(0, nekodata.size() - nekofs_kNekodata_FileExtension.size()) + nekofs_PathSeparator;
+			nekodatafs->setTracePrefix(prefixPath + tmp_prefixPath);
 			if (!refreshFileList(tmp_files, tmp_lfm, nekodatafs, prefixPath + tmp_prefixPath))
 			{
 				return false;
@@ -234,18 +269,85 @@ namespace nekofs {
 	std::string OverlayFileSystem::getFileURI(const std::string& filepath) const
 	{
 		auto it = files_.find(filepath);
-		if (it != files_.end())
+		if (it != files_.end() && !it->second.base)
 		{
-			switch (it->second.first->getFSType())
+			switch (it->second.fs->getFSType())
 			{
 			case FileSystemType::Native:
-				return nekofs_kURIPrefix_Native + it->second.second;
+				return nekofs_kURIPrefix_Native + it->second.filepath;
 			case FileSystemType::Nekodata:
-				return nekofs_kURIPrefix_Nekodata + it->second.second;
+				return nekofs_kURIPrefix_Nekodata + it->second.filepath;
 			default:
 				break;
 			}
 		}
 		return std::string();
 	}
+	bool OverlayFileSystem::preload(const WarmSetMeta& wsm, int64_t memoryLimit)
+	{
+		releasePreload();
+		auto preloader = std::make_shared<NekodataPreloader>(0, true, memoryLimit);
+		for (const auto& item : wsm.getFiles())
+		{
+			auto it = files_.find(item.first);
+			if (it != files_.end())
+			{
+				addPreloadFile(*preloader, it->second, item.second.getPriority(), item.second.getBlocks());
+			}
+		}
+		if (!preloader->start())
+		{
+			return false;
+		}
+		preloader_ = preloader;
+		return true;
+	}
+	void OverlayFileSystem::releasePreload()
+	{
+		// 析构时取消，等待正在处理的文件结束
+		preloader_.reset();
+	}
+	void OverlayFileSystem::addPreloadFile(NekodataPreloader& preloader, const OverlayFile& file, int32_t priority, const std::vector<int64_t>& blocks)
+	{
+		preloader.add(file.fs, file.filepath, priority, blocks);
+		// 差异文件还原时需要读取整个base
+		for (auto base = file.base; base; base = base->base)
+		{
+			preloader.add(base->fs, base->filepath, priority);
+		}
+	}
+	std::shared_ptr<IStream> OverlayFileSystem::openFileIStream(const OverlayFile& file)
+	{
+		if (!file.base)
+		{
+			return file.fs->openIStream(file.filepath);
+		}
+		return LayerDeltaIStream::create(openFileIStream(*file.base), file.fs->openIStream(file.filepath));
+	}
+	/*
+	* 差异文件的基础是之前的层中的同名文件，sha256必须和差异记录的一致。
+	*/
+	bool OverlayFileSystem::addFile(FileMap& tmp_files, LayerFilesMeta& tmp_lfm, const std::string& filepath, const OverlayFile& file, const LayerFilesMeta::FileMeta& meta)
+	{
+		auto newFile = file;
+		auto newMeta = meta;
+		if (meta.getDeltaBase().has_value())
+		{
+			auto it = tmp_files.find(filepath);
+			auto baseMeta = tmp_lfm.getFileMeta(filepath);
+			if (it == tmp_files.end() || !baseMeta.has_value() || baseMeta->getSHA256() != meta.getDeltaBase().value())
+			{
+				std::stringstream ss;
+				ss << u8"OverlayFileSystem::addFile delta base not found ! filepath = ";
+				ss << filepath;
+				logerr(ss.str());
+				return false;
+			}
+			newFile.base = std::make_shared<const OverlayFile>(it->second);
+			newMeta.setDeltaBase(std::nullopt);
+		}
+		tmp_files[filepath] = newFile;
+		tmp_lfm.setFileMeta(filepath, newMeta);
+		return true;
+	}
 }
@@ -3,6 +3,7 @@
 #include "../common/typedef.h"
 #include "layerversionmeta.h"
 #include "layerfilesmeta.h"
+#include "warmsetmeta.h"
 
 #include <cstdint>
 #include <memory>
@@ -15,10 +16,17 @@ namespace nekofs {
 	class LayerVersionMeta;
 	class LayerFilesMeta;
 	class NekodataFileSystem;
+	class NekodataPreloader;
 
 	class OverlayFileSystem final : public FileSystem, public std::enable_shared_from_this<OverlayFileSystem>
 	{
-		typedef std::map<std::string, std::pair<std::shared_ptr<FileSystem>, std::string>> FileMap;
+		struct OverlayFile final
+		{
+			std::shared_ptr<FileSystem> fs;
+			std::string filepath;
+			std::shared_ptr<const OverlayFile> base; // 不为空时fs中保存的是相对base的差异
+		};
+		typedef std::map<std::string, OverlayFile> FileMap;
 
 	private:
 		OverlayFileSystem(const OverlayFileSystem&) = delete;
@@ -29,11 +37,15 @@ namespace nekofs {
 	public:
 		std::string getCurrentPath() const override;
 		std::vector<std::string> getAllFiles(const std::string& dirpath) const override;
+		/*
+		* 以差异保存的文件没有对应的原始文件，返回nullptr，需要用openIStream读取还原后的内容。
+		*/
 		std::unique_ptr<FileHandle> getFileHandle(const std::string& filepath) override;
 		std::shared_ptr<IStream> openIStream(const std::string& filepath) override;
 		FileType getFileType(const std::string& path) const override;
 		int64_t getSize(const std::string& filepath) const override;
 		FileSystemType getFSType() const override;
+		std::shared_ptr<Prefetch> prefetch(const std::vector<std::string>& filepaths, int32_t priority, bool decompress) override;
 
 	public:
 		OverlayFileSystem() = default;
@@ -42,12 +54,26 @@ namespace nekofs {
 		bool refreshFileList(FileMap& tmp_files, LayerFilesMeta& tmp_lfm, std::shared_ptr<NekodataFileSystem> fs, const std::string& prefixPath);
 		std::optional<LayerVersionMeta> getVersion() const;
 		std::optional<LayerFilesMeta> getFiles() const;
+		/*
+		* 以差异保存的文件返回空字符串，同getFileHandle。
+		*/
 		std::string getFileURI(const std::string& filepath) const;
+		/*
+		* 按预热清单在后台预读并解压文件，清单中是overlay中的路径。解压的块保留到releasePreload或下一次preload。
+		*/
+		bool preload(const WarmSetMeta& wsm, int64_t memoryLimit = nekofs_kNekodata_PreloadMemoryLimit);
+		void releasePreload();
+
+	private:
+		static std::shared_ptr<IStream> openFileIStream(const OverlayFile& file);
+		static void addPreloadFile(NekodataPreloader& preloader, const OverlayFile& file, int32_t priority, const std::vector<int64_t>& blocks);
+		static bool addFile(FileMap& tmp_files, LayerFilesMeta& tmp_lfm, const std::string& filepath, const OverlayFile& file, const LayerFilesMeta::FileMeta& meta);
 
 	private:
 		std::vector<std::tuple<std::shared_ptr<FileSystem>, LayerVersionMeta, LayerFilesMeta, std::string>> layers_;
 		FileMap files_;
 		std::optional<LayerVersionMeta> lvm_;
 		std::optional<LayerFilesMeta> lfm_;
+		std::shared_ptr<NekodataPreloader> preloader_;
 	};
 }
@@ -0,0 +1,214 @@
+﻿#include "warmsetmeta.h"
+#include "../common/error.h"
+#include "../common/utils.h"
+#include "../common/bufferedostream.h"
+#include "../common/accesstrace.h"
+
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+#include <sstream>
+
+namespace nekofs {
+	std::optional<WarmSetMeta> WarmSetMeta::load(std::shared_ptr<IStream> is)
+	{
+		if (!is)
+		{
+			return std::nullopt;
+		}
+		JsonInputStream jis(is);
+		JSONDocument d;
+		d.ParseStream(jis);
+		if (d.HasParseError())
+		{
+			return std::nullopt;
+		}
+		return load(&d);
+	}
+	std::optional<WarmSetMeta> WarmSetMeta::load(const JSONValue* jsondoc)
+	{
+		if (jsondoc == nullptr || !jsondoc->IsObject())
+		{
+			return std::nullopt;
+		}
+		WarmSetMeta wsm;
+		{
+			// files
+			auto filesIt = jsondoc->FindMember(nekofs_kWarmSet_Files);
+			if (filesIt == jsondoc->MemberEnd() || !filesIt->value.IsObject())
+			{
+				return std::nullopt;
+			}
+			for (auto it = filesIt->value.MemberBegin(); it != filesIt->value.MemberEnd(); it++)
+			{
+				if (!it->value.IsObject())
+				{
+					return std::nullopt;
+				}
+				WarmSetMeta::FileMeta meta;
+				auto priorityIt = it->value.FindMember(nekofs_kWarmSet_Priority);
+				if (priorityIt != it->value.MemberEnd() && priorityIt->value.IsInt())
+				{
+					meta.setPriority(priorityIt->value.GetInt());
+				}
+				auto blocksIt = it->value.FindMember(nekofs_kWarmSet_Blocks);
+				if (blocksIt != it->value.MemberEnd())
+				{
+					if (!blocksIt->value.IsArray())
+					{
+						return std::nullopt;
+					}
+					for (auto blockIt = blocksIt->value.Begin(); blockIt != blocksIt->value.End(); blockIt++)
+					{
+						if (!blockIt->IsInt64())
+						{
+							return std::nullopt;
+						}
+						meta.addBlock(blockIt->GetInt64());
+					}
+				}
+				wsm.setFileMeta(std::string(it->name.GetString(), it->name.GetStringLength()), meta);
+			}
+		}
+		return wsm;
+	}
+	WarmSetMeta WarmSetMeta::fromTrace(const std::vector<std::string>& paths, const std::vector<AccessTraceRecord>& records, int64_t duration)
+	{
+		std::vector<const AccessTraceRecord*> sorted;
+		sorted.reserve(records.size());
+		for (const auto& record : records)
+		{
+			if (record.pathId < paths.size() && (record.event == AccessTraceEvent::OverlayOpen || record.event == AccessTraceEvent::NekodataBlock))
+			{
+				sorted.push_back(&record);
+			}
+		}
+		std::stable_sort(sorted.begin(), sorted.end(), [](const AccessTraceRecord* left, const AccessTraceRecord* right) { return left->timestamp < right->timestamp; });
+		const int64_t beginTime = sorted.empty() ? 0 : sorted.front()->timestamp;
+		// 打开的文件按第一次打开的顺序
+		std::vector<std::string> files;
+		std::set<std::string> opened;
+		for (auto record : sorted)
+		{
+			if (duration > 0 && record->timestamp - beginTime > duration)
+			{
+				break;
+			}
+			if (record->event == AccessTraceEvent::OverlayOpen && opened.insert(paths[record->pathId]).second)
+			{
+				files.push_back(paths[record->pathId]);
+			}
+		}
+		// 块记录的路径与打开的路径相同（都是overlay中的路径）
+		std::unordered_map<std::string, size_t> indexes;
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			indexes.emplace(files[i], i);
+		}
+		std::vector<WarmSetMeta::FileMeta> metas(files.size());
+		std::vector<std::set<int64_t>> blocks(files.size());
+		for (auto record : sorted)
+		{
+			if (duration > 0 && record->timestamp - beginTime > duration)
+			{
+				break;
+			}
+			if (record->event != AccessTraceEvent::NekodataBlock)
+			{
+				continue;
+			}
+			auto it = indexes.find(paths[record->pathId]);
+			if (it != indexes.end() && blocks[it->second].insert(record->index).second)
+			{
+				metas[it->second].addBlock(record->index);
+			}
+		}
+		WarmSetMeta wsm;
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			metas[i].setPriority(static_cast<int32_t>(files.size() - i));
+			wsm.setFileMeta(files[i], metas[i]);
+		}
+		return wsm;
+	}
+	bool WarmSetMeta::save(std::shared_ptr<OStream> os) const
+	{
+		if (!os)
+		{
+			return false;
+		}
+		// JsonOutputStream每次只写1个字节，需要合并后再写入
+		auto bos = std::make_shared<BufferedOStream>(os);
+		JsonOutputStream jos(bos);
+		JSONFileWriter writer(jos);
+		JSONDocument d(rapidjson::kObjectType);
+		if (!save(&d, d.GetAllocator()))
+		{
+			return false;
+		}
+		try
+		{
+			return d.Accept(writer) && bos->flush();
+		}
+		catch (const FSException& ex)
+		{
+			std::stringstream ss;
+			ss << u8"WarmSetMeta::save error. code = ";
+			ss << (int32_t)ex.getErrCode();
+			logerr(ss.str());
+			return false;
+		}
+		return true;
+	}
+	bool WarmSetMeta::save(JSONValue* jsondoc, JSONDocument::AllocatorType& allocator) const
+	{
+		{
+			// files
+			JSONValue files(rapidjson::kObjectType);
+			for (const auto& item : this->files_)
+			{
+				JSONValue info(rapidjson::kObjectType);
+				JSONValue priority(item.second.getPriority());
+				info.AddMember(rapidjson::StringRef(nekofs_kWarmSet_Priority), priority, allocator);
+				if (!item.second.getBlocks().empty())
+				{
+					JSONValue blocks(rapidjson::kArrayType);
+					for (auto index : item.second.getBlocks())
+					{
+						blocks.PushBack(index, allocator);
+					}
+					info.AddMember(rapidjson::StringRef(nekofs_kWarmSet_Blocks), blocks, allocator);
+				}
+				files.AddMember(rapidjson::StringRef(item.first), info, allocator);
+			}
+			jsondoc->AddMember(rapidjson::StringRef(nekofs_kWarmSet_Files), files, allocator);
+		}
+		return true;
+	}
+	void WarmSetMeta::setFileMeta(const std::string& filepath, const WarmSetMeta::FileMeta& meta)
+	{
+		files_[filepath] = meta;
+	}
+	const std::map<std::string, WarmSetMeta::FileMeta>& WarmSetMeta::getFiles() const
+	{
+		return files_;
+	}
+
+
+	void WarmSetMeta::FileMeta::setPriority(const int32_t& priority)
+	{
+		priority_ = priority;
+	}
+	int32_t WarmSetMeta::FileMeta::getPriority() const
+	{
+		return priority_;
+	}
+	void WarmSetMeta::FileMeta::addBlock(const int64_t& index)
+	{
+		blocks_.push_back(index);
+	}
+	const std::vector<int64_t>& WarmSetMeta::FileMeta::getBlocks() const
+	{
+		return blocks_;
+	}
+}
@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include "../common/typedef.h"
+
+
+#include "../common/rapidjson.h"
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <vector>
+#include <map>
+#include <optional>
+
+namespace nekofs {
+	struct AccessTraceRecord;
+
+	/*
+	* 预热清单：启动时需要预加载的文件及其优先级，可以只列出文件中需要的nekodata块。
+	*/
+	class WarmSetMeta final
+	{
+	public:
+		class FileMeta;
+
+	public:
+		static std::optional<WarmSetMeta> load(std::shared_ptr<IStream> is);
+		static std::optional<WarmSetMeta> load(const JSONValue* jsondoc);
+		/*
+		* 从访问记录生成，只使用开始后duration纳秒内的记录（为0时使用全部）。越早打开的文件优先级越高，
+		* 块记录的路径和打开的路径一样是overlay中的路径，直接对应到打开的文件上。
+		*/
+		static WarmSetMeta fromTrace(const std::vector<std::string>& paths, const std::vector<AccessTraceRecord>& records, int64_t duration = 0);
+		bool save(std::shared_ptr<OStream> os) const;
+		bool save(JSONValue* jsondoc, JSONDocument::AllocatorType& allocator) const;
+		void setFileMeta(const std::string& filepath, const WarmSetMeta::FileMeta& meta);
+		const std::map<std::string, WarmSetMeta::FileMeta>& getFiles() const;
+
+	private:
+		std::map<std::string, WarmSetMeta::FileMeta> files_;
+	};
+
+
+	class WarmSetMeta::FileMeta final
+	{
+	public:
+		void setPriority(const int32_t& priority);
+		int32_t getPriority() const;
+		void addBlock(const int64_t& index);
+		/*
+		* 为空时预加载整个文件。
+		*/
+		const std::vector<int64_t>& getBlocks() const;
+
+	private:
+		int32_t priority_ = 0;
+		std::vector<int64_t> blocks_;
+	};
+}
@@ -11,6 +11,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <cstring>
+#include <cerrno>
 #include <sstream>
 #include <functional>
 #include <filesystem>
@@ -24,7 +25,7 @@ namespace nekofs {
 	{
 		return filepath_;
 	}
-	std::shared_ptr<NativeIStream> NativeFile::openIStream()
+	std::shared_ptr<NativeIStream> NativeFile::openIStream(AccessHint hint)
 	{
 		std::lock_guard<std::recursive_mutex> lock(mtx_);
 		if (-1 != writeFd_)
@@ -42,10 +43,14 @@ namespace nekofs {
 		}
 		readStreamCount_++;
 		std::shared_ptr<NativeIStream> isPtr;
-		isPtr.reset(new NativeIStream(shared_from_this(), readFileSize_), std::bind(&NativeFile::weakReadDeleteCallback, std::weak_ptr<NativeFile>(shared_from_this()), std::placeholders::_1));
+		isPtr.reset(new NativeIStream(shared_from_this(), readFileSize_, hint), std::bind(&NativeFile::weakReadDeleteCallback, std::weak_ptr<NativeFile>(shared_from_this()), std::placeholders::_1));
 		return isPtr;
 	}
-	std::shared_ptr<NativeOStream> NativeFile::openOStream()
+	int NativeFile::getReadFd() const
+	{
+		return readFd_;
+	}
+	std::shared_ptr<NativeOStream> NativeFile::openOStream(bool openExisting)
 	{
 		std::lock_guard<std::recursive_mutex> lock(mtx_);
 		if (readStreamCount_ > 0 || -1 != writeFd_)
@@ -56,7 +61,7 @@ namespace nekofs {
 			logerr(ss.str());
 			return nullptr;
 		}
-		openWriteFdInternal();
+		openWriteFdInternal(openExisting);
 		if (-1 == writeFd_)
 		{
 			return nullptr;
@@ -74,7 +79,7 @@ namespace nekofs {
 		}
 		env::getInstance().getNativeFileSystem()->createDirectories(filepath_.substr(0, filepath_.rfind(nekofs_PathSeparator)));
 	}
-	std::shared_ptr<NativeFileBlock> NativeFile::openBlockInternal(int64_t offset)
+	std::shared_ptr<NativeFileBlock> NativeFile::openBlockInternal(int64_t offset, bool populate)
 	{
 		size_t index = offset >> nekofs_MapBlockSizeBitOffset;
 		std::shared_ptr<NativeFileBlock> fPtr;
@@ -89,7 +94,7 @@ namespace nekofs {
 					const int64_t offset = index << nekofs_MapBlockSizeBitOffset;
 					const int32_t size = readFileSize_ - offset > nekofs_MapBlockSize ? nekofs_MapBlockSize : static_cast<int32_t>(readFileSize_ - offset);
 					rawPtr = new NativeFileBlock(shared_from_this(), readFd_, offset, size);
-					rawPtr->mmap();
+					rawPtr->mmap(populate);
 					blockPtrs_[index] = rawPtr;
 				}
 				fPtr.reset(rawPtr, std::bind(&NativeFile::weakBlockDeleteCallback, std::weak_ptr<NativeFile>(shared_from_this()), std::placeholders::_1));
@@ -204,12 +209,21 @@ namespace nekofs {
 		}
 		readFileSize_ = 0;
 	}
-	void NativeFile::openWriteFdInternal()
+	/*
+	* openExisting时只打开已有的文件继续写入，不创建也不截断，用于追加写入。
+	*/
+	void NativeFile::openWriteFdInternal(bool openExisting)
 	{
 		if (-1 == writeFd_)
 		{
-			createParentDirectory();
-			writeFd_ = ::open(filepath_.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+			const int flags = openExisting ? O_RDWR : O_RDWR | O_CREAT;
+			// 父目录通常已经存在，打开失败时再创建，省去逐级检查目录
+			writeFd_ = ::open(filepath_.c_str(), flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+			if (-1 == writeFd_ && ENOENT == errno && !openExisting)
+			{
+				createParentDirectory();
+				writeFd_ = ::open(filepath_.c_str(), flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+			}
 			if (-1 == writeFd_)
 			{
 				auto errmsg = getSysErrMsg();
@@ -22,10 +22,11 @@ namespace nekofs {
 	public:
 		NativeFile(const std::string& filepath);
 		const std::string& getFilePath() const;
-		std::shared_ptr<NativeIStream> openIStream();
-		std::shared_ptr<NativeOStream> openOStream();
+		int getReadFd() const;
+		std::shared_ptr<NativeIStream> openIStream(AccessHint hint = AccessHint::Auto);
+		std::shared_ptr<NativeOStream> openOStream(bool openExisting = false);
 		void createParentDirectory();
-		std::shared_ptr<NativeFileBlock> openBlockInternal(int64_t offset);
+		std::shared_ptr<NativeFileBlock> openBlockInternal(int64_t offset, bool populate = false);
 
 	private:
 		static void weakWriteDeleteCallback(std::weak_ptr<NativeFile> file, NativeOStream* ostream);
@@ -34,7 +35,7 @@ namespace nekofs {
 		void closeBlockInternal(int64_t offset);
 		void openReadFdInternal();
 		void closeReadFdInternal();
-		void openWriteFdInternal();
+		void openWriteFdInternal(bool openExisting);
 		void closeWriteFdInternal();
 
 	private:
@@ -35,6 +35,21 @@ namespace nekofs {
 		}
 		return -1;
 	}
+	/*
+	* 直接返回映射内存中pos处的地址，count会被截断到块的末尾。
+	*/
+	const uint8_t* NativeFileBlock::data(int64_t pos, int32_t& count) const
+	{
+		if (MAP_FAILED != lpBaseAddress_ && pos >= offset_ && pos < offset_ + size_ && count > 0)
+		{
+			if (pos + count > offset_ + size_)
+			{
+				count = static_cast<int32_t>(offset_ + size_ - pos);
+			}
+			return ((const uint8_t*)lpBaseAddress_) - offset_ + pos;
+		}
+		return nullptr;
+	}
 	int64_t NativeFileBlock::getOffset() const
 	{
 		return offset_;
@@ -43,11 +58,22 @@ namespace nekofs {
 	{
 		return offset_ + size_;
 	}
-	void NativeFileBlock::mmap()
+	void NativeFileBlock::mmap(bool populate)
 	{
 		size_t length = size_;
 		off_t offset = offset_;
-		lpBaseAddress_ = ::mmap(NULL, length, PROT_READ, MAP_SHARED, fd_, offset);
+		int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+		if (populate)
+		{
+			flags |= MAP_POPULATE;
+		}
+#endif
+		lpBaseAddress_ = ::mmap(NULL, length, PROT_READ, flags, fd_, offset);
+		if (populate)
+		{
+			advice_ = AccessHint::Populate;
+		}
 		if (MAP_FAILED == lpBaseAddress_)
 		{
 			auto errmsg = getSysErrMsg();
@@ -85,4 +111,37 @@ namespace nekofs {
 			lpBaseAddress_ = MAP_FAILED;
 		}
 	}
+	void NativeFileBlock::advise(AccessHint hint)
+	{
+		if (MAP_FAILED == lpBaseAddress_ || advice_.exchange(hint) == hint)
+		{
+			return;
+		}
+		int advice = MADV_NORMAL;
+		switch (hint)
+		{
+		case AccessHint::Sequential:
+			advice = MADV_SEQUENTIAL;
+			break;
+		case AccessHint::Random:
+			advice = MADV_RANDOM;
+			break;
+		case AccessHint::WillNeed:
+			advice = MADV_WILLNEED;
+			break;
+		case AccessHint::Populate:
+#ifdef MADV_POPULATE_READ
+			// 已经映射过的块无法再用MAP_POPULATE，Linux 5.14以上可以同步读入
+			if (0 == ::madvise(lpBaseAddress_, size_, MADV_POPULATE_READ))
+			{
+				return;
+			}
+#endif
+			advice = MADV_WILLNEED;
+			break;
+		default:
+			break;
+		}
+		::madvise(lpBaseAddress_, size_, advice);
+	}
 }
@@ -4,6 +4,7 @@
 #include <sys/mman.h>
 #include <cstdint>
 #include <memory>
+#include <atomic>
 
 namespace nekofs {
 	class NativeFile;
@@ -19,10 +20,12 @@ namespace nekofs {
 	public:
 		NativeFileBlock(std::shared_ptr<NativeFile> file, int fd, int64_t offset, int32_t size);
 		int32_t read(int64_t pos, void* buffer, int32_t count);
+		const uint8_t* data(int64_t pos, int32_t& count) const;
 		int64_t getOffset() const;
 		int64_t getEndOffset() const;
-		void mmap();
+		void mmap(bool populate = false);
 		void munmap();
+		void advise(AccessHint hint);
 
 	private:
 		std::shared_ptr<NativeFile> file_;
@@ -30,5 +33,6 @@ namespace nekofs {
 		void* lpBaseAddress_ = MAP_FAILED;
 		int64_t offset_;
 		int32_t size_;
+		std::atomic<AccessHint> advice_ = AccessHint::Auto; // 多个流共用映射，只在变化时调用madvise
 	};
 }
@@ -1,12 +1,19 @@
 ﻿#include "nativefileistream.h"
 #include "nativefileblock.h"
 #include "nativefile.h"
+#include "../common/accesstrace.h"
+#include "../nekodata/nekodatapreloader.h"
+
+#include <algorithm>
+#include <fcntl.h>
 
 namespace nekofs {
-	NativeIStream::NativeIStream(std::shared_ptr<NativeFile> file, int64_t fileSize)
+	NativeIStream::NativeIStream(std::shared_ptr<NativeFile> file, int64_t fileSize, AccessHint hint)
 	{
 		file_ = file;
 		fileSize_ = fileSize;
+		hint_ = hint;
+		readaheadLimit_ = fileSize;
 	}
 
 	int32_t NativeIStream::read(void* buf, int32_t size)
@@ -23,10 +30,28 @@ namespace nekofs {
 		{
 			return 0;
 		}
+		auto& trace = AccessTrace::getInstance();
+		const bool tracing = trace.isEnabled();
+		const int64_t beginTime = tracing ? AccessTrace::now() : 0;
+		const int64_t position = position_;
+		// 当前映射块可以直接读取时记为命中
+		const bool cacheHit = tracing && block_ != nullptr && position_ >= block_->getOffset() && position_ < block_->getEndOffset();
+		trackAccess();
+		// 前台读取本地文件（包括nekodata的分卷）时预加载让出
+		NekodataPreloader::notifyForeground();
 		int32_t actulRead = prepareBlock()->read(position_, buf, size);
 		if (actulRead > 0)
 		{
 			position_ += actulRead;
+			lastEnd_ = position_;
+			if (AccessHint::Sequential == getAdvice())
+			{
+				readahead();
+			}
+		}
+		if (tracing)
+		{
+			trace.record(AccessTraceEvent::NativeRead, file_->getFilePath(), position, actulRead, beginTime, cacheHit);
 		}
 		return actulRead;
 	}
@@ -79,15 +104,125 @@ namespace nekofs {
 	}
 	std::shared_ptr<IStream> NativeIStream::createNew()
 	{
-		return file_->openIStream();
+		return file_->openIStream(hint_);
+	}
+	std::shared_ptr<NativeIStream> NativeIStream::createNew(AccessHint hint)
+	{
+		return file_->openIStream(hint);
+	}
+	std::shared_ptr<NativeIStream> NativeIStream::getNativeRange(int64_t& size)
+	{
+		size = fileSize_ - position_;
+		return shared_from_this();
+	}
+	int NativeIStream::getReadFd() const
+	{
+		return file_->getReadFd();
+	}
+	/*
+	* 只读取文件中的一段时（如nekodata分卷中的一个文件），顺序预读不超过这一段的末尾。
+	*/
+	void NativeIStream::setReadaheadLimit(int64_t end)
+	{
+		readaheadLimit_ = std::clamp(end, static_cast<int64_t>(0), fileSize_);
+	}
+	/*
+	* 不拷贝数据，返回当前位置在映射内存中的地址，size会被截断到映射块的末尾，不移动读取位置。
+	* 返回的地址在下一次read/seek/peek之前有效。
+	*/
+	const void* NativeIStream::peek(int32_t& size)
+	{
+		if (size <= 0 || position_ == fileSize_)
+		{
+			size = 0;
+			return nullptr;
+		}
+		auto block = prepareBlock();
+		return block ? block->data(position_, size) : nullptr;
+	}
+	/*
+	* 提示系统从当前位置开始的size字节很快会被读取，让内核提前读入页缓存。不移动读取位置。
+	*/
+	bool NativeIStream::willNeed(int64_t size)
+	{
+		size = std::min(size, fileSize_ - position_);
+		if (size <= 0)
+		{
+			return true;
+		}
+#ifdef __linux__
+		return ::posix_fadvise(getReadFd(), position_, size, POSIX_FADV_WILLNEED) == 0;
+#else
+		return false;
+#endif
 	}
 	std::shared_ptr<NativeFileBlock> NativeIStream::prepareBlock()
 	{
 		bool useCurrent = (block_ != nullptr && position_ >= block_->getOffset() && position_ < block_->getEndOffset());
 		if (!useCurrent)
 		{
-			block_ = file_->openBlockInternal(position_);
+			block_ = file_->openBlockInternal(position_, AccessHint::Populate == hint_);
+			blockAdvice_ = AccessHint::Auto;
+		}
+		// 映射块由同一文件的所有流共用，只在换块或访问方式变化时设置，最后设置的流生效
+		AccessHint advice = getAdvice();
+		if (block_ && advice != blockAdvice_)
+		{
+			block_->advise(advice);
+			blockAdvice_ = advice;
 		}
 		return block_;
 	}
+	/*
+	* 每次读取紧接上一次读取时记为顺序，否则记为随机，连续多次相同时改变判断的访问方式。
+	*/
+	void NativeIStream::trackAccess()
+	{
+		if (lastEnd_ < 0)
+		{
+			return;
+		}
+		if (position_ == lastEnd_)
+		{
+			++sequentialNum_;
+			randomNum_ = 0;
+		}
+		else
+		{
+			++randomNum_;
+			sequentialNum_ = 0;
+			readaheadEnd_ = 0;
+		}
+		if (sequentialNum_ >= nekofs_kNative_AccessPatternThreshold)
+		{
+			pattern_ = AccessHint::Sequential;
+		}
+		else if (randomNum_ >= nekofs_kNative_AccessPatternThreshold)
+		{
+			pattern_ = AccessHint::Random;
+		}
+	}
+	/*
+	* 顺序读取时让内核提前读入当前位置之后的数据，可以跨过映射块的边界。已预读的部分用掉一半后再继续。
+	*/
+	void NativeIStream::readahead()
+	{
+#ifdef __linux__
+		if (readaheadEnd_ - position_ > nekofs_kNative_SequentialReadahead / 2)
+		{
+			return;
+		}
+		int64_t begin = std::max(position_, readaheadEnd_);
+		int64_t end = std::min(position_ + nekofs_kNative_SequentialReadahead, readaheadLimit_);
+		if (begin < end)
+		{
+			::posix_fadvise(getReadFd(), begin, end - begin, POSIX_FADV_WILLNEED);
+			readaheadEnd_ = end;
+		}
+#endif
+	}
+	AccessHint NativeIStream::getAdvice() const
+	{
+		return AccessHint::Auto == hint_ ? pattern_ : hint_;
+	}
 }
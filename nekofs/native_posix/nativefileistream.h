@@ -8,7 +8,7 @@ namespace nekofs {
 	class NativeFile;
 	class NativeFileBlock;
 
-	class NativeIStream final : public IStream, public std::enable_shared_from_this<NativeIStream>
+	class NativeIStream final : public IStream, public NativeCopySource, public std::enable_shared_from_this<NativeIStream>
 	{
 	private:
 		NativeIStream(const NativeIStream&) = delete;
@@ -17,7 +17,7 @@ namespace nekofs {
 		NativeIStream& operator=(NativeIStream&&) = delete;
 
 	public:
-		NativeIStream(std::shared_ptr<NativeFile> file, int64_t fileSize);
+		NativeIStream(std::shared_ptr<NativeFile> file, int64_t fileSize, AccessHint hint = AccessHint::Auto);
 
 	public:
 		int32_t read(void* buf, int32_t size) override;
@@ -25,14 +25,31 @@ namespace nekofs {
 		int64_t getPosition() const override;
 		int64_t getLength() const override;
 		std::shared_ptr<IStream> createNew() override;
+		std::shared_ptr<NativeIStream> createNew(AccessHint hint);
+		std::shared_ptr<NativeIStream> getNativeRange(int64_t& size) override;
+		const void* peek(int32_t& size);
+		bool willNeed(int64_t size);
+		int getReadFd() const;
+		void setReadaheadLimit(int64_t end);
 
 	private:
 		std::shared_ptr<NativeFileBlock> prepareBlock();
+		void trackAccess();
+		void readahead();
+		AccessHint getAdvice() const;
 
 	private:
 		std::shared_ptr<NativeFile> file_;
 		std::shared_ptr<NativeFileBlock> block_;
 		int64_t fileSize_ = 0;
 		int64_t position_ = 0;
+		AccessHint hint_ = AccessHint::Auto;
+		AccessHint pattern_ = AccessHint::Auto; // hint_为Auto时根据读取位置判断的访问方式
+		AccessHint blockAdvice_ = AccessHint::Auto; // 已对block_使用的访问方式
+		int64_t lastEnd_ = -1;
+		int32_t sequentialNum_ = 0;
+		int32_t randomNum_ = 0;
+		int64_t readaheadEnd_ = 0;
+		int64_t readaheadLimit_ = 0; // 预读不超过的位置，默认为文件末尾
 	};
 }
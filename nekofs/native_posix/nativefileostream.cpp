@@ -1,11 +1,18 @@
 ﻿#include "nativefileostream.h"
+#include "nativefileistream.h"
 #include "nativefile.h"
 #include "../common/utils.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <cerrno>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include <cstring>
+#include <algorithm>
 #include <sstream>
 
 namespace nekofs {
@@ -125,4 +132,163 @@ namespace nekofs {
 		}
 		return info.st_size;
 	}
+	/*
+	* 在指定偏移处写入，不改变当前的文件位置。
+	*/
+	int32_t NativeOStream::writeAt(const void* buf, int32_t size, int64_t offset)
+	{
+		if (size < 0 || offset < 0)
+		{
+			return -1;
+		}
+		if (size == 0)
+		{
+			return 0;
+		}
+		size_t count = size;
+		ssize_t ret = ::pwrite(fd_, buf, count, offset);
+		if (-1 == ret)
+		{
+			auto errmsg = getSysErrMsg();
+			std::stringstream ss;
+			ss << u8"NativeOStream::writeAt pwrite error ! filepath = ";
+			ss << file_->getFilePath();
+			ss << u8", offset = ";
+			ss << offset;
+			ss << u8", err = ";
+			ss << errmsg;
+			logerr(ss.str());
+		}
+		return ret;
+	}
+	int64_t NativeOStream::copyRange(std::shared_ptr<NativeIStream> is, int64_t size)
+	{
+		off_t offset = ::lseek(fd_, 0, SEEK_CUR);
+		if (offset < 0)
+		{
+			return 0;
+		}
+		int64_t copied = copyAt(is, size, offset);
+		if (copied > 0 && ::lseek(fd_, offset + copied, SEEK_SET) < 0)
+		{
+			return -1;
+		}
+		return copied;
+	}
+	/*
+	* 由内核把is当前位置的数据拷贝到文件的offset处，不改变文件的读写位置，is的位置会后移。
+	* 优先使用copy_file_range，不支持时（跨文件系统等）改用sendfile。都不支持时返回0，调用方改用普通读写。
+	*/
+	int64_t NativeOStream::copyAt(std::shared_ptr<NativeIStream> is, int64_t size, int64_t offset)
+	{
+		int64_t copied = 0;
+#ifdef __linux__
+		int infd = is->getReadFd();
+		if (-1 == infd || size <= 0 || offset < 0)
+		{
+			return 0;
+		}
+		loff_t inoff = is->getPosition();
+		loff_t outoff = offset;
+		bool useSendfile = false;
+#ifndef __ANDROID__
+		while (copied < size)
+		{
+			ssize_t ret = ::copy_file_range(infd, &inoff, fd_, &outoff, static_cast<size_t>(std::min<int64_t>(size - copied, 1 << 30)), 0);
+			if (ret <= 0)
+			{
+				useSendfile = ret < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP);
+				break;
+			}
+			copied += ret;
+		}
+#else
+		useSendfile = true;
+#endif
+		if (useSendfile)
+		{
+			// sendfile只能写到文件的当前位置，写完后恢复
+			off_t pos = ::lseek(fd_, 0, SEEK_CUR);
+			if (pos >= 0 && ::lseek(fd_, outoff, SEEK_SET) == outoff)
+			{
+				while (copied < size)
+				{
+					ssize_t ret = ::sendfile(fd_, infd, &inoff, static_cast<size_t>(std::min<int64_t>(size - copied, 1 << 30)));
+					if (ret <= 0)
+					{
+						break;
+					}
+					copied += ret;
+				}
+				::lseek(fd_, pos, SEEK_SET);
+			}
+		}
+		if (copied > 0 && is->seek(copied, SeekOrigin::Current) < 0)
+		{
+			return -1;
+		}
+#endif
+		return copied;
+	}
+	/*
+	* 预先分配磁盘空间，不改变文件大小。不支持时返回false，调用方可以忽略。
+	*/
+	bool NativeOStream::allocate(int64_t length)
+	{
+#ifdef __linux__
+		if (0 == ::fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, length))
+		{
+			return true;
+		}
+#endif
+		return false;
+	}
+	bool NativeOStream::setLength(int64_t length)
+	{
+		if (-1 == ::ftruncate(fd_, length))
+		{
+			auto errmsg = getSysErrMsg();
+			std::stringstream ss;
+			ss << u8"NativeOStream::setLength ftruncate error ! filepath = ";
+			ss << file_->getFilePath();
+			ss << u8", length = ";
+			ss << length;
+			ss << u8", err = ";
+			ss << errmsg;
+			logerr(ss.str());
+			return false;
+		}
+		return true;
+	}
+	bool NativeOStream::sync()
+	{
+#ifdef __APPLE__
+		int ret = ::fsync(fd_);
+#else
+		int ret = ::fdatasync(fd_);
+#endif
+		if (-1 == ret)
+		{
+			auto errmsg = getSysErrMsg();
+			std::stringstream ss;
+			ss << u8"NativeOStream::sync error ! filepath = ";
+			ss << file_->getFilePath();
+			ss << u8", err = ";
+			ss << errmsg;
+			logerr(ss.str());
+			return false;
+		}
+		return true;
+	}
+	/*
+	* 让内核开始把已写入的数据写回磁盘，不等待完成。之后的sync需要等待的数据更少。
+	*/
+	bool NativeOStream::writeback()
+	{
+#ifdef __linux__
+		return 0 == ::sync_file_range(fd_, 0, 0, SYNC_FILE_RANGE_WRITE);
+#else
+		return false;
+#endif
+	}
 }
@@ -7,7 +7,7 @@
 namespace nekofs {
 	class NativeFile;
 
-	class NativeOStream final : public OStream, public std::enable_shared_from_this<NativeOStream>
+	class NativeOStream final : public OStream, public NativeCopyTarget, public std::enable_shared_from_this<NativeOStream>
 	{
 	private:
 		NativeOStream(const NativeOStream&) = delete;
@@ -24,6 +24,13 @@ namespace nekofs {
 		int64_t seek(int64_t offset, const SeekOrigin& origin) override;
 		int64_t getPosition() const override;
 		int64_t getLength() const override;
+		int32_t writeAt(const void* buf, int32_t size, int64_t offset);
+		int64_t copyRange(std::shared_ptr<NativeIStream> is, int64_t size) override;
+		int64_t copyAt(std::shared_ptr<NativeIStream> is, int64_t size, int64_t offset);
+		bool allocate(int64_t length);
+		bool setLength(int64_t length);
+		bool sync();
+		bool writeback();
 
 	private:
 		std::shared_ptr<NativeFile> file_;
@@ -4,10 +4,16 @@
 #include "nativefileistream.h"
 #include "nativefileostream.h"
 #include "../common/utils.h"
+#include "../nekodata/nekodatapreloader.h"
 
 #include <dirent.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 #include <cstring>
 #include <filesystem>
 #include <sstream>
@@ -67,6 +73,10 @@ namespace nekofs {
 	{
 		return openFileInternal(filepath)->openIStream();
 	}
+	std::shared_ptr<IStream> NativeFileSystem::openIStream(const std::string& filepath, AccessHint hint)
+	{
+		return openFileInternal(filepath)->openIStream(hint);
+	}
 	FileType NativeFileSystem::getFileType(const std::string& path) const
 	{
 		struct stat info;
@@ -87,6 +97,22 @@ namespace nekofs {
 		}
 		return FileType::None;
 	}
+	bool NativeFileSystem::getFileStat(const std::string& filepath, NativeFileStat& stat) const
+	{
+		struct stat info;
+		if (0 != ::stat(filepath.c_str(), &info) || (info.st_mode & S_IFREG) == 0)
+		{
+			return false;
+		}
+		stat.size = info.st_size;
+#ifdef __APPLE__
+		stat.mtime = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+		stat.mtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+		stat.inode = info.st_ino;
+		return true;
+	}
 	int64_t NativeFileSystem::getSize(const std::string& filepath) const
 	{
 		struct stat info;
@@ -117,6 +143,10 @@ namespace nekofs {
 	{
 		return FileSystemType::Native;
 	}
+	std::shared_ptr<Prefetch> NativeFileSystem::prefetch(const std::vector<std::string>& filepaths, int32_t priority, bool decompress)
+	{
+		return NekodataPreloader::prefetch(shared_from_this(), filepaths, priority, decompress);
+	}
 
 
 	std::vector<std::string> NativeFileSystem::getFiles(const std::string& dirpath) const
@@ -549,10 +579,117 @@ namespace nekofs {
 		}
 		return true;
 	}
+	/*
+	* 用srcpath原子地替换destpath，destpath可以不存在。
+	* destpath已打开的流继续读取旧的文件，之后打开的是新的文件。
+	*/
+	bool NativeFileSystem::replaceFile(const std::string& srcpath, const std::string& destpath)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mtx_);
+		if (filePtrs_.find(srcpath) != filePtrs_.end())
+		{
+			std::stringstream ss;
+			ss << u8"NativeFileSystem::replaceFile file in use. path = ";
+			ss << srcpath;
+			logerr(ss.str());
+			return false;
+		}
+		if (getFileType(srcpath) != FileType::Regular)
+		{
+			std::stringstream ss;
+			ss << u8"NativeFileSystem::replaceFile file not exist. path = ";
+			ss << srcpath;
+			logerr(ss.str());
+			return false;
+		}
+		if (-1 == ::rename(srcpath.c_str(), destpath.c_str()))
+		{
+			auto errmsg = getSysErrMsg();
+			std::stringstream ss;
+			ss << u8"NativeFileSystem::replaceFile rename error. srcpath = ";
+			ss << srcpath;
+			ss << u8", destpath = ";
+			ss << destpath;
+			ss << u8", err = ";
+			ss << errmsg;
+			logerr(ss.str());
+			return false;
+		}
+		// 旧文件不再对应这个路径，最后一个流关闭时由closeFileInternal释放
+		auto rit = filePtrs_.find(destpath);
+		if (rit != filePtrs_.end())
+		{
+			replacedFiles_[rit->second] = files_[destpath];
+			files_.erase(destpath);
+			filePtrs_.erase(rit);
+		}
+		return true;
+	}
+	/*
+	* 复制文件。优先使用reflink共享数据块（写时复制），不支持时按allowHardlink创建硬链接，否则由内核拷贝。
+	* 硬链接与源文件共用数据，之后不能再修改。
+	*/
+	bool NativeFileSystem::cloneFile(const std::string& srcpath, const std::string& destpath, bool allowHardlink, bool& hardlinked)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mtx_);
+		hardlinked = false;
+		if (getFileType(srcpath) != FileType::Regular)
+		{
+			std::stringstream ss;
+			ss << u8"NativeFileSystem::cloneFile file not exist. path = ";
+			ss << srcpath;
+			logerr(ss.str());
+			return false;
+		}
+		if (getFileType(destpath) != FileType::None)
+		{
+			std::stringstream ss;
+			ss << u8"NativeFileSystem::cloneFile already exist. path = ";
+			ss << destpath;
+			logerr(ss.str());
+			return false;
+		}
+		if (auto pos = destpath.rfind(nekofs_PathSeparator); pos != std::string::npos && pos > 0)
+		{
+			createDirectories(destpath.substr(0, pos));
+		}
+#if defined(__linux__) && defined(FICLONE)
+		int srcfd = ::open(srcpath.c_str(), O_RDONLY);
+		if (-1 != srcfd)
+		{
+			int destfd = ::open(destpath.c_str(), O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+			bool cloned = false;
+			if (-1 != destfd)
+			{
+				cloned = 0 == ::ioctl(destfd, FICLONE, srcfd);
+				::close(destfd);
+				if (!cloned)
+				{
+					::unlink(destpath.c_str());
+				}
+			}
+			::close(srcfd);
+			if (cloned)
+			{
+				return true;
+			}
+		}
+#endif
+		if (allowHardlink && 0 == ::link(srcpath.c_str(), destpath.c_str()))
+		{
+			hardlinked = true;
+			return true;
+		}
+		return copyfile(openIStream(srcpath, AccessHint::Sequential), openOStream(destpath));
+	}
 	std::shared_ptr<OStream> NativeFileSystem::openOStream(const std::string& filepath)
 	{
 		return openFileInternal(filepath)->openOStream();
 	}
+	std::shared_ptr<OStream> NativeFileSystem::openOStream(const std::string& filepath, bool openExisting)
+	{
+		return openFileInternal(filepath)->openOStream(openExisting);
+	}
 
 
 	void NativeFileSystem::weakDeleteCallback(std::weak_ptr<NativeFileSystem> filesystem, NativeFile* file)
@@ -560,7 +697,7 @@ namespace nekofs {
 		auto fsPtr = filesystem.lock();
 		if (fsPtr)
 		{
-			fsPtr->closeFileInternal(file->getFilePath());
+			fsPtr->closeFileInternal(file);
 		}
 		else
 		{
@@ -596,10 +733,22 @@ namespace nekofs {
 		}
 		return fPtr;
 	}
-	void NativeFileSystem::closeFileInternal(const std::string& filepath)
+	void NativeFileSystem::closeFileInternal(NativeFile* file)
 	{
 		std::shared_ptr<NativeFile> fPtr;
 		std::lock_guard<std::recursive_mutex> lock(mtx_);
+		std::string filepath = file->getFilePath();
+		auto pit = replacedFiles_.find(file);
+		if (pit != replacedFiles_.end())
+		{
+			// 已经被replaceFile替换掉的旧文件
+			if (!pit->second.lock())
+			{
+				replacedFiles_.erase(pit);
+				delete file;
+			}
+			return;
+		}
 		auto it = files_.find(filepath);
 		if (it != files_.end())
 		{
@@ -19,7 +19,7 @@ namespace nekofs {
 	{
 		return filepath_;
 	}
-	std::shared_ptr<NativeIStream> NativeFile::openIStream()
+	std::shared_ptr<NativeIStream> NativeFile::openIStream(AccessHint hint)
 	{
 		std::lock_guard<std::recursive_mutex> lock(mtx_);
 		if (INVALID_HANDLE_VALUE != writeFd_)
@@ -37,10 +37,10 @@ namespace nekofs {
 		}
 		readStreamCount_++;
 		std::shared_ptr<NativeIStream> isPtr;
-		isPtr.reset(new NativeIStream(shared_from_this(), readFileSize_), std::bind(&NativeFile::weakReadDeleteCallback, std::weak_ptr<NativeFile>(shared_from_this()), std::placeholders::_1));
+		isPtr.reset(new NativeIStream(shared_from_this(), readFileSize_, hint), std::bind(&NativeFile::weakReadDeleteCallback, std::weak_ptr<NativeFile>(shared_from_this()), std::placeholders::_1));
 		return isPtr;
 	}
-	std::shared_ptr<NativeOStream> NativeFile::openOStream()
+	std::shared_ptr<NativeOStream> NativeFile::openOStream(bool openExisting)
 	{
 		std::lock_guard<std::recursive_mutex> lock(mtx_);
 		if (readStreamCount_ > 0 || INVALID_HANDLE_VALUE != writeFd_)
@@ -51,7 +51,7 @@ namespace nekofs {
 			logerr(ss.str());
 			return nullptr;
 		}
-		openWriteFdInternal();
+		openWriteFdInternal(openExisting);
 		if (INVALID_HANDLE_VALUE == writeFd_)
 		{
 			return nullptr;
@@ -69,7 +69,7 @@ namespace nekofs {
 		}
 		env::getInstance().getNativeFileSystem()->createDirectories(filepath_.substr(0, filepath_.rfind(nekofs_PathSeparator)));
 	}
-	std::shared_ptr<NativeFileBlock> NativeFile::openBlockInternal(int64_t offset)
+	std::shared_ptr<NativeFileBlock> NativeFile::openBlockInternal(int64_t offset, bool populate)
 	{
 		size_t index = offset >> nekofs_MapBlockSizeBitOffset;
 		std::shared_ptr<NativeFileBlock> fPtr;
@@ -84,7 +84,7 @@ namespace nekofs {
 					const int64_t offset = index << nekofs_MapBlockSizeBitOffset;
 					const int32_t size = readFileSize_ - offset > nekofs_MapBlockSize ? nekofs_MapBlockSize : static_cast<int32_t>(readFileSize_ - offset);
 					rawPtr = new NativeFileBlock(shared_from_this(), readMapFd_, offset, size);
-					rawPtr->mmap();
+					rawPtr->mmap(populate);
 					blockPtrs_[index] = rawPtr;
 				}
 				fPtr.reset(rawPtr, std::bind(&NativeFile::weakBlockDeleteCallback, std::weak_ptr<NativeFile>(shared_from_this()), std::placeholders::_1));
@@ -241,12 +241,21 @@ namespace nekofs {
 		}
 		readFileSize_ = 0;
 	}
-	void NativeFile::openWriteFdInternal()
+	/*
+	* openExisting时只打开已有的文件继续写入，不创建也不截断，用于追加写入。
+	*/
+	void NativeFile::openWriteFdInternal(bool openExisting)
 	{
 		if (INVALID_HANDLE_VALUE == writeFd_)
 		{
-			createParentDirectory();
-			writeFd_ = CreateFile(u8_to_u16(filepath_).c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			const DWORD creation = openExisting ? OPEN_EXISTING : CREATE_NEW;
+			// 父目录通常已经存在，打开失败时再创建，省去逐级检查目录
+			writeFd_ = CreateFile(u8_to_u16(filepath_).c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, creation, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (INVALID_HANDLE_VALUE == writeFd_ && ERROR_PATH_NOT_FOUND == GetLastError() && !openExisting)
+			{
+				createParentDirectory();
+				writeFd_ = CreateFile(u8_to_u16(filepath_).c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, creation, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			}
 			if (INVALID_HANDLE_VALUE == writeFd_)
 			{
 				auto errmsg = getSysErrMsg();
@@ -35,6 +35,21 @@ namespace nekofs {
 		}
 		return -1;
 	}
+	/*
+	* 直接返回映射内存中pos处的地址，count会被截断到块的末尾。
+	*/
+	const uint8_t* NativeFileBlock::data(int64_t pos, int32_t& count) const
+	{
+		if (NULL != lpBaseAddress_ && pos >= offset_ && pos < offset_ + size_ && count > 0)
+		{
+			if (pos + count > offset_ + size_)
+			{
+				count = static_cast<int32_t>(offset_ + size_ - pos);
+			}
+			return ((const uint8_t*)lpBaseAddress_) - offset_ + pos;
+		}
+		return nullptr;
+	}
 	int64_t NativeFileBlock::getOffset() const
 	{
 		return offset_;
@@ -43,7 +58,7 @@ namespace nekofs {
 	{
 		return offset_ + size_;
 	}
-	void NativeFileBlock::mmap()
+	void NativeFileBlock::mmap(bool populate)
 	{
 		DWORD dwFileOffsetHigh = offset_ >> 32;
 		DWORD dwFileOffsetLow = offset_ & 0x0FFFFFFFF;
@@ -63,6 +78,25 @@ namespace nekofs {
 			ss << errmsg;
 			logerr(ss.str());
 		}
+		else if (populate)
+		{
+			advise(AccessHint::Populate);
+		}
+	}
+	/*
+	* Windows没有顺序/随机访问的提示，只处理需要提前读入的情况。
+	*/
+	void NativeFileBlock::advise(AccessHint hint)
+	{
+#if _WIN32_WINNT >= _WIN32_WINNT_WIN8
+		if (NULL != lpBaseAddress_ && (AccessHint::WillNeed == hint || AccessHint::Populate == hint))
+		{
+			WIN32_MEMORY_RANGE_ENTRY entry;
+			entry.VirtualAddress = const_cast<PVOID>(lpBaseAddress_);
+			entry.NumberOfBytes = size_;
+			PrefetchVirtualMemory(GetCurrentProcess(), 1, &entry, 0);
+		}
+#endif
 	}
 	void NativeFileBlock::munmap()
 	{
@@ -19,10 +19,12 @@ namespace nekofs {
 	public:
 		NativeFileBlock(std::shared_ptr<NativeFile> file, HANDLE readMapFd, int64_t offset, int32_t size);
 		int32_t read(int64_t pos, void* buffer, int32_t count);
+		const uint8_t* data(int64_t pos, int32_t& count) const;
 		int64_t getOffset() const;
 		int64_t getEndOffset() const;
-		void mmap();
+		void mmap(bool populate = false);
 		void munmap();
+		void advise(AccessHint hint);
 
 	private:
 		std::shared_ptr<NativeFile> file_;
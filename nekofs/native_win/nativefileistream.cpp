@@ -1,12 +1,15 @@
 ﻿#include "nativefileistream.h"
 #include "nativefileblock.h"
 #include "nativefile.h"
+#include "../common/accesstrace.h"
+#include "../nekodata/nekodatapreloader.h"
 
 namespace nekofs {
-	NativeIStream::NativeIStream(std::shared_ptr<NativeFile> file, int64_t fileSize)
+	NativeIStream::NativeIStream(std::shared_ptr<NativeFile> file, int64_t fileSize, AccessHint hint)
 	{
 		file_ = file;
 		fileSize_ = fileSize;
+		hint_ = hint;
 	}
 
 	int32_t NativeIStream::read(void* buf, int32_t size)
@@ -23,11 +26,23 @@ namespace nekofs {
 		{
 			return 0;
 		}
+		auto& trace = AccessTrace::getInstance();
+		const bool tracing = trace.isEnabled();
+		const int64_t beginTime = tracing ? AccessTrace::now() : 0;
+		const int64_t position = position_;
+		// 当前映射块可以直接读取时记为命中
+		const bool cacheHit = tracing && block_ != nullptr && position_ >= block_->getOffset() && position_ < block_->getEndOffset();
+		// 前台读取本地文件（包括nekodata的分卷）时预加载让出
+		NekodataPreloader::notifyForeground();
 		int32_t actulRead = prepareBlock()->read(position_, buf, size);
 		if (actulRead > 0)
 		{
 			position_ += actulRead;
 		}
+		if (tracing)
+		{
+			trace.record(AccessTraceEvent::NativeRead, file_->getFilePath(), position, actulRead, beginTime, cacheHit);
+		}
 		return actulRead;
 	}
 	int64_t NativeIStream::seek(int64_t offset, const SeekOrigin& origin)
@@ -79,14 +94,46 @@ namespace nekofs {
 	}
 	std::shared_ptr<IStream> NativeIStream::createNew()
 	{
-		return file_->openIStream();
+		return file_->openIStream(hint_);
+	}
+	std::shared_ptr<NativeIStream> NativeIStream::createNew(AccessHint hint)
+	{
+		return file_->openIStream(hint);
+	}
+	std::shared_ptr<NativeIStream> NativeIStream::getNativeRange(int64_t& size)
+	{
+		size = fileSize_ - position_;
+		return shared_from_this();
+	}
+	/*
+	* 不拷贝数据，返回当前位置在映射内存中的地址，size会被截断到映射块的末尾，不移动读取位置。
+	* 返回的地址在下一次read/seek/peek之前有效。
+	*/
+	const void* NativeIStream::peek(int32_t& size)
+	{
+		if (size <= 0 || position_ == fileSize_)
+		{
+			size = 0;
+			return nullptr;
+		}
+		auto block = prepareBlock();
+		return block ? block->data(position_, size) : nullptr;
+	}
+	bool NativeIStream::willNeed(int64_t size)
+	{
+		// 没有对应文件描述符的预读提示，由系统自己的预读处理
+		return false;
 	}
 	std::shared_ptr<NativeFileBlock> NativeIStream::prepareBlock()
 	{
 		bool useCurrent = (block_ != nullptr && position_ >= block_->getOffset() && position_ < block_->getEndOffset());
 		if (!useCurrent)
 		{
-			block_ = file_->openBlockInternal(position_);
+			block_ = file_->openBlockInternal(position_, AccessHint::Populate == hint_);
+			if (block_ && AccessHint::WillNeed == hint_)
+			{
+				block_->advise(hint_);
+			}
 		}
 		return block_;
 	}
@@ -8,7 +8,7 @@ namespace nekofs {
 	class NativeFile;
 	class NativeFileBlock;
 
-	class NativeIStream final : public IStream, public std::enable_shared_from_this<NativeIStream>
+	class NativeIStream final : public IStream, public NativeCopySource, public std::enable_shared_from_this<NativeIStream>
 	{
 	private:
 		NativeIStream(const NativeIStream&) = delete;
@@ -17,7 +17,7 @@ namespace nekofs {
 		NativeIStream& operator=(NativeIStream&&) = delete;
 
 	public:
-		NativeIStream(std::shared_ptr<NativeFile> file, int64_t fileSize);
+		NativeIStream(std::shared_ptr<NativeFile> file, int64_t fileSize, AccessHint hint = AccessHint::Auto);
 
 	public:
 		int32_t read(void* buf, int32_t size) override;
@@ -25,6 +25,10 @@ namespace nekofs {
 		int64_t getPosition() const override;
 		int64_t getLength() const override;
 		std::shared_ptr<IStream> createNew() override;
+		std::shared_ptr<NativeIStream> createNew(AccessHint hint);
+		std::shared_ptr<NativeIStream> getNativeRange(int64_t& size) override;
+		const void* peek(int32_t& size);
+		bool willNeed(int64_t size);
 
 	private:
 		std::shared_ptr<NativeFileBlock> prepareBlock();
@@ -34,5 +38,6 @@ namespace nekofs {
 		std::shared_ptr<NativeFileBlock> block_;
 		int64_t fileSize_ = 0;
 		int64_t position_ = 0;
+		AccessHint hint_ = AccessHint::Auto;
 	};
 }
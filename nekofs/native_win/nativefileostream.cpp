@@ -127,4 +127,95 @@ namespace nekofs {
 		}
 		return length.QuadPart;
 	}
+	/*
+	* 在指定偏移处写入。同步句柄下文件指针会移动到写入结束的位置。
+	*/
+	int32_t NativeOStream::writeAt(const void* buf, int32_t size, int64_t offset)
+	{
+		if (size < 0 || offset < 0)
+		{
+			return -1;
+		}
+		if (size == 0)
+		{
+			return 0;
+		}
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+		overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD ret = 0;
+		if (FALSE == WriteFile(fd_, buf, size, &ret, &overlapped))
+		{
+			ret = -1;
+			auto errmsg = getSysErrMsg();
+			std::stringstream ss;
+			ss << u8"NativeOStream::writeAt WriteFile error ! filepath = ";
+			ss << file_->getFilePath();
+			ss << u8", offset = ";
+			ss << offset;
+			ss << u8", err = ";
+			ss << errmsg;
+			logerr(ss.str());
+		}
+		return ret;
+	}
+	int64_t NativeOStream::copyRange(std::shared_ptr<NativeIStream> is, int64_t size)
+	{
+		return copyAt(is, size, getPosition());
+	}
+	/*
+	* Windows没有对应的内核拷贝接口，返回0，调用方改用普通读写。
+	*/
+	int64_t NativeOStream::copyAt(std::shared_ptr<NativeIStream> is, int64_t size, int64_t offset)
+	{
+		return 0;
+	}
+	/*
+	* 预先分配磁盘空间，不改变文件大小。失败时调用方可以忽略。
+	*/
+	bool NativeOStream::allocate(int64_t length)
+	{
+		FILE_ALLOCATION_INFO info;
+		info.AllocationSize.QuadPart = length;
+		return TRUE == SetFileInformationByHandle(fd_, FileAllocationInfo, &info, sizeof(info));
+	}
+	bool NativeOStream::setLength(int64_t length)
+	{
+		FILE_END_OF_FILE_INFO info;
+		info.EndOfFile.QuadPart = length;
+		if (FALSE == SetFileInformationByHandle(fd_, FileEndOfFileInfo, &info, sizeof(info)))
+		{
+			auto errmsg = getSysErrMsg();
+			std::stringstream ss;
+			ss << u8"NativeOStream::setLength SetFileInformationByHandle error ! filepath = ";
+			ss << file_->getFilePath();
+			ss << u8", length = ";
+			ss << length;
+			ss << u8", err = ";
+			ss << errmsg;
+			logerr(ss.str());
+			return false;
+		}
+		return true;
+	}
+	bool NativeOStream::sync()
+	{
+		if (FALSE == FlushFileBuffers(fd_))
+		{
+			auto errmsg = getSysErrMsg();
+			std::stringstream ss;
+			ss << u8"NativeOStream::sync FlushFileBuffers error ! filepath = ";
+			ss << file_->getFilePath();
+			ss << u8", err = ";
+			ss << errmsg;
+			logerr(ss.str());
+			return false;
+		}
+		return true;
+	}
+	bool NativeOStream::writeback()
+	{
+		// 没有只发起写回、不等待的接口，交给系统的延迟写入
+		return false;
+	}
 }
@@ -4,6 +4,7 @@
 #include "nativefileistream.h"
 #include "nativefileostream.h"
 #include "../common/utils.h"
+#include "../nekodata/nekodatapreloader.h"
 
 #include <Windows.h>
 #include <cstring>
@@ -66,6 +67,10 @@ namespace nekofs {
 	{
 		return openFileInternal(filepath)->openIStream();
 	}
+	std::shared_ptr<IStream> NativeFileSystem::openIStream(const std::string& filepath, AccessHint hint)
+	{
+		return openFileInternal(filepath)->openIStream(hint);
+	}
 	FileType NativeFileSystem::getFileType(const std::string& path) const
 	{
 		WIN32_FIND_DATA find_data;
@@ -88,6 +93,27 @@ namespace nekofs {
 		}
 		return FileType::None;
 	}
+	bool NativeFileSystem::getFileStat(const std::string& filepath, NativeFileStat& stat) const
+	{
+		HANDLE handle = CreateFile(u8_to_u16(filepath).c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (INVALID_HANDLE_VALUE == handle)
+		{
+			return false;
+		}
+		BY_HANDLE_FILE_INFORMATION info;
+		BOOL ret = GetFileInformationByHandle(handle, &info);
+		CloseHandle(handle);
+		if (FALSE == ret || (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+		{
+			return false;
+		}
+		// FILETIME是从1601年开始的100纳秒数
+		const int64_t filetime = (static_cast<int64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+		stat.size = (static_cast<int64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+		stat.mtime = (filetime - 116444736000000000LL) * 100;
+		stat.inode = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+		return true;
+	}
 	int64_t NativeFileSystem::getSize(const std::string& filepath) const
 	{
 		WIN32_FIND_DATA find_data;
@@ -122,6 +148,10 @@ namespace nekofs {
 	{
 		return FileSystemType::Native;
 	}
+	std::shared_ptr<Prefetch> NativeFileSystem::prefetch(const std::vector<std::string>& filepaths, int32_t priority, bool decompress)
+	{
+		return NekodataPreloader::prefetch(shared_from_this(), filepaths, priority, decompress);
+	}
 
 
 	std::vector<std::string> NativeFileSystem::getFiles(const std::string& dirpath) const
@@ -558,10 +588,89 @@ namespace nekofs {
 		}
 		return true;
 	}
+	/*
+	* 用srcpath原子地替换destpath，destpath可以不存在。
+	* Windows上destpath被打开时无法替换，需要先关闭所有读取destpath的流。
+	*/
+	bool NativeFileSystem::replaceFile(const std::string& srcpath, const std::string& destpath)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mtx_);
+		if (filePtrs_.find(srcpath) != filePtrs_.end() || filePtrs_.find(destpath) != filePtrs_.end())
+		{
+			std::stringstream ss;
+			ss << u8"NativeFileSystem::replaceFile file in use. srcpath = ";
+			ss << srcpath;
+			ss << u8", destpath = ";
+			ss << destpath;
+			logerr(ss.str());
+			return false;
+		}
+		if (getFileType(srcpath) != FileType::Regular)
+		{
+			std::stringstream ss;
+			ss << u8"NativeFileSystem::replaceFile file not exist. path = ";
+			ss << srcpath;
+			logerr(ss.str());
+			return false;
+		}
+		if (FALSE == MoveFileEx(u8_to_u16(srcpath).c_str(), u8_to_u16(destpath).c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+		{
+			auto errmsg = getSysErrMsg();
+			std::stringstream ss;
+			ss << u8"NativeFileSystem::replaceFile MoveFileEx error. srcpath = ";
+			ss << srcpath;
+			ss << u8", destpath = ";
+			ss << destpath;
+			ss << u8", err = ";
+			ss << errmsg;
+			logerr(ss.str());
+			return false;
+		}
+		return true;
+	}
+	/*
+	* 复制文件。按allowHardlink创建硬链接，否则普通拷贝。
+	* 硬链接与源文件共用数据，之后不能再修改。
+	*/
+	bool NativeFileSystem::cloneFile(const std::string& srcpath, const std::string& destpath, bool allowHardlink, bool& hardlinked)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mtx_);
+		hardlinked = false;
+		if (getFileType(srcpath) != FileType::Regular)
+		{
+			std::stringstream ss;
+			ss << u8"NativeFileSystem::cloneFile file not exist. path = ";
+			ss << srcpath;
+			logerr(ss.str());
+			return false;
+		}
+		if (getFileType(destpath) != FileType::None)
+		{
+			std::stringstream ss;
+			ss << u8"NativeFileSystem::cloneFile already exist. path = ";
+			ss << destpath;
+			logerr(ss.str());
+			return false;
+		}
+		if (auto pos = destpath.rfind(nekofs_PathSeparator); pos != std::string::npos && pos > 0)
+		{
+			createDirectories(destpath.substr(0, pos));
+		}
+		if (allowHardlink && FALSE != CreateHardLink(u8_to_u16(destpath).c_str(), u8_to_u16(srcpath).c_str(), NULL))
+		{
+			hardlinked = true;
+			return true;
+		}
+		return copyfile(openIStream(srcpath, AccessHint::Sequential), openOStream(destpath));
+	}
 	std::shared_ptr<OStream> NativeFileSystem::openOStream(const std::string& filepath)
 	{
 		return openFileInternal(filepath)->openOStream();
 	}
+	std::shared_ptr<OStream> NativeFileSystem::openOStream(const std::string& filepath, bool openExisting)
+	{
+		return openFileInternal(filepath)->openOStream(openExisting);
+	}
 
 
 	void NativeFileSystem::weakDeleteCallback(std::weak_ptr<NativeFileSystem> filesystem, NativeFile* file)
@@ -12,6 +12,16 @@ namespace nekofs {
 	class NativeOStream;
 	class NativeFile;
 
+	/*
+	* 用于判断文件是否改动过，mtime单位是纳秒(unix纪元)。
+	*/
+	struct NativeFileStat final
+	{
+		int64_t size = 0;
+		int64_t mtime = 0;
+		uint64_t inode = 0;
+	};
+
 	class NativeFileSystem final : public FileSystem, public std::enable_shared_from_this<NativeFileSystem>
 	{
 	private:
@@ -28,18 +38,24 @@ namespace nekofs {
 		FileType getFileType(const std::string& path) const override;
 		int64_t getSize(const std::string& filepath) const override;
 		FileSystemType getFSType() const override;
+		std::shared_ptr<Prefetch> prefetch(const std::vector<std::string>& filepaths, int32_t priority, bool decompress) override;
 
 	public:
 		NativeFileSystem() = default;
+		std::shared_ptr<IStream> openIStream(const std::string& filepath, AccessHint hint);
 		std::vector<std::string> getFiles(const std::string& dirpath) const;
 		std::vector<std::string> getDirs(const std::string& dirpath) const;
+		bool getFileStat(const std::string& filepath, NativeFileStat& stat) const;
 		bool createDirectories(const std::string& dirpath);
 		bool removeDirectories(const std::string& dirpath);
 		bool cleanEmptyDirectories(const std::string& dirpath);
 		bool moveDirectory(const std::string& srcpath, const std::string& destpath);
 		bool removeFile(const std::string& filepath);
 		bool moveFile(const std::string& srcpath, const std::string& destpath);
+		bool replaceFile(const std::string& srcpath, const std::string& destpath);
+		bool cloneFile(const std::string& srcpath, const std::string& destpath, bool allowHardlink, bool& hardlinked);
 		std::shared_ptr<OStream> openOStream(const std::string& filepath);
+		std::shared_ptr<OStream> openOStream(const std::string& filepath, bool openExisting);
 
 	private:
 		static void weakDeleteCallback(std::weak_ptr<NativeFileSystem> filesystem, NativeFile* file);
@@ -1,13 +1,17 @@
 ﻿#include "nekodataarchiver.h"
 #include "nekodataostream.h"
+#include "nekodatafilesystem.h"
 #include "util.h"
 #include "../common/env.h"
 #include "../common/utils.h"
 #include "../common/sha256.h"
+#include "../common/bufferedostream.h"
 #ifdef _WIN32
 #include "../native_win/nativefilesystem.h"
+#include "../native_win/nativefileostream.h"
 #else
 #include "../native_posix/nativefilesystem.h"
+#include "../native_posix/nativefileostream.h"
 #endif
 
 #include <cstring>
@@ -17,11 +21,52 @@
 #include <filesystem>
 
 namespace nekofs {
-	NekodataArchiver::FileBlockTask::FileBlockTask(const std::string& path, std::shared_ptr<IStream> is, int64_t index)
+	/*
+	* 同时在后台构建的子archive数量上限。每个archiver自带3个压缩线程。
+	*/
+	static std::atomic_int32_t s_archiveSlots(0);
+	static std::atomic_uint64_t s_spillId(0);
+	static bool tryAcquireArchiveSlot()
+	{
+		static const int32_t kMaxSlots = static_cast<int32_t>(std::max(1u, std::thread::hardware_concurrency() / 4));
+		int32_t slots = s_archiveSlots.load();
+		while (slots < kMaxSlots)
+		{
+			if (s_archiveSlots.compare_exchange_weak(slots, slots + 1))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+	static void releaseArchiveSlot()
+	{
+		s_archiveSlots--;
+	}
+	static const size_t kParallelVolumeNum = 4;
+	/*
+	* 按内容分块用的gear表。分块结果必须在不同版本间保持一致，所以用固定种子的splitmix64生成，不能修改。
+	*/
+	static const std::array<uint64_t, 256> s_gearTable = []() {
+		std::array<uint64_t, 256> table = {};
+		uint64_t seed = 0x6E656B6F66736364ULL;
+		for (auto& value : table)
+		{
+			seed += 0x9E3779B97F4A7C15ULL;
+			uint64_t z = seed;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			value = z ^ (z >> 31);
+		}
+		return table;
+	}();
+
+	NekodataArchiver::FileBlockTask::FileBlockTask(const std::string& path, std::shared_ptr<IStream> is, int64_t beginPos, int64_t endPos)
 	{
 		path_ = path;
 		is_ = is;
-		index_ = index;
+		beginPos_ = beginPos;
+		endPos_ = endPos;
 	}
 	void NekodataArchiver::FileBlockTask::setStatus(Status status)
 	{
@@ -33,13 +78,13 @@ namespace nekofs {
 		std::lock_guard lock(mtx_);
 		return status_;
 	}
-	int64_t NekodataArchiver::FileBlockTask::getIndex() const
+	std::tuple<int64_t, int64_t> NekodataArchiver::FileBlockTask::getRange() const
 	{
-		return index_;
+		return std::tuple<int64_t, int64_t>(beginPos_, endPos_);
 	}
-	std::tuple<int64_t, int64_t> NekodataArchiver::FileBlockTask::getRange() const
+	void NekodataArchiver::FileBlockTask::setEndPos(int64_t endPos)
 	{
-		return std::tuple<int64_t, int64_t>(index_ * nekofs_kNekoData_LZ4_Buffer_Size, std::min(is_->getLength(), (index_ + 1) * nekofs_kNekoData_LZ4_Buffer_Size));
+		endPos_ = endPos;
 	}
 	const std::string& NekodataArchiver::FileBlockTask::getPath() const
 	{
@@ -83,6 +128,238 @@ namespace nekofs {
 			archiveFilename_.append(nekofs_kNekodata_FileExtension);
 		}
 	}
+	std::shared_ptr<NekodataArchiver> NekodataArchiver::createForAppend(const std::string& archiveFilename)
+	{
+		std::string filepath = archiveFilename;
+		if (!str_EndWith(filepath, nekofs_kNekodata_FileExtension))
+		{
+			filepath.append(nekofs_kNekodata_FileExtension);
+		}
+		auto fs = NekodataFileSystem::create(env::getInstance().getNativeFileSystem(), filepath);
+		if (!fs)
+		{
+			std::stringstream ss;
+			ss << u8"NekodataArchiver::createForAppend open error ! filepath = ";
+			ss << filepath;
+			logerr(ss.str());
+			return nullptr;
+		}
+		auto archiver = std::make_shared<NekodataArchiver>(filepath, fs->getVolumeSzie());
+		for (const auto& item : fs->getAllFiles(std::string()))
+		{
+			archiver->baseFiles_[item] = fs->getFileMeta(item).value();
+		}
+		archiver->appendDataPos_ = fs->getDataLength();
+		archiver->appendVolumeNum_ = fs->getVolumeNum();
+		archiver->stageVolumes_ = true;
+		return archiver;
+	}
+	std::shared_ptr<NekodataArchiver> NekodataArchiver::createFromBase(const std::string& archiveFilename, const std::string& baseFilename, bool allowHardlink)
+	{
+		std::string basepath = baseFilename;
+		if (!str_EndWith(basepath, nekofs_kNekodata_FileExtension))
+		{
+			basepath.append(nekofs_kNekodata_FileExtension);
+		}
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		auto fs = NekodataFileSystem::create(nativefs, basepath);
+		if (!fs)
+		{
+			std::stringstream ss;
+			ss << u8"NekodataArchiver::createFromBase open error ! filepath = ";
+			ss << basepath;
+			logerr(ss.str());
+			return nullptr;
+		}
+		auto archiver = std::make_shared<NekodataArchiver>(archiveFilename, fs->getVolumeSzie());
+		for (const auto& item : fs->getAllFiles(std::string()))
+		{
+			archiver->baseFiles_[item] = fs->getFileMeta(item).value();
+		}
+		archiver->appendDataPos_ = fs->getDataLength();
+		archiver->appendVolumeNum_ = fs->getVolumeNum();
+		archiver->keepBaseFiles_ = false;
+		fs.reset();
+		for (size_t i = 0; i < archiver->appendVolumeNum_; i++)
+		{
+			// 最后一个分卷要继续写入，不能用硬链接
+			bool hardlinked = false;
+			if (!nativefs->cloneFile(getVolumePath(basepath, i), getVolumePath(archiver->archiveFilename_, i), allowHardlink && i + 1 < archiver->appendVolumeNum_, hardlinked))
+			{
+				return nullptr;
+			}
+			if (hardlinked)
+			{
+				archiver->linkedVolumes_.insert(i);
+			}
+		}
+		return archiver;
+	}
+	/*
+	* 开启后，写完的分卷会在后台线程中fdatasync，archive返回时所有分卷都已落盘。
+	*/
+	void NekodataArchiver::setSyncOnFinish(bool sync)
+	{
+		syncOnFinish_ = sync;
+	}
+	void NekodataArchiver::setParallelWrite(bool parallelWrite)
+	{
+		parallelWrite_ = parallelWrite;
+	}
+	bool NekodataArchiver::setContentDefinedChunking(int32_t minSize, int32_t avgSize, int32_t maxSize)
+	{
+		if (avgSize == 0)
+		{
+			chunkMinSize_ = 0;
+			chunkAvgSize_ = 0;
+			chunkMaxSize_ = 0;
+			return true;
+		}
+		if (minSize <= 0 || avgSize < 1024 || minSize >= avgSize || avgSize >= maxSize || maxSize > nekofs_kNekoData_LZ4_Buffer_Size || (avgSize & (avgSize - 1)) != 0)
+		{
+			std::stringstream ss;
+			ss << u8"NekodataArchiver::setContentDefinedChunking error ! min = " << minSize << u8", avg = " << avgSize << u8", max = " << maxSize;
+			logerr(ss.str());
+			return false;
+		}
+		chunkMinSize_ = minSize;
+		chunkAvgSize_ = avgSize;
+		chunkMaxSize_ = maxSize;
+		return true;
+	}
+	/*
+	* 在压缩线程中按内容切分任务，不持有锁。读取任务的最大区间到buffer，按切分点缩短区间，buffer中的数据直接用于压缩。
+	* 之后在锁内更新文件的compressIndex，唤醒等待这个文件下一块的线程。读取失败时按最大区间更新，返回false。
+	*/
+	bool NekodataArchiver::cutChunk(std::shared_ptr<FileBlockTask> ftask, uint8_t* buffer)
+	{
+		auto range = ftask->getRange();
+		const int64_t beginPos = std::get<0>(range);
+		int64_t endPos = std::get<1>(range);
+		const int32_t size = static_cast<int32_t>(endPos - beginPos);
+		auto is = ftask->getIStream();
+		bool success = is && is->seek(beginPos, SeekOrigin::Begin) == beginPos && istream_read(is, buffer, size) == size;
+		if (success)
+		{
+			endPos = beginPos + getChunkSize(buffer, size);
+			ftask->setEndPos(endPos);
+		}
+		{
+			std::lock_guard lock(mtx_taskList_);
+			std::lock_guard lockFile(mtx_archiveFileList_);
+			auto it = archiveFileList_.find(ftask->getPath());
+			if (it != archiveFileList_.end() && it->second.first == FileCategory::File)
+			{
+				ArchiveInfo_File& fileInfo = std::any_cast<ArchiveInfo_File&>(it->second.second);
+				fileInfo.compressIndex = endPos;
+				fileInfo.cutting = false;
+			}
+		}
+		cond_getTask_.notify_all();
+		return success;
+	}
+	/*
+	* FastCDC：跳过前minSize字节，之后用gear滚动哈希找切分点。avgSize之前用更严格的掩码，之后用更宽松的掩码，使块大小集中在avgSize附近。
+	* size不超过maxSize，没有找到切分点时整个作为一块。
+	*/
+	int32_t NekodataArchiver::getChunkSize(const uint8_t* data, int32_t size) const
+	{
+		if (size <= chunkMinSize_)
+		{
+			return size;
+		}
+		int32_t bits = 0;
+		while ((1 << bits) < chunkAvgSize_)
+		{
+			bits++;
+		}
+		const uint64_t maskS = ~0ULL << (64 - bits - 2);
+		const uint64_t maskL = ~0ULL << (64 - bits + 2);
+		const int32_t normalSize = std::min(chunkAvgSize_, size);
+		uint64_t hash = 0;
+		int32_t i = chunkMinSize_;
+		for (; i < normalSize; i++)
+		{
+			hash = (hash << 1) + s_gearTable[data[i]];
+			if ((hash & maskS) == 0)
+			{
+				return i + 1;
+			}
+		}
+		for (; i < size; i++)
+		{
+			hash = (hash << 1) + s_gearTable[data[i]];
+			if ((hash & maskL) == 0)
+			{
+				return i + 1;
+			}
+		}
+		return size;
+	}
+	void NekodataArchiver::setDeduplicate(bool deduplicate)
+	{
+		deduplicate_ = deduplicate;
+	}
+	void NekodataArchiver::setBlockDeduplicate(bool blockDeduplicate)
+	{
+		blockDeduplicate_ = blockDeduplicate;
+	}
+	void NekodataArchiver::setAccessOrder(const std::vector<std::string>& order)
+	{
+		auto ranks = std::make_shared<std::unordered_map<std::string, size_t>>();
+		for (const auto& filepath : order)
+		{
+			ranks->emplace(filepath, ranks->size());
+		}
+		std::lock_guard lock(mtx_archiveFileList_);
+		accessOrder_ = order;
+		// 按新的顺序重建待写入的列表
+		std::map<std::string, std::pair<FileCategory, std::any>, FileOrder> tmp(FileOrder{ ranks });
+		for (auto& item : archiveFileList_)
+		{
+			if (item.second.first == FileCategory::Archiver)
+			{
+				std::any_cast<std::shared_ptr<NekodataArchiver>&>(item.second.second)->setAccessOrder(getChildAccessOrder(order, item.first));
+			}
+			tmp.emplace(item.first, std::move(item.second));
+		}
+		archiveFileList_.swap(tmp);
+	}
+	/*
+	* 与overlay中的路径对应，子archive中的文件以子archive去掉扩展名的路径为前缀。
+	*/
+	std::vector<std::string> NekodataArchiver::getChildAccessOrder(const std::vector<std::string>& order, const std::string& filepath)
+	{
+		std::vector<std::string> childOrder;
+		if (filepath.size() <= nekofs_kNekodata_FileExtension.size())
+		{
+			return childOrder;
+		}
+		const std::string prefix = filepath.substr(0, filepath.size() - nekofs_kNekodata_FileExtension.size()) + nekofs_PathSeparator;
+		for (const auto& item : order)
+		{
+			if (item.size() > prefix.size() && item.compare(0, prefix.size(), prefix) == 0)
+			{
+				childOrder.push_back(item.substr(prefix.size()));
+			}
+		}
+		return childOrder;
+	}
+	bool NekodataArchiver::FileOrder::operator()(const std::string& left, const std::string& right) const
+	{
+		if (ranks)
+		{
+			auto lit = ranks->find(left);
+			auto rit = ranks->find(right);
+			const size_t lrank = lit != ranks->end() ? lit->second : ranks->size();
+			const size_t rrank = rit != ranks->end() ? rit->second : ranks->size();
+			if (lrank != rrank)
+			{
+				return lrank < rrank;
+			}
+		}
+		return left < right;
+	}
 	void NekodataArchiver::addFile(const std::string& filepath, std::shared_ptr<FileSystem> srcfs, const std::string& srcfilepath)
 	{
 		ArchiveInfo_File fileInfo;
@@ -91,6 +368,13 @@ namespace nekofs {
 		fileInfo.length = srcfs->getSize(srcfilepath);
 		archiveFileList_[filepath] = std::make_pair(FileCategory::File, fileInfo);
 	}
+	void NekodataArchiver::addStream(const std::string& filepath, std::shared_ptr<IStream> is)
+	{
+		ArchiveInfo_File fileInfo;
+		fileInfo.is = is;
+		fileInfo.length = is ? is->getLength() : -1;
+		archiveFileList_[filepath] = std::make_pair(FileCategory::File, fileInfo);
+	}
 	void NekodataArchiver::addBuffer(const std::string& filepath, const void* buffer, int64_t length)
 	{
 		ArchiveInfo_Buffer bufferInfo;
@@ -98,19 +382,51 @@ namespace nekofs {
 		bufferInfo.length = length;
 		archiveFileList_[filepath] = std::make_pair(FileCategory::Buffer, bufferInfo);
 	}
-	void NekodataArchiver::addRawFile(const std::string& filepath, std::shared_ptr<IStream> is, const NekodataFileMeta& meta)
+	void NekodataArchiver::addRawFile(const std::string& filepath, std::shared_ptr<IStream> is, const NekodataFileMeta& meta, bool verify)
 	{
+		if (isBaseFile(filepath, meta))
+		{
+			// 数据已经在基础nekodata的相同位置，不需要再写
+			archiveFileList_.erase(filepath);
+			retainedFiles_.insert(filepath);
+			return;
+		}
 		ArchiveInfo_RawNekodataStream streamInfo;
 		streamInfo.is = is;
 		streamInfo.meta = meta;
+		streamInfo.verify = verify;
 		archiveFileList_[filepath] = std::make_pair(FileCategory::RawNekodataStream, streamInfo);
 	}
 	std::shared_ptr<NekodataArchiver> NekodataArchiver::addArchive(const std::string& filepath)
 	{
 		auto newArchiver = std::make_shared<NekodataArchiver>(filepath, nekofs_kNekodata_MaxVolumeSize, true);
+		newArchiver->deduplicate_ = deduplicate_;
+		newArchiver->blockDeduplicate_ = blockDeduplicate_;
+		if (!accessOrder_.empty())
+		{
+			newArchiver->setAccessOrder(getChildAccessOrder(accessOrder_, filepath));
+		}
+		newArchiver->chunkMinSize_ = chunkMinSize_;
+		newArchiver->chunkAvgSize_ = chunkAvgSize_;
+		newArchiver->chunkMaxSize_ = chunkMaxSize_;
 		archiveFileList_[filepath] = std::make_pair<FileCategory, std::any>(FileCategory::Archiver, newArchiver);
 		return newArchiver;
 	}
+	void NekodataArchiver::removeFile(const std::string& filepath)
+	{
+		archiveFileList_.erase(filepath);
+		baseFiles_.erase(filepath);
+		retainedFiles_.erase(filepath);
+	}
+	bool NekodataArchiver::isBaseFile(const std::string& filepath, const NekodataFileMeta& meta) const
+	{
+		auto it = baseFiles_.find(filepath);
+		return it != baseFiles_.end()
+			&& it->second.getOriginalSize() == meta.getOriginalSize()
+			&& it->second.getBeginPos() == meta.getBeginPos()
+			&& it->second.getCompressedSize() == meta.getCompressedSize()
+			&& it->second.getSHA256() == meta.getSHA256();
+	}
 	bool NekodataArchiver::archive(std::function<void()> completeOneCallback)
 	{
 		completeOneCallback_ = completeOneCallback;
@@ -119,20 +435,48 @@ namespace nekofs {
 			logerr(u8"can not use stream mode on top-level call!");
 			return false;
 		}
+		spillPrefix_ = archiveFilename_;
 		os_ = std::make_shared<NekodataOStream>(shared_from_this(), volumeSize_);
-		bool success = archiveFiles() && archiveCentralDirectory() && archiveFileFooters();
+		if (completeOneCallback_ != nullptr)
+		{
+			for (size_t i = 0; i < retainedFiles_.size(); i++)
+			{
+				completeOneCallback_();
+			}
+		}
+		bool success = resumeVolumes() && archiveFiles() && archiveCentralDirectory() && archiveFileFooters() && finishVolumes();
 		os_.reset();
+		volumeOS_.clear();
+		success = success && publishVolumes();
+		clearStagingVolumes();
 		completeOneCallback_ = nullptr;
 		return success;
 	}
+	/*
+	* 输出到只能顺序写入的流（管道、网络等），全程不回写、不回读。
+	* 需要使用stream模式、单个分卷，分卷数和尾部信息在最后顺序写出。
+	* archiveFilename只用作嵌套archive临时文件的路径前缀。os只会被顺序写入，回调形式的输出用NekodataSinkOStream包装一次即可。
+	*/
+	bool NekodataArchiver::archiveToStream(std::shared_ptr<OStream> os, std::function<void()> completeOneCallback)
+	{
+		if (!isStreamMode_ || volumeSize_ != nekofs_kNekodata_MaxVolumeSize)
+		{
+			logerr(u8"NekodataArchiver::archiveToStream need stream mode and max volume size !");
+			return false;
+		}
+		spillPrefix_ = archiveFilename_;
+		auto bos = std::make_shared<BufferedOStream>(os);
+		return archive(bos, std::string(), completeOneCallback) && bos->flush();
+	}
 	bool NekodataArchiver::archive(std::shared_ptr<OStream> os, const std::string& progressInfo, std::function<void()> completeOneCallback)
 	{
 		progressInfo_ = progressInfo;
 		completeOneCallback_ = completeOneCallback;
 		rawOS_ = os;
 		os_ = std::make_shared<NekodataOStream>(shared_from_this(), volumeSize_);
-		bool success = archiveFiles() && archiveCentralDirectory() && archiveFileFooters();
+		bool success = archiveFiles() && archiveCentralDirectory() && archiveFileFooters() && finishVolumes();
 		os_.reset();
+		volumeOS_.clear();
 		rawOS_.reset();
 		completeOneCallback_ = nullptr;
 		return success;
@@ -141,8 +485,174 @@ namespace nekofs {
 	{
 		return ostream_write(os, nekofs_kNekodata_FileHeader.data(), nekofs_kNekodata_FileHeaderSize) == nekofs_kNekodata_FileHeaderSize;
 	}
+	/*
+	* 查找内容相同的文件，只有最先写入的一份写入数据，其余的标记为Duplicate，在目录中指向同一位置。
+	* 普通文件先按大小和首尾采样的指纹分组，指纹也相同的才读取全部内容计算sha256确认。
+	* 原始数据流的meta中已有压缩后数据的sha256，直接比较，不需要读取。
+	*/
+	void NekodataArchiver::deduplicateFiles()
+	{
+		if (!deduplicate_)
+		{
+			return;
+		}
+		constexpr int32_t kSampleSize = 4096;
+		auto openContent = [](const std::pair<FileCategory, std::any>& item) -> std::shared_ptr<IStream> {
+			if (item.first != FileCategory::File)
+			{
+				return nullptr;
+			}
+			const auto& fileInfo = std::any_cast<const ArchiveInfo_File&>(item.second);
+			return fileInfo.fs ? fileInfo.fs->openIStream(fileInfo.filepath) : fileInfo.is->createNew();
+		};
+		auto readContent = [](const std::pair<FileCategory, std::any>& item, std::shared_ptr<IStream> is, int64_t pos, uint8_t* buf, int32_t size) {
+			if (item.first == FileCategory::Buffer)
+			{
+				std::memcpy(buf, static_cast<const uint8_t*>(std::any_cast<const ArchiveInfo_Buffer&>(item.second).buffer) + pos, size);
+				return true;
+			}
+			return is && is->seek(pos, SeekOrigin::Begin) == pos && istream_read(is, buf, size) == size;
+		};
+
+		// 普通文件和内存数据按大小分组
+		std::map<int64_t, std::vector<std::string>> sizeGroups;
+		// 原始数据流按meta分组
+		std::map<std::tuple<std::array<uint32_t, 8>, int64_t, int64_t>, std::string> rawFiles;
+		size_t dupNum = 0;
+		int64_t dupSize = 0;
+		for (auto& item : archiveFileList_)
+		{
+			if (item.second.first == FileCategory::File)
+			{
+				const auto& fileInfo = std::any_cast<const ArchiveInfo_File&>(item.second.second);
+				if (fileInfo.length > 0)
+				{
+					sizeGroups[fileInfo.length].push_back(item.first);
+				}
+			}
+			else if (item.second.first == FileCategory::Buffer)
+			{
+				const auto& bufferInfo = std::any_cast<const ArchiveInfo_Buffer&>(item.second.second);
+				if (bufferInfo.length > 0)
+				{
+					sizeGroups[bufferInfo.length].push_back(item.first);
+				}
+			}
+			else if (item.second.first == FileCategory::RawNekodataStream)
+			{
+				const auto& streamInfo = std::any_cast<const ArchiveInfo_RawNekodataStream&>(item.second.second);
+				const auto& meta = streamInfo.meta;
+				if (meta.getOriginalSize() <= 0)
+				{
+					continue;
+				}
+				auto key = std::make_tuple(meta.getSHA256(), meta.getCompressedSize(), meta.getOriginalSize());
+				auto it = rawFiles.find(key);
+				if (it == rawFiles.end())
+				{
+					rawFiles.emplace(key, item.first);
+					continue;
+				}
+				auto& target = std::any_cast<ArchiveInfo_RawNekodataStream&>(archiveFileList_[it->second].second);
+				bool sameBlocks = target.meta.getBlocks().size() == meta.getBlocks().size();
+				for (size_t i = 0; sameBlocks && i < meta.getBlocks().size(); i++)
+				{
+					sameBlocks = target.meta.getBlocks()[i].second == meta.getBlocks()[i].second
+						&& target.meta.getBlockOriginalSize(static_cast<int64_t>(i)) == meta.getBlockOriginalSize(static_cast<int64_t>(i));
+				}
+				if (sameBlocks)
+				{
+					// 要求校验的副本由写入数据的那一份校验
+					target.verify = target.verify || streamInfo.verify;
+					dupNum++;
+					dupSize += meta.getCompressedSize() > 0 ? meta.getCompressedSize() : meta.getOriginalSize();
+					item.second = std::make_pair<FileCategory, std::any>(FileCategory::Duplicate, ArchiveInfo_Duplicate{ it->second });
+				}
+			}
+		}
+
+		auto buffer = env::getInstance().newBuffer4M();
+		for (const auto& group : sizeGroups)
+		{
+			if (group.second.size() < 2)
+			{
+				continue;
+			}
+			// 首尾各取一段计算指纹
+			const int64_t length = group.first;
+			const int32_t sampleSize = static_cast<int32_t>(std::min<int64_t>(length, kSampleSize));
+			std::map<uint64_t, std::vector<std::string>> fingerprintGroups;
+			for (const auto& path : group.second)
+			{
+				const auto& item = archiveFileList_[path];
+				auto is = openContent(item);
+				if (!readContent(item, is, 0, buffer->data(), sampleSize) || !readContent(item, is, length - sampleSize, buffer->data() + sampleSize, sampleSize))
+				{
+					continue;
+				}
+				uint64_t fingerprint = 0xCBF29CE484222325ULL;
+				for (int32_t i = 0; i < sampleSize * 2; i++)
+				{
+					fingerprint = (fingerprint ^ (*buffer)[i]) * 0x100000001B3ULL;
+				}
+				fingerprintGroups[fingerprint].push_back(path);
+			}
+			for (const auto& fgroup : fingerprintGroups)
+			{
+				if (fgroup.second.size() < 2)
+				{
+					continue;
+				}
+				std::map<std::array<uint32_t, 8>, std::string> hashes;
+				for (const auto& path : fgroup.second)
+				{
+					auto& item = archiveFileList_[path];
+					auto is = openContent(item);
+					sha256sum hash;
+					bool success = true;
+					for (int64_t pos = 0; success && pos < length; )
+					{
+						const int32_t size = static_cast<int32_t>(std::min<int64_t>(length - pos, buffer->size()));
+						success = readContent(item, is, pos, buffer->data(), size);
+						hash.update(buffer->data(), size);
+						pos += size;
+					}
+					if (!success)
+					{
+						// 读取失败的留给压缩时报错
+						continue;
+					}
+					hash.final();
+					auto it = hashes.find(hash.readHash());
+					if (it == hashes.end())
+					{
+						hashes.emplace(hash.readHash(), path);
+						continue;
+					}
+					dupNum++;
+					dupSize += length;
+					item = std::make_pair<FileCategory, std::any>(FileCategory::Duplicate, ArchiveInfo_Duplicate{ it->second });
+				}
+			}
+		}
+		if (dupNum > 0)
+		{
+			std::stringstream ss;
+			ss << u8"deduplicate ";
+			if (!progressInfo_.empty())
+			{
+				ss << progressInfo_ << u8" ";
+			}
+			ss << u8"files = " << dupNum << u8", size = " << dupSize;
+			loginfo(ss.str());
+		}
+	}
 	bool NekodataArchiver::archiveFiles()
 	{
+		deduplicateFiles();
+		blockIndex_.clear();
+		blockDupNum_ = 0;
+		blockDupSize_ = 0;
 		const auto filesCount = archiveFileList_.size();
 		const size_t kThreadNum = 3;
 		bool hasError = false;
@@ -151,6 +661,7 @@ namespace nekofs {
 		{
 			t.push_back(std::thread(std::bind(&NekodataArchiver::threadfunction, shared_from_this())));
 		}
+		launchArchivers();
 		while (!hasError)
 		{
 			std::string pack_progress;
@@ -186,58 +697,51 @@ namespace nekofs {
 			{
 				std::shared_ptr<NekodataArchiver> archiver = std::any_cast<std::shared_ptr<NekodataArchiver>>(task->second);
 				int64_t beginPos = os_->getPosition();
-				if (archiver->archive(os_, pack_progress, completeOneCallback_))
+				std::array<uint32_t, 8> sha256;
+				bool success = false;
+				os_->beginHash();
+				auto spill = spills_.find(taskpath);
+				if (spill != spills_.end())
+				{
+					// 已在后台构建好，直接拼接过来
+					success = spill->second->result.get() && spliceArchive(spill->second);
+				}
+				else
+				{
+					archiver->spillPrefix_ = spillPrefix_;
+					success = archiver->archive(os_, pack_progress, completeOneCallback_);
+				}
+				if (success)
 				{
-					sha256sum hash;
 					NekodataFileMeta meta;
 					meta.setBeginPos(beginPos);
 					int64_t endPos = os_->getPosition();
-					int64_t totalLength = endPos - beginPos;
-					if (os_->seek(beginPos, SeekOrigin::Begin) >= 0)
+					// 子archive是顺序写入的，写入时已经算好了hash。否则回读一遍重新计算
+					if (os_->endHash(sha256) || rehash(beginPos, endPos, sha256))
 					{
-						auto buffer = env::getInstance().newBuffer4M();
-						int32_t actualRead = 0;
-						do
-						{
-							int32_t readSize = static_cast<int32_t>(std::min(totalLength, static_cast<int64_t>(buffer->size())));
-							actualRead = ostream_read(os_, &(*buffer)[0], readSize);
-							if (actualRead > 0)
-							{
-								totalLength -= actualRead;
-								hash.update(&(*buffer)[0], actualRead);
-							}
-						} while (totalLength > 0 && actualRead > 0);
-						if (totalLength == 0)
-						{
-							hash.final();
-							meta.setSHA256(hash.readHash());
-							meta.setOriginalSize(endPos - beginPos);
-							files_[taskpath] = meta;
-							std::lock_guard lock(mtx_archiveFileList_);
-							archiveFileList_.erase(archiveFileList_.cbegin());
-							if (completeOneCallback_ != nullptr)
-							{
-								completeOneCallback_();
-							}
-						}
-						else
+						meta.setSHA256(sha256);
+						meta.setOriginalSize(endPos - beginPos);
+						files_[taskpath] = meta;
+						std::lock_guard lock(mtx_archiveFileList_);
+						archiveFileList_.erase(archiveFileList_.cbegin());
+						if (completeOneCallback_ != nullptr)
 						{
-							hasError = true;
-							break;
+							completeOneCallback_();
 						}
 					}
 					else
 					{
-
 						hasError = true;
 						break;
 					}
 				}
 				else
 				{
+					os_->endHash(sha256);
 					hasError = true;
 					break;
 				}
+				launchArchivers();
 				cond_getTask_.notify_all();
 			}
 			else if (task->first == FileCategory::File)
@@ -295,8 +799,8 @@ namespace nekofs {
 					{
 						cond_getTask_.notify_one();
 						hash.update(&(*ftask->getBuffer())[0], ftask->getCompressedSize());
-						int32_t actualWrite = ostream_write(os_, &(*ftask->getBuffer())[0], ftask->getCompressedSize());
-						if (actualWrite != ftask->getCompressedSize())
+						int64_t blockPos = 0;
+						if (!writeBlock(&(*ftask->getBuffer())[0], ftask->getCompressedSize(), blockPos))
 						{
 							// 写文件发生错误，中止流程。
 							hasError = true;
@@ -304,7 +808,8 @@ namespace nekofs {
 						}
 						if (ftask->getCompressedSize() > 0)
 						{
-							meta.addBlock(ftask->getCompressedSize());
+							const auto range = ftask->getRange();
+							meta.addBlockAt(blockPos, ftask->getCompressedSize(), static_cast<int32_t>(std::get<1>(range) - std::get<0>(range)));
 						}
 						if (ftask->isFinalTask())
 						{
@@ -336,6 +841,10 @@ namespace nekofs {
 					while (remains > 0)
 					{
 						int blockSize = (int)std::min(remains, (int64_t)nekofs_kNekoData_LZ4_Buffer_Size);
+						if (chunkAvgSize_ > 0)
+						{
+							blockSize = getChunkSize((const uint8_t*)blockBuffer, (int32_t)std::min(remains, (int64_t)chunkMaxSize_));
+						}
 						remains -= blockSize;
 						LZ4_resetStreamHC(lz4Stream_body.get(), LZ4HC_CLEVEL_MAX);
 						const int cmpBytes = LZ4_compress_HC_continue(lz4Stream_body.get(), blockBuffer, (char*)&(*blockCompressBuffer)[0], blockSize, nekofs_kNekoData_LZ4_Compress_Buffer_Size);
@@ -349,8 +858,8 @@ namespace nekofs {
 							hasError = true;
 							break;
 						}
-						int32_t actualWrite = ostream_write(os_, blockCompressBuffer->data(), cmpBytes);
-						if (actualWrite != cmpBytes)
+						int64_t blockPos = 0;
+						if (!writeBlock(blockCompressBuffer->data(), cmpBytes, blockPos))
 						{
 							std::stringstream ss;
 							ss << u8"FileCategory::Buffer ostream_write error. filepath = ";
@@ -361,7 +870,7 @@ namespace nekofs {
 							break;
 						}
 						hash.update(blockCompressBuffer->data(), cmpBytes);
-						meta.addBlock(cmpBytes);
+						meta.addBlockAt(blockPos, cmpBytes, blockSize);
 						blockBuffer += blockSize;
 					}
 				}
@@ -376,50 +885,106 @@ namespace nekofs {
 				}
 				cond_getTask_.notify_all();
 			}
-			else if (task->first == FileCategory::RawNekodataStream)
+			else if (task->first == FileCategory::Duplicate)
 			{
-				ArchiveInfo_RawNekodataStream& streamInfo = std::any_cast<ArchiveInfo_RawNekodataStream&>(task->second);
-				streamInfo.meta.setBeginPos(os_->getPosition());
-				if (streamInfo.is->getLength() > 0 && (streamInfo.meta.getCompressedSize() == streamInfo.is->getLength() || streamInfo.meta.getOriginalSize() == streamInfo.is->getLength()))
-				{
-					if (!copyfile(streamInfo.is, os_))
-					{
-						// error
-						logerr(u8"write raw NekodataStream error. filename = " + taskpath);
-						hasError = true;
-						break;
-					}
-				}
-				else
+				// 内容相同的文件已写入，直接使用它的数据位置
+				const ArchiveInfo_Duplicate& duplicate = std::any_cast<const ArchiveInfo_Duplicate&>(task->second);
+				auto it = files_.find(duplicate.target);
+				if (it == files_.end())
 				{
-					if (streamInfo.meta.getCompressedSize() != 0 || streamInfo.meta.getOriginalSize() != 0)
-					{
-						// error
-						logerr(u8"write raw NekodataStream error. invalid meta. filename = " + taskpath);
-						hasError = true;
-						break;
-					}
+					logerr(u8"NekodataArchiver::archiveFiles duplicate target not found ! filename = " + taskpath + u8", target = " + duplicate.target);
+					hasError = true;
+					break;
 				}
-				files_[taskpath] = streamInfo.meta;
+				files_[taskpath] = it->second;
 				std::lock_guard lock(mtx_archiveFileList_);
 				archiveFileList_.erase(archiveFileList_.cbegin());
 				if (completeOneCallback_ != nullptr)
 				{
 					completeOneCallback_();
 				}
-				cond_getTask_.notify_all();
 			}
-		}
-		{
-			std::lock_guard lock(mtx_taskList_);
-			finish = true;
-		}
-		cond_getTask_.notify_all();
-		for (size_t i = 0; i < kThreadNum; i++)
-		{
+			else if (task->first == FileCategory::RawNekodataStream)
+			{
+				ArchiveInfo_RawNekodataStream& streamInfo = std::any_cast<ArchiveInfo_RawNekodataStream&>(task->second);
+				streamInfo.meta.setBeginPos(os_->getPosition());
+				if (streamInfo.is->getLength() > 0 && (streamInfo.meta.getCompressedSize() == streamInfo.is->getLength() || streamInfo.meta.getOriginalSize() == streamInfo.is->getLength()))
+				{
+					if (blockDeduplicate_ && !streamInfo.meta.getBlocks().empty() && streamInfo.meta.getCompressedSize() == streamInfo.is->getLength())
+					{
+						if (!copyBlocks(streamInfo))
+						{
+							// error
+							logerr(u8"write raw NekodataStream error. copy blocks failed. filename = " + taskpath);
+							hasError = true;
+							break;
+						}
+					}
+					else
+					{
+						// 按块的顺序连续写到beginPos处，不再需要每块的位置
+						streamInfo.meta.clearBlockPositions();
+						if (streamInfo.verify)
+						{
+							if (!copyVerified(streamInfo.is, streamInfo.meta.getSHA256()))
+							{
+								// error
+								logerr(u8"write raw NekodataStream error. verify sha256 failed. filename = " + taskpath);
+								hasError = true;
+								break;
+							}
+						}
+						else if (!copyfile(streamInfo.is, os_))
+						{
+							// error
+							logerr(u8"write raw NekodataStream error. filename = " + taskpath);
+							hasError = true;
+							break;
+						}
+					}
+				}
+				else
+				{
+					if (streamInfo.meta.getCompressedSize() != 0 || streamInfo.meta.getOriginalSize() != 0)
+					{
+						// error
+						logerr(u8"write raw NekodataStream error. invalid meta. filename = " + taskpath);
+						hasError = true;
+						break;
+					}
+				}
+				files_[taskpath] = streamInfo.meta;
+				std::lock_guard lock(mtx_archiveFileList_);
+				archiveFileList_.erase(archiveFileList_.cbegin());
+				if (completeOneCallback_ != nullptr)
+				{
+					completeOneCallback_();
+				}
+				cond_getTask_.notify_all();
+			}
+		}
+		{
+			std::lock_guard lock(mtx_taskList_);
+			finish = true;
+		}
+		cond_getTask_.notify_all();
+		for (size_t i = 0; i < kThreadNum; i++)
+		{
 			t[i].join();
 		}
 		t.clear();
+		clearSpills();
+		if (blockDupNum_ > 0)
+		{
+			std::stringstream ss;
+			ss << u8"deduplicate ";
+			if (!progressInfo_.empty())
+			{
+				ss << progressInfo_ << u8" ";
+			}
+			ss << u8"blocks = " << blockDupNum_ << u8", size = " << blockDupSize_;
+			loginfo(ss.str());
+		}
 
 		return !hasError && taskList_.empty() && archiveFileList_.empty();
 	}
@@ -427,25 +992,57 @@ namespace nekofs {
 	{
 		int64_t curpos = os_->getPosition();
 		bool success = true;
+		// 追加写入时，保留未被替换的旧文件
+		for (const auto& item : baseFiles_)
+		{
+			if (keepBaseFiles_ || retainedFiles_.find(item.first) != retainedFiles_.end())
+			{
+				files_.emplace(item.first, item.second);
+			}
+		}
+		// 目录由大量很小的写入组成，合并后再写入
+		auto os = std::make_shared<BufferedOStream>(os_);
 		for (const auto& item : files_)
 		{
-			success = success && nekodata_writeString(os_, item.first);
-			success = success && nekodata_writeFileSize(os_, item.second.getOriginalSize());
+			success = success && nekodata_writeString(os, item.first);
+			success = success && nekodata_writeFileSize(os, item.second.getOriginalSize());
 			if (success && item.second.getOriginalSize() > 0)
 			{
-				success = success && nekodata_writePosition(os_, item.second.getBeginPos());
-				success = success && nekodata_writeBlockNum(os_, item.second.getBlocks().size());
-				if (success && !item.second.getBlocks().empty())
+				success = success && nekodata_writePosition(os, item.second.getBeginPos());
+				success = success && nekodata_writeBlockNum(os, item.second.getBlocks().size());
+				const uint32_t blockFlags = (item.second.isVariableBlocks() ? nekofs_kNekodata_BlockFlag_OriginalSize : 0)
+					| (item.second.hasBlockPositions() ? nekofs_kNekodata_BlockFlag_Position : 0);
+				if (success && blockFlags != 0)
+				{
+					// 扩展的块信息：先写0作为标记（旧版本读到0会报错，不会误读），再写标记位，然后每块依次写压缩后大小、解压后大小、数据位置
+					success = success && nekodata_writeUint32(os, 0);
+					success = success && nekodata_writeUint32(os, blockFlags);
+					const auto& blocks = item.second.getBlocks();
+					for (size_t i = 0; success && i < blocks.size(); i++)
+					{
+						success = success && nekodata_writeBlockSize(os, blocks[i].second);
+						if (blockFlags & nekofs_kNekodata_BlockFlag_OriginalSize)
+						{
+							success = success && nekodata_writeBlockSize(os, item.second.getBlockOriginalSize(static_cast<int64_t>(i)));
+						}
+						if (blockFlags & nekofs_kNekodata_BlockFlag_Position)
+						{
+							success = success && nekodata_writePosition(os, item.second.getBlockPos(static_cast<int64_t>(i)));
+						}
+					}
+				}
+				else if (success && !item.second.getBlocks().empty())
 				{
 					for (const auto& blockSize : item.second.getBlocks())
 					{
-						success = success && nekodata_writeBlockSize(os_, blockSize.second);
+						success = success && nekodata_writeBlockSize(os, blockSize.second);
 					}
 				}
-				success = success && nekodata_writeSHA256(os_, item.second.getSHA256());
+				success = success && nekodata_writeSHA256(os, item.second.getSHA256());
 			}
 		}
-		success = success && nekodata_writeCentralDirectoryPosition(os_, curpos);
+		success = success && nekodata_writeCentralDirectoryPosition(os, curpos);
+		success = success && os->flush();
 		return success;
 	}
 	bool NekodataArchiver::archiveFileFooters()
@@ -454,6 +1051,37 @@ namespace nekofs {
 		for (size_t i = 0; success && i < volumeOS_.size(); i++)
 		{
 			auto os = std::get<1>(volumeOS_[i]);
+			if (!os)
+			{
+				// 追加写入时没有改动的旧分卷，分卷数变化时只需要更新尾部信息
+				if (volumeOS_.size() != appendVolumeNum_)
+				{
+					std::shared_ptr<OStream> nos;
+					if (stageVolumes_)
+					{
+						nos = openStagingOStream(i, true);
+					}
+					else
+					{
+						if (linkedVolumes_.find(i) != linkedVolumes_.end() && !unlinkVolume(std::get<0>(volumeOS_[i])))
+						{
+							return false;
+						}
+						nos = env::getInstance().getNativeFileSystem()->openOStream(std::get<0>(volumeOS_[i]), true);
+					}
+					success = nos && nos->seek(volumeSize_ - nekofs_kNekodata_FileFooterSize, SeekOrigin::Begin) == volumeSize_ - nekofs_kNekodata_FileFooterSize;
+					success = success && nekodata_writeVolumeNum(nos, static_cast<uint32_t>(i + 1));
+					success = success && nekodata_writeVolumeNum(nos, static_cast<uint32_t>(volumeOS_.size()));
+					success = success && nekodata_writeVolumeSize(nos, volumeSize_);
+					if (success && stageVolumes_)
+					{
+						auto nativeOS = std::dynamic_pointer_cast<NativeOStream>(nos);
+						success = nativeOS && nativeOS->sync();
+					}
+				}
+				continue;
+			}
+			success = os->finishParallelWrite();
 			if (os->getLength() == volumeSize_)
 			{
 				success = success && os->seek(-nekofs_kNekodata_FileFooterSize, SeekOrigin::End) == volumeSize_ - nekofs_kNekodata_FileFooterSize;
@@ -465,26 +1093,418 @@ namespace nekofs {
 		return success;
 	}
 	/*
-	* 获取分卷的OStream。如果volumeOS_已存在，直接返回，不存在就创建新的。新创建的一定是在前一个之后。
+	* 所有分卷写完后，截掉预分配多出的空间。如果需要，等待所有分卷落盘，每个分卷只sync一次。
+	* 追加写入的临时分卷在替换前必须落盘。
 	*/
-	std::shared_ptr<NekodataVolumeOStream> NekodataArchiver::getVolumeOStreamByDataPos(int64_t pos)
+	bool NekodataArchiver::finishVolumes()
 	{
+		bool success = true;
+		for (size_t i = 0; success && i < volumeOS_.size(); i++)
+		{
+			success = !std::get<1>(volumeOS_[i]) || std::get<1>(volumeOS_[i])->truncate();
+		}
+		if (success && (syncOnFinish_ || stageVolumes_))
+		{
+			for (const auto& item : volumeOS_)
+			{
+				auto volumeOS = std::get<1>(item);
+				if (!volumeOS)
+				{
+					continue;
+				}
+				syncs_.push_back(std::async(std::launch::async, [volumeOS]() { return volumeOS->sync(); }));
+			}
+		}
+		for (auto& item : syncs_)
+		{
+			success = item.get() && success;
+		}
+		syncs_.clear();
+		return success;
+	}
+	/*
+	* 追加写入时，重新打开最后一个旧分卷（的临时副本），从已有数据末尾继续写。更早的分卷不需要打开。
+	*/
+	bool NekodataArchiver::resumeVolumes()
+	{
+		if (appendVolumeNum_ == 0)
+		{
+			return true;
+		}
 		int64_t dataSizePerVolume = volumeSize_ - nekofs_kNekodata_VolumeFormatSize;
-		size_t index = pos / dataSizePerVolume;
-		if (index >= volumeOS_.size())
+		for (size_t index = 0; index < appendVolumeNum_; index++)
+		{
+			std::string filepath = getVolumePath(archiveFilename_, index);
+			if (index + 1 < appendVolumeNum_)
+			{
+				volumeOS_.push_back(std::make_tuple(filepath, std::shared_ptr<NekodataVolumeOStream>()));
+				continue;
+			}
+			auto os = stageVolumes_ ? openStagingOStream(index, true) : env::getInstance().getNativeFileSystem()->openOStream(filepath, true);
+			if (!os)
+			{
+				return false;
+			}
+			auto volumeOS = std::make_shared<NekodataVolumeOStream>(os, volumeSize_, index * dataSizePerVolume);
+			if (!volumeOS->resume(appendDataPos_ - index * dataSizePerVolume + nekofs_kNekodata_FileHeaderSize))
+			{
+				return false;
+			}
+			volumeOS->preallocate();
+			if (parallelWrite_)
+			{
+				volumeOS->enableParallelWrite();
+			}
+			volumeOS_.push_back(std::make_tuple(filepath, volumeOS));
+		}
+		os_->resume(appendDataPos_);
+		return true;
+	}
+	/*
+	* 打开分卷的临时文件用于写入，copyVolume时先复制已有的分卷（reflink/内核拷贝）。
+	*/
+	std::shared_ptr<OStream> NekodataArchiver::openStagingOStream(size_t index, bool copyVolume)
+	{
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		std::string filepath = getVolumePath(archiveFilename_, index);
+		std::string tmppath = filepath + u8".tmp";
+		bool hardlinked = false;
+		if (nativefs->getFileType(tmppath) != FileType::None && !nativefs->removeFile(tmppath))
+		{
+			return nullptr;
+		}
+		if (copyVolume && !nativefs->cloneFile(filepath, tmppath, false, hardlinked))
+		{
+			return nullptr;
+		}
+		stagingVolumes_.insert(index);
+		return nativefs->openOStream(tmppath, copyVolume);
+	}
+	/*
+	* 用落盘后的临时文件替换分卷。新增的分卷在旧的分卷数之外，先放好不影响读取；
+	* 旧分卷从后往前替换，第一个分卷（记录分卷数）最后替换。
+	*/
+	bool NekodataArchiver::publishVolumes()
+	{
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		std::vector<size_t> order;
+		for (auto it = stagingVolumes_.begin(); it != stagingVolumes_.end(); ++it)
+		{
+			if (*it >= appendVolumeNum_)
+			{
+				order.push_back(*it);
+			}
+		}
+		for (auto it = stagingVolumes_.rbegin(); it != stagingVolumes_.rend(); ++it)
+		{
+			if (*it < appendVolumeNum_)
+			{
+				order.push_back(*it);
+			}
+		}
+		for (auto index : order)
+		{
+			std::string filepath = getVolumePath(archiveFilename_, index);
+			if (!nativefs->replaceFile(filepath + u8".tmp", filepath))
+			{
+				return false;
+			}
+			stagingVolumes_.erase(index);
+		}
+		return true;
+	}
+	/*
+	* 删除没有用上的临时分卷（archive失败时）。
+	*/
+	void NekodataArchiver::clearStagingVolumes()
+	{
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		for (auto index : stagingVolumes_)
+		{
+			std::string tmppath = getVolumePath(archiveFilename_, index) + u8".tmp";
+			if (nativefs->getFileType(tmppath) != FileType::None)
+			{
+				nativefs->removeFile(tmppath);
+			}
+		}
+		stagingVolumes_.clear();
+	}
+	/*
+	* 硬链接的分卷需要修改时，先换成独立的副本，避免改到基础nekodata。
+	*/
+	bool NekodataArchiver::unlinkVolume(const std::string& filepath)
+	{
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		std::string tmppath = filepath + u8".tmp";
+		bool hardlinked = false;
+		if (nativefs->getFileType(tmppath) != FileType::None)
+		{
+			nativefs->removeFile(tmppath);
+		}
+		return nativefs->cloneFile(filepath, tmppath, false, hardlinked) && nativefs->removeFile(filepath) && nativefs->moveFile(tmppath, filepath);
+	}
+	std::string NekodataArchiver::getVolumePath(const std::string& archiveFilename, size_t index)
+	{
+		if (index == 0)
+		{
+			return archiveFilename;
+		}
+		std::stringstream ss;
+		ss << archiveFilename.substr(0, archiveFilename.size() - nekofs_kNekodata_FileExtension.size());
+		ss << u8"." << index << nekofs_kNekodata_FileExtension;
+		return ss.str();
+	}
+	/*
+	* 回读[beginPos, endPos)区间的数据，重新计算sha256。
+	*/
+	bool NekodataArchiver::rehash(int64_t beginPos, int64_t endPos, std::array<uint32_t, 8>& sha256)
+	{
+		if (os_->seek(beginPos, SeekOrigin::Begin) < 0)
 		{
-			std::string filepath = "";
-			if (index != 0)
+			return false;
+		}
+		sha256sum hash;
+		int64_t totalLength = endPos - beginPos;
+		auto buffer = env::getInstance().newBuffer4M();
+		int32_t actualRead = 0;
+		do
+		{
+			int32_t readSize = static_cast<int32_t>(std::min(totalLength, static_cast<int64_t>(buffer->size())));
+			actualRead = ostream_read(os_, &(*buffer)[0], readSize);
+			if (actualRead > 0)
+			{
+				totalLength -= actualRead;
+				hash.update(&(*buffer)[0], actualRead);
+			}
+		} while (totalLength > 0 && actualRead > 0);
+		if (totalLength != 0)
+		{
+			return false;
+		}
+		hash.final();
+		sha256 = hash.readHash();
+		return true;
+	}
+	/*
+	* 写入一个压缩块，返回块的数据位置。开启块去重时，已写入过的相同的块不再写入，返回之前的位置。
+	*/
+	bool NekodataArchiver::writeBlock(const void* data, int32_t size, int64_t& pos)
+	{
+		std::array<uint32_t, 8> sha256 = {};
+		if (blockDeduplicate_ && size > 0)
+		{
+			sha256sum hash;
+			hash.final(data, size);
+			sha256 = hash.readHash();
+			auto it = blockIndex_.find(sha256);
+			if (it != blockIndex_.end())
+			{
+				pos = it->second;
+				blockDupNum_++;
+				blockDupSize_ += size;
+				return true;
+			}
+		}
+		pos = os_->getPosition();
+		if (ostream_write(os_, data, size) != size)
+		{
+			return false;
+		}
+		if (blockDeduplicate_ && size > 0)
+		{
+			blockIndex_.emplace(sha256, pos);
+		}
+		return true;
+	}
+	/*
+	* 逐块拷贝压缩后的原始数据流，每块都经过块去重。需要校验时同时计算整个数据流的sha256与meta对比。
+	*/
+	bool NekodataArchiver::copyBlocks(ArchiveInfo_RawNekodataStream& streamInfo)
+	{
+		const NekodataFileMeta& srcMeta = streamInfo.meta;
+		NekodataFileMeta meta;
+		meta.setBeginPos(os_->getPosition());
+		meta.setOriginalSize(srcMeta.getOriginalSize());
+		meta.setSHA256(srcMeta.getSHA256());
+		sha256sum hash;
+		auto buffer = env::getInstance().newBufferCompressSize();
+		const auto& blocks = srcMeta.getBlocks();
+		for (size_t i = 0; i < blocks.size(); i++)
+		{
+			const int32_t blockSize = blocks[i].second;
+			if (blockSize > static_cast<int32_t>(buffer->size()) || istream_read(streamInfo.is, buffer->data(), blockSize) != blockSize)
+			{
+				return false;
+			}
+			if (streamInfo.verify)
+			{
+				hash.update(buffer->data(), blockSize);
+			}
+			int64_t blockPos = 0;
+			if (!writeBlock(buffer->data(), blockSize, blockPos))
+			{
+				return false;
+			}
+			meta.addBlockAt(blockPos, blockSize, srcMeta.getBlockOriginalSize(static_cast<int64_t>(i)));
+		}
+		if (streamInfo.verify)
+		{
+			hash.final();
+			if (hash.readHash() != srcMeta.getSHA256())
+			{
+				return false;
+			}
+		}
+		streamInfo.meta = meta;
+		return true;
+	}
+	size_t NekodataArchiver::BlockHash::operator()(const std::array<uint32_t, 8>& sha256) const
+	{
+		return static_cast<size_t>((static_cast<uint64_t>(sha256[0]) << 32) | sha256[1]);
+	}
+	/*
+	* 经过缓冲区拷贝，同时计算sha256。数据都写完之后才知道是否一致，不一致时由调用方放弃整个archive。
+	*/
+	bool NekodataArchiver::copyVerified(std::shared_ptr<IStream> is, const std::array<uint32_t, 8>& sha256)
+	{
+		sha256sum hash;
+		auto buffer = env::getInstance().newBuffer4M();
+		const int32_t buffer_size = static_cast<int32_t>(buffer->size());
+		int32_t actualRead = 0;
+		do
+		{
+			actualRead = istream_read(is, buffer->data(), buffer_size);
+			if (actualRead > 0)
+			{
+				hash.update(buffer->data(), actualRead);
+				if (ostream_write(os_, buffer->data(), actualRead) != actualRead)
+				{
+					return false;
+				}
+			}
+		} while (actualRead == buffer_size);
+		if (actualRead < 0)
+		{
+			return false;
+		}
+		hash.final();
+		return hash.readHash() == sha256;
+	}
+	/*
+	* 在空闲的后台槽位上，按顺序提前构建尚未开始的子archive。
+	* 没有槽位时不等待，轮到该子archive时直接写入当前archive。
+	*/
+	void NekodataArchiver::launchArchivers()
+	{
+		std::lock_guard lock(mtx_archiveFileList_);
+		const size_t filesCount = files_.size() + archiveFileList_.size();
+		size_t index = files_.size();
+		for (const auto& item : archiveFileList_)
+		{
+			index++;
+			if (item.second.first != FileCategory::Archiver || spills_.find(item.first) != spills_.end())
+			{
+				continue;
+			}
+			// 队首的子archive马上就会被处理，直接写入即可
+			if (item.first == archiveFileList_.begin()->first || !tryAcquireArchiveSlot())
+			{
+				continue;
+			}
+			auto spill = std::make_shared<ArchiveSpill>();
 			{
 				std::stringstream ss;
-				ss << archiveFilename_.substr(0, archiveFilename_.size() - nekofs_kNekodata_FileExtension.size());
-				ss << u8"." << index << nekofs_kNekodata_FileExtension;
-				filepath = ss.str();
+				ss << spillPrefix_ << u8"." << ++s_spillId << u8".spill";
+				spill->filepath = ss.str();
 			}
-			else
+			auto nativefs = env::getInstance().getNativeFileSystem();
+			if (nativefs->getFileType(spill->filepath) != FileType::None)
+			{
+				nativefs->removeFile(spill->filepath);
+			}
+			auto spillOS = nativefs->openOStream(spill->filepath);
+			if (!spillOS)
+			{
+				releaseArchiveSlot();
+				break;
+			}
+			spill->os = std::make_shared<BufferedOStream>(spillOS);
+			std::string progressInfo;
+			{
+				std::stringstream ss;
+				ss << u8"[" << index << u8"/" << filesCount << u8"] ";
+				ss << item.first;
+				progressInfo = ss.str();
+			}
+			std::shared_ptr<NekodataArchiver> archiver = std::any_cast<std::shared_ptr<NekodataArchiver>>(item.second.second);
+			archiver->spillPrefix_ = spillPrefix_;
+			std::shared_ptr<OStream> os = spill->os;
+			auto completeOneCallback = completeOneCallback_;
+			spill->result = std::async(std::launch::async, [archiver, os, progressInfo, completeOneCallback]() {
+				bool success = archiver->archive(os, progressInfo, completeOneCallback);
+				releaseArchiveSlot();
+				return success;
+				});
+			spills_[item.first] = spill;
+		}
+	}
+	/*
+	* 把临时文件中构建好的子archive拷贝到当前位置，并删除临时文件。
+	*/
+	bool NekodataArchiver::spliceArchive(std::shared_ptr<ArchiveSpill> spill)
+	{
+		int64_t totalLength = spill->os->getLength();
+		bool success = spill->os->seek(0, SeekOrigin::Begin) == 0;
+		if (success)
+		{
+			auto buffer = env::getInstance().newBuffer4M();
+			while (success && totalLength > 0)
+			{
+				int32_t size = static_cast<int32_t>(std::min(totalLength, static_cast<int64_t>(buffer->size())));
+				success = ostream_read(spill->os, buffer->data(), size) == size && ostream_write(os_, buffer->data(), size) == size;
+				totalLength -= size;
+			}
+		}
+		if (!success)
+		{
+			std::stringstream ss;
+			ss << u8"NekodataArchiver::spliceArchive error ! filepath = ";
+			ss << spill->filepath;
+			logerr(ss.str());
+		}
+		spill->os.reset();
+		env::getInstance().getNativeFileSystem()->removeFile(spill->filepath);
+		return success;
+	}
+	/*
+	* 等待所有后台构建结束，并删除剩余的临时文件。
+	*/
+	void NekodataArchiver::clearSpills()
+	{
+		for (auto& item : spills_)
+		{
+			if (item.second->result.valid())
+			{
+				item.second->result.wait();
+			}
+			if (item.second->os)
 			{
-				filepath = archiveFilename_;
+				item.second->os.reset();
+				env::getInstance().getNativeFileSystem()->removeFile(item.second->filepath);
 			}
+		}
+		spills_.clear();
+	}
+	/*
+	* 获取分卷的OStream。如果volumeOS_已存在，直接返回，不存在就创建新的。新创建的一定是在前一个之后。
+	*/
+	std::shared_ptr<NekodataVolumeOStream> NekodataArchiver::getVolumeOStreamByDataPos(int64_t pos)
+	{
+		int64_t dataSizePerVolume = volumeSize_ - nekofs_kNekodata_VolumeFormatSize;
+		size_t index = pos / dataSizePerVolume;
+		if (index >= volumeOS_.size())
+		{
+			std::string filepath = getVolumePath(archiveFilename_, index);
 			if (index > 0 && std::get<1>(volumeOS_[index - 1])->getLength() < volumeSize_)
 			{
 				// 补全上一个分卷的内容
@@ -503,10 +1523,15 @@ namespace nekofs {
 			}
 			else
 			{
-				auto os = env::getInstance().getNativeFileSystem()->openOStream(filepath);
+				auto os = stageVolumes_ ? openStagingOStream(index, false) : env::getInstance().getNativeFileSystem()->openOStream(filepath);
 				if (os)
 				{
 					volumeOS_.push_back(std::make_tuple(filepath, std::make_shared<NekodataVolumeOStream>(os, volumeSize_, index * dataSizePerVolume)));
+					std::get<1>(volumeOS_[index])->preallocate();
+					if (parallelWrite_)
+					{
+						std::get<1>(volumeOS_[index])->enableParallelWrite();
+					}
 					if (!archiveFileHeader(std::get<1>(volumeOS_[index])))
 					{
 						return nullptr;
@@ -516,6 +1541,20 @@ namespace nekofs {
 				{
 					return nullptr;
 				}
+				// 同时在写的分卷有上限，等待较早的分卷写完
+				if (index >= kParallelVolumeNum)
+				{
+					auto volumeOS = std::get<1>(volumeOS_[index - kParallelVolumeNum]);
+					if (volumeOS && !volumeOS->finishParallelWrite())
+					{
+						return nullptr;
+					}
+					if (volumeOS && (syncOnFinish_ || stageVolumes_))
+					{
+						// 已写完的分卷在后台开始写回，最后写完尾部信息时只需要sync一次
+						syncs_.push_back(std::async(std::launch::async, [volumeOS]() { volumeOS->writeback(); return true; }));
+					}
+				}
 			}
 		}
 		return std::get<1>(volumeOS_[index]);
@@ -523,7 +1562,7 @@ namespace nekofs {
 
 	/*
 	* 压缩文件块的线程。做如下几步操作：
-	* 1. 查询哪个文件需要压缩，并且获取待压缩区间
+	* 1. 查询哪个文件需要压缩，并且获取待压缩区间。按内容分块时先取最大区间，在锁外读取并切分后再确定下一块的起点
 	* 2. 根据压缩区间去读取文件，并进行压缩
 	* 3. 标记该文件块已压缩，将压缩后的数据放入队列中
 	*
@@ -536,6 +1575,7 @@ namespace nekofs {
 		while (!needExit)
 		{
 			std::shared_ptr<FileBlockTask> ftask;
+			bool needCut = false;
 			{
 				std::unique_lock lock(mtx_taskList_);
 				needExit = finish;
@@ -563,12 +1603,24 @@ namespace nekofs {
 						while (it != archiveFileList_.end())
 						{
 							fileCaetgory = it->second.first;
+							if (fileCaetgory == FileCategory::Duplicate)
+							{
+								// 不需要压缩，也不会阻塞后面的文件
+								it++;
+								continue;
+							}
 							if (fileCaetgory != FileCategory::File)
 							{
 								// 暂无文件需要压缩
 								break;
 							}
 							ArchiveInfo_File& fileInfo = std::any_cast<ArchiveInfo_File&>(it->second.second);
+							if (fileInfo.cutting)
+							{
+								// 等待上一块切分完成，下一块的起点才确定。文件的块需要按顺序入队，不能先取后面的文件
+								fileCaetgory = FileCategory::None;
+								break;
+							}
 							if (fileInfo.compressIndex >= fileInfo.length)
 							{
 								// 此文件的压缩已全部完成。也可能是文件大小为0，不需要压缩
@@ -578,8 +1630,22 @@ namespace nekofs {
 							else
 							{
 								// 查询到压缩任务
-								ftask = std::make_shared<FileBlockTask>(it->first, fileInfo.fs->openIStream(fileInfo.filepath), fileInfo.compressIndex / nekofs_kNekoData_LZ4_Buffer_Size);
-								fileInfo.compressIndex = std::min(fileInfo.length, fileInfo.compressIndex + nekofs_kNekoData_LZ4_Buffer_Size);
+								auto is = fileInfo.fs ? fileInfo.fs->openIStream(fileInfo.filepath) : fileInfo.is->createNew();
+								int64_t endPos = std::min(fileInfo.length, fileInfo.compressIndex + nekofs_kNekoData_LZ4_Buffer_Size);
+								if (chunkAvgSize_ > 0)
+								{
+									endPos = std::min(fileInfo.length, fileInfo.compressIndex + chunkMaxSize_);
+									needCut = endPos - fileInfo.compressIndex > chunkMinSize_;
+								}
+								ftask = std::make_shared<FileBlockTask>(it->first, is, fileInfo.compressIndex, endPos);
+								if (needCut)
+								{
+									fileInfo.cutting = true;
+								}
+								else
+								{
+									fileInfo.compressIndex = endPos;
+								}
 								taskList_.push(ftask);
 								break;
 							}
@@ -608,47 +1674,62 @@ namespace nekofs {
 			auto blockBuffer = env::getInstance().newBufferBlockSize();
 			auto blockCompressBuffer = env::getInstance().newBufferCompressSize();
 			ftask->setBuffer(blockCompressBuffer);
+			if (needCut && !cutChunk(ftask, &(*blockBuffer)[0]))
+			{
+				// error
+				std::stringstream ss;
+				ss << u8"read stream error. filepath = ";
+				ss << ftask->getPath();
+				logerr(ss.str());
+				ftask->setStatus(FileBlockTask::Status::Error);
+				needExit = true;
+				continue;
+			}
 			LZ4_resetStreamHC(lz4Stream_body.get(), LZ4HC_CLEVEL_MAX);
 			auto range = ftask->getRange();
 			int blockSize = static_cast<int>(std::get<1>(range) - std::get<0>(range));
 			if (blockSize > 0)
 			{
-				auto is = ftask->getIStream();
-				if (!is)
+				if (!needCut)
 				{
-					// error
-					std::stringstream ss;
-					ss << u8"sream is null. filepath = ";
-					ss << ftask->getPath();
-					logerr(ss.str());
-					ftask->setStatus(FileBlockTask::Status::Error);
-					needExit = true;
-					continue;
-				}
-				if (is->seek(std::get<0>(range), SeekOrigin::Begin) != std::get<0>(range))
-				{
-					// error
-					std::stringstream ss;
-					ss << u8"sream seek error. filepath = ";
-					ss << ftask->getPath();
-					ss << u8", seekpos = ";
-					ss << std::get<0>(range);
-					logerr(ss.str());
-					ftask->setStatus(FileBlockTask::Status::Error);
-					needExit = true;
-					continue;
-				}
-				int64_t actualRead = istream_read(is, &(*blockBuffer)[0], blockSize);
-				if (actualRead != blockSize)
-				{
-					// error
-					std::stringstream ss;
-					ss << u8"read stream error. filepath = ";
-					ss << ftask->getPath();
-					logerr(ss.str());
-					ftask->setStatus(FileBlockTask::Status::Error);
-					needExit = true;
-					continue;
+					// 切分时已经读取过的数据不需要再读
+					auto is = ftask->getIStream();
+					if (!is)
+					{
+						// error
+						std::stringstream ss;
+						ss << u8"sream is null. filepath = ";
+						ss << ftask->getPath();
+						logerr(ss.str());
+						ftask->setStatus(FileBlockTask::Status::Error);
+						needExit = true;
+						continue;
+					}
+					if (is->seek(std::get<0>(range), SeekOrigin::Begin) != std::get<0>(range))
+					{
+						// error
+						std::stringstream ss;
+						ss << u8"sream seek error. filepath = ";
+						ss << ftask->getPath();
+						ss << u8", seekpos = ";
+						ss << std::get<0>(range);
+						logerr(ss.str());
+						ftask->setStatus(FileBlockTask::Status::Error);
+						needExit = true;
+						continue;
+					}
+					int64_t actualRead = istream_read(is, &(*blockBuffer)[0], blockSize);
+					if (actualRead != blockSize)
+					{
+						// error
+						std::stringstream ss;
+						ss << u8"read stream error. filepath = ";
+						ss << ftask->getPath();
+						logerr(ss.str());
+						ftask->setStatus(FileBlockTask::Status::Error);
+						needExit = true;
+						continue;
+					}
 				}
 				const int cmpBytes = LZ4_compress_HC_continue(lz4Stream_body.get(), (const char*)&(*blockBuffer)[0], (char*)&(*blockCompressBuffer)[0], blockSize, nekofs_kNekoData_LZ4_Compress_Buffer_Size);
 				if (cmpBytes <= 0)
@@ -9,6 +9,8 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <unordered_map>
+#include <set>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
@@ -17,6 +19,7 @@
 #include <tuple>
 #include <atomic>
 #include <functional>
+#include <future>
 
 namespace nekofs {
 	class NekodataOStream;
@@ -36,14 +39,17 @@ namespace nekofs {
 			File,
 			Buffer,
 			RawNekodataStream,
-			Archiver
+			Archiver,
+			Duplicate
 		};
 		struct ArchiveInfo_File final
 		{
 			std::shared_ptr<FileSystem> fs;
 			std::string filepath;
+			std::shared_ptr<IStream> is; // fs为空时从is读取，每个压缩任务使用is->createNew()
 			int64_t length = 0;
 			int64_t compressIndex = 0;
+			bool cutting = false; // 有线程正在按内容切分上一块，compressIndex还不是下一块的起点
 		};
 		struct ArchiveInfo_Buffer final
 		{
@@ -54,6 +60,11 @@ namespace nekofs {
 		{
 			std::shared_ptr<IStream> is;
 			NekodataFileMeta meta;
+			bool verify = false; // 拷贝时计算sha256并与meta对比
+		};
+		struct ArchiveInfo_Duplicate final
+		{
+			std::string target; // 内容相同、数据已写入的文件，总是排在自己之前
 		};
 		class FileBlockTask final
 		{
@@ -68,11 +79,11 @@ namespace nekofs {
 				Error
 			};
 		public:
-			FileBlockTask(const std::string& path, std::shared_ptr<IStream> is, int64_t index);
+			FileBlockTask(const std::string& path, std::shared_ptr<IStream> is, int64_t beginPos, int64_t endPos);
 			void setStatus(Status status);
 			Status getStatus();
-			int64_t getIndex() const;
 			std::tuple<int64_t, int64_t> getRange() const;
+			void setEndPos(int64_t endPos);
 			const std::string& getPath() const;
 			std::shared_ptr<IStream> getIStream() const;
 			void setBuffer(std::shared_ptr<std::array<uint8_t, nekofs_kNekoData_LZ4_Compress_Buffer_Size>> buffer);
@@ -83,20 +94,80 @@ namespace nekofs {
 
 		private:
 			Status status_ = Status::None;
-			int64_t index_ = 0;
+			int64_t beginPos_ = 0;
+			int64_t endPos_ = 0;
 			std::string path_;
 			std::shared_ptr<IStream> is_;
 			std::shared_ptr<std::array<uint8_t, nekofs_kNekoData_LZ4_Compress_Buffer_Size>> compressBuffer_;
 			int32_t compressedSize_ = 0;
 			std::mutex mtx_;
 		};
+		/*
+		* 并行构建的子archive，先写入临时文件，轮到它时再拼接到当前archive中。
+		*/
+		struct ArchiveSpill final
+		{
+			std::string filepath;
+			std::shared_ptr<OStream> os;
+			std::future<bool> result;
+		};
+		/*
+		* 文件的写入顺序。在访问顺序中的文件按其中的位置排在前面，其余的按路径排在后面。
+		*/
+		struct FileOrder final
+		{
+			bool operator()(const std::string& left, const std::string& right) const;
+			std::shared_ptr<const std::unordered_map<std::string, size_t>> ranks;
+		};
 	public:
 		NekodataArchiver(const std::string& archiveFilename, int64_t volumeSize = nekofs_kNekodata_DefalutVolumeSize, bool streamMode = false);
+		/*
+		* 打开已有的nekodata用于追加写入。新增或替换的文件写在已有数据之后，最后写入新的目录和分卷尾部信息。
+		* 需要改动的分卷（最后一个旧分卷、新增的分卷，分卷数变化时还有更早的旧分卷）都先写到旁边的临时文件，
+		* 全部写完并落盘后再用rename替换，archive期间已有的分卷不会被修改，读取方可以一直打开旧的nekodata。
+		* 分卷数不变时只替换最后一个分卷，替换是原子的；分卷数变化时按从后往前的顺序逐个替换，第一个分卷最后替换，
+		* 中途崩溃可能留下新旧混合的分卷。已打开的NekodataFileSystem继续读取旧的数据，重新打开才能看到新的目录。
+		* Windows上被打开的分卷无法替换，archive前需要关闭该nekodata的NekodataFileSystem。
+		*/
+		static std::shared_ptr<NekodataArchiver> createForAppend(const std::string& archiveFilename);
+		/*
+		* 以已有的nekodata为基础生成新的nekodata。先把基础nekodata的分卷复制（reflink/硬链接/内核拷贝）过来，再追加写入。
+		* 基础中的文件只有通过addRawFile再次加入、且数据位置相同时才会保留，其余的只留下无用数据。
+		*/
+		static std::shared_ptr<NekodataArchiver> createFromBase(const std::string& archiveFilename, const std::string& baseFilename, bool allowHardlink = false);
+		void setSyncOnFinish(bool sync);
+		/*
+		* 分卷的并行写入模式，默认开启。关闭后所有分卷按顺序同步写入。
+		*/
+		void setParallelWrite(bool parallelWrite);
+		/*
+		* 内容相同的文件只保存一份数据，目录中的多个文件指向同一位置。默认开启，子archive使用相同的设置。
+		*/
+		void setDeduplicate(bool deduplicate);
+		/*
+		* 块级去重：内容相同的压缩块只写入一次，之后的块在目录中记录数据位置引用它。
+		* 默认关闭（旧版本无法读取这种目录），子archive使用相同的设置，但只在各自内部去重。
+		*/
+		void setBlockDeduplicate(bool blockDeduplicate);
+		/*
+		* 按内容分块（FastCDC），块的边界由内容决定，文件中插入或删除数据后其余部分仍得到相同的块。
+		* 块大小在[minSize, maxSize]之间，平均约avgSize。avgSize为0时使用固定大小分块（默认）。子archive使用相同的设置。
+		*/
+		bool setContentDefinedChunking(int32_t minSize = nekofs_kNekoData_CDC_MinSize, int32_t avgSize = nekofs_kNekoData_CDC_AvgSize, int32_t maxSize = nekofs_kNekoData_CDC_MaxSize);
+		/*
+		* 按访问顺序写入文件（例如访问记录中第一次访问的顺序），一起访问的文件相邻，也尽量在同一个分卷中，冷启动时的读取基本是顺序的。
+		* order之外的文件按路径排在后面。子archive使用order中以其路径（去掉扩展名）为前缀的部分。
+		*/
+		void setAccessOrder(const std::vector<std::string>& order);
 		void addFile(const std::string& filepath, std::shared_ptr<FileSystem> srcfs, const std::string& srcfilepath);
 		void addBuffer(const std::string& filepath, const void* buffer, int64_t length);
-		void addRawFile(const std::string& filepath, std::shared_ptr<IStream> is, const NekodataFileMeta& meta);
+		void addStream(const std::string& filepath, std::shared_ptr<IStream> is);
+		void addRawFile(const std::string& filepath, std::shared_ptr<IStream> is, const NekodataFileMeta& meta, bool verify = false);
 		std::shared_ptr<NekodataArchiver> addArchive(const std::string& filepath);
+		void removeFile(const std::string& filepath);
+		bool isBaseFile(const std::string& filepath, const NekodataFileMeta& meta) const;
 		bool archive(std::function<void()> completeOneCallback = nullptr);
+		bool archiveToStream(std::shared_ptr<OStream> os, std::function<void()> completeOneCallback = nullptr);
 
 	private:
 		bool archive(std::shared_ptr<OStream> os, const std::string& progressInfo, std::function<void()> completeOneCallback = nullptr);
@@ -104,25 +175,69 @@ namespace nekofs {
 		bool archiveFiles();
 		bool archiveCentralDirectory();
 		bool archiveFileFooters();
+		bool finishVolumes();
+		bool resumeVolumes();
+		std::shared_ptr<OStream> openStagingOStream(size_t index, bool copyVolume);
+		bool publishVolumes();
+		void clearStagingVolumes();
+		bool unlinkVolume(const std::string& filepath);
+		static std::string getVolumePath(const std::string& archiveFilename, size_t index);
+		bool rehash(int64_t beginPos, int64_t endPos, std::array<uint32_t, 8>& sha256);
+		bool copyVerified(std::shared_ptr<IStream> is, const std::array<uint32_t, 8>& sha256);
+		void launchArchivers();
+		bool spliceArchive(std::shared_ptr<ArchiveSpill> spill);
+		void clearSpills();
 		std::shared_ptr<NekodataVolumeOStream> getVolumeOStreamByDataPos(int64_t pos);
+		bool cutChunk(std::shared_ptr<FileBlockTask> ftask, uint8_t* buffer);
+		int32_t getChunkSize(const uint8_t* data, int32_t size) const;
+		static std::vector<std::string> getChildAccessOrder(const std::vector<std::string>& order, const std::string& filepath);
+		void deduplicateFiles();
+		bool writeBlock(const void* data, int32_t size, int64_t& pos);
+		bool copyBlocks(ArchiveInfo_RawNekodataStream& streamInfo);
 
 
 	private:
 		void threadfunction();
+		struct BlockHash final
+		{
+			size_t operator()(const std::array<uint32_t, 8>& sha256) const;
+		};
 
 	private:
 		bool finish = false;
 		std::string archiveFilename_;
 		int64_t volumeSize_ = nekofs_kNekodata_MaxVolumeSize;
 		bool isStreamMode_ = false;
+		bool syncOnFinish_ = false;
+		bool parallelWrite_ = true;
+		bool deduplicate_ = true;
+		bool blockDeduplicate_ = false;
+		std::unordered_map<std::array<uint32_t, 8>, int64_t, BlockHash> blockIndex_; // 已写入的压缩块的sha256 -> 数据位置
+		int64_t blockDupNum_ = 0;
+		int64_t blockDupSize_ = 0;
+		int32_t chunkMinSize_ = 0;
+		int32_t chunkAvgSize_ = 0;
+		int32_t chunkMaxSize_ = 0;
+		std::vector<std::future<bool>> syncs_;
 		std::shared_ptr<OStream> rawOS_;
 		std::string progressInfo_;
+		std::string spillPrefix_;
+		std::map<std::string, std::shared_ptr<ArchiveSpill>> spills_;
 		std::function<void ()> completeOneCallback_ = nullptr;
 		std::shared_ptr<NekodataOStream> os_;
 		std::vector<std::tuple<std::string, std::shared_ptr<NekodataVolumeOStream>>> volumeOS_;
-		std::map<std::string, std::pair<FileCategory, std::any>> archiveFileList_;
+		std::vector<std::string> accessOrder_;
+		std::map<std::string, std::pair<FileCategory, std::any>, FileOrder> archiveFileList_;
 		std::mutex mtx_archiveFileList_;
 		std::map<std::string, NekodataFileMeta> files_;
+		std::map<std::string, NekodataFileMeta> baseFiles_;
+		std::set<std::string> retainedFiles_;
+		std::set<size_t> linkedVolumes_;
+		bool keepBaseFiles_ = true;
+		bool stageVolumes_ = false;
+		std::set<size_t> stagingVolumes_;
+		int64_t appendDataPos_ = 0;
+		size_t appendVolumeNum_ = 0;
 		std::queue<std::shared_ptr<FileBlockTask>> taskList_;
 		std::mutex mtx_taskList_;
 		std::condition_variable cond_getTask_;
@@ -2,8 +2,10 @@
 #include "nekodatafilemeta.h"
 #include "nekodatafilesystem.h"
 #include "nekodataistream.h"
+#include "nekodatapreloader.h"
 #include "../common/env.h"
 #include "../common/utils.h"
+#include "../common/accesstrace.h"
 
 #include <sstream>
 
@@ -24,15 +26,22 @@ namespace nekofs {
 		}
 		return std::make_shared<NekodataIStream>(shared_from_this());
 	}
-	std::shared_ptr<IStream> NekodataFile::openRawIStream()
+	/*
+	* hint为打开分卷的访问方式。校验、解包、拷贝等从头到尾读取时传Sequential，未压缩文件的普通读取用Auto。
+	*/
+	std::shared_ptr<IStream> NekodataFile::openRawIStream(AccessHint hint)
 	{
-		if (meta_->getCompressedSize() > 0)
+		if (meta_->hasBlockPositions())
 		{
-			return fs_->openRawIStream(meta_->getBeginPos(), meta_->getCompressedSize());
+			return std::make_shared<NekodataBlocksIStream>(fs_, meta_, hint);
+		}
+		else if (meta_->getCompressedSize() > 0)
+		{
+			return fs_->openRawIStream(meta_->getBeginPos(), meta_->getCompressedSize(), hint);
 		}
 		else
 		{
-			return fs_->openRawIStream(meta_->getBeginPos(), meta_->getOriginalSize());
+			return fs_->openRawIStream(meta_->getBeginPos(), meta_->getOriginalSize(), hint);
 		}
 	}
 	const std::string& NekodataFile::getFilePath() const
@@ -48,6 +57,23 @@ namespace nekofs {
 		return meta_->getCompressedSize();
 	}
 	std::shared_ptr<std::array<uint8_t, nekofs_kNekoData_LZ4_Buffer_Size>> NekodataFile::getBlock(int64_t index)
+	{
+		bool cacheHit = false;
+		auto& trace = AccessTrace::getInstance();
+		if (!trace.isEnabled())
+		{
+			return getBlockInternal(index, cacheHit);
+		}
+		const int64_t beginTime = AccessTrace::now();
+		auto block = getBlockInternal(index, cacheHit);
+		// 记录overlay中的路径，不同子archive中的同名文件可以区分
+		trace.record(AccessTraceEvent::NekodataBlock, fs_->getTracePrefix() + filepath_, index, meta_->getBlockOriginalSize(index), beginTime, cacheHit);
+		return block;
+	}
+	/*
+	* cacheHit表示块已解压（或正在由别的线程解压），不需要在当前线程解压。
+	*/
+	std::shared_ptr<std::array<uint8_t, nekofs_kNekoData_LZ4_Buffer_Size>> NekodataFile::getBlockInternal(int64_t index, bool& cacheHit)
 	{
 		bool needDecompress = false;
 		std::shared_ptr<std::array<uint8_t, nekofs_kNekoData_LZ4_Buffer_Size>> block = nullptr;
@@ -76,6 +102,7 @@ namespace nekofs {
 			}
 			else
 			{
+				cacheHit = true;
 				// 如果正在解压就等等
 				while (blocks_[index].first == BlockStatus::None)
 				{
@@ -91,16 +118,14 @@ namespace nekofs {
 		}
 		if (needDecompress)
 		{
+			NekodataPreloader::notifyForeground();
 			bool success = false;
-			auto ris = openRawIStream();
 			const auto& blocks = meta_->getBlocks();
-			if (ris->seek(blocks[index].first, SeekOrigin::Begin) == blocks[index].first)
+			// 只打开这一块的数据，块不一定和前后的块相邻，按随机访问打开分卷
+			auto ris = fs_->openRawIStream(meta_->getBlockPos(index), blocks[index].second, AccessHint::Random);
+			if (ris)
 			{
-				int32_t originalSize = nekofs_kNekoData_LZ4_Buffer_Size;
-				if (blocks.size() == index + 1)
-				{
-					originalSize = static_cast<int32_t>(getFileSize() - nekofs_kNekoData_LZ4_Buffer_Size * index);
-				}
+				const int32_t originalSize = meta_->getBlockOriginalSize(index);
 				auto buffer = env::getInstance().newBufferCompressSize();
 
 				if (istream_read(ris, buffer->data(), blocks[index].second) == blocks[index].second)
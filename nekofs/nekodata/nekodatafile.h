@@ -25,6 +25,7 @@ namespace nekofs {
 			Error
 		};
 		friend class NekodataIStream;
+		friend class NekodataPreloader;
 		NekodataFile(const NekodataFile&) = delete;
 		NekodataFile(NekodataFile&&) = delete;
 		NekodataFile& operator=(const NekodataFile&) = delete;
@@ -32,13 +33,14 @@ namespace nekofs {
 	public:
 		NekodataFile(std::shared_ptr<NekodataFileSystem> fs, const std::string& filepath, const NekodataFileMeta* meta);
 		std::shared_ptr<IStream> openIStream();
-		std::shared_ptr<IStream> openRawIStream();
+		std::shared_ptr<IStream> openRawIStream(AccessHint hint = AccessHint::Auto);
 		const std::string& getFilePath() const;
 		int64_t getFileSize() const;
 		int64_t getFileCompressedSize() const;
 
 	private:
 		std::shared_ptr<std::array<uint8_t, nekofs_kNekoData_LZ4_Buffer_Size>> getBlock(int64_t index);
+		std::shared_ptr<std::array<uint8_t, nekofs_kNekoData_LZ4_Buffer_Size>> getBlockInternal(int64_t index, bool& cacheHit);
 
 	private:
 		std::shared_ptr<NekodataFileSystem> fs_;
@@ -1,4 +1,7 @@
 ﻿#include "nekodatafilemeta.h"
+#include "../common/lz4.h"
+
+#include <algorithm>
 
 namespace nekofs {
 	void NekodataFileMeta::setBeginPos(int64_t beginPos)
@@ -38,8 +41,92 @@ namespace nekofs {
 		blocks_.push_back(std::pair<int64_t, int32_t>(compressedSize_, blockSize));
 		compressedSize_ += blockSize;
 	}
+	void NekodataFileMeta::addBlock(int32_t blockSize, int32_t originalBlockSize)
+	{
+		const int64_t blockNum = static_cast<int64_t>(blocks_.size());
+		if (blockOriginalPos_.empty() && blocksOriginalSize_ != blockNum * nekofs_kNekoData_LZ4_Buffer_Size)
+		{
+			// 之前的最后一块不完整却不是最后一块，转为记录每块的位置，之前的块都是固定大小
+			for (int64_t i = 0; i < blockNum; i++)
+			{
+				blockOriginalPos_.push_back(i * nekofs_kNekoData_LZ4_Buffer_Size);
+			}
+		}
+		if (!blockOriginalPos_.empty())
+		{
+			blockOriginalPos_.push_back(blocksOriginalSize_);
+		}
+		blocksOriginalSize_ += originalBlockSize;
+		addBlock(blockSize);
+	}
 	const std::vector<std::pair<int64_t, int32_t>>& NekodataFileMeta::getBlocks() const
 	{
 		return blocks_;
 	}
+	bool NekodataFileMeta::isVariableBlocks() const
+	{
+		return !blockOriginalPos_.empty();
+	}
+	int64_t NekodataFileMeta::getBlockIndex(int64_t originalPos) const
+	{
+		if (blockOriginalPos_.empty())
+		{
+			return originalPos / nekofs_kNekoData_LZ4_Buffer_Size;
+		}
+		return static_cast<int64_t>(std::upper_bound(blockOriginalPos_.begin(), blockOriginalPos_.end(), originalPos) - blockOriginalPos_.begin()) - 1;
+	}
+	int64_t NekodataFileMeta::getBlockOriginalPos(int64_t index) const
+	{
+		if (blockOriginalPos_.empty())
+		{
+			return index * nekofs_kNekoData_LZ4_Buffer_Size;
+		}
+		return blockOriginalPos_[static_cast<size_t>(index)];
+	}
+	int32_t NekodataFileMeta::getBlockOriginalSize(int64_t index) const
+	{
+		const int64_t beginPos = getBlockOriginalPos(index);
+		int64_t endPos = originalSize_;
+		if (index + 1 < static_cast<int64_t>(blocks_.size()))
+		{
+			endPos = getBlockOriginalPos(index + 1);
+		}
+		return static_cast<int32_t>(std::min<int64_t>(endPos - beginPos, nekofs_kNekoData_LZ4_Buffer_Size));
+	}
+	void NekodataFileMeta::addBlockAt(int64_t pos, int32_t blockSize, int32_t originalBlockSize)
+	{
+		if (blockPos_.empty() && pos != beginPos_ + compressedSize_)
+		{
+			// 不再连续，转为记录每块的位置
+			for (const auto& block : blocks_)
+			{
+				blockPos_.push_back(beginPos_ + block.first);
+			}
+			blockPos_.push_back(pos);
+		}
+		else if (!blockPos_.empty())
+		{
+			blockPos_.push_back(pos);
+		}
+		addBlock(blockSize, originalBlockSize);
+	}
+	bool NekodataFileMeta::hasBlockPositions() const
+	{
+		return !blockPos_.empty();
+	}
+	int64_t NekodataFileMeta::getBlockPos(int64_t index) const
+	{
+		if (blockPos_.empty())
+		{
+			return beginPos_ + blocks_[static_cast<size_t>(index)].first;
+		}
+		return blockPos_[static_cast<size_t>(index)];
+	}
+	/*
+	* 块的数据已按顺序连续写到beginPos处。
+	*/
+	void NekodataFileMeta::clearBlockPositions()
+	{
+		blockPos_.clear();
+	}
 }
@@ -19,7 +19,22 @@ namespace nekofs {
 		void setOriginalSize(int64_t originalSize);
 		int64_t getOriginalSize() const;
 		void addBlock(int32_t blockSize);
+		/*
+		* 解压后大小可变的块（按内容分块）。所有块都是完整块（只有最后一块较小）时仍按固定大小保存。
+		*/
+		void addBlock(int32_t blockSize, int32_t originalBlockSize);
 		const std::vector<std::pair<int64_t, int32_t>>& getBlocks() const;
+		bool isVariableBlocks() const;
+		int64_t getBlockIndex(int64_t originalPos) const;
+		int64_t getBlockOriginalPos(int64_t index) const;
+		int32_t getBlockOriginalSize(int64_t index) const;
+		/*
+		* 块写在数据区的指定位置（块去重时引用之前已写入的块）。与前面的块连续时仍按连续的块保存。
+		*/
+		void addBlockAt(int64_t pos, int32_t blockSize, int32_t originalBlockSize);
+		bool hasBlockPositions() const;
+		int64_t getBlockPos(int64_t index) const;
+		void clearBlockPositions();
 
 	private:
 		std::array<uint32_t, 8> sha256_ = {};
@@ -27,5 +42,8 @@ namespace nekofs {
 		int64_t compressedSize_ = 0;
 		int64_t originalSize_ = 0;
 		std::vector<std::pair<int64_t, int32_t>> blocks_;
+		std::vector<int64_t> blockOriginalPos_; // 只有可变大小的块才记录每块解压后的起始位置
+		int64_t blocksOriginalSize_ = 0;
+		std::vector<int64_t> blockPos_; // 只有不连续的块才记录每块在数据区中的位置
 	};
 }
@@ -1,20 +1,26 @@
 ﻿#include "nekodatafilesystem.h"
 #include "nekodataistream.h"
 #include "nekodatafile.h"
+#include "nekodatapreloader.h"
 #include "util.h"
 #include "../common/env.h"
 #include "../common/sha256.h"
 #include "../common/utils.h"
 #ifdef _WIN32
 #include "../native_win/nativefilesystem.h"
+#include "../native_win/nativefileistream.h"
 #else
 #include "../native_posix/nativefilesystem.h"
+#include "../native_posix/nativefileistream.h"
 #endif
 
 #include <sstream>
 #include <functional>
+#include <algorithm>
 
 namespace nekofs {
+	constexpr int64_t kVerifyBatchFileSize = 64 * 1024; // 不超过这个大小的文件放在一起用多路sha256校验
+
 	NekodataFileSystem::NekodataFileSystem(std::vector<std::shared_ptr<IStream>> v_is, int64_t volumeSize)
 	{
 		v_is_ = v_is;
@@ -68,6 +74,10 @@ namespace nekofs {
 	{
 		return FileSystemType::Nekodata;
 	}
+	std::shared_ptr<Prefetch> NekodataFileSystem::prefetch(const std::vector<std::string>& filepaths, int32_t priority, bool decompress)
+	{
+		return NekodataPreloader::prefetch(shared_from_this(), filepaths, priority, decompress);
+	}
 	std::shared_ptr<NekodataFileSystem> NekodataFileSystem::create(std::shared_ptr<FileSystem> fs, const std::string& filepath)
 	{
 		if (filepath.size() < nekofs_kNekodata_FileExtension.size() + 1)
@@ -143,24 +153,70 @@ namespace nekofs {
 		auto nekodatafs = std::shared_ptr<NekodataFileSystem>(new NekodataFileSystem(v_is, volumeSize));
 		if (nekodatafs->init())
 		{
+			if (fs->getFSType() == FileSystemType::Nekodata)
+			{
+				nekodatafs->tracePrefix_ = std::static_pointer_cast<NekodataFileSystem>(fs)->tracePrefix_ + filepath.substr(0, filepath.size() - nekofs_kNekodata_FileExtension.size()) + nekofs_PathSeparator;
+			}
 			return nekodatafs;
 		}
 		return nullptr;
 	}
+	/*
+	* 小文件先读到同一块缓冲区里，攒满后用sha256batch一起校验。
+	*/
 	bool NekodataFileSystem::verify()
 	{
+		auto buffer = env::getInstance().newBuffer4M();
+		sha256batch batch;
+		std::vector<std::array<uint32_t, 8>> expected;
+		size_t used = 0;
+		auto verifyBatch = [&batch, &expected, &used]() {
+			batch.compute();
+			for (size_t i = 0; i < expected.size(); i++)
+			{
+				if (batch.readHash(i) != expected[i])
+				{
+					return false;
+				}
+			}
+			batch.clear();
+			expected.clear();
+			used = 0;
+			return true;
+		};
 		for (const auto& item : rawFiles_)
 		{
 			if (item.second.second.getOriginalSize() > 0)
 			{
 				auto file = openFileInternal(item.first);
-				if (!file || !verifySHA256(file->openRawIStream(), item.second.second.getSHA256()))
+				auto is = file ? file->openRawIStream(AccessHint::Sequential) : nullptr;
+				if (!is)
+				{
+					return false;
+				}
+				const int64_t length = is->getLength();
+				if (length > kVerifyBatchFileSize)
+				{
+					if (!verifySHA256(is, item.second.second.getSHA256()))
+					{
+						return false;
+					}
+					continue;
+				}
+				if (used + static_cast<size_t>(length) > buffer->size() && !verifyBatch())
+				{
+					return false;
+				}
+				if (istream_read(is, buffer->data() + used, static_cast<int32_t>(length)) != length)
 				{
 					return false;
 				}
+				batch.add(buffer->data() + used, static_cast<size_t>(length));
+				expected.push_back(item.second.second.getSHA256());
+				used += static_cast<size_t>(length);
 			}
 		}
-		return true;
+		return verifyBatch();
 	}
 	int64_t NekodataFileSystem::getVolumeSzie() const
 	{
@@ -170,12 +226,29 @@ namespace nekofs {
 	{
 		return volumeSize_ - nekofs_kNekodata_VolumeFormatSize;
 	}
-	std::shared_ptr<IStream> NekodataFileSystem::openRawIStream(const std::string& filepath)
+	size_t NekodataFileSystem::getVolumeNum() const
+	{
+		return v_is_.size();
+	}
+	/*
+	* 所有分卷数据部分的总长度，包含末尾的目录。
+	*/
+	int64_t NekodataFileSystem::getDataLength() const
+	{
+		if (v_is_.empty())
+		{
+			return 0;
+		}
+		int64_t totalSize = (v_is_.size() - 1) * (volumeSize_ - nekofs_kNekodata_VolumeFormatSize);
+		totalSize += (v_is_.back()->getLength() - nekofs_kNekodata_VolumeFormatSize);
+		return totalSize;
+	}
+	std::shared_ptr<IStream> NekodataFileSystem::openRawIStream(const std::string& filepath, AccessHint hint)
 	{
 		auto file = openFileInternal(filepath);
 		if (file)
 		{
-			return file->openRawIStream();
+			return file->openRawIStream(hint);
 		}
 		return nullptr;
 	}
@@ -195,9 +268,7 @@ namespace nekofs {
 			return false;
 		}
 		bool success = true;
-		int64_t totalSize = (v_is_.size() - 1) * (volumeSize_ - nekofs_kNekodata_VolumeFormatSize);
-		totalSize += (v_is_.back()->getLength() - nekofs_kNekodata_VolumeFormatSize);
-		auto ris = openRawIStream(0, totalSize);
+		auto ris = openRawIStream(0, getDataLength());
 		int64_t endPos = ris->seek(-8, SeekOrigin::End);
 		success = success && endPos >= 0;
 		int64_t beginPos;
@@ -228,13 +299,56 @@ namespace nekofs {
 				meta.setBeginPos(fileBeginPos);
 				int64_t blockNum;
 				success = success && nekodata_readBlockNum(ris, blockNum);
-				for (int64_t i = 0; success && i < blockNum; i++)
+				uint32_t firstValue = 0;
+				if (success && blockNum > 0)
+				{
+					success = nekodata_readUint32(ris, firstValue);
+				}
+				if (success && blockNum > 0 && firstValue == 0)
 				{
-					int32_t blockSize;
-					success = success && nekodata_readBlockSize(ris, blockSize);
-					if (success)
+					// 扩展的块信息，标记位之后每块依次是压缩后大小、解压后大小、数据位置
+					uint32_t blockFlags = 0;
+					success = success && nekodata_readUint32(ris, blockFlags);
+					success = success && blockFlags != 0 && (blockFlags & ~(nekofs_kNekodata_BlockFlag_OriginalSize | nekofs_kNekodata_BlockFlag_Position)) == 0;
+					int64_t blocksOriginalSize = 0;
+					for (int64_t i = 0; success && i < blockNum; i++)
 					{
-						meta.addBlock(blockSize);
+						int32_t blockSize;
+						int32_t originalBlockSize = static_cast<int32_t>(std::min<int64_t>(originalSize - blocksOriginalSize, nekofs_kNekoData_LZ4_Buffer_Size));
+						int64_t blockPos = fileBeginPos + meta.getCompressedSize();
+						success = success && nekodata_readBlockSize(ris, blockSize);
+						if (blockFlags & nekofs_kNekodata_BlockFlag_OriginalSize)
+						{
+							success = success && nekodata_readBlockSize(ris, originalBlockSize);
+						}
+						if (blockFlags & nekofs_kNekodata_BlockFlag_Position)
+						{
+							success = success && nekodata_readPosition(ris, blockPos);
+						}
+						success = success && originalBlockSize > 0 && originalBlockSize <= nekofs_kNekoData_LZ4_Buffer_Size;
+						success = success && blockSize > 0 && blockPos + blockSize <= beginPos;
+						if (success)
+						{
+							meta.addBlockAt(blockPos, blockSize, originalBlockSize);
+							blocksOriginalSize += originalBlockSize;
+						}
+					}
+					success = success && blocksOriginalSize == originalSize;
+				}
+				else
+				{
+					for (int64_t i = 0; success && i < blockNum; i++)
+					{
+						int32_t blockSize = static_cast<int32_t>(firstValue);
+						if (i > 0)
+						{
+							success = success && nekodata_readBlockSize(ris, blockSize);
+						}
+						success = success && blockSize > 0;
+						if (success)
+						{
+							meta.addBlock(blockSize);
+						}
 					}
 				}
 				success = success && nekodata_readSHA256(ris, sha256);
@@ -258,13 +372,34 @@ namespace nekofs {
 
 		return success;
 	}
-	std::shared_ptr<IStream> NekodataFileSystem::getVolumeIStream(size_t index)
+	void NekodataFileSystem::setTracePrefix(const std::string& prefix)
+	{
+		tracePrefix_ = prefix;
+	}
+	const std::string& NekodataFileSystem::getTracePrefix() const
+	{
+		return tracePrefix_;
+	}
+	std::shared_ptr<IStream> NekodataFileSystem::getVolumeIStream(size_t index, AccessHint hint, int64_t readaheadEnd)
 	{
-		return v_is_[index]->createNew();
+		auto nis = std::dynamic_pointer_cast<NativeIStream>(v_is_[index]);
+		if (!nis)
+		{
+			return v_is_[index]->createNew();
+		}
+		auto is = AccessHint::Auto == hint ? std::static_pointer_cast<NativeIStream>(nis->createNew()) : nis->createNew(hint);
+#ifndef _WIN32
+		// 顺序读取的预读不超过数据流的末尾，分卷中后面的数据属于别的文件
+		if (is)
+		{
+			is->setReadaheadLimit(readaheadEnd);
+		}
+#endif
+		return is;
 	}
-	std::shared_ptr<NekodataRawIStream> NekodataFileSystem::openRawIStream(int64_t beginPos, int64_t length)
+	std::shared_ptr<NekodataRawIStream> NekodataFileSystem::openRawIStream(int64_t beginPos, int64_t length, AccessHint hint)
 	{
-		return std::make_shared<NekodataRawIStream>(shared_from_this(), beginPos, length);
+		return std::make_shared<NekodataRawIStream>(shared_from_this(), beginPos, length, hint);
 	}
 	void NekodataFileSystem::weakDeleteCallback(std::weak_ptr<NekodataFileSystem> filesystem, NekodataFile* file)
 	{
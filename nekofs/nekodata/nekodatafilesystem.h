@@ -14,11 +14,14 @@
 namespace nekofs {
 	class NekodataFile;
 	class NekodataRawIStream;
+	class NekodataBlocksIStream;
 
 	class NekodataFileSystem final : public FileSystem, public std::enable_shared_from_this<NekodataFileSystem>
 	{
 		friend class NekodataFile;
 		friend class NekodataRawIStream;
+		friend class NekodataBlocksIStream;
+		friend class NekodataPreloader;
 		NekodataFileSystem(const NekodataFileSystem&) = delete;
 		NekodataFileSystem(NekodataFileSystem&&) = delete;
 		NekodataFileSystem& operator=(const NekodataFileSystem&) = delete;
@@ -33,19 +36,29 @@ namespace nekofs {
 		FileType getFileType(const std::string& path) const override;
 		int64_t getSize(const std::string& filepath) const override;
 		FileSystemType getFSType() const override;
+		std::shared_ptr<Prefetch> prefetch(const std::vector<std::string>& filepaths, int32_t priority, bool decompress) override;
 
 	public:
 		static std::shared_ptr<NekodataFileSystem> create(std::shared_ptr<FileSystem> fs, const std::string& filepath);
 		bool verify();
 		int64_t getVolumeSzie() const;
 		int64_t getVolumeDataSzie() const;
-		std::shared_ptr<IStream> openRawIStream(const std::string& filepath);
+		size_t getVolumeNum() const;
+		int64_t getDataLength() const;
+		std::shared_ptr<IStream> openRawIStream(const std::string& filepath, AccessHint hint = AccessHint::Auto);
 		std::optional<NekodataFileMeta> getFileMeta(const std::string& filepath) const;
+		/*
+		* 访问记录中块的路径前缀，与overlay中的路径对应，子archive中的文件以子archive去掉扩展名的路径为前缀。
+		* 从NekodataFileSystem中打开的子archive默认为父archive的前缀加上这一级的前缀。
+		*/
+		void setTracePrefix(const std::string& prefix);
+		const std::string& getTracePrefix() const;
 
 	private:
 		bool init();
-		std::shared_ptr<IStream> getVolumeIStream(size_t index);
-		std::shared_ptr<NekodataRawIStream> openRawIStream(int64_t beginPos, int64_t length);
+		// hint不是Auto时分卷按hint打开，每个流只读少量数据时自动判断不准。readaheadEnd为分卷中预读不超过的位置
+		std::shared_ptr<IStream> getVolumeIStream(size_t index, AccessHint hint, int64_t readaheadEnd);
+		std::shared_ptr<NekodataRawIStream> openRawIStream(int64_t beginPos, int64_t length, AccessHint hint = AccessHint::Auto);
 		static void weakDeleteCallback(std::weak_ptr<NekodataFileSystem> filesystem, NekodataFile* file);
 		std::shared_ptr<NekodataFile> openFileInternal(const std::string& filepath);
 		void closeFileInternal(const std::string& filepath);
@@ -55,6 +68,7 @@ namespace nekofs {
 		int64_t volumeSize_;
 		std::map<std::string, std::pair<NekodataFile*, NekodataFileMeta>> rawFiles_;
 		std::map<std::string, std::weak_ptr<NekodataFile>> files_;
+		std::string tracePrefix_;
 		std::mutex mtx_;
 	};
 }
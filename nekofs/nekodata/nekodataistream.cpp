@@ -1,17 +1,20 @@
 ﻿#include "nekodataistream.h"
 #include "nekodatafilesystem.h"
 #include "nekodatafile.h"
+#include "nekodatafilemeta.h"
 #include "../common/env.h"
 #include "../common/utils.h"
 
 #include <sstream>
+#include <algorithm>
 
 namespace nekofs {
-	NekodataRawIStream::NekodataRawIStream(std::shared_ptr<NekodataFileSystem> fs, int64_t beginPos, int64_t length)
+	NekodataRawIStream::NekodataRawIStream(std::shared_ptr<NekodataFileSystem> fs, int64_t beginPos, int64_t length, AccessHint hint)
 	{
 		fs_ = fs;
 		beginPos_ = beginPos;
 		length_ = length;
+		hint_ = hint;
 	}
 	std::shared_ptr<IStream> NekodataRawIStream::prepare()
 	{
@@ -21,7 +24,8 @@ namespace nekofs {
 			// 计算出在哪个分卷
 			int64_t index = (beginPos_ + position_) / fs_->getVolumeDataSzie();
 			// 获取分卷IStream
-			is_ = fs_->getVolumeIStream(static_cast<size_t>(index));
+			const int64_t readaheadEnd = beginPos_ + length_ - index * fs_->getVolumeDataSzie() + nekofs_kNekodata_FileHeaderSize;
+			is_ = fs_->getVolumeIStream(static_cast<size_t>(index), hint_, readaheadEnd);
 
 			// 计算分卷包含数据的区间
 			voldataRange.first = index * fs_->getVolumeDataSzie();
@@ -123,10 +127,133 @@ namespace nekofs {
 	}
 	std::shared_ptr<IStream> NekodataRawIStream::createNew()
 	{
-		return fs_->openRawIStream(beginPos_, length_);
+		return fs_->openRawIStream(beginPos_, length_, hint_);
+	}
+	/*
+	* 当前分卷内剩余的数据区间。分卷本身也可能在另一个nekodata中，逐层找到本地文件。
+	*/
+	std::shared_ptr<NativeIStream> NekodataRawIStream::getNativeRange(int64_t& size)
+	{
+		size = 0;
+		if (position_ == length_)
+		{
+			return nullptr;
+		}
+		auto source = std::dynamic_pointer_cast<NativeCopySource>(prepare());
+		if (!source)
+		{
+			return nullptr;
+		}
+		int64_t volumeSize = 0;
+		auto is = source->getNativeRange(volumeSize);
+		size = std::min(volumeSize, std::min(length_ - position_, voldataRange.second - (beginPos_ + position_)));
+		return is;
 	}
 
 
+	NekodataBlocksIStream::NekodataBlocksIStream(std::shared_ptr<NekodataFileSystem> fs, const NekodataFileMeta* meta, AccessHint hint)
+	{
+		fs_ = fs;
+		meta_ = meta;
+		hint_ = hint;
+	}
+	std::shared_ptr<IStream> NekodataBlocksIStream::prepare()
+	{
+		bool need = is_ == nullptr || blockBeginPos_ > position_ || blockEndPos_ <= position_;
+		if (need)
+		{
+			// 找到position所在的块，块按数据流中的偏移排列
+			const auto& blocks = meta_->getBlocks();
+			auto it = std::upper_bound(blocks.begin(), blocks.end(), position_, [](int64_t pos, const std::pair<int64_t, int32_t>& block) { return pos < block.first; });
+			const int64_t index = static_cast<int64_t>(it - blocks.begin()) - 1;
+			blockBeginPos_ = blocks[static_cast<size_t>(index)].first;
+			blockEndPos_ = blockBeginPos_ + blocks[static_cast<size_t>(index)].second;
+			is_ = fs_->openRawIStream(meta_->getBlockPos(index), blocks[static_cast<size_t>(index)].second, hint_);
+		}
+		const int64_t offset = position_ - blockBeginPos_;
+		if (is_->getPosition() != offset && is_->seek(offset, SeekOrigin::Begin) != offset)
+		{
+			is_.reset();
+		}
+		return is_;
+	}
+	int32_t NekodataBlocksIStream::read(void* buf, int32_t size)
+	{
+		if (size < 0)
+		{
+			return -1;
+		}
+		if (position_ == getLength() || size == 0)
+		{
+			return 0;
+		}
+		if (!prepare())
+		{
+			return -1;
+		}
+		// 每次最多读到当前块的末尾
+		size = static_cast<int32_t>(std::min<int64_t>(size, blockEndPos_ - position_));
+		int32_t actulRead = is_->read(buf, size);
+		if (actulRead > 0)
+		{
+			position_ += actulRead;
+		}
+		return actulRead;
+	}
+	int64_t NekodataBlocksIStream::seek(int64_t offset, const SeekOrigin& origin)
+	{
+		bool success = true;
+		const int64_t length = getLength();
+		switch (origin)
+		{
+		case SeekOrigin::Begin:
+			success = offset >= 0 && offset <= length;
+			if (success)
+			{
+				position_ = offset;
+			}
+			break;
+		case SeekOrigin::Current:
+			success = offset + position_ >= 0 && offset + position_ <= length;
+			if (success)
+			{
+				position_ = offset + position_;
+			}
+			break;
+		case SeekOrigin::End:
+			success = offset <= 0 && offset + length >= 0;
+			if (success)
+			{
+				position_ = offset + length;
+			}
+			break;
+		}
+		if (!success)
+		{
+			std::stringstream ss;
+			ss << u8"NekodataBlocksIStream::seek error ! offset = ";
+			ss << offset;
+			ss << u8", origin = ";
+			ss << static_cast<int32_t>(origin);
+			ss << u8", position = ";
+			ss << position_;
+			logerr(ss.str());
+			return -1;
+		}
+		return position_;
+	}
+	int64_t NekodataBlocksIStream::getPosition() const
+	{
+		return position_;
+	}
+	int64_t NekodataBlocksIStream::getLength() const
+	{
+		return meta_->getCompressedSize();
+	}
+	std::shared_ptr<IStream> NekodataBlocksIStream::createNew()
+	{
+		return std::make_shared<NekodataBlocksIStream>(fs_, meta_, hint_);
+	}
 	NekodataIStream::NekodataIStream(std::shared_ptr<NekodataFile> file)
 	{
 		file_ = file;
@@ -137,11 +264,11 @@ namespace nekofs {
 		if (need)
 		{
 			// 计算压缩块索引
-			int64_t index = position_ / nekofs_kNekoData_LZ4_Buffer_Size;
+			int64_t index = file_->meta_->getBlockIndex(position_);
 			// 获取解压后的块
 			block_ = file_->getBlock(index);
-			blockBeginPos_ = index * nekofs_kNekoData_LZ4_Buffer_Size;
-			blockEndPos_ = std::min(file_->getFileSize(), nekofs_kNekoData_LZ4_Buffer_Size + blockBeginPos_);
+			blockBeginPos_ = file_->meta_->getBlockOriginalPos(index);
+			blockEndPos_ = blockBeginPos_ + file_->meta_->getBlockOriginalSize(index);
 		}
 		return block_;
 	}
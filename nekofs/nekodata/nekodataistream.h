@@ -12,18 +12,19 @@
 namespace nekofs {
 	class NekodataFileSystem;
 	class NekodataFile;
+	class NekodataFileMeta;
 
 	/*
 	* nekodata读数据流。不包含分卷的头尾信息。
 	*/
-	class NekodataRawIStream final : public IStream, public std::enable_shared_from_this<NekodataRawIStream>
+	class NekodataRawIStream final : public IStream, public NativeCopySource, public std::enable_shared_from_this<NekodataRawIStream>
 	{
 		NekodataRawIStream(const NekodataRawIStream&) = delete;
 		NekodataRawIStream(NekodataRawIStream&&) = delete;
 		NekodataRawIStream& operator=(const NekodataRawIStream&) = delete;
 		NekodataRawIStream& operator=(NekodataRawIStream&&) = delete;
 	public:
-		NekodataRawIStream(std::shared_ptr<NekodataFileSystem> fs, int64_t beginPos, int64_t length);
+		NekodataRawIStream(std::shared_ptr<NekodataFileSystem> fs, int64_t beginPos, int64_t length, AccessHint hint = AccessHint::Auto);
 	private:
 		std::shared_ptr<IStream> prepare();
 
@@ -33,6 +34,7 @@ namespace nekofs {
 		int64_t getPosition() const override;
 		int64_t getLength() const override;
 		std::shared_ptr<IStream> createNew() override;
+		std::shared_ptr<NativeIStream> getNativeRange(int64_t& size) override;
 
 	private:
 		std::shared_ptr<NekodataFileSystem> fs_;
@@ -41,6 +43,38 @@ namespace nekofs {
 		int64_t beginPos_ = 0;   // 数据流的起始位置
 		int64_t length_ = 0;     // 数据流的长度
 		int64_t position_ = 0;   // 相对数据流的起始位置的偏移
+		AccessHint hint_ = AccessHint::Auto; // 打开分卷流的访问方式
+	};
+
+	/*
+	* nekodata读数据流。块分散在数据区中（块去重后引用其他位置的块），按块的顺序拼成连续的压缩数据。
+	*/
+	class NekodataBlocksIStream final : public IStream, public std::enable_shared_from_this<NekodataBlocksIStream>
+	{
+		NekodataBlocksIStream(const NekodataBlocksIStream&) = delete;
+		NekodataBlocksIStream(NekodataBlocksIStream&&) = delete;
+		NekodataBlocksIStream& operator=(const NekodataBlocksIStream&) = delete;
+		NekodataBlocksIStream& operator=(NekodataBlocksIStream&&) = delete;
+	public:
+		NekodataBlocksIStream(std::shared_ptr<NekodataFileSystem> fs, const NekodataFileMeta* meta, AccessHint hint = AccessHint::Auto);
+	private:
+		std::shared_ptr<IStream> prepare();
+
+	public:
+		int32_t read(void* buf, int32_t size) override;
+		int64_t seek(int64_t offset, const SeekOrigin& origin) override;
+		int64_t getPosition() const override;
+		int64_t getLength() const override;
+		std::shared_ptr<IStream> createNew() override;
+
+	private:
+		std::shared_ptr<NekodataFileSystem> fs_;
+		const NekodataFileMeta* meta_ = nullptr;
+		std::shared_ptr<IStream> is_; // 当前块的IStream
+		int64_t blockBeginPos_ = 0; // 当前块在数据流中的区间
+		int64_t blockEndPos_ = 0;
+		int64_t position_ = 0;
+		AccessHint hint_ = AccessHint::Auto; // 打开每块的流的访问方式
 	};
 
 	/*
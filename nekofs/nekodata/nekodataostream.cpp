@@ -1,7 +1,15 @@
 ﻿#include "nekodataostream.h"
 #include "nekodataarchiver.h"
+#include "../common/env.h"
 #include "../common/utils.h"
+#include "../common/sha256.h"
+#ifdef _WIN32
+#include "../native_win/nativefileostream.h"
+#else
+#include "../native_posix/nativefileostream.h"
+#endif
 
+#include <cstring>
 #include <sstream>
 
 namespace nekofs {
@@ -10,6 +18,38 @@ namespace nekofs {
 		archiver_ = archiver;
 		volumeSize_ = volumeSize;
 	}
+	NekodataOStream::~NekodataOStream()
+	{
+	}
+	void NekodataOStream::beginHash()
+	{
+		hash_ = std::make_unique<sha256sum>();
+		hashPos_ = position_;
+		hashBroken_ = false;
+	}
+	bool NekodataOStream::endHash(std::array<uint32_t, 8>& sha256)
+	{
+		if (!hash_)
+		{
+			return false;
+		}
+		bool success = !hashBroken_ && hashPos_ == length_;
+		if (success)
+		{
+			hash_->final();
+			sha256 = hash_->readHash();
+		}
+		hash_.reset();
+		return success;
+	}
+	/*
+	* 追加写入已有的nekodata，从已有数据的末尾开始写。
+	*/
+	void NekodataOStream::resume(int64_t length)
+	{
+		position_ = length;
+		length_ = length;
+	}
 	int32_t NekodataOStream::read(void* buf, int32_t size)
 	{
 		if (size < 0)
@@ -78,6 +118,19 @@ namespace nekofs {
 		int32_t writenum = os_->write(buf, size);
 		if (writenum > 0)
 		{
+			if (hash_)
+			{
+				// 只有紧接着已计算部分的追加写入才能累加到hash中
+				if (position_ == hashPos_)
+				{
+					hash_->update(buf, writenum);
+					hashPos_ += writenum;
+				}
+				else
+				{
+					hashBroken_ = true;
+				}
+			}
 			position_ += writenum;
 			length_ = std::max(length_, position_);
 		}
@@ -132,6 +185,31 @@ namespace nekofs {
 	{
 		return length_;
 	}
+	int64_t NekodataOStream::copyRange(std::shared_ptr<NativeIStream> is, int64_t size)
+	{
+		// 计算hash需要经过内存，不走内核拷贝
+		if (hash_ || size <= 0)
+		{
+			return 0;
+		}
+		prepareVolumeOStream();
+		if (!os_)
+		{
+			return 0;
+		}
+		int64_t needpos = position_ - os_->getVolDataBeginPos() + nekofs_kNekodata_FileHeaderSize;
+		if (needpos != os_->getPosition() && os_->seek(needpos, SeekOrigin::Begin) != needpos)
+		{
+			return 0;
+		}
+		int64_t copied = os_->copyRange(is, std::min(size, os_->getVolDataEndPos_max() - position_));
+		if (copied > 0)
+		{
+			position_ += copied;
+			length_ = std::max(length_, position_);
+		}
+		return copied;
+	}
 	std::shared_ptr<NekodataVolumeOStream> NekodataOStream::prepareVolumeOStream()
 	{
 		bool useCurrent = (os_ && position_ >= os_->getVolDataBeginPos() && position_ < os_->getVolDataEndPos_max());
@@ -149,6 +227,11 @@ namespace nekofs {
 		rawBeginPos_ = os->getPosition();
 		volumeSize_ = volumeSize;
 		voldataBeginPos_ = voldataBeginPos;
+		nativeOS_ = std::dynamic_pointer_cast<NativeOStream>(os);
+	}
+	NekodataVolumeOStream::~NekodataVolumeOStream()
+	{
+		finishParallelWrite();
 	}
 	int64_t NekodataVolumeOStream::getVolDataBeginPos() const
 	{
@@ -160,6 +243,17 @@ namespace nekofs {
 	}
 	bool NekodataVolumeOStream::fill()
 	{
+		// 本地文件直接扩展文件大小，补全的部分不占用写入。文件后面有旧数据时仍然写0
+		if (nativeOS_ && position_ < volumeSize_)
+		{
+			int64_t fileLength = nativeOS_->getLength();
+			if (fileLength >= 0 && fileLength <= rawBeginPos_ + position_ && nativeOS_->setLength(rawBeginPos_ + volumeSize_))
+			{
+				position_ = volumeSize_;
+				length_ = volumeSize_;
+				return parallelWrite_ || os_->seek(rawBeginPos_ + position_, SeekOrigin::Begin) >= 0;
+			}
+		}
 		std::shared_ptr<OStream> ptr = shared_from_this();
 		char buffer[8192] = { 0 };
 		for (int64_t roundnum = (volumeSize_ - position_) / 8192; roundnum > 0; roundnum--)
@@ -176,12 +270,164 @@ namespace nekofs {
 		}
 		return true;
 	}
+	/*
+	* 预先为整个分卷分配磁盘空间，减少碎片。失败不影响写入。
+	*/
+	bool NekodataVolumeOStream::preallocate()
+	{
+		return nativeOS_ && nativeOS_->allocate(rawBeginPos_ + volumeSize_);
+	}
+	/*
+	* 把文件大小截断为实际写入的长度，释放多分配的空间。
+	*/
+	bool NekodataVolumeOStream::truncate()
+	{
+		if (!nativeOS_)
+		{
+			return true;
+		}
+		return finishParallelWrite() && nativeOS_->setLength(rawBeginPos_ + length_);
+	}
+	bool NekodataVolumeOStream::sync()
+	{
+		if (!nativeOS_)
+		{
+			return true;
+		}
+		return nativeOS_->sync();
+	}
+	bool NekodataVolumeOStream::writeback()
+	{
+		return nativeOS_ && nativeOS_->writeback();
+	}
+	/*
+	* 重新打开已有的分卷，length是保留的长度（包含分卷头），之后从这里继续写。需要在开启并行写入前调用。
+	*/
+	bool NekodataVolumeOStream::resume(int64_t length)
+	{
+		if (parallelWrite_ || length < nekofs_kNekodata_FileHeaderSize || length > volumeSize_ || os_->seek(rawBeginPos_ + length, SeekOrigin::Begin) < 0)
+		{
+			std::stringstream ss;
+			ss << u8"NekodataVolumeOStream::resume error ! length = ";
+			ss << length;
+			logerr(ss.str());
+			return false;
+		}
+		position_ = length;
+		length_ = length;
+		return true;
+	}
+	bool NekodataVolumeOStream::enableParallelWrite()
+	{
+		if (parallelWrite_)
+		{
+			return true;
+		}
+		if (!nativeOS_)
+		{
+			return false;
+		}
+		parallelWrite_ = true;
+		stopWrite_ = false;
+		writeError_ = false;
+		writeThread_ = std::thread(&NekodataVolumeOStream::parallelWriteThread, this);
+		return true;
+	}
+	bool NekodataVolumeOStream::finishParallelWrite()
+	{
+		if (!parallelWrite_)
+		{
+			return true;
+		}
+		bool success = submitStaging();
+		{
+			std::lock_guard lock(mtx_pending_);
+			stopWrite_ = true;
+		}
+		cond_pending_.notify_all();
+		writeThread_.join();
+		success = success && !writeError_;
+		parallelWrite_ = false;
+		// 恢复同步写入，文件位置需要和position_一致
+		success = success && os_->seek(rawBeginPos_ + position_, SeekOrigin::Begin) >= 0;
+		return success;
+	}
+	/*
+	* 把缓冲区交给后台线程。队列满时等待，避免占用过多内存。
+	*/
+	bool NekodataVolumeOStream::submitStaging()
+	{
+		std::unique_lock lock(mtx_pending_);
+		if (!staging_)
+		{
+			return !writeError_;
+		}
+		while (pending_.size() >= 4 && !writeError_)
+		{
+			cond_pending_.wait(lock);
+		}
+		if (!writeError_)
+		{
+			PendingWrite item;
+			item.buffer = staging_;
+			item.size = stagingSize_;
+			item.offset = stagingOffset_;
+			pending_.push(item);
+		}
+		staging_.reset();
+		stagingSize_ = 0;
+		cond_pending_.notify_all();
+		return !writeError_;
+	}
+	void NekodataVolumeOStream::parallelWriteThread()
+	{
+		while (true)
+		{
+			PendingWrite item;
+			{
+				std::unique_lock lock(mtx_pending_);
+				while (pending_.empty() && !stopWrite_)
+				{
+					cond_pending_.wait(lock);
+				}
+				if (pending_.empty())
+				{
+					break;
+				}
+				item = pending_.front();
+				pending_.pop();
+			}
+			cond_pending_.notify_all();
+			int32_t written = 0;
+			while (written < item.size)
+			{
+				int32_t ret = nativeOS_->writeAt(item.buffer->data() + written, item.size - written, item.offset + written);
+				if (ret <= 0)
+				{
+					break;
+				}
+				written += ret;
+			}
+			if (written != item.size)
+			{
+				std::lock_guard lock(mtx_pending_);
+				writeError_ = true;
+				pending_ = std::queue<PendingWrite>();
+				cond_pending_.notify_all();
+				break;
+			}
+		}
+	}
 	int32_t NekodataVolumeOStream::read(void* buf, int32_t size)
 	{
 		if (size < 0)
 		{
 			return -1;
 		}
+		if (parallelWrite_ && !finishParallelWrite())
+		{
+			return -1;
+		}
 		if (position_ + size > length_)
 		{
 			size = static_cast<int32_t>(length_ - position_);
@@ -211,6 +457,36 @@ namespace nekofs {
 		{
 			return 0;
 		}
+		if (parallelWrite_)
+		{
+			if (staging_ && stagingOffset_ + stagingSize_ != rawBeginPos_ + position_ && !submitStaging())
+			{
+				return -1;
+			}
+			const uint8_t* data = static_cast<const uint8_t*>(buf);
+			int32_t remains = size;
+			while (remains > 0)
+			{
+				if (!staging_)
+				{
+					staging_ = env::getInstance().newBuffer4M();
+					stagingSize_ = 0;
+					stagingOffset_ = rawBeginPos_ + position_ + (size - remains);
+				}
+				int32_t count = std::min(remains, static_cast<int32_t>(staging_->size()) - stagingSize_);
+				::memcpy(staging_->data() + stagingSize_, data, count);
+				stagingSize_ += count;
+				data += count;
+				remains -= count;
+				if (stagingSize_ == static_cast<int32_t>(staging_->size()) && !submitStaging())
+				{
+					return -1;
+				}
+			}
+			position_ += size;
+			length_ = std::max(length_, position_);
+			return size;
+		}
 		int32_t writenum = os_->write(buf, size);
 		if (writenum > 0)
 		{
@@ -247,6 +523,11 @@ namespace nekofs {
 			}
 			break;
 		}
+		if (success && parallelWrite_ && !finishParallelWrite())
+		{
+			position_ = pos;
+			return -1;
+		}
 		if (!success)
 		{
 			std::stringstream ss;
@@ -269,6 +550,40 @@ namespace nekofs {
 		}
 		return position_;
 	}
+	/*
+	* 本地文件直接按偏移由内核拷贝，并行写入时先把缓冲区交给后台线程，两者写的区间不重叠。
+	*/
+	int64_t NekodataVolumeOStream::copyRange(std::shared_ptr<NativeIStream> is, int64_t size)
+	{
+		size = std::min(size, volumeSize_ - position_);
+		if (size <= 0)
+		{
+			return 0;
+		}
+		int64_t copied = 0;
+		if (nativeOS_)
+		{
+			if (parallelWrite_ && !submitStaging())
+			{
+				return -1;
+			}
+			copied = nativeOS_->copyAt(is, size, rawBeginPos_ + position_);
+			if (copied > 0 && !parallelWrite_ && os_->seek(rawBeginPos_ + position_ + copied, SeekOrigin::Begin) < 0)
+			{
+				return -1;
+			}
+		}
+		else if (auto target = std::dynamic_pointer_cast<NativeCopyTarget>(os_))
+		{
+			copied = target->copyRange(is, size);
+		}
+		if (copied > 0)
+		{
+			position_ += copied;
+			length_ = std::max(length_, position_);
+		}
+		return copied;
+	}
 	int64_t NekodataVolumeOStream::getPosition() const
 	{
 		return position_;
@@ -277,4 +592,57 @@ namespace nekofs {
 	{
 		return length_;
 	}
+
+
+	NekodataSinkOStream::NekodataSinkOStream(std::function<int32_t(const void*, int32_t)> writer)
+	{
+		writer_ = writer;
+	}
+	int32_t NekodataSinkOStream::read(void* buf, int32_t size)
+	{
+		logerr(u8"NekodataSinkOStream::read not supported !");
+		return -1;
+	}
+	int32_t NekodataSinkOStream::write(const void* buf, int32_t size)
+	{
+		if (size < 0)
+		{
+			return -1;
+		}
+		if (size == 0)
+		{
+			return 0;
+		}
+		int32_t writenum = writer_(buf, size);
+		if (writenum > 0)
+		{
+			position_ += writenum;
+		}
+		return writenum;
+	}
+	int64_t NekodataSinkOStream::seek(int64_t offset, const SeekOrigin& origin)
+	{
+		// 只允许原地seek
+		if ((origin == SeekOrigin::Begin && offset == position_) || (origin != SeekOrigin::Begin && offset == 0))
+		{
+			return position_;
+		}
+		std::stringstream ss;
+		ss << u8"NekodataSinkOStream::seek not supported ! offset = ";
+		ss << offset;
+		ss << u8", origin = ";
+		ss << static_cast<int32_t>(origin);
+		ss << u8", position = ";
+		ss << position_;
+		logerr(ss.str());
+		return -1;
+	}
+	int64_t NekodataSinkOStream::getPosition() const
+	{
+		return position_;
+	}
+	int64_t NekodataSinkOStream::getLength() const
+	{
+		return position_;
+	}
 }
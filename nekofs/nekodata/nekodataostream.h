@@ -3,14 +3,22 @@
 #include "../common/typedef.h"
 
 #include <cstdint>
+#include <array>
 #include <string>
 #include <memory>
 #include <map>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
 
 namespace nekofs {
 	class NekodataArchiver;
+	class NativeOStream;
+	class sha256sum;
 
-	class NekodataVolumeOStream final : public OStream, public std::enable_shared_from_this<NekodataVolumeOStream>
+	class NekodataVolumeOStream final : public OStream, public NativeCopyTarget, public std::enable_shared_from_this<NekodataVolumeOStream>
 	{
 		NekodataVolumeOStream(const NekodataVolumeOStream&) = delete;
 		NekodataVolumeOStream& operator=(const NekodataVolumeOStream&) = delete;
@@ -18,9 +26,22 @@ namespace nekofs {
 		NekodataVolumeOStream& operator=(NekodataVolumeOStream&&) = delete;
 	public:
 		NekodataVolumeOStream(std::shared_ptr<OStream> os, int64_t volumeSize, int64_t voldataBeginPos);
+		~NekodataVolumeOStream();
 		int64_t getVolDataBeginPos() const;
 		int64_t getVolDataEndPos_max() const;
 		bool fill();
+		bool preallocate();
+		bool truncate();
+		bool sync();
+		bool writeback();
+		bool resume(int64_t length);
+		/*
+		* 并行写入模式。写入的数据先合并到4M的缓冲区，再由后台线程按预先算好的偏移写入分卷文件，
+		* 这样上一个分卷还在落盘时，就可以继续写下一个分卷。
+		* 只支持本地文件。finishParallelWrite会等待数据全部写完，之后恢复为同步写入。
+		*/
+		bool enableParallelWrite();
+		bool finishParallelWrite();
 
 	public:
 		int32_t read(void* buf, int32_t size) override;
@@ -28,6 +49,7 @@ namespace nekofs {
 		int64_t seek(int64_t offset, const SeekOrigin& origin) override;
 		int64_t getPosition() const override;
 		int64_t getLength() const override;
+		int64_t copyRange(std::shared_ptr<NativeIStream> is, int64_t size) override;
 
 	private:
 		std::shared_ptr<OStream> os_;
@@ -36,12 +58,33 @@ namespace nekofs {
 		int64_t position_ = 0;
 		int64_t length_ = 0;
 		int64_t rawBeginPos_ = 0;
+
+	private:
+		struct PendingWrite final
+		{
+			std::shared_ptr<std::array<uint8_t, 4 * 1024 * 1024>> buffer;
+			int32_t size = 0;
+			int64_t offset = 0;
+		};
+		bool submitStaging();
+		void parallelWriteThread();
+		std::shared_ptr<NativeOStream> nativeOS_;
+		bool parallelWrite_ = false;
+		std::shared_ptr<std::array<uint8_t, 4 * 1024 * 1024>> staging_;
+		int32_t stagingSize_ = 0;
+		int64_t stagingOffset_ = 0;
+		std::queue<PendingWrite> pending_;
+		bool stopWrite_ = false;
+		bool writeError_ = false;
+		std::mutex mtx_pending_;
+		std::condition_variable cond_pending_;
+		std::thread writeThread_;
 	};
 
 	/*
 	* nekodata写数据流。不包含分卷的头尾信息。
 	*/
-	class NekodataOStream final : public OStream, public std::enable_shared_from_this<NekodataOStream>
+	class NekodataOStream final : public OStream, public NativeCopyTarget, public std::enable_shared_from_this<NekodataOStream>
 	{
 		NekodataOStream(const NekodataOStream&) = delete;
 		NekodataOStream& operator=(const NekodataOStream&) = delete;
@@ -49,6 +92,14 @@ namespace nekofs {
 		NekodataOStream& operator=(NekodataOStream&&) = delete;
 	public:
 		NekodataOStream(std::shared_ptr<NekodataArchiver> archiver, int64_t volumeSize);
+		~NekodataOStream();
+		/*
+		* 从当前位置开始，对后续顺序写入的数据计算sha256。
+		* 如果期间发生了非顺序写入，endHash返回false，需要调用方自行重新计算。
+		*/
+		void beginHash();
+		bool endHash(std::array<uint32_t, 8>& sha256);
+		void resume(int64_t length);
 
 	public:
 		int32_t read(void* buf, int32_t size) override;
@@ -56,6 +107,7 @@ namespace nekofs {
 		int64_t seek(int64_t offset, const SeekOrigin& origin) override;
 		int64_t getPosition() const override;
 		int64_t getLength() const override;
+		int64_t copyRange(std::shared_ptr<NativeIStream> is, int64_t size) override;
 
 	private:
 		std::shared_ptr<NekodataVolumeOStream> prepareVolumeOStream();
@@ -66,5 +118,32 @@ namespace nekofs {
 		int64_t position_ = 0;
 		int64_t length_ = 0;
 		std::shared_ptr<NekodataVolumeOStream> os_;
+		std::unique_ptr<sha256sum> hash_;
+		int64_t hashPos_ = 0;
+		bool hashBroken_ = false;
+	};
+
+	/*
+	* 只能顺序写入的输出，例如管道、网络。自己记录写入的位置，不支持读和seek。
+	*/
+	class NekodataSinkOStream final : public OStream, public std::enable_shared_from_this<NekodataSinkOStream>
+	{
+		NekodataSinkOStream(const NekodataSinkOStream&) = delete;
+		NekodataSinkOStream& operator=(const NekodataSinkOStream&) = delete;
+		NekodataSinkOStream(NekodataSinkOStream&&) = delete;
+		NekodataSinkOStream& operator=(NekodataSinkOStream&&) = delete;
+	public:
+		NekodataSinkOStream(std::function<int32_t(const void*, int32_t)> writer);
+
+	public:
+		int32_t read(void* buf, int32_t size) override;
+		int32_t write(const void* buf, int32_t size) override;
+		int64_t seek(int64_t offset, const SeekOrigin& origin) override;
+		int64_t getPosition() const override;
+		int64_t getLength() const override;
+
+	private:
+		std::function<int32_t(const void*, int32_t)> writer_;
+		int64_t position_ = 0;
 	};
 }
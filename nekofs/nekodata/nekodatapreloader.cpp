@@ -0,0 +1,394 @@
+﻿#include "nekodatapreloader.h"
+#include "nekodatafile.h"
+#include "nekodatafilemeta.h"
+#include "nekodatafilesystem.h"
+#include "nekodataistream.h"
+#include "../common/env.h"
+#include "../common/utils.h"
+#include "../common/accesstrace.h"
+#ifdef _WIN32
+#include "../native_win/nativefileistream.h"
+#else
+#include "../native_posix/nativefileistream.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sstream>
+
+namespace nekofs {
+	/*
+	* 等待处理的请求和后台线程。线程在没有请求时退出，有新请求时再创建。
+	* 不析构：退出时请求和文件系统可能还没有释放，它们的析构需要使用这里的锁。
+	*/
+	struct NekodataPreloader::Scheduler final
+	{
+		std::mutex mtx;
+		std::condition_variable cond; // 处理完一个文件时通知，cancel在上面等待
+		std::vector<std::weak_ptr<NekodataPreloader>> queue;
+		std::atomic<size_t> queueSize = 0; // queue的大小，前台读取时不加锁判断是否有预加载
+		std::thread thread;
+		uint64_t sequence = 0;
+		bool working = false;
+	};
+
+	std::atomic<int64_t> NekodataPreloader::s_foregroundTime_ = 0;
+	static thread_local bool s_isPreloadThread = false;
+
+	NekodataPreloader::NekodataPreloader(int32_t priority, bool decompress, int64_t memoryLimit)
+	{
+		priority_ = priority;
+		decompress_ = decompress;
+		memoryLimit_ = memoryLimit;
+	}
+	NekodataPreloader::~NekodataPreloader()
+	{
+		cancel();
+	}
+	void NekodataPreloader::add(std::shared_ptr<FileSystem> fs, const std::string& filepath, int32_t priority, const std::vector<int64_t>& blocks)
+	{
+		if (!fs || started_)
+		{
+			return;
+		}
+		tasks_.push_back(Task{ fs, filepath, priority, blocks });
+	}
+	bool NekodataPreloader::start()
+	{
+		auto& scheduler = getScheduler();
+		std::lock_guard lock(scheduler.mtx);
+		if (started_ || cancel_)
+		{
+			return false;
+		}
+		started_ = true;
+		// 优先级高的在前，相同优先级保持加入的顺序
+		std::stable_sort(tasks_.begin(), tasks_.end(), [](const Task& left, const Task& right) { return left.priority > right.priority; });
+		sequence_ = scheduler.sequence++;
+		scheduler.queue.push_back(weak_from_this());
+		scheduler.queueSize.store(scheduler.queue.size(), std::memory_order_relaxed);
+		if (!scheduler.working)
+		{
+			// 上一个线程已经不再使用锁，可以在这里等它结束
+			if (scheduler.thread.joinable())
+			{
+				scheduler.thread.join();
+			}
+			scheduler.working = true;
+			scheduler.thread = std::thread(&NekodataPreloader::threadfunction);
+		}
+		return true;
+	}
+	void NekodataPreloader::cancel()
+	{
+		auto& scheduler = getScheduler();
+		std::unique_lock lock(scheduler.mtx);
+		cancel_ = true;
+		scheduler.cond.wait(lock, [this]() { return !running_; });
+	}
+	bool NekodataPreloader::isFinished() const
+	{
+		return finished_;
+	}
+	int64_t NekodataPreloader::getPreloadedSize() const
+	{
+		return preloadedSize_;
+	}
+	std::shared_ptr<NekodataPreloader> NekodataPreloader::prefetch(std::shared_ptr<FileSystem> fs, const std::vector<std::string>& filepaths, int32_t priority, bool decompress)
+	{
+		auto preloader = std::make_shared<NekodataPreloader>(priority, decompress);
+		for (const auto& filepath : filepaths)
+		{
+			preloader->add(fs, filepath);
+		}
+		preloader->start();
+		return preloader;
+	}
+	void NekodataPreloader::notifyForeground()
+	{
+		// 没有预加载时只有一次原子读取
+		if (!s_isPreloadThread && getScheduler().queueSize.load(std::memory_order_relaxed) > 0)
+		{
+			// 每次读取都会调用，时间变化不大时不写，避免多个前台线程争用同一个缓存行
+			const int64_t time = now();
+			if (time - s_foregroundTime_.load(std::memory_order_relaxed) >= nekofs_kNekodata_PreloadYieldTime / 8)
+			{
+				s_foregroundTime_.store(time, std::memory_order_relaxed);
+			}
+		}
+	}
+	NekodataPreloader::Scheduler& NekodataPreloader::getScheduler()
+	{
+		static Scheduler* scheduler = new Scheduler();
+		return *scheduler;
+	}
+	void NekodataPreloader::threadfunction()
+	{
+		s_isPreloadThread = true;
+		// 预加载的读取和解压不是应用的访问，不能混进访问记录，否则用记录生成的预热清单会包含预热本身
+		AccessTrace::ignoreCurrentThread();
+		auto& scheduler = getScheduler();
+		while (true)
+		{
+			std::shared_ptr<NekodataPreloader> preloader;
+			{
+				// 请求可能在这里被释放，析构时会加锁，要在解锁之后释放
+				std::vector<std::shared_ptr<NekodataPreloader>> alive;
+				{
+					std::lock_guard lock(scheduler.mtx);
+					std::vector<std::weak_ptr<NekodataPreloader>> queue;
+					for (const auto& item : scheduler.queue)
+					{
+						auto p = item.lock();
+						if (p && !p->cancel_)
+						{
+							queue.push_back(item);
+							alive.push_back(p);
+						}
+					}
+					scheduler.queue.swap(queue);
+					scheduler.queueSize.store(scheduler.queue.size(), std::memory_order_relaxed);
+					for (const auto& p : alive)
+					{
+						if (!preloader || p->priority_ > preloader->priority_ || (p->priority_ == preloader->priority_ && p->sequence_ < preloader->sequence_))
+						{
+							preloader = p;
+						}
+					}
+					if (preloader)
+					{
+						preloader->running_ = true;
+					}
+				}
+			}
+			if (!preloader)
+			{
+				std::lock_guard lock(scheduler.mtx);
+				if (scheduler.queue.empty())
+				{
+					scheduler.working = false;
+					return;
+				}
+				continue;
+			}
+			const bool more = preloader->step();
+			{
+				std::lock_guard lock(scheduler.mtx);
+				preloader->running_ = false;
+				if (!more)
+				{
+					if (!preloader->isCancelled())
+					{
+						preloader->finished_ = true;
+						std::stringstream ss;
+						ss << u8"NekodataPreloader finish. files = " << preloader->tasks_.size() << u8", blocks = " << preloader->blocks_.size() << u8", size = " << preloader->preloadedSize_;
+						loginfo(ss.str());
+					}
+					auto& queue = scheduler.queue;
+					queue.erase(std::remove_if(queue.begin(), queue.end(), [&preloader](const std::weak_ptr<NekodataPreloader>& item) { return !item.owner_before(preloader) && !preloader.owner_before(item); }), queue.end());
+					scheduler.queueSize.store(queue.size(), std::memory_order_relaxed);
+				}
+			}
+			scheduler.cond.notify_all();
+		}
+	}
+	/*
+	* 处理一个文件，还有没处理的返回true。
+	*/
+	bool NekodataPreloader::step()
+	{
+		if (isCancelled())
+		{
+			return false;
+		}
+		// 预读提示是异步的，先对所有文件发出，磁盘可以尽早开始读取
+		if (next_ < tasks_.size())
+		{
+			for (const auto& is : openRanges(tasks_[next_]))
+			{
+				willNeed(is);
+			}
+		}
+		else if (next_ < tasks_.size() * 2)
+		{
+			const auto& task = tasks_[next_ - tasks_.size()];
+			if (!decompress_ || !decompress(task))
+			{
+				for (const auto& is : openRanges(task))
+				{
+					touch(is);
+				}
+			}
+		}
+		next_++;
+		return next_ < tasks_.size() * 2 && !isCancelled();
+	}
+	bool NekodataPreloader::isCancelled() const
+	{
+		return cancel_;
+	}
+	/*
+	* 文件需要读取的数据，nekodata中是压缩数据，只包含需要的块，相邻的块合并成一段。
+	*/
+	std::vector<std::shared_ptr<IStream>> NekodataPreloader::openRanges(const Task& task) const
+	{
+		std::vector<std::shared_ptr<IStream>> ranges;
+		if (task.fs->getFSType() != FileSystemType::Nekodata)
+		{
+			if (auto is = task.fs->openIStream(task.filepath))
+			{
+				ranges.push_back(is);
+			}
+			return ranges;
+		}
+		auto fs = std::static_pointer_cast<NekodataFileSystem>(task.fs);
+		auto meta = fs->getFileMeta(task.filepath);
+		if (!meta)
+		{
+			return ranges;
+		}
+		if (meta->getCompressedSize() == 0)
+		{
+			if (auto is = fs->openRawIStream(meta->getBeginPos(), meta->getOriginalSize()))
+			{
+				ranges.push_back(is);
+			}
+			return ranges;
+		}
+		std::vector<int64_t> indexes = task.blocks;
+		if (indexes.empty())
+		{
+			indexes.resize(meta->getBlocks().size());
+			for (size_t i = 0; i < indexes.size(); i++)
+			{
+				indexes[i] = static_cast<int64_t>(i);
+			}
+		}
+		const auto& blocks = meta->getBlocks();
+		int64_t beginPos = 0;
+		int64_t endPos = 0;
+		auto addRange = [&]() {
+			if (endPos > beginPos)
+			{
+				if (auto is = fs->openRawIStream(beginPos, endPos - beginPos))
+				{
+					ranges.push_back(is);
+				}
+			}
+		};
+		for (auto index : indexes)
+		{
+			if (index < 0 || index >= static_cast<int64_t>(blocks.size()))
+			{
+				continue;
+			}
+			const int64_t pos = meta->getBlockPos(index);
+			if (pos != endPos)
+			{
+				addRange();
+				beginPos = pos;
+				endPos = pos;
+			}
+			endPos += blocks[static_cast<size_t>(index)].second;
+		}
+		addRange();
+		return ranges;
+	}
+	void NekodataPreloader::willNeed(std::shared_ptr<IStream> is) const
+	{
+		auto source = std::dynamic_pointer_cast<NativeCopySource>(is);
+		if (!source)
+		{
+			return;
+		}
+		while (!isCancelled())
+		{
+			int64_t size = 0;
+			auto nis = source->getNativeRange(size);
+			if (!nis || size <= 0)
+			{
+				break;
+			}
+			nis->willNeed(size);
+			if (is->seek(size, SeekOrigin::Current) < 0)
+			{
+				break;
+			}
+		}
+		is->seek(0, SeekOrigin::Begin);
+	}
+	/*
+	* 读一遍，数据进入页缓存。
+	*/
+	void NekodataPreloader::touch(std::shared_ptr<IStream> is) const
+	{
+		auto buffer = env::getInstance().newBuffer64K();
+		while (!isCancelled())
+		{
+			waitForeground();
+			if (is->read(buffer->data(), static_cast<int32_t>(buffer->size())) <= 0)
+			{
+				break;
+			}
+		}
+	}
+	/*
+	* 解压文件的块并保留。文件没有压缩或超过内存限制时返回false，剩下的数据由调用方读入。
+	*/
+	bool NekodataPreloader::decompress(const Task& task)
+	{
+		if (task.fs->getFSType() != FileSystemType::Nekodata || preloadedSize_ >= memoryLimit_)
+		{
+			return false;
+		}
+		auto file = std::static_pointer_cast<NekodataFileSystem>(task.fs)->openFileInternal(task.filepath);
+		if (!file)
+		{
+			return true;
+		}
+		if (file->getFileCompressedSize() == 0)
+		{
+			return false;
+		}
+		const int64_t blockNum = static_cast<int64_t>(file->meta_->getBlocks().size());
+		const int64_t num = task.blocks.empty() ? blockNum : static_cast<int64_t>(task.blocks.size());
+		bool keep = false;
+		int64_t i = 0;
+		for (; i < num && !isCancelled() && preloadedSize_ < memoryLimit_; i++)
+		{
+			const int64_t index = task.blocks.empty() ? i : task.blocks[static_cast<size_t>(i)];
+			if (index < 0 || index >= blockNum)
+			{
+				continue;
+			}
+			waitForeground();
+			auto block = file->getBlock(index);
+			if (block)
+			{
+				blocks_.push_back(block);
+				preloadedSize_ += nekofs_kNekoData_LZ4_Buffer_Size;
+				keep = true;
+			}
+		}
+		if (keep)
+		{
+			// 块缓存在NekodataFile中，文件关闭后缓存也就没有了
+			files_.push_back(file);
+		}
+		return i == num;
+	}
+	void NekodataPreloader::waitForeground() const
+	{
+		while (!isCancelled() && now() - s_foregroundTime_.load(std::memory_order_relaxed) < nekofs_kNekodata_PreloadYieldTime)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	int64_t NekodataPreloader::now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
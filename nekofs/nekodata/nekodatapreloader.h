@@ -0,0 +1,85 @@
+﻿#pragma once
+
+#include "../common/typedef.h"
+#include "../common/lz4.h"
+
+#include <cstdint>
+#include <array>
+#include <string>
+#include <memory>
+#include <vector>
+#include <atomic>
+
+namespace nekofs {
+	class NekodataFile;
+
+	/*
+	* 预加载/预取：先提示系统预读文件的数据，再把数据读入页缓存，或者把nekodata的块解压并保留在NekodataFile的块缓存中，直到对象释放。
+	* 所有请求由同一个后台线程处理，优先级高的先处理（相同的按提交顺序），每处理完一个文件重新选择，后来的高优先级请求可以插队。
+	* 前台线程读取本地文件或需要解压块时预加载暂停，只使用空闲的时间。
+	*/
+	class NekodataPreloader final : public Prefetch, public std::enable_shared_from_this<NekodataPreloader>
+	{
+		NekodataPreloader(const NekodataPreloader&) = delete;
+		NekodataPreloader(NekodataPreloader&&) = delete;
+		NekodataPreloader& operator=(const NekodataPreloader&) = delete;
+		NekodataPreloader& operator=(NekodataPreloader&&) = delete;
+	public:
+		struct Task final
+		{
+			std::shared_ptr<FileSystem> fs;
+			std::string filepath;
+			int32_t priority = 0;
+			std::vector<int64_t> blocks; // 为空时是文件的所有块
+		};
+	private:
+		struct Scheduler;
+	public:
+		NekodataPreloader(int32_t priority = 0, bool decompress = true, int64_t memoryLimit = nekofs_kNekodata_PreloadMemoryLimit);
+		~NekodataPreloader();
+		/*
+		* 在start之前加入，priority是请求内文件的顺序。
+		*/
+		void add(std::shared_ptr<FileSystem> fs, const std::string& filepath, int32_t priority = 0, const std::vector<int64_t>& blocks = std::vector<int64_t>());
+		bool start();
+		/*
+		* 等到正在处理的文件结束后返回，已解压的数据保留到对象释放。
+		*/
+		void cancel() override;
+		bool isFinished() const override;
+		int64_t getPreloadedSize() const;
+		static std::shared_ptr<NekodataPreloader> prefetch(std::shared_ptr<FileSystem> fs, const std::vector<std::string>& filepaths, int32_t priority, bool decompress);
+		/*
+		* 前台读取本地文件或解压块时调用，之后一段时间内预加载让出。预加载线程自己的读取不算。
+		*/
+		static void notifyForeground();
+
+	private:
+		static Scheduler& getScheduler();
+		static void threadfunction();
+		bool step();
+		bool isCancelled() const;
+		std::vector<std::shared_ptr<IStream>> openRanges(const Task& task) const;
+		void willNeed(std::shared_ptr<IStream> is) const;
+		void touch(std::shared_ptr<IStream> is) const;
+		bool decompress(const Task& task);
+		void waitForeground() const;
+		static int64_t now();
+
+	private:
+		int32_t priority_ = 0;
+		bool decompress_ = true;
+		int64_t memoryLimit_ = 0;
+		uint64_t sequence_ = 0;
+		size_t next_ = 0; // 先对所有文件发出预读提示，再依次读入
+		bool started_ = false;
+		bool running_ = false; // 后台线程正在处理，由Scheduler的锁保护
+		std::vector<Task> tasks_;
+		std::vector<std::shared_ptr<NekodataFile>> files_;
+		std::vector<std::shared_ptr<std::array<uint8_t, nekofs_kNekoData_LZ4_Buffer_Size>>> blocks_;
+		std::atomic<int64_t> preloadedSize_ = 0;
+		std::atomic<bool> cancel_ = false;
+		std::atomic<bool> finished_ = false;
+		static std::atomic<int64_t> s_foregroundTime_;
+	};
+}
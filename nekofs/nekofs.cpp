@@ -2,6 +2,7 @@
 #include "common/env.h"
 #include "common/utils.h"
 #include "common/sha256.h"
+#include "common/accesstrace.h"
 #include "common/rapidjson.h"
 #ifdef _WIN32
 #include "native_win/nativefilesystem.h"
@@ -28,6 +29,8 @@ std::mutex g_mtx_ostreams_;
 std::unordered_map<NekoFSHandle, std::shared_ptr<nekofs::OStream>> g_ostreams_;
 std::mutex g_mtx_fs_;
 std::unordered_map<NekoFSHandle, std::shared_ptr<nekofs::FileSystem>> g_filesystems_;
+std::mutex g_mtx_prefetches_;
+std::unordered_map<NekoFSHandle, std::shared_ptr<nekofs::Prefetch>> g_prefetches_;
 
 
 // 传入 utf8 字符串，返回utf8字符串
@@ -154,14 +157,19 @@ NEKOFS_API NekoFSBool nekofs_native_CleanEmptyDirectory(const char* u8dirpath)
 }
 
 NEKOFS_API NekoFSHandle nekofs_native_OpenIStream(const char* u8filepath)
+{
+	return nekofs_native_OpenIStreamWithHint(u8filepath, NEKOFS_ACCESS_AUTO);
+}
+
+NEKOFS_API NekoFSHandle nekofs_native_OpenIStreamWithHint(const char* u8filepath, NekoFSAccessHint hint)
 {
 	auto path = __normalrootpath(u8filepath);
-	if (path.empty())
+	if (path.empty() || hint < NEKOFS_ACCESS_AUTO || hint > NEKOFS_ACCESS_POPULATE)
 	{
 		return INVALID_NEKOFSHANDLE;
 	}
 	NekoFSHandle handle = INVALID_NEKOFSHANDLE;
-	auto stream = nekofs::env::getInstance().getNativeFileSystem()->openIStream(path);
+	auto stream = nekofs::env::getInstance().getNativeFileSystem()->openIStream(path, static_cast<nekofs::AccessHint>(hint));
 	if (stream)
 	{
 		handle = nekofs::env::getInstance().genId();
@@ -470,16 +478,15 @@ NEKOFS_API NekoFSBool nekofs_sha256_sumistream32(NekoFSHandle isHandle, uint32_t
 	}
 	if (stream)
 	{
-		const size_t buffer_size = 8 * 1024;
-		uint8_t buffer[buffer_size];
+		auto buffer = nekofs::env::getInstance().newBuffer64K();
 		int32_t actualRead = 0;
 		nekofs::sha256sum sha256;
 		do
 		{
-			actualRead = nekofs::istream_read(stream, buffer, buffer_size);
+			actualRead = nekofs::istream_read(stream, buffer->data(), static_cast<int32_t>(buffer->size()));
 			if (actualRead > 0)
 			{
-				sha256.update(buffer, actualRead);
+				sha256.update(buffer->data(), actualRead);
 			}
 		} while (actualRead > 0);
 		if (actualRead >= 0)
@@ -493,6 +500,78 @@ NEKOFS_API NekoFSBool nekofs_sha256_sumistream32(NekoFSHandle isHandle, uint32_t
 	return NEKOFS_FALSE;
 }
 
+NEKOFS_API NekoFSBool nekofs_sha256_sum32(const void* data, int64_t size, uint32_t result[8])
+{
+	::memset(result, 0, 32);
+	if (size < 0 || (data == nullptr && size > 0))
+	{
+		return NEKOFS_FALSE;
+	}
+	nekofs::sha256sum sha256;
+	sha256.final(data, static_cast<size_t>(size));
+	const auto& hashResult = sha256.readHash();
+	std::copy(hashResult.begin(), hashResult.end(), result);
+	return NEKOFS_TRUE;
+}
+NEKOFS_API NekoFSSHA256Kernel nekofs_sha256_GetKernel()
+{
+	return static_cast<NekoFSSHA256Kernel>(nekofs::sha256sum::getKernel());
+}
+NEKOFS_API NekoFSBool nekofs_sha256_SetKernel(NekoFSSHA256Kernel kernel)
+{
+	if (kernel != NEKOFS_SHA256_SCALAR && kernel != NEKOFS_SHA256_SHANI && kernel != NEKOFS_SHA256_ARMV8)
+	{
+		return NEKOFS_FALSE;
+	}
+	return nekofs::sha256sum::setKernel(static_cast<nekofs::SHA256Kernel>(kernel)) ? NEKOFS_TRUE : NEKOFS_FALSE;
+}
+NEKOFS_API NekoFSBool nekofs_sha256_sumbatch32(const void* const* datas, const int64_t* sizes, int32_t num, uint32_t* results)
+{
+	if (num < 0 || (num > 0 && (datas == nullptr || sizes == nullptr || results == nullptr)))
+	{
+		return NEKOFS_FALSE;
+	}
+	::memset(results, 0, static_cast<size_t>(num) * 32);
+	nekofs::sha256batch batch;
+	for (int32_t i = 0; i < num; i++)
+	{
+		if (sizes[i] < 0 || (datas[i] == nullptr && sizes[i] > 0))
+		{
+			return NEKOFS_FALSE;
+		}
+		batch.add(datas[i], static_cast<size_t>(sizes[i]));
+	}
+	batch.compute();
+	for (int32_t i = 0; i < num; i++)
+	{
+		const auto& hashResult = batch.readHash(i);
+		std::copy(hashResult.begin(), hashResult.end(), results + static_cast<size_t>(i) * 8);
+	}
+	return NEKOFS_TRUE;
+}
+NEKOFS_API int32_t nekofs_sha256_GetBatchLanes()
+{
+	return static_cast<int32_t>(nekofs::sha256batch::getLanes());
+}
+NEKOFS_API NekoFSBool nekofs_sha256_SetMultiBuffer(NekoFSBool enabled)
+{
+	return nekofs::sha256batch::setMultiBufferEnabled(enabled != NEKOFS_FALSE) ? NEKOFS_TRUE : NEKOFS_FALSE;
+}
+
+NEKOFS_API NekoFSBool nekofs_trace_Start(const char* u8filepath)
+{
+	auto path = __normalrootpath(u8filepath);
+	if (path.empty())
+	{
+		return NEKOFS_FALSE;
+	}
+	return nekofs::AccessTrace::getInstance().start(path) ? NEKOFS_TRUE : NEKOFS_FALSE;
+}
+NEKOFS_API NekoFSBool nekofs_trace_Stop()
+{
+	return nekofs::AccessTrace::getInstance().stop() ? NEKOFS_TRUE : NEKOFS_FALSE;
+}
+
 NEKOFS_API NekoFSHandle nekofs_nekodata_CreateFromNative(const char* u8filepath)
 {
 	auto path = __normalrootpath(u8filepath);
@@ -637,6 +716,96 @@ NEKOFS_API int32_t nekofs_filesystem_GetAllFiles(NekoFSHandle fsHandle, const ch
 	return 0;
 }
 
+NEKOFS_API NekoFSHandle nekofs_filesystem_Prefetch(NekoFSHandle fsHandle, const char** u8filepaths, int32_t filenum, int32_t priority, NekoFSBool decompress)
+{
+	if (filenum <= 0)
+	{
+		return INVALID_NEKOFSHANDLE;
+	}
+	std::vector<std::string> filepaths;
+	for (int32_t i = 0; i < filenum; i++)
+	{
+		auto path = __normalpath(u8filepaths[i]);
+		if (path.empty())
+		{
+			return INVALID_NEKOFSHANDLE;
+		}
+		filepaths.push_back(path);
+	}
+	std::shared_ptr<nekofs::FileSystem> fs;
+	{
+		std::lock_guard<std::mutex> lock(g_mtx_fs_);
+		auto it = g_filesystems_.find(fsHandle);
+		if (it != g_filesystems_.end())
+		{
+			fs = it->second;
+		}
+	}
+	NekoFSHandle handle = INVALID_NEKOFSHANDLE;
+	if (fs)
+	{
+		auto prefetch = fs->prefetch(filepaths, priority, decompress != NEKOFS_FALSE);
+		if (prefetch)
+		{
+			handle = nekofs::env::getInstance().genId();
+			std::lock_guard<std::mutex> lock(g_mtx_prefetches_);
+			g_prefetches_[handle] = prefetch;
+		}
+	}
+	return handle;
+}
+
+NEKOFS_API NekoFSBool nekofs_prefetch_IsFinished(NekoFSHandle prefetchHandle)
+{
+	std::shared_ptr<nekofs::Prefetch> prefetch;
+	{
+		std::lock_guard<std::mutex> lock(g_mtx_prefetches_);
+		auto it = g_prefetches_.find(prefetchHandle);
+		if (it != g_prefetches_.end())
+		{
+			prefetch = it->second;
+		}
+	}
+	return prefetch && prefetch->isFinished() ? NEKOFS_TRUE : NEKOFS_FALSE;
+}
+
+NEKOFS_API void nekofs_prefetch_Cancel(NekoFSHandle prefetchHandle)
+{
+	std::shared_ptr<nekofs::Prefetch> prefetch;
+	{
+		std::lock_guard<std::mutex> lock(g_mtx_prefetches_);
+		auto it = g_prefetches_.find(prefetchHandle);
+		if (it != g_prefetches_.end())
+		{
+			prefetch = it->second;
+		}
+	}
+	if (prefetch)
+	{
+		prefetch->cancel();
+	}
+}
+
+NEKOFS_API void nekofs_prefetch_Close(NekoFSHandle prefetchHandle)
+{
+	if (INVALID_NEKOFSHANDLE == prefetchHandle)
+	{
+		return;
+	}
+	std::shared_ptr<nekofs::Prefetch> prefetch;
+	{
+		std::lock_guard<std::mutex> lock(g_mtx_prefetches_);
+		auto it = g_prefetches_.find(prefetchHandle);
+		if (it != g_prefetches_.end())
+		{
+			// 释放时会等待正在处理的文件，不在锁内进行
+			prefetch = it->second;
+			g_prefetches_.erase(it);
+			nekofs::env::getInstance().ungenId(prefetchHandle);
+		}
+	}
+}
+
 NEKOFS_API NekoFSHandle nekofs_overlay_Create()
 {
 	NekoFSHandle handle = INVALID_NEKOFSHANDLE;
@@ -826,6 +995,51 @@ NEKOFS_API NekoFSBool nekofs_overlay_RefreshFileList(NekoFSHandle olfsHandle)
 	return NEKOFS_FALSE;
 }
 
+NEKOFS_API NekoFSBool nekofs_overlay_Preload(NekoFSHandle olfsHandle, const char* u8filepath, int64_t memoryLimit)
+{
+	auto path = __normalpath(u8filepath);
+	if (path.empty())
+	{
+		return NEKOFS_FALSE;
+	}
+	std::shared_ptr<nekofs::OverlayFileSystem> fs;
+	{
+		std::lock_guard<std::mutex> lock(g_mtx_fs_);
+		auto it = g_filesystems_.find(olfsHandle);
+		if (it != g_filesystems_.end() && it->second->getFSType() == nekofs::FileSystemType::Overlay)
+		{
+			fs = std::static_pointer_cast<nekofs::OverlayFileSystem>(it->second);
+		}
+	}
+	if (!fs)
+	{
+		return NEKOFS_FALSE;
+	}
+	auto wsm = nekofs::WarmSetMeta::load(fs->openIStream(path));
+	if (!wsm)
+	{
+		return NEKOFS_FALSE;
+	}
+	return fs->preload(wsm.value(), memoryLimit > 0 ? memoryLimit : nekofs_kNekodata_PreloadMemoryLimit) ? NEKOFS_TRUE : NEKOFS_FALSE;
+}
+
+NEKOFS_API void nekofs_overlay_ReleasePreload(NekoFSHandle olfsHandle)
+{
+	std::shared_ptr<nekofs::OverlayFileSystem> fs;
+	{
+		std::lock_guard<std::mutex> lock(g_mtx_fs_);
+		auto it = g_filesystems_.find(olfsHandle);
+		if (it != g_filesystems_.end() && it->second->getFSType() == nekofs::FileSystemType::Overlay)
+		{
+			fs = std::static_pointer_cast<nekofs::OverlayFileSystem>(it->second);
+		}
+	}
+	if (fs)
+	{
+		fs->releasePreload();
+	}
+}
+
 #ifdef ANDROID
 NEKOFS_API NekoFSHandle nekofs_assetmanager_OpenIStream(const char* u8filepath)
 {
@@ -896,6 +1110,9 @@ NEKOFS_API NekoFSBool nekofs_overlay_AddLayerFromAssetManager(NekoFSHandle olfsH
 #include "tools/unpack.h"
 #include "tools/mkdiff.h"
 #include "tools/merge.h"
+#include "tools/compact.h"
+#include "tools/warmset.h"
+#include "nekodata/nekodataostream.h"
 
 NEKOFS_API NekoFSBool nekofs_tools_prepare(const char* u8path, const char* u8versionpath, uint32_t offset)
 {
@@ -911,7 +1128,42 @@ NEKOFS_API NekoFSBool nekofs_tools_prepare(const char* u8path, const char* u8ver
 	}
 	return nekofs::tools::PrePare::exec(path, vpath, offset) ? NEKOFS_TRUE : NEKOFS_FALSE;
 }
+NEKOFS_API NekoFSBool nekofs_tools_prepareWithCache(const char* u8path, const char* u8versionpath, uint32_t offset, const char* u8cachepath, NekoFSBool paranoid)
+{
+	auto path = __normalrootpath(u8path);
+	if (path.empty())
+	{
+		return NEKOFS_FALSE;
+	}
+	auto vpath = __normalrootpath(u8versionpath);
+	if (vpath.empty())
+	{
+		return NEKOFS_FALSE;
+	}
+	auto cpath = __normalrootpath(u8cachepath);
+	if (cpath.empty())
+	{
+		return NEKOFS_FALSE;
+	}
+	return nekofs::tools::PrePare::exec(path, vpath, offset, cpath, paranoid == NEKOFS_TRUE) ? NEKOFS_TRUE : NEKOFS_FALSE;
+}
 NEKOFS_API NekoFSBool nekofs_tools_pack(const char* u8dirpath, const char* u8filepath, int64_t volumeSize)
+{
+	return nekofs_tools_packWithChunking(u8dirpath, u8filepath, volumeSize, NEKOFS_FALSE);
+}
+NEKOFS_API NekoFSBool nekofs_tools_packWithChunking(const char* u8dirpath, const char* u8filepath, int64_t volumeSize, NekoFSBool contentDefined)
+{
+	return nekofs_tools_packWithOptions(u8dirpath, u8filepath, volumeSize, contentDefined, NEKOFS_FALSE);
+}
+NEKOFS_API NekoFSBool nekofs_tools_packWithOptions(const char* u8dirpath, const char* u8filepath, int64_t volumeSize, NekoFSBool contentDefined, NekoFSBool blockDedup)
+{
+	return nekofs_tools_packWithOrder(u8dirpath, u8filepath, volumeSize, contentDefined, blockDedup, nullptr);
+}
+NEKOFS_API NekoFSBool nekofs_tools_packWithOrder(const char* u8dirpath, const char* u8filepath, int64_t volumeSize, NekoFSBool contentDefined, NekoFSBool blockDedup, const char* u8orderpath)
+{
+	return nekofs_tools_packWithOrderPrefix(u8dirpath, u8filepath, volumeSize, contentDefined, blockDedup, u8orderpath, nullptr);
+}
+NEKOFS_API NekoFSBool nekofs_tools_packWithOrderPrefix(const char* u8dirpath, const char* u8filepath, int64_t volumeSize, NekoFSBool contentDefined, NekoFSBool blockDedup, const char* u8orderpath, const char* u8orderprefix)
 {
 	if (volumeSize > nekofs_kNekodata_MaxVolumeSize || volumeSize <= 1024)
 	{
@@ -927,7 +1179,36 @@ NEKOFS_API NekoFSBool nekofs_tools_pack(const char* u8dirpath, const char* u8fil
 	{
 		return NEKOFS_FALSE;
 	}
-	return nekofs::tools::Pack::exec(dpath, fpath, volumeSize) ? NEKOFS_TRUE : NEKOFS_FALSE;
+	std::string opath;
+	if (u8orderpath != nullptr && u8orderpath[0] != '\0')
+	{
+		opath = __normalrootpath(u8orderpath);
+		if (opath.empty())
+		{
+			return NEKOFS_FALSE;
+		}
+	}
+	const std::string oprefix = u8orderprefix != nullptr ? u8orderprefix : "";
+	return nekofs::tools::Pack::exec(dpath, fpath, volumeSize, contentDefined != NEKOFS_FALSE, blockDedup != NEKOFS_FALSE, opath, oprefix) ? NEKOFS_TRUE : NEKOFS_FALSE;
+}
+NEKOFS_API NekoFSBool nekofs_tools_packToStream(const char* u8dirpath, const char* u8tmppath, writedelegate* writer, void* userdata)
+{
+	if (writer == nullptr)
+	{
+		return NEKOFS_FALSE;
+	}
+	auto dpath = __normalrootpath(u8dirpath);
+	if (dpath.empty())
+	{
+		return NEKOFS_FALSE;
+	}
+	auto tpath = __normalrootpath(u8tmppath);
+	if (tpath.empty())
+	{
+		return NEKOFS_FALSE;
+	}
+	auto os = std::make_shared<nekofs::NekodataSinkOStream>([writer, userdata](const void* buf, int32_t size) { return writer(userdata, buf, size); });
+	return nekofs::tools::Pack::exec(dpath, tpath, os) ? NEKOFS_TRUE : NEKOFS_FALSE;
 }
 NEKOFS_API NekoFSBool nekofs_tools_unpack(const char* u8filepath, const char* u8dirpath)
 {
@@ -945,6 +1226,18 @@ NEKOFS_API NekoFSBool nekofs_tools_unpack(const char* u8filepath, const char* u8
 }
 NEKOFS_API NekoFSBool nekofs_tools_mkldiff(const char* u8earlierfile, const char* u8latestfile, const char* u8filepath, int64_t volumeSize)
 {
+	return nekofs_tools_mkldiffWithVerify(u8earlierfile, u8latestfile, u8filepath, volumeSize, NEKOFS_DIFFVERIFY_ALL);
+}
+NEKOFS_API NekoFSBool nekofs_tools_mkldiffWithVerify(const char* u8earlierfile, const char* u8latestfile, const char* u8filepath, int64_t volumeSize, NekoFSDiffVerify verify)
+{
+	return nekofs_tools_mkldiffWithDelta(u8earlierfile, u8latestfile, u8filepath, volumeSize, verify, NEKOFS_FALSE);
+}
+NEKOFS_API NekoFSBool nekofs_tools_mkldiffWithDelta(const char* u8earlierfile, const char* u8latestfile, const char* u8filepath, int64_t volumeSize, NekoFSDiffVerify verify, NekoFSBool delta)
+{
+	if (verify != NEKOFS_DIFFVERIFY_ALL && verify != NEKOFS_DIFFVERIFY_NONE && verify != NEKOFS_DIFFVERIFY_PATCH)
+	{
+		return NEKOFS_FALSE;
+	}
 	if (volumeSize > nekofs_kNekodata_MaxVolumeSize || volumeSize <= 1024)
 	{
 		return NEKOFS_FALSE;
@@ -965,7 +1258,7 @@ NEKOFS_API NekoFSBool nekofs_tools_mkldiff(const char* u8earlierfile, const char
 		return NEKOFS_FALSE;
 	}
 	nekofs::tools::MKDiff mkdiff;
-	return mkdiff.exec(earlierfile, latestfile, filepath, volumeSize) ? NEKOFS_TRUE : NEKOFS_FALSE;
+	return mkdiff.exec(earlierfile, latestfile, filepath, volumeSize, static_cast<nekofs::tools::MKDiff::VerifyMode>(verify), delta != NEKOFS_FALSE) ? NEKOFS_TRUE : NEKOFS_FALSE;
 }
 NEKOFS_API NekoFSBool nekofs_tools_mergeToNekodata(const char* u8outpath, int64_t volumeSize, const char** u8filepaths, int32_t filenum, NekoFSBool verify)
 {
@@ -994,6 +1287,29 @@ NEKOFS_API NekoFSBool nekofs_tools_mergeToNekodata(const char* u8outpath, int64_
 	}
 	return nekofs::tools::Merge::execNekodata(outpath, volumeSize, patchfiles, verify == NEKOFS_TRUE) ? NEKOFS_TRUE : NEKOFS_FALSE;
 }
+NEKOFS_API NekoFSBool nekofs_tools_mergeToNekodataReuseBase(const char* u8outpath, const char** u8filepaths, int32_t filenum, NekoFSBool verify, NekoFSBool hardlink)
+{
+	auto outpath = __normalrootpath(u8outpath);
+	if (outpath.empty())
+	{
+		return NEKOFS_FALSE;
+	}
+	if (filenum <= 0)
+	{
+		return NEKOFS_FALSE;
+	}
+	std::vector<std::string> patchfiles;
+	for (int32_t i = 0; i < filenum; i++)
+	{
+		auto path = __normalrootpath(u8filepaths[i]);
+		if (path.empty())
+		{
+			return NEKOFS_FALSE;
+		}
+		patchfiles.push_back(path);
+	}
+	return nekofs::tools::Merge::execNekodataReuseBase(outpath, patchfiles, verify == NEKOFS_TRUE, hardlink == NEKOFS_TRUE) ? NEKOFS_TRUE : NEKOFS_FALSE;
+}
 NEKOFS_API NekoFSBool nekofs_tools_mergeToDir(const char* u8outpath, int64_t volumeSize, const char** u8filepaths, int32_t filenum, NekoFSBool verify)
 {
 	if (volumeSize > nekofs_kNekodata_MaxVolumeSize || volumeSize <= 1024)
@@ -1021,4 +1337,40 @@ NEKOFS_API NekoFSBool nekofs_tools_mergeToDir(const char* u8outpath, int64_t vol
 	}
 	return nekofs::tools::Merge::execDir(outpath, volumeSize, patchfiles, verify == NEKOFS_TRUE) ? NEKOFS_TRUE : NEKOFS_FALSE;
 }
+NEKOFS_API NekoFSBool nekofs_tools_compact(const char* u8filepath, const char* u8outpath, int64_t volumeSize)
+{
+	if (volumeSize != 0 && (volumeSize > nekofs_kNekodata_MaxVolumeSize || volumeSize <= 1024))
+	{
+		return NEKOFS_FALSE;
+	}
+	auto fpath = __normalrootpath(u8filepath);
+	if (fpath.empty())
+	{
+		return NEKOFS_FALSE;
+	}
+	auto outpath = __normalrootpath(u8outpath);
+	if (outpath.empty())
+	{
+		return NEKOFS_FALSE;
+	}
+	return nekofs::tools::Compact::exec(fpath, outpath, volumeSize) ? NEKOFS_TRUE : NEKOFS_FALSE;
+}
+NEKOFS_API NekoFSBool nekofs_tools_mkwarmset(const char* u8tracepath, const char* u8outpath, int64_t durationMs)
+{
+	if (durationMs < 0)
+	{
+		return NEKOFS_FALSE;
+	}
+	auto tpath = __normalrootpath(u8tracepath);
+	if (tpath.empty())
+	{
+		return NEKOFS_FALSE;
+	}
+	auto outpath = __normalrootpath(u8outpath);
+	if (outpath.empty())
+	{
+		return NEKOFS_FALSE;
+	}
+	return nekofs::tools::WarmSet::exec(tpath, outpath, durationMs) ? NEKOFS_TRUE : NEKOFS_FALSE;
+}
 #endif // NEKOFS_TOOLS
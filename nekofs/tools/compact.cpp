@@ -0,0 +1,77 @@
+﻿#include "compact.h"
+#include "../common/env.h"
+#include "../common/utils.h"
+#ifdef _WIN32
+#include "../native_win/nativefilesystem.h"
+#else
+#include "../native_posix/nativefilesystem.h"
+#endif
+#include "../nekodata/nekodatafilesystem.h"
+#include "../nekodata/nekodataarchiver.h"
+
+#include <sstream>
+#include <set>
+
+namespace nekofs::tools {
+	bool Compact::exec(const std::string& filepath, const std::string& outpath, int64_t volumeSize)
+	{
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		if (auto ft = nativefs->getFileType(outpath); ft != nekofs::FileType::None)
+		{
+			nekofs::logerr(u8"outpath already exist!");
+			return false;
+		}
+		auto fs = nekofs::NekodataFileSystem::create(nativefs, filepath);
+		if (!fs)
+		{
+			nekofs::logerr(u8"open " + filepath + u8" ... failed!");
+			return false;
+		}
+		if (volumeSize == 0)
+		{
+			volumeSize = fs->getVolumeSzie();
+		}
+		auto archiver = std::make_shared<NekodataArchiver>(outpath, volumeSize);
+		int64_t liveSize = 0;
+		std::set<int64_t> liveExtents; // 去重后多个文件可能共用同一段数据
+		bool hasBlockPositions = false;
+		auto allfiles = fs->getAllFiles(std::string());
+		for (const auto& item : allfiles)
+		{
+			auto meta = fs->getFileMeta(item);
+			auto is = fs->openRawIStream(item, AccessHint::Sequential);
+			if (!meta.has_value() || !is)
+			{
+				nekofs::logerr(u8"open " + filepath + u8" < " + item + u8" ... failed!");
+				return false;
+			}
+			if (meta->hasBlockPositions())
+			{
+				// 块去重后，块分散在数据区中，每块单独统计
+				hasBlockPositions = true;
+				const auto& blocks = meta->getBlocks();
+				for (size_t i = 0; i < blocks.size(); i++)
+				{
+					if (liveExtents.insert(meta->getBlockPos(static_cast<int64_t>(i))).second)
+					{
+						liveSize += blocks[i].second;
+					}
+				}
+			}
+			else if (is->getLength() > 0 && liveExtents.insert(meta->getBeginPos()).second)
+			{
+				liveSize += is->getLength();
+			}
+			archiver->addRawFile(item, is, meta.value());
+		}
+		{
+			std::stringstream ss;
+			ss << u8"compact " << filepath << u8", files = " << allfiles.size();
+			ss << u8", live = " << liveSize << u8", total = " << fs->getDataLength();
+			nekofs::loginfo(ss.str());
+		}
+		// 原来使用了块去重，整理后继续共用相同的块
+		archiver->setBlockDeduplicate(hasBlockPositions);
+		return archiver->archive();
+	}
+}
@@ -0,0 +1,17 @@
+﻿#pragma once
+#include "../common/typedef.h"
+
+#include <cstdint>
+#include <string>
+
+namespace nekofs::tools {
+	class Compact final
+	{
+	public:
+		/*
+		* 把nekodata中仍在使用的文件原样拷贝到新的nekodata，丢弃追加写入后遗留的无用数据。不解压、不重新压缩。
+		* volumeSize为0时使用原nekodata的分卷大小。
+		*/
+		static bool exec(const std::string& filepath, const std::string& outpath, int64_t volumeSize);
+	};
+}
@@ -83,6 +83,19 @@ namespace nekofs::tools {
 		}
 		return false;
 	}
+	/*
+	* 复用第一个包的分卷，未改动的文件保持原位置，改动的文件追加在后面。分卷大小和第一个包相同。
+	*/
+	bool Merge::execNekodataReuseBase(const std::string& outfilepath, const std::vector<std::string> patchfiles, bool verify, bool allowHardlink)
+	{
+		auto merger = prepare(patchfiles, verify);
+		if (merger)
+		{
+			auto archiver = NekodataArchiver::createFromBase(outfilepath, patchfiles[0], allowHardlink);
+			return archiver && merger->exec(archiver);
+		}
+		return false;
+	}
 	bool Merge::execDir(const std::string& outdirpath, int64_t volumeSize, const std::vector<std::string> patchfiles, bool verify)
 	{
 		auto merger = prepare(patchfiles, verify);
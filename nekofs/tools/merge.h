@@ -9,6 +9,7 @@ namespace nekofs::tools {
 	{
 	public:
 		static bool execNekodata(const std::string& outfilepath, int64_t volumeSize, const std::vector<std::string> patchfiles, bool verify = true);
+		static bool execNekodataReuseBase(const std::string& outfilepath, const std::vector<std::string> patchfiles, bool verify = true, bool allowHardlink = false);
 		static bool execDir(const std::string& outdirpath, int64_t volumeSize, const std::vector<std::string> patchfiles, bool verify = true);
 	};
 }
@@ -4,6 +4,7 @@
 #include "../common/sha256.h"
 #include "../layer/layerfilesmeta.h"
 #include "../layer/layerversionmeta.h"
+#include "../layer/layerdelta.h"
 #ifdef _WIN32
 #include "../native_win/nativefilesystem.h"
 #else
@@ -13,10 +14,37 @@
 #include "../nekodata/nekodataarchiver.h"
 
 #include <sstream>
+#include <algorithm>
 
 namespace nekofs::tools {
-	bool MKDiff::exec(const std::string& earlierfile, const std::string& latestfile, const std::string& filepath, int64_t volumeSize)
+	// 只对这个范围内的文件计算差异，小文件收益不大，大文件需要整个读入内存
+	constexpr int64_t kDeltaMinFileSize = 1024 * 1024;
+	constexpr int64_t kDeltaMaxFileSize = 256 * 1024 * 1024;
+
+	static bool readAll(std::shared_ptr<IStream> is, int64_t size, std::vector<uint8_t>& data)
 	{
+		if (!is || is->getLength() != size)
+		{
+			return false;
+		}
+		data.resize(static_cast<size_t>(size));
+		int64_t pos = 0;
+		while (pos < size)
+		{
+			const int32_t length = static_cast<int32_t>(std::min<int64_t>(size - pos, nekofs_kNekoData_LZ4_Buffer_Size));
+			if (istream_read(is, data.data() + pos, length) != length)
+			{
+				return false;
+			}
+			pos += length;
+		}
+		return true;
+	}
+
+	bool MKDiff::exec(const std::string& earlierfile, const std::string& latestfile, const std::string& filepath, int64_t volumeSize, VerifyMode verifyMode, bool delta)
+	{
+		verifyMode_ = verifyMode;
+		delta_ = delta;
 		auto nativefs = env::getInstance().getNativeFileSystem();
 		// 检查文件是否已存在，如果存在就报错退出
 		if (auto ft = nativefs->getFileType(filepath); ft != nekofs::FileType::None)
@@ -47,20 +75,45 @@ namespace nekofs::tools {
 		}
 		auto earlierfs = NekodataFileSystem::create(nativefs, earlierfile);
 		auto latestfs = NekodataFileSystem::create(nativefs, latestfile);
-		nekofs::loginfo(u8"verify " + earlierfile + u8" ...");
-		if (!earlierfs || !earlierfs->verify())
+		if (!earlierfs)
 		{
-			nekofs::logerr(u8"verify " + earlierfile + u8" ... failed");
+			nekofs::logerr(u8"earlierfile: can not open " + earlierfile);
 			return false;
 		}
-		nekofs::loginfo(u8"verify " + earlierfile + u8" ... ok");
-		nekofs::loginfo(u8"verify " + latestfile + u8" ...");
-		if (!latestfs || !latestfs->verify())
+		if (!latestfs)
 		{
-			nekofs::logerr(u8"verify " + latestfile + u8" ... failed");
+			nekofs::logerr(u8"latestfile: can not open " + latestfile);
 			return false;
 		}
-		nekofs::loginfo(u8"verify " + latestfile + u8" ... ok");
+		if (verifyMode_ == VerifyMode::All)
+		{
+			nekofs::loginfo(u8"verify " + earlierfile + u8" ...");
+			if (!earlierfs->verify())
+			{
+				nekofs::logerr(u8"verify " + earlierfile + u8" ... failed");
+				return false;
+			}
+			nekofs::loginfo(u8"verify " + earlierfile + u8" ... ok");
+			nekofs::loginfo(u8"verify " + latestfile + u8" ...");
+			if (!latestfs->verify())
+			{
+				nekofs::logerr(u8"verify " + latestfile + u8" ... failed");
+				return false;
+			}
+			nekofs::loginfo(u8"verify " + latestfile + u8" ... ok");
+		}
+		else if (verifyMode_ == VerifyMode::Patch)
+		{
+			// 差异只由版本信息和files.json决定，先校验它们，补丁里的文件在拷贝时校验
+			if (!verifyLayerMeta(earlierfs, earlierfile) || !verifyLayerMeta(latestfs, latestfile))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			nekofs::logwarn(u8"mkdiff without verify: " + earlierfile + u8", " + latestfile);
+		}
 
 		auto vm_earlier = nekofs::LayerVersionMeta::load(earlierfs->openIStream(nekofs_kLayerVersion));
 		auto vm_latest = nekofs::LayerVersionMeta::load(latestfs->openIStream(nekofs_kLayerVersion));
@@ -98,6 +151,12 @@ namespace nekofs::tools {
 		// versionmeta和filesmeta都没有问题。准备对比差异。
 		auto lfm = nekofs::LayerFilesMeta::makediff(fm_earlier.value(), fm_latest.value(), vm_latest->getVersion());
 
+		auto archiver = std::make_shared<NekodataArchiver>(filepath, volumeSize);
+		// 先加入文件，保存成差异的文件会修改lfm
+		if (!addFiles(archiver, earlierfs, latestfs, fm_earlier.value(), lfm))
+		{
+			return false;
+		}
 		auto jsonStrBuffer_lvm = newJsonBuffer();
 		JSONStringPrettyWriter jsonString_lvm(*jsonStrBuffer_lvm);
 		JSONDocument d_lvm(rapidjson::kObjectType);
@@ -109,24 +168,8 @@ namespace nekofs::tools {
 		lfm.save(&d_lfm, d_lfm.GetAllocator());
 		d_lfm.Accept(jsonString_lfm);
 
-		auto archiver = std::make_shared<NekodataArchiver>(filepath, volumeSize);
 		archiver->addBuffer(nekofs_kLayerVersion, jsonStrBuffer_lvm->GetString(), static_cast<int64_t>(jsonStrBuffer_lvm->GetSize()));
 		archiver->addBuffer(nekofs_kLayerFiles, jsonStrBuffer_lfm->GetString(), static_cast<int64_t>(jsonStrBuffer_lfm->GetSize()));
-		const auto& files = lfm.getFiles();
-		for (const auto& item : files)
-		{
-			auto meta = latestfs->getFileMeta(item.first);
-			auto is = latestfs->openRawIStream(item.first);
-			if (meta.has_value() && is)
-			{
-				archiver->addRawFile(item.first, is, meta.value());
-			}
-			else
-			{
-				nekofs::logerr(u8"!get nekodata.filemeta failed! file = " + item.first);
-				return false;
-			}
-		}
 		const auto& nekodatas = lfm.getNekodatas();
 		for (const auto& item : nekodatas)
 		{
@@ -144,6 +187,11 @@ namespace nekofs::tools {
 	}
 	bool MKDiff::diffLayer(std::shared_ptr<NekodataArchiver> archiver, std::shared_ptr<NekodataFileSystem> earlierfs, std::shared_ptr<NekodataFileSystem> latestfs, uint32_t latestVersion)
 	{
+		if (verifyMode_ == VerifyMode::Patch && ((earlierfs && !verifyLayerMeta(earlierfs, u8"earlier sub layer"))
+			|| (latestfs && !verifyLayerMeta(latestfs, u8"latest sub layer"))))
+		{
+			return false;
+		}
 		auto fm_earlier = earlierfs ? nekofs::LayerFilesMeta::load(earlierfs->openIStream(nekofs_kLayerFiles)) : std::nullopt;
 		auto fm_latest = latestfs ? nekofs::LayerFilesMeta::load(latestfs->openIStream(nekofs_kLayerFiles)) : std::nullopt;
 		if (!fm_earlier.has_value())
@@ -155,6 +203,10 @@ namespace nekofs::tools {
 			fm_latest = nekofs::LayerFilesMeta();
 		}
 		auto lfm = nekofs::LayerFilesMeta::makediff(fm_earlier.value(), fm_latest.value(), latestVersion);
+		if (!addFiles(archiver, earlierfs, latestfs, fm_earlier.value(), lfm))
+		{
+			return false;
+		}
 		auto jsonStrBuffer_lfm = newJsonBuffer();
 		JSONStringPrettyWriter jsonString_lfm(*jsonStrBuffer_lfm);
 		JSONDocument d_lfm(rapidjson::kObjectType);
@@ -163,30 +215,95 @@ namespace nekofs::tools {
 
 		archiver->addBuffer(nekofs_kLayerFiles, jsonStrBuffer_lfm->GetString(), static_cast<int64_t>(jsonStrBuffer_lfm->GetSize()));
 
-		const auto& files = lfm.getFiles();
+		const auto& nekodatas = lfm.getNekodatas();
+		for (const auto& item : nekodatas)
+		{
+			auto subArchiver = archiver->addArchive(item);
+			auto earliersubfs = NekodataFileSystem::create(earlierfs, item);
+			auto latestsubfs = NekodataFileSystem::create(latestfs, item);
+			if (!diffLayer(subArchiver, earliersubfs, latestsubfs, latestVersion))
+			{
+				nekofs::logerr(u8"diffLayer: !diffLayer(subArchiver, earliersubfs, latestsubfs)");
+				return false;
+			}
+		}
+		return true;
+	}
+	bool MKDiff::addFiles(std::shared_ptr<NekodataArchiver> archiver, std::shared_ptr<NekodataFileSystem> earlierfs, std::shared_ptr<NekodataFileSystem> latestfs, const LayerFilesMeta& fm_earlier, LayerFilesMeta& lfm)
+	{
+		const auto files = lfm.getFiles();
 		for (const auto& item : files)
 		{
 			auto meta = latestfs->getFileMeta(item.first);
-			auto is = latestfs->openRawIStream(item.first);
-			if (meta.has_value() && is)
+			auto is = latestfs->openRawIStream(item.first, AccessHint::Sequential);
+			if (!meta.has_value() || !is)
 			{
-				archiver->addRawFile(item.first, is, meta.value());
+				nekofs::logerr(u8"MKDiff::addFiles get nekodata.filemeta failed! file = " + item.first);
+				return false;
 			}
-			else
+			if (delta_ && earlierfs)
 			{
-				nekofs::logerr(u8"diffLayer: get nekodata.filemeta failed! file = " + item.first);
-				return false;
+				auto earlierMeta = fm_earlier.getFileMeta(item.first);
+				if (earlierMeta.has_value() && addDeltaFile(archiver, earlierfs, latestfs, item.first, earlierMeta.value(), item.second))
+				{
+					auto deltaMeta = item.second;
+					deltaMeta.setDeltaBase(earlierMeta->getSHA256());
+					lfm.setFileMeta(item.first, deltaMeta);
+					continue;
+				}
 			}
+			archiver->addRawFile(item.first, is, meta.value(), verifyMode_ == VerifyMode::Patch);
 		}
-		const auto& nekodatas = lfm.getNekodatas();
-		for (const auto& item : nekodatas)
+		return true;
+	}
+	/*
+	* 两个版本都完整读入内存并用files.json中的sha256校验，校验失败或差异不够小时返回false，由调用方保存完整文件。
+	*/
+	bool MKDiff::addDeltaFile(std::shared_ptr<NekodataArchiver> archiver, std::shared_ptr<NekodataFileSystem> earlierfs, std::shared_ptr<NekodataFileSystem> latestfs, const std::string& filepath, const LayerFilesMeta::FileMeta& earlierMeta, const LayerFilesMeta::FileMeta& latestMeta)
+	{
+		if (latestMeta.getSize() < kDeltaMinFileSize || latestMeta.getSize() > kDeltaMaxFileSize || earlierMeta.getSize() > kDeltaMaxFileSize)
 		{
-			auto subArchiver = archiver->addArchive(item);
-			auto earliersubfs = NekodataFileSystem::create(earlierfs, item);
-			auto latestsubfs = NekodataFileSystem::create(latestfs, item);
-			if (!diffLayer(subArchiver, earliersubfs, latestsubfs, latestVersion))
+			return false;
+		}
+		std::vector<uint8_t> base;
+		std::vector<uint8_t> target;
+		if (!readAll(earlierfs->openIStream(filepath), earlierMeta.getSize(), base) || !readAll(latestfs->openIStream(filepath), latestMeta.getSize(), target))
+		{
+			return false;
+		}
+		sha256sum baseSHA256;
+		baseSHA256.final(base.data(), base.size());
+		sha256sum targetSHA256;
+		targetSHA256.final(target.data(), target.size());
+		if (baseSHA256.readHash() != earlierMeta.getSHA256() || targetSHA256.readHash() != latestMeta.getSHA256())
+		{
+			nekofs::logwarn(u8"MKDiff::addDeltaFile sha256 mismatch, store full file. file = " + filepath);
+			return false;
+		}
+		auto delta = std::make_shared<std::vector<uint8_t>>();
+		if (!LayerDelta::encode(base.data(), static_cast<int64_t>(base.size()), earlierMeta.getSHA256(), target.data(), static_cast<int64_t>(target.size()), *delta))
+		{
+			return false;
+		}
+		deltaBuffer_.push_back(delta);
+		archiver->addBuffer(filepath, delta->data(), static_cast<int64_t>(delta->size()));
+		std::stringstream ss;
+		ss << u8"delta " << filepath << u8" " << target.size() << u8" -> " << delta->size();
+		nekofs::loginfo(ss.str());
+		return true;
+	}
+	bool MKDiff::verifyLayerMeta(std::shared_ptr<NekodataFileSystem> fs, const std::string& name) const
+	{
+		for (const char* filepath : { nekofs_kLayerVersion, nekofs_kLayerFiles })
+		{
+			auto meta = fs->getFileMeta(filepath);
+			if (!meta.has_value() || meta->getOriginalSize() == 0)
 			{
-				nekofs::logerr(u8"diffLayer: !diffLayer(subArchiver, earliersubfs, latestsubfs)");
+				continue;
+			}
+			if (!verifySHA256(fs->openRawIStream(filepath, AccessHint::Sequential), meta->getSHA256()))
+			{
+				nekofs::logerr(u8"verify " + name + u8" " + filepath + u8" ... failed");
 				return false;
 			}
 		}
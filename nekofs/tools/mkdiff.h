@@ -1,6 +1,7 @@
 ﻿#pragma once
 #include "../common/typedef.h"
 #include "../common/rapidjson.h"
+#include "../layer/layerfilesmeta.h"
 
 #include <cstdint>
 #include <memory>
@@ -15,14 +16,31 @@ namespace nekofs::tools {
 	class MKDiff final
 	{
 	public:
-		bool exec(const std::string& earlierfile, const std::string& latestfile, const std::string& filepath, int64_t volumeSize);
+		enum class VerifyMode : int32_t
+		{
+			All = 0,    // 对比前完整校验两个nekodata
+			None = 1,   // 完全信任files.json，不校验
+			Patch = 2   // 只校验files.json和写入补丁的文件，在拷贝时校验
+		};
+
+	public:
+		/*
+		* delta为true时，两个版本中都有且大小合适的文件尝试只保存相对旧版本的块级差异（LayerDelta），差异不够小时仍保存完整文件。
+		*/
+		bool exec(const std::string& earlierfile, const std::string& latestfile, const std::string& filepath, int64_t volumeSize, VerifyMode verifyMode = VerifyMode::All, bool delta = false);
 
 	private:
+		bool addFiles(std::shared_ptr<NekodataArchiver> archiver, std::shared_ptr<NekodataFileSystem> earlierfs, std::shared_ptr<NekodataFileSystem> latestfs, const LayerFilesMeta& fm_earlier, LayerFilesMeta& lfm);
+		bool addDeltaFile(std::shared_ptr<NekodataArchiver> archiver, std::shared_ptr<NekodataFileSystem> earlierfs, std::shared_ptr<NekodataFileSystem> latestfs, const std::string& filepath, const LayerFilesMeta::FileMeta& earlierMeta, const LayerFilesMeta::FileMeta& latestMeta);
 		bool diffLayer(std::shared_ptr<NekodataArchiver> archiver, std::shared_ptr<NekodataFileSystem> earlierfs, std::shared_ptr<NekodataFileSystem> latestfs, uint32_t latestVersion);
+		bool verifyLayerMeta(std::shared_ptr<NekodataFileSystem> fs, const std::string& name) const;
 		std::shared_ptr<JSONStringBuffer> newJsonBuffer();
 
 	private:
 		std::vector<std::shared_ptr<JSONStringBuffer>> jsonBuffer_;
+		std::vector<std::shared_ptr<std::vector<uint8_t>>> deltaBuffer_;
+		VerifyMode verifyMode_ = VerifyMode::All;
+		bool delta_ = false;
 	};
 }
 
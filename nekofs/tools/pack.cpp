@@ -2,6 +2,7 @@
 #include "../common/env.h"
 #include "../common/utils.h"
 #include "../common/sha256.h"
+#include "../common/accesstrace.h"
 #ifdef _WIN32
 #include "../native_win/nativefilesystem.h"
 #else
@@ -13,7 +14,7 @@
 #include <sstream>
 
 namespace nekofs::tools {
-	bool Pack::exec(const std::string& dirpath, const std::string& outpath, int64_t volumeSize)
+	bool Pack::exec(const std::string& dirpath, const std::string& outpath, int64_t volumeSize, bool contentDefinedChunking, bool blockDeduplicate, const std::string& orderpath, const std::string& orderprefix)
 	{
 		auto nativefs = env::getInstance().getNativeFileSystem();
 		if (auto ft = nativefs->getFileType(dirpath); ft != nekofs::FileType::Directory)
@@ -26,6 +27,57 @@ namespace nekofs::tools {
 			nekofs::logerr(u8"outpath already exist!");
 			return false;
 		}
+		auto archiver = std::make_shared<NekodataArchiver>(outpath, volumeSize);
+		if (contentDefinedChunking)
+		{
+			archiver->setContentDefinedChunking();
+		}
+		archiver->setBlockDeduplicate(blockDeduplicate);
+		if (!orderpath.empty())
+		{
+			std::string prefix = orderprefix;
+			if (prefix.empty())
+			{
+				// 层中的nekodata挂载在去掉扩展名的文件名下
+				const auto pos = outpath.find_last_of(nekofs_PathSeparator);
+				prefix = pos == std::string::npos ? outpath : outpath.substr(pos + 1);
+				if (str_EndWith(prefix, nekofs_kNekodata_FileExtension))
+				{
+					prefix.resize(prefix.size() - nekofs_kNekodata_FileExtension.size());
+				}
+			}
+			if (!str_EndWith(prefix, std::string(nekofs_PathSeparator)))
+			{
+				prefix.append(nekofs_PathSeparator);
+			}
+			std::vector<std::string> order;
+			if (!loadAccessOrder(orderpath, prefix, order))
+			{
+				return false;
+			}
+			archiver->setAccessOrder(order);
+		}
+		return addDir(archiver, dirpath) && archiver->archive();
+	}
+
+	/*
+	* 输出到顺序写入的流，只生成单个分卷。tmppath用作嵌套nekodata临时文件的前缀。
+	*/
+	bool Pack::exec(const std::string& dirpath, const std::string& tmppath, std::shared_ptr<OStream> os)
+	{
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		if (auto ft = nativefs->getFileType(dirpath); ft != nekofs::FileType::Directory)
+		{
+			nekofs::logerr(u8"pack dir not found!");
+			return false;
+		}
+		auto archiver = std::make_shared<NekodataArchiver>(tmppath, nekofs_kNekodata_MaxVolumeSize, true);
+		return addDir(archiver, dirpath) && archiver->archiveToStream(os);
+	}
+
+	bool Pack::addDir(std::shared_ptr<nekofs::NekodataArchiver> archiver, const std::string& dirpath)
+	{
+		auto nativefs = env::getInstance().getNativeFileSystem();
 		if (auto ft = nativefs->getFileType(dirpath + nekofs_PathSeparator + nekofs_kLayerVersion); ft != nekofs::FileType::Regular)
 		{
 			nekofs::logerr(u8"file not found! " + dirpath + nekofs_PathSeparator + nekofs_kLayerVersion);
@@ -37,7 +89,6 @@ namespace nekofs::tools {
 			nekofs::logerr(u8"open " + dirpath + nekofs_PathSeparator + nekofs_kLayerFiles + u8" failed!");
 			return false;
 		}
-		auto archiver = std::make_shared<NekodataArchiver>(outpath, volumeSize);
 		archiver->addFile(nekofs_kLayerVersion, nativefs, dirpath + nekofs_PathSeparator + nekofs_kLayerVersion);
 		archiver->addFile(nekofs_kLayerFiles, nativefs, dirpath + nekofs_PathSeparator + nekofs_kLayerFiles);
 		auto allfiles = lfm->getFiles();
@@ -53,7 +104,73 @@ namespace nekofs::tools {
 				return false;
 			}
 		}
-		return archiver->archive();
+		return true;
+	}
+
+	/*
+	* 访问顺序可以是访问记录（.nekotrace，按第一次打开排序），也可以是每行一个路径的文本文件。
+	* 路径是overlay中的路径，去掉prefix后才是nekodata中的路径，不以prefix开头的属于别的文件，丢弃。
+	* 没有路径以prefix开头时认为记录时这个nekodata直接作为层挂载，路径不变。
+	*/
+	bool Pack::loadAccessOrder(const std::string& orderpath, const std::string& prefix, std::vector<std::string>& order)
+	{
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		auto is = nativefs->getFileType(orderpath) == nekofs::FileType::Regular ? nativefs->openIStream(orderpath) : nullptr;
+		if (!is)
+		{
+			nekofs::logerr(u8"open " + orderpath + u8" failed!");
+			return false;
+		}
+		std::string data(static_cast<size_t>(is->getLength()), '\0');
+		if (istream_read(is, data.data(), static_cast<int32_t>(data.size())) != static_cast<int32_t>(data.size()))
+		{
+			nekofs::logerr(u8"read " + orderpath + u8" failed!");
+			return false;
+		}
+		if (data.compare(0, nekofs_kAccessTrace_FileHeader.size(), nekofs_kAccessTrace_FileHeader) == 0)
+		{
+			std::vector<std::string> paths;
+			std::vector<AccessTraceRecord> records;
+			if (is->seek(0, SeekOrigin::Begin) != 0 || !AccessTrace::load(is, paths, records))
+			{
+				nekofs::logerr(u8"load " + orderpath + u8" failed!");
+				return false;
+			}
+			order = AccessTrace::getFirstTouchOrder(paths, records);
+		}
+		else
+		{
+			std::stringstream ss(data);
+			std::string line;
+			while (std::getline(ss, line))
+			{
+				if (!line.empty() && line.back() == '\r')
+				{
+					line.pop_back();
+				}
+				if (!line.empty())
+				{
+					order.push_back(line);
+				}
+			}
+		}
+		std::vector<std::string> stripped;
+		for (const auto& item : order)
+		{
+			if (item.size() > prefix.size() && item.compare(0, prefix.size(), prefix) == 0)
+			{
+				stripped.push_back(item.substr(prefix.size()));
+			}
+		}
+		const bool hasPrefix = !stripped.empty();
+		if (hasPrefix)
+		{
+			order.swap(stripped);
+		}
+		std::stringstream ss;
+		ss << u8"access order " << orderpath << u8", prefix = " << (hasPrefix ? prefix : std::string()) << u8", files = " << order.size();
+		nekofs::loginfo(ss.str());
+		return true;
 	}
 
 	bool Pack::packDir(std::shared_ptr<nekofs::NekodataArchiver> archiver, const std::string& dirpath)
@@ -3,6 +3,8 @@
 
 #include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace nekofs {
 	class NekodataArchiver;
@@ -12,10 +14,16 @@ namespace nekofs::tools {
 	class Pack final
 	{
 	public:
-		static bool exec(const std::string& dirpath, const std::string& outpath, int64_t volumeSize);
+		/*
+		* orderprefix是访问顺序中这个nekodata的路径前缀，为空时使用outpath去掉扩展名的文件名。
+		*/
+		static bool exec(const std::string& dirpath, const std::string& outpath, int64_t volumeSize, bool contentDefinedChunking = false, bool blockDeduplicate = false, const std::string& orderpath = std::string(), const std::string& orderprefix = std::string());
+		static bool exec(const std::string& dirpath, const std::string& tmppath, std::shared_ptr<OStream> os);
 
 	private:
+		static bool addDir(std::shared_ptr<nekofs::NekodataArchiver> archiver, const std::string& dirpath);
 		static bool packDir(std::shared_ptr<nekofs::NekodataArchiver> archiver, const std::string& dirpath);
+		static bool loadAccessOrder(const std::string& orderpath, const std::string& prefix, std::vector<std::string>& order);
 	};
 }
 
@@ -6,16 +6,31 @@
 #include "../common/sha256.h"
 #ifdef _WIN32
 #include "../native_win/nativefilesystem.h"
+#include "../native_win/nativefileistream.h"
 #else
 #include "../native_posix/nativefilesystem.h"
+#include "../native_posix/nativefileistream.h"
 #endif
 
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <limits>
+#include <chrono>
 
 namespace nekofs::tools {
-	bool PrePare::exec(const std::string& genpath, const std::string& versionfile, uint32_t versionOffset)
+	constexpr const char* kPrepareCacheHeader = u8"nekofs-prepare-cache 1";
+	constexpr size_t kHashGroupSize = 64; // 每个线程一次取的文件数
+	constexpr int64_t kBatchHashFileSize = 64 * 1024; // 不超过这个大小的文件放在一起用多路sha256计算
+
+	bool PrePare::exec(const std::string& genpath, const std::string& versionfile, uint32_t versionOffset, const std::string& cachefile, bool paranoid)
 	{
 		auto nativefs = env::getInstance().getNativeFileSystem();
+		if (!cachefile.empty() && cachefile.rfind(genpath + nekofs_PathSeparator, 0) == 0)
+		{
+			nekofs::logerr(u8"cachefile can not be in " + genpath);
+			return false;
+		}
 		if (auto ft = nativefs->getFileType(genpath + nekofs_PathSeparator + nekofs_kLayerFiles); ft != nekofs::FileType::None)
 		{
 			if (!nativefs->removeFile(genpath + nekofs_PathSeparator + nekofs_kLayerFiles))
@@ -45,55 +60,100 @@ namespace nekofs::tools {
 			}
 		}
 
-		const uint32_t buffer_size = 8 * 1024;
-		char buffer[buffer_size];
-		nekofs::LayerFilesMeta lfm;
+		/*
+		* 先遍历出所有文件，再用多个线程从映射内存直接计算sha256。
+		* 子目录的文件写入各自的files.json，根目录的文件写在最后，和以前的输出一致。
+		*/
 		auto files = nativefs->getFiles(genpath);
 		auto dirs = nativefs->getDirs(genpath);
-		for (const auto& item : dirs)
+		std::vector<std::vector<PrepareFile>> dirfiles(dirs.size());
+		std::vector<PrepareFile> allfiles;
+		for (size_t i = 0; i < dirs.size(); i++)
 		{
-			lfm.addNekodata(item + nekofs_kNekodata_FileExtension.data());
-			if (!prepareDir(genpath + nekofs_PathSeparator + item, lvm->getVersion()))
+			if (!prepareDir(genpath + nekofs_PathSeparator + dirs[i], dirfiles[i]))
 			{
-				nekofs::logerr(u8"prepareDir " + genpath + nekofs_PathSeparator + item + u8" faild!");
+				nekofs::logerr(u8"prepareDir " + genpath + nekofs_PathSeparator + dirs[i] + u8" faild!");
 				return false;
 			}
+			for (const auto& item : dirfiles[i])
+			{
+				allfiles.push_back(PrepareFile{ dirs[i] + nekofs_PathSeparator + item.filepath });
+			}
 		}
 		for (const auto& item : files)
 		{
-			sha256sum sum;
-			auto is = nativefs->openIStream(genpath + nekofs_PathSeparator + item);
-			int32_t actualRead = 0;
-			do
+			allfiles.push_back(PrepareFile{ item });
+		}
+		const int64_t startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		PrepareCache cache;
+		bool useCache = !cachefile.empty() && !paranoid && loadCache(cachefile, cache);
+		if (!hashFiles(genpath, allfiles, useCache ? &cache : nullptr))
+		{
+			return false;
+		}
+		if (!cachefile.empty())
+		{
+			size_t cachedNum = 0;
+			for (const auto& item : allfiles)
 			{
-				actualRead = is->read(buffer, buffer_size);
-				if (actualRead > 0)
-				{
-					sum.update(buffer, actualRead);
-				}
-			} while (actualRead > 0);
-			if (actualRead < 0)
+				cachedNum += item.cached ? 1 : 0;
+			}
+			std::stringstream ss;
+			ss << u8"prepare files = " << allfiles.size() << u8", cached = " << cachedNum;
+			nekofs::loginfo(ss.str());
+		}
+
+		size_t index = 0;
+		for (size_t i = 0; i < dirs.size(); i++)
+		{
+			nekofs::LayerFilesMeta dirlfm;
+			for (const auto& item : dirfiles[i])
 			{
-				std::stringstream ss;
-				ss << u8"read stream error! filepath = ";
-				ss << genpath << nekofs_PathSeparator << item;
-				nekofs::logerr(ss.str());
+				nekofs::LayerFilesMeta::FileMeta meta;
+				meta.setVersion(lvm->getVersion());
+				meta.setSHA256(allfiles[index].sha256);
+				meta.setSize(allfiles[index].size);
+				dirlfm.setFileMeta(item.filepath, meta);
+				index++;
+			}
+			auto fos = nativefs->openOStream(genpath + nekofs_PathSeparator + dirs[i] + nekofs_PathSeparator + nekofs_kLayerFiles);
+			if (!dirlfm.save(fos))
+			{
+				nekofs::logerr(u8"prepareDir " + genpath + nekofs_PathSeparator + dirs[i] + u8" faild!");
 				return false;
 			}
-			sum.final();
-
+		}
+		nekofs::LayerFilesMeta lfm;
+		for (const auto& item : dirs)
+		{
+			lfm.addNekodata(item + nekofs_kNekodata_FileExtension.data());
+		}
+		for (; index < allfiles.size(); index++)
+		{
 			nekofs::LayerFilesMeta::FileMeta meta;
 			meta.setVersion(lvm->getVersion());
-			meta.setSHA256(sum.readHash());
-			meta.setSize(is->getLength());
-			lfm.setFileMeta(item, meta);
+			meta.setSHA256(allfiles[index].sha256);
+			meta.setSize(allfiles[index].size);
+			lfm.setFileMeta(allfiles[index].filepath, meta);
 		}
 		auto fos = nativefs->openOStream(genpath + nekofs_PathSeparator + nekofs_kLayerFiles);
 		auto vos = nativefs->openOStream(genpath + nekofs_PathSeparator + nekofs_kLayerVersion);
-		return lfm.save(fos) && lvm->save(vos);
+		if (!lfm.save(fos) || !lvm->save(vos))
+		{
+			return false;
+		}
+		// 缓存写失败不影响结果，下次全部重新计算
+		if (!cachefile.empty() && !saveCache(cachefile, startTime, allfiles))
+		{
+			nekofs::logwarn(u8"save prepare cache " + cachefile + u8" faild!");
+		}
+		return true;
 	}
 
-	bool PrePare::prepareDir(const std::string& genpath, uint32_t currentVersion)
+	/*
+	* 删除旧的files.json，列出目录下的所有文件。
+	*/
+	bool PrePare::prepareDir(const std::string& genpath, std::vector<PrepareFile>& files)
 	{
 		auto nativefs = env::getInstance().getNativeFileSystem();
 		if (auto ft = nativefs->getFileType(genpath + nekofs_PathSeparator + nekofs_kLayerFiles); ft != nekofs::FileType::None)
@@ -104,40 +164,189 @@ namespace nekofs::tools {
 				return false;
 			}
 		}
-		const uint32_t buffer_size = 8 * 1024;
-		char buffer[buffer_size];
-		nekofs::LayerFilesMeta lfm;
-		auto allfiles = nativefs->getAllFiles(genpath);
-		for (const auto& item : allfiles)
+		for (const auto& item : nativefs->getAllFiles(genpath))
 		{
-			sha256sum sum;
-			auto is = nativefs->openIStream(genpath + nekofs_PathSeparator + item);
-			int32_t actualRead = 0;
-			do
+			files.push_back(PrepareFile{ item });
+		}
+		return true;
+	}
+	bool PrePare::hashFiles(const std::string& genpath, std::vector<PrepareFile>& files, const PrepareCache* cache)
+	{
+		std::atomic<size_t> next = 0;
+		std::atomic<bool> success = true;
+		auto threadfunction = [&genpath, &files, cache, &next, &success]() {
+			for (size_t i = next.fetch_add(kHashGroupSize); i < files.size() && success; i = next.fetch_add(kHashGroupSize))
 			{
-				actualRead = is->read(buffer, buffer_size);
-				if (actualRead > 0)
+				if (!hashFileGroup(genpath, files.data() + i, std::min(kHashGroupSize, files.size() - i), cache))
 				{
-					sum.update(buffer, actualRead);
+					success = false;
 				}
-			} while (actualRead > 0);
-			if (actualRead < 0)
+			}
+		};
+		size_t threadNum = std::min(static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency())), (files.size() + kHashGroupSize - 1) / kHashGroupSize);
+		std::vector<std::thread> t;
+		for (size_t i = 1; i < threadNum; i++)
+		{
+			t.push_back(std::thread(threadfunction));
+		}
+		threadfunction();
+		for (auto& item : t)
+		{
+			item.join();
+		}
+		return success;
+	}
+	/*
+	* 小文件整个映射后交给sha256batch一起计算，大文件单独按流计算。
+	*/
+	bool PrePare::hashFileGroup(const std::string& genpath, PrepareFile* files, size_t count, const PrepareCache* cache)
+	{
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		sha256batch batch;
+		std::vector<std::pair<PrepareFile*, std::shared_ptr<NativeIStream>>> batchFiles;
+		for (size_t i = 0; i < count; i++)
+		{
+			auto& file = files[i];
+			if (loadFromCache(genpath, file, cache))
+			{
+				continue;
+			}
+			auto is = std::dynamic_pointer_cast<NativeIStream>(nativefs->openIStream(genpath + nekofs_PathSeparator + file.filepath));
+			if (is && is->getLength() <= kBatchHashFileSize)
+			{
+				int32_t size = static_cast<int32_t>(is->getLength());
+				const void* data = size > 0 ? is->peek(size) : nullptr;
+				if (size == is->getLength() && (data != nullptr || size == 0))
+				{
+					batch.add(data, size);
+					batchFiles.emplace_back(&file, is);
+					continue;
+				}
+			}
+			if (!hashOneFile(genpath, file, is))
 			{
-				std::stringstream ss;
-				ss << u8"read stream error! filepath = ";
-				ss << genpath << nekofs_PathSeparator << item;
-				nekofs::logerr(ss.str());
 				return false;
 			}
-			sum.final();
-
-			nekofs::LayerFilesMeta::FileMeta meta;
-			meta.setVersion(currentVersion);
-			meta.setSHA256(sum.readHash());
-			meta.setSize(is->getLength());
-			lfm.setFileMeta(item, meta);
 		}
-		auto fos = nativefs->openOStream(genpath + nekofs_PathSeparator + nekofs_kLayerFiles);
-		return lfm.save(fos);
+		batch.compute();
+		for (size_t i = 0; i < batchFiles.size(); i++)
+		{
+			batchFiles[i].first->sha256 = batch.readHash(i);
+			batchFiles[i].first->size = batchFiles[i].second->getLength();
+		}
+		return true;
+	}
+	bool PrePare::loadFromCache(const std::string& genpath, PrepareFile& file, const PrepareCache* cache)
+	{
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		// 先取文件信息再计算，计算期间文件被修改的话，下次信息对不上会重新计算
+		file.hasStat = nativefs->getFileStat(genpath + nekofs_PathSeparator + file.filepath, file.stat);
+		if (cache && file.hasStat)
+		{
+			auto it = cache->files.find(file.filepath);
+			if (it != cache->files.end() && file.stat.mtime < cache->time
+				&& it->second.stat.size == file.stat.size && it->second.stat.mtime == file.stat.mtime && it->second.stat.inode == file.stat.inode)
+			{
+				file.sha256 = it->second.sha256;
+				file.size = file.stat.size;
+				file.cached = true;
+				return true;
+			}
+		}
+		return false;
+	}
+	bool PrePare::hashOneFile(const std::string& genpath, PrepareFile& file, std::shared_ptr<NativeIStream> is)
+	{
+		bool success = is != nullptr;
+		sha256sum sum;
+		while (success && is->getPosition() < is->getLength())
+		{
+			int32_t size = std::numeric_limits<int32_t>::max();
+			auto data = is->peek(size);
+			success = data != nullptr && size > 0 && is->seek(size, SeekOrigin::Current) >= 0;
+			if (success)
+			{
+				sum.update(data, size);
+			}
+		}
+		if (!success)
+		{
+			std::stringstream ss;
+			ss << u8"read stream error! filepath = ";
+			ss << genpath << nekofs_PathSeparator << file.filepath;
+			nekofs::logerr(ss.str());
+			return false;
+		}
+		sum.final();
+		file.sha256 = sum.readHash();
+		file.size = is->getLength();
+		return true;
+	}
+	/*
+	* 缓存是文本文件，第一行是格式标识和上次开始计算的时间，之后每行一个文件：
+	* size	mtime	inode	sha256	path
+	*/
+	bool PrePare::loadCache(const std::string& cachefile, PrepareCache& cache)
+	{
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		if (nativefs->getFileType(cachefile) != FileType::Regular)
+		{
+			return false;
+		}
+		auto is = nativefs->openIStream(cachefile);
+		if (!is || is->getLength() > std::numeric_limits<int32_t>::max())
+		{
+			return false;
+		}
+		std::string content(static_cast<size_t>(is->getLength()), '\0');
+		if (istream_read(is, content.data(), static_cast<int32_t>(content.size())) != static_cast<int32_t>(content.size()))
+		{
+			return false;
+		}
+		std::stringstream ss(content);
+		std::string line;
+		if (!std::getline(ss, line) || line.rfind(kPrepareCacheHeader, 0) != 0)
+		{
+			nekofs::logwarn(u8"prepare cache " + cachefile + u8" format error!");
+			return false;
+		}
+		std::stringstream header(line.substr(std::string(kPrepareCacheHeader).size()));
+		if (!(header >> cache.time))
+		{
+			return false;
+		}
+		while (std::getline(ss, line))
+		{
+			std::stringstream ls(line);
+			PrepareFile file;
+			std::string sha256;
+			if (ls >> file.stat.size >> file.stat.mtime >> file.stat.inode >> sha256 && ls.get() == '\t' && std::getline(ls, file.filepath) && sha256.size() == 64)
+			{
+				file.sha256 = str_to_sha256(sha256.c_str());
+				cache.files[file.filepath] = file;
+			}
+		}
+		return true;
+	}
+	bool PrePare::saveCache(const std::string& cachefile, int64_t time, const std::vector<PrepareFile>& files)
+	{
+		std::stringstream ss;
+		ss << kPrepareCacheHeader << u8" " << time << u8"\n";
+		for (const auto& item : files)
+		{
+			if (item.hasStat)
+			{
+				ss << item.stat.size << u8"\t" << item.stat.mtime << u8"\t" << item.stat.inode << u8"\t" << sha256_to_str(item.sha256) << u8"\t" << item.filepath << u8"\n";
+			}
+		}
+		auto content = ss.str();
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		if (nativefs->getFileType(cachefile) != FileType::None && !nativefs->removeFile(cachefile))
+		{
+			return false;
+		}
+		auto os = nativefs->openOStream(cachefile);
+		return os && content.size() <= static_cast<size_t>(std::numeric_limits<int32_t>::max())
+			&& ostream_write(os, content.data(), static_cast<int32_t>(content.size())) == static_cast<int32_t>(content.size());
 	}
 }
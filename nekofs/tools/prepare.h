@@ -1,16 +1,50 @@
 ﻿#pragma once
 #include "../common/typedef.h"
+#ifdef _WIN32
+#include "../native_win/nativefilesystem.h"
+#else
+#include "../native_posix/nativefilesystem.h"
+#endif
 
 #include <cstdint>
+#include <array>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
 
 namespace nekofs::tools {
 	class PrePare final
 	{
 	public:
-		static bool exec(const std::string& genpath, const std::string& versionfile, uint32_t versionOffset);
+		/*
+		* cachefile不为空时，记录每个文件的大小、修改时间、inode和sha256，下次执行时这些都没变的文件不再重新计算。
+		* paranoid为true时忽略已有的缓存，全部重新计算，但仍然写入新的缓存。
+		*/
+		static bool exec(const std::string& genpath, const std::string& versionfile, uint32_t versionOffset, const std::string& cachefile = "", bool paranoid = false);
 
 	private:
-		static bool prepareDir(const std::string& genpath, uint32_t currentVersion);
+		struct PrepareFile final
+		{
+			std::string filepath;
+			std::array<uint32_t, 8> sha256 = {};
+			int64_t size = 0;
+			NativeFileStat stat;
+			bool hasStat = false;
+			bool cached = false;
+		};
+		struct PrepareCache final
+		{
+			int64_t time = 0; // 上次开始计算的时间，在这之后修改的文件不能信任缓存
+			std::map<std::string, PrepareFile> files;
+		};
+		static bool prepareDir(const std::string& genpath, std::vector<PrepareFile>& files);
+		static bool hashFiles(const std::string& genpath, std::vector<PrepareFile>& files, const PrepareCache* cache);
+		static bool hashFileGroup(const std::string& genpath, PrepareFile* files, size_t count, const PrepareCache* cache);
+		static bool loadFromCache(const std::string& genpath, PrepareFile& file, const PrepareCache* cache);
+		static bool hashOneFile(const std::string& genpath, PrepareFile& file, std::shared_ptr<NativeIStream> is);
+		static bool loadCache(const std::string& cachefile, PrepareCache& cache);
+		static bool saveCache(const std::string& cachefile, int64_t time, const std::vector<PrepareFile>& files);
 	};
 }
 
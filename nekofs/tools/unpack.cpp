@@ -2,17 +2,58 @@
 #include "../common/env.h"
 #include "../common/utils.h"
 #include "../common/sha256.h"
+#include "../common/lz4.h"
 #ifdef _WIN32
 #include "../native_win/nativefilesystem.h"
+#include "../native_win/nativefileostream.h"
 #else
 #include "../native_posix/nativefilesystem.h"
+#include "../native_posix/nativefileostream.h"
 #endif
 #include "../nekodata/nekodatafilesystem.h"
+#include "../nekodata/nekodatafilemeta.h"
 #include "../layer/layerfilesmeta.h"
 
 #include <sstream>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 
 namespace nekofs::tools {
+	// 一个分段解压后不超过2MB，压缩数据不超过4MB，正好放进一个4M缓冲区
+	constexpr const int64_t kSegmentBlockNum = 64;
+	constexpr const int64_t kSegmentRawSize = 4 * 1024 * 1024;
+
+	struct Unpack::UnpackFile final
+	{
+		std::shared_ptr<NekodataFileSystem> fs;
+		std::string filepath;
+		std::string outfilepath;
+		std::string progressInfo;
+		NekodataFileMeta meta;
+		size_t segmentNum = 0;
+		std::shared_ptr<NativeOStream> os;
+		sha256sum hash;
+		size_t hashedSegmentNum = 0;  // 按顺序计算sha256，已经计算到的分段
+		size_t finishedSegmentNum = 0;
+		bool error = false;
+		std::mutex mtx;
+		std::condition_variable cond;
+	};
+	struct Unpack::UnpackSegment final
+	{
+		std::shared_ptr<UnpackFile> file;
+		size_t index = 0;
+	};
+
+	/*
+	* 不再预先完整校验一遍，解压每个文件时顺带校验它的sha256。
+	* 大文件按压缩块切成分段，多个线程同时解压写入，sha256仍按分段顺序计算。
+	* 失败时删除已经写出的内容。
+	*/
 	bool Unpack::exec(const std::string& filepath, const std::string& outpath)
 	{
 		auto nativefs = env::getInstance().getNativeFileSystem();
@@ -27,30 +68,34 @@ namespace nekofs::tools {
 			return false;
 		}
 		auto fs = NekodataFileSystem::create(nativefs, filepath);
-		nekofs::loginfo(u8"verify " + filepath + u8" ...");
-		if (!fs || !fs->verify())
+		if (!fs)
 		{
-			nekofs::logerr(u8"verify " + filepath + u8" ... failed");
+			nekofs::logerr(u8"open " + filepath + u8" ... failed");
 			return false;
 		}
-		nekofs::loginfo(u8"verify " + filepath + u8" ... ok");
+		std::vector<std::shared_ptr<UnpackFile>> files;
 		auto lfm = nekofs::LayerFilesMeta::load(fs->openIStream(nekofs_kLayerFiles));
 		if (lfm.has_value())
 		{
-			std::stringstream ss;
-			ss << u8"unpack file ";
-			ss << nekofs_kLayerVersion;
-			loginfo(ss.str());
-			if (!unpackOneFile(fs->openIStream(nekofs_kLayerVersion), outpath + nekofs_PathSeparator + nekofs_kLayerVersion))
+			if (!collectOneFile(fs, nekofs_kLayerVersion, outpath + nekofs_PathSeparator + nekofs_kLayerVersion, std::string(u8"unpack file ") + nekofs_kLayerVersion, files)
+				|| !collectLayer(fs, &lfm.value(), outpath, "", files))
 			{
-				logerr(u8"unpack error: " + outpath + nekofs_PathSeparator + nekofs_kLayerVersion);
 				return false;
 			}
-			return unpackLayer(fs, &lfm.value(), outpath, "");
 		}
-		return unpackNormal(fs, outpath);
+		else
+		{
+			collectNormal(fs, outpath, files);
+		}
+		if (!unpackFiles(files))
+		{
+			files.clear();
+			nativefs->removeDirectories(outpath);
+			return false;
+		}
+		return true;
 	}
-	bool Unpack::unpackLayer(std::shared_ptr<FileSystem> fs, const LayerFilesMeta* lfm, const std::string& outpath, const std::string& progressInfo)
+	bool Unpack::collectLayer(std::shared_ptr<NekodataFileSystem> fs, const LayerFilesMeta* lfm, const std::string& outpath, const std::string& progressInfo, std::vector<std::shared_ptr<UnpackFile>>& files)
 	{
 		{
 			std::stringstream ss;
@@ -60,10 +105,8 @@ namespace nekofs::tools {
 				ss << progressInfo << u8" < ";
 			}
 			ss << nekofs_kLayerFiles;
-			loginfo(ss.str());
-			if (!unpackOneFile(fs->openIStream(nekofs_kLayerFiles), outpath + nekofs_PathSeparator + nekofs_kLayerFiles))
+			if (!collectOneFile(fs, nekofs_kLayerFiles, outpath + nekofs_PathSeparator + nekofs_kLayerFiles, ss.str(), files))
 			{
-				logerr(u8"unpack error: " + outpath + nekofs_PathSeparator + nekofs_kLayerVersion);
 				return false;
 			}
 		}
@@ -82,10 +125,8 @@ namespace nekofs::tools {
 			}
 			ss << u8"[" << index << u8"/" << allfileNum << u8"] ";
 			ss << item.first;
-			loginfo(ss.str());
-			if (!unpackOneFile(fs->openIStream(item.first), outpath + nekofs_PathSeparator + item.first))
+			if (!collectOneFile(fs, item.first, outpath + nekofs_PathSeparator + item.first, ss.str(), files))
 			{
-				logerr(u8"unpack error: " + outpath + nekofs_PathSeparator + item.first);
 				return false;
 			}
 		}
@@ -105,7 +146,7 @@ namespace nekofs::tools {
 				logerr(u8"unpackLayer error: " + item + u8" open " + nekofs_kLayerFiles + u8" failed!");
 				return false;
 			}
-			if (!unpackLayer(layerfs, &lfm_tmp.value(), outpath + nekofs_PathSeparator + item.substr(0, item.size() - nekofs_kNekodata_FileExtension.size()), progressInfo.empty() ? item : progressInfo + u8" < " + item))
+			if (!collectLayer(layerfs, &lfm_tmp.value(), outpath + nekofs_PathSeparator + item.substr(0, item.size() - nekofs_kNekodata_FileExtension.size()), progressInfo.empty() ? item : progressInfo + u8" < " + item, files))
 			{
 				logerr(u8"unpackLayer error: " + item);
 				return false;
@@ -113,52 +154,238 @@ namespace nekofs::tools {
 		}
 		return true;
 	}
-	bool Unpack::unpackNormal(std::shared_ptr<FileSystem> fs, const std::string& outpath)
+	void Unpack::collectNormal(std::shared_ptr<NekodataFileSystem> fs, const std::string& outpath, std::vector<std::shared_ptr<UnpackFile>>& files)
 	{
-		auto nativefs = env::getInstance().getNativeFileSystem();
 		auto allfiles = fs->getAllFiles(u8"");
 		for (size_t i = 0; i < allfiles.size(); i++)
 		{
 			const auto& item = allfiles[i];
+			std::stringstream ss;
+			ss << u8"unpack file [" << i + 1 << u8"/" << allfiles.size() << u8"] ";
+			ss << item;
+			collectOneFile(fs, item, outpath + nekofs_PathSeparator + item, ss.str(), files);
+		}
+	}
+	bool Unpack::collectOneFile(std::shared_ptr<NekodataFileSystem> fs, const std::string& filepath, const std::string& outfilepath, const std::string& progressInfo, std::vector<std::shared_ptr<UnpackFile>>& files)
+	{
+		auto meta = fs->getFileMeta(filepath);
+		if (!meta.has_value())
+		{
+			logerr(u8"unpack error: " + filepath + u8" not found!");
+			return false;
+		}
+		auto file = std::make_shared<UnpackFile>();
+		file->fs = fs;
+		file->filepath = filepath;
+		file->outfilepath = outfilepath;
+		file->progressInfo = progressInfo;
+		file->meta = meta.value();
+		if (file->meta.getCompressedSize() > 0)
+		{
+			file->segmentNum = static_cast<size_t>((file->meta.getBlocks().size() + kSegmentBlockNum - 1) / kSegmentBlockNum);
+		}
+		else
+		{
+			file->segmentNum = static_cast<size_t>((file->meta.getOriginalSize() + kSegmentRawSize - 1) / kSegmentRawSize);
+		}
+		// 空文件也要有一个分段来创建文件
+		file->segmentNum = std::max(file->segmentNum, static_cast<size_t>(1));
+		files.push_back(file);
+		return true;
+	}
+	bool Unpack::unpackFiles(const std::vector<std::shared_ptr<UnpackFile>>& files)
+	{
+		// 目录只创建一次，打开文件时就不用再逐个检查父目录了
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		std::set<std::string> dirs;
+		for (const auto& file : files)
+		{
+			auto pos = file->outfilepath.rfind(nekofs_PathSeparator);
+			if (pos != std::string::npos && pos > 0)
 			{
-				std::stringstream ss;
-				ss << u8"unpack file [" << i + 1 << u8"/" << allfiles.size() << u8"] ";
-				ss << item;
-				loginfo(ss.str());
+				dirs.insert(file->outfilepath.substr(0, pos));
 			}
-			if (!unpackOneFile(fs->openIStream(item), outpath + nekofs_PathSeparator + item))
+		}
+		for (const auto& dir : dirs)
+		{
+			if (!nativefs->createDirectories(dir))
 			{
-				logerr(u8"unpack error: " + outpath + nekofs_PathSeparator + item);
+				logerr(u8"unpack error: create directory " + dir + u8" failed!");
 				return false;
 			}
 		}
-		return true;
+
+		std::vector<UnpackSegment> segments;
+		for (const auto& file : files)
+		{
+			for (size_t i = 0; i < file->segmentNum; i++)
+			{
+				segments.push_back(UnpackSegment{ file, i });
+			}
+		}
+		/*
+		* 分段按顺序取出，一个分段等待计算sha256时，它前面的分段都已经被别的线程取走了，不会死锁。
+		*/
+		std::atomic<size_t> next = 0;
+		std::atomic<bool> success = true;
+		auto threadfunction = [&segments, &next, &success]() {
+			for (size_t i = next++; i < segments.size() && success; i = next++)
+			{
+				if (!unpackSegment(segments[i]))
+				{
+					success = false;
+				}
+			}
+		};
+		size_t threadNum = std::min(static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency())), segments.size());
+		std::vector<std::thread> t;
+		for (size_t i = 1; i < threadNum; i++)
+		{
+			t.push_back(std::thread(threadfunction));
+		}
+		threadfunction();
+		for (auto& item : t)
+		{
+			item.join();
+		}
+		return success;
 	}
-	bool Unpack::unpackOneFile(std::shared_ptr<IStream> is, const std::string& outfilepath)
+	bool Unpack::unpackSegment(const UnpackSegment& segment)
 	{
-		auto nativefs = env::getInstance().getNativeFileSystem();
-		auto buffer = env::getInstance().newBuffer4M();
-		auto os = nativefs->openOStream(outfilepath);
-		if (!os || !is)
+		auto file = segment.file;
+		const auto& meta = file->meta;
+		const auto& blocks = meta.getBlocks();
+		const bool compressed = meta.getCompressedSize() > 0;
+		if (segment.index == 0)
 		{
-			return false;
+			loginfo(file->progressInfo);
+		}
+
+		// 计算分段的压缩数据区间和解压后的数据区间
+		int64_t rawBeginPos = 0;
+		int64_t rawEndPos = 0;
+		int64_t outBeginPos = 0;
+		int64_t outEndPos = 0;
+		size_t blockBegin = 0;
+		size_t blockEnd = 0;
+		if (compressed)
+		{
+			blockBegin = segment.index * kSegmentBlockNum;
+			blockEnd = std::min(blocks.size(), blockBegin + kSegmentBlockNum);
+			rawBeginPos = blocks[blockBegin].first;
+			rawEndPos = blockEnd == blocks.size() ? meta.getCompressedSize() : blocks[blockEnd].first;
+			outBeginPos = meta.getBlockOriginalPos(static_cast<int64_t>(blockBegin));
+			outEndPos = meta.getBlockOriginalPos(static_cast<int64_t>(blockEnd - 1)) + meta.getBlockOriginalSize(static_cast<int64_t>(blockEnd - 1));
+		}
+		else
+		{
+			rawBeginPos = segment.index * kSegmentRawSize;
+			rawEndPos = std::min(meta.getOriginalSize(), rawBeginPos + kSegmentRawSize);
+			outBeginPos = rawBeginPos;
+			outEndPos = rawEndPos;
 		}
-		int64_t totalLength = os->getLength();
-		int32_t actualRead = 0;
-		int32_t actualWrite = 0;
-		do
+
+		std::shared_ptr<NativeOStream> os;
 		{
-			actualWrite = 0;
-			actualRead = istream_read(is, &(*buffer)[0], static_cast<int32_t>(buffer->size()));
-			if (actualRead > 0)
+			std::lock_guard lock(file->mtx);
+			if (!file->os && !file->error)
 			{
-				actualWrite = ostream_write(os, &(*buffer)[0], actualRead);
+				auto nativefs = env::getInstance().getNativeFileSystem();
+				file->os = std::dynamic_pointer_cast<NativeOStream>(nativefs->openOStream(file->outfilepath));
+				if (!file->os)
+				{
+					logerr(u8"unpack error: open " + file->outfilepath + u8" failed!");
+					file->error = true;
+				}
+				else if (meta.getOriginalSize() > 0)
+				{
+					file->os->allocate(meta.getOriginalSize());
+				}
 			}
-		} while (actualRead > 0 && actualRead == actualWrite);
-		if (actualRead != 0 || actualRead != actualWrite)
+			os = file->os;
+		}
+
+		bool success = os != nullptr;
+		auto rawBuffer = env::getInstance().newBuffer4M();
+		const int32_t rawSize = static_cast<int32_t>(rawEndPos - rawBeginPos);
+		if (success && rawSize > 0)
 		{
-			return false;
+			auto is = file->fs->openRawIStream(file->filepath, AccessHint::Sequential);
+			success = is && is->seek(rawBeginPos, SeekOrigin::Begin) == rawBeginPos
+				&& rawSize <= static_cast<int32_t>(rawBuffer->size())
+				&& istream_read(is, rawBuffer->data(), rawSize) == rawSize;
 		}
-		return true;
+
+		// 轮到这个分段时再计算sha256，最后一个分段负责比对
+		{
+			std::unique_lock lock(file->mtx);
+			while (file->hashedSegmentNum != segment.index)
+			{
+				file->cond.wait(lock);
+			}
+			if (success && !file->error && meta.getOriginalSize() > 0)
+			{
+				file->hash.update(rawBuffer->data(), rawSize);
+				if (segment.index + 1 == file->segmentNum)
+				{
+					file->hash.final();
+					if (file->hash.readHash() != meta.getSHA256())
+					{
+						std::stringstream ss;
+						ss << u8"unpack error: verify " << file->filepath << u8" sha256 failed!";
+						logerr(ss.str());
+						file->error = true;
+					}
+				}
+			}
+			if (!success)
+			{
+				file->error = true;
+			}
+			file->hashedSegmentNum++;
+			success = !file->error;
+		}
+		file->cond.notify_all();
+
+		if (success && outEndPos > outBeginPos)
+		{
+			if (compressed)
+			{
+				auto outBuffer = env::getInstance().newBuffer4M();
+				for (size_t i = blockBegin; i < blockEnd && success; i++)
+				{
+					const int64_t blockOutPos = meta.getBlockOriginalPos(static_cast<int64_t>(i));
+					const int32_t originalSize = meta.getBlockOriginalSize(static_cast<int64_t>(i));
+					const int decBytes = LZ4_decompress_safe((const char*)rawBuffer->data() + (blocks[i].first - rawBeginPos), (char*)outBuffer->data() + (blockOutPos - outBeginPos), blocks[i].second, originalSize);
+					success = decBytes == originalSize;
+				}
+				if (success)
+				{
+					success = os->writeAt(outBuffer->data(), static_cast<int32_t>(outEndPos - outBeginPos), outBeginPos) == outEndPos - outBeginPos;
+				}
+			}
+			else
+			{
+				success = os->writeAt(rawBuffer->data(), rawSize, outBeginPos) == rawSize;
+			}
+			if (!success)
+			{
+				logerr(u8"unpack error: " + file->outfilepath);
+			}
+		}
+
+		{
+			std::lock_guard lock(file->mtx);
+			if (!success)
+			{
+				file->error = true;
+			}
+			file->finishedSegmentNum++;
+			if (file->finishedSegmentNum == file->segmentNum)
+			{
+				file->os.reset();
+			}
+		}
+		return success;
 	}
 }
@@ -3,9 +3,12 @@
 
 #include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace nekofs {
 	class LayerFilesMeta;
+	class NekodataFileSystem;
 }
 
 namespace nekofs::tools {
@@ -15,9 +18,13 @@ namespace nekofs::tools {
 		static bool exec(const std::string& filepath, const std::string& outpath);
 
 	private:
-		static bool unpackLayer(std::shared_ptr<FileSystem> fs, const LayerFilesMeta* lfm , const std::string& outpath, const std::string& progressInfo);
-		static bool unpackNormal(std::shared_ptr<FileSystem> fs, const std::string& outpath);
-		static bool unpackOneFile(std::shared_ptr<IStream> is, const std::string& outfilepath);
+		struct UnpackFile;
+		struct UnpackSegment;
+		static bool collectLayer(std::shared_ptr<NekodataFileSystem> fs, const LayerFilesMeta* lfm, const std::string& outpath, const std::string& progressInfo, std::vector<std::shared_ptr<UnpackFile>>& files);
+		static void collectNormal(std::shared_ptr<NekodataFileSystem> fs, const std::string& outpath, std::vector<std::shared_ptr<UnpackFile>>& files);
+		static bool collectOneFile(std::shared_ptr<NekodataFileSystem> fs, const std::string& filepath, const std::string& outfilepath, const std::string& progressInfo, std::vector<std::shared_ptr<UnpackFile>>& files);
+		static bool unpackFiles(const std::vector<std::shared_ptr<UnpackFile>>& files);
+		static bool unpackSegment(const UnpackSegment& segment);
 	};
 }
 
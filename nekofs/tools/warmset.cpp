@@ -0,0 +1,44 @@
+﻿#include "warmset.h"
+#include "../common/env.h"
+#include "../common/utils.h"
+#include "../common/accesstrace.h"
+#ifdef _WIN32
+#include "../native_win/nativefilesystem.h"
+#else
+#include "../native_posix/nativefilesystem.h"
+#endif
+#include "../layer/warmsetmeta.h"
+
+namespace nekofs::tools {
+	bool WarmSet::exec(const std::string& tracepath, const std::string& outpath, int64_t duration)
+	{
+		auto nativefs = env::getInstance().getNativeFileSystem();
+		auto is = nativefs->getFileType(tracepath) == nekofs::FileType::Regular ? nativefs->openIStream(tracepath) : nullptr;
+		std::vector<std::string> paths;
+		std::vector<AccessTraceRecord> records;
+		if (!is || !AccessTrace::load(is, paths, records))
+		{
+			nekofs::logerr(u8"load " + tracepath + u8" failed!");
+			return false;
+		}
+		auto wsm = WarmSetMeta::fromTrace(paths, records, duration * 1000 * 1000);
+		if (wsm.getFiles().empty())
+		{
+			nekofs::logerr(u8"no file opened in " + tracepath);
+			return false;
+		}
+		// windows下不能覆盖已存在的文件
+		if (nativefs->getFileType(outpath) != nekofs::FileType::None && !nativefs->removeFile(outpath))
+		{
+			nekofs::logerr(u8"remove " + outpath + u8" failed!");
+			return false;
+		}
+		auto os = nativefs->openOStream(outpath);
+		if (!os || !wsm.save(os))
+		{
+			nekofs::logerr(u8"write " + outpath + u8" failed!");
+			return false;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,16 @@
+﻿#pragma once
+#include "../common/typedef.h"
+
+#include <cstdint>
+#include <string>
+
+namespace nekofs::tools {
+	class WarmSet final
+	{
+	public:
+		/*
+		* 从.nekotrace访问记录生成预热清单（json），只使用开始后duration毫秒内的访问，为0时使用全部。
+		*/
+		static bool exec(const std::string& tracepath, const std::string& outpath, int64_t duration);
+	};
+}
@@ -11,6 +11,7 @@
 #endif
 #include "../nekodata/nekodatafilesystem.h"
 #include "../nekodata/nekodataarchiver.h"
+#include "../layer/layerdelta.h"
 
 #include <sstream>
 #include <functional>
@@ -93,11 +94,43 @@ namespace nekofs {
 		}
 		LayerVersionMeta lvm = std::get<1>(patchfs_.back());
 		lvm.setFromVersion(baseVersion_);
-		auto lfm = getLayerFilesMeta(fslist);
-		const auto& allfiles = lfm->getFiles();
+		std::vector<LayerFilesMeta> layers;
+		auto lfm = getLayerFilesMeta(fslist, &layers);
+		const auto allfiles = lfm->getFiles();
 		for (const auto& file : allfiles)
 		{
-			if (!copyfile(getIStream(fslist, file.first), nativefs->openOStream(outdir + nekofs_PathSeparator + file.first)))
+			auto is = getIStream(fslist, file.first);
+			if (file.second.getDeltaBase().has_value())
+			{
+				// 基础版本也在合并范围内时还原成完整文件，否则合并成相对于范围外版本的差异
+				auto deltais = openDeltaIStream(fslist, layers, layers.size(), file.first);
+				auto meta = file.second;
+				if (deltais)
+				{
+					is = deltais;
+					meta.setDeltaBase(std::nullopt);
+				}
+				else
+				{
+					std::vector<uint8_t> delta;
+					std::array<uint32_t, 8> deltaBase;
+					if (!composeDelta(fslist, layers, file.first, delta, deltaBase))
+					{
+						return false;
+					}
+					meta.setDeltaBase(deltaBase);
+					lfm->setFileMeta(file.first, meta);
+					auto os = nativefs->openOStream(outdir + nekofs_PathSeparator + file.first);
+					if (!os || ostream_write(os, delta.data(), static_cast<int32_t>(delta.size())) != static_cast<int32_t>(delta.size()))
+					{
+						return false;
+					}
+					addComplete();
+					continue;
+				}
+				lfm->setFileMeta(file.first, meta);
+			}
+			if (!copyfile(is, nativefs->openOStream(outdir + nekofs_PathSeparator + file.first)))
 			{
 				return false;
 			}
@@ -116,8 +149,7 @@ namespace nekofs {
 					fslist_nekodata.push_back(nekodatafs);
 				}
 			}
-			exec(archiver, fslist_nekodata);
-			if (!archiver->archive(std::bind(&Merger::addComplete, this)))
+			if (!exec(archiver, fslist_nekodata) || !archiver->archive(std::bind(&Merger::addComplete, this)))
 			{
 				return false;
 			}
@@ -161,8 +193,7 @@ namespace nekofs {
 		lvm.save(&d_lvm, d_lvm.GetAllocator());
 		d_lvm.Accept(jsonString_lfm);
 		archiver->addBuffer(nekofs_kLayerVersion, jsonStrBuffer_lvm->GetString(), static_cast<int64_t>(jsonStrBuffer_lvm->GetSize()));
-		exec(archiver, fslist);
-		return archiver->archive(std::bind(&Merger::addComplete, this));
+		return exec(archiver, fslist) && archiver->archive(std::bind(&Merger::addComplete, this));
 	}
 	bool Merger::getProgress(int64_t& complete, int64_t& total)
 	{
@@ -205,12 +236,37 @@ namespace nekofs {
 		}
 		return true;
 	}
-	void Merger::exec(std::shared_ptr<NekodataArchiver> archiver, const std::vector<std::shared_ptr<FileSystem>>& fslist)
+	bool Merger::exec(std::shared_ptr<NekodataArchiver> archiver, const std::vector<std::shared_ptr<FileSystem>>& fslist)
 	{
-		auto lfm = getLayerFilesMeta(fslist);
-		const auto& allfiles = lfm->getFiles();
+		std::vector<LayerFilesMeta> layers;
+		auto lfm = getLayerFilesMeta(fslist, &layers);
+		const auto allfiles = lfm->getFiles();
 		for (const auto& file : allfiles)
 		{
+			if (file.second.getDeltaBase().has_value())
+			{
+				// 基础版本也在合并范围内时还原成完整文件，否则合并成相对于范围外版本的差异
+				auto deltais = openDeltaIStream(fslist, layers, layers.size(), file.first);
+				auto meta = file.second;
+				if (deltais)
+				{
+					archiver->addStream(file.first, deltais);
+					meta.setDeltaBase(std::nullopt);
+				}
+				else
+				{
+					auto delta = newDeltaBuffer();
+					std::array<uint32_t, 8> deltaBase;
+					if (!composeDelta(fslist, layers, file.first, *delta, deltaBase))
+					{
+						return false;
+					}
+					archiver->addBuffer(file.first, delta->data(), static_cast<int64_t>(delta->size()));
+					meta.setDeltaBase(deltaBase);
+				}
+				lfm->setFileMeta(file.first, meta);
+				continue;
+			}
 			auto streamInfo = tryGetIStream(fslist, file.first);
 			if (streamInfo.rawis != nullptr)
 			{
@@ -224,7 +280,6 @@ namespace nekofs {
 		const auto& allnekodatas = lfm->getNekodatas();
 		for (const auto& nekodata : allnekodatas)
 		{
-			auto archiver_tmp = archiver->addArchive(nekodata);
 			std::vector<std::shared_ptr<FileSystem>> fslist_nekodata;
 			for (auto fs : fslist)
 			{
@@ -234,7 +289,24 @@ namespace nekofs {
 					fslist_nekodata.push_back(nekodatafs);
 				}
 			}
-			exec(archiver_tmp, fslist_nekodata);
+			if (fslist_nekodata.size() == 1)
+			{
+				// 只有一个来源且已在基础nekodata的相同位置，整个保留，不需要重新生成
+				auto streamInfo = tryGetIStream(fslist, nekodata);
+				if (streamInfo.rawis != nullptr && archiver->isBaseFile(nekodata, streamInfo.meta))
+				{
+					int64_t total = 0;
+					prepare(total, fslist_nekodata);
+					archiver->addRawFile(nekodata, streamInfo.rawis, streamInfo.meta);
+					std::lock_guard lock(mtx_);
+					complete_ += total;
+					continue;
+				}
+			}
+			if (!exec(archiver->addArchive(nekodata), fslist_nekodata))
+			{
+				return false;
+			}
 		}
 		auto jsonStrBuffer_lfm = newJsonBuffer();
 		JSONStringPrettyWriter jsonString_lfm(*jsonStrBuffer_lfm);
@@ -242,8 +314,9 @@ namespace nekofs {
 		lfm->save(&d_lfm, d_lfm.GetAllocator());
 		d_lfm.Accept(jsonString_lfm);
 		archiver->addBuffer(nekofs_kLayerFiles, jsonStrBuffer_lfm->GetString(), static_cast<int64_t>(jsonStrBuffer_lfm->GetSize()));
+		return true;
 	}
-	std::optional<LayerFilesMeta> Merger::getLayerFilesMeta(const std::vector<std::shared_ptr<FileSystem>>& fslist)
+	std::optional<LayerFilesMeta> Merger::getLayerFilesMeta(const std::vector<std::shared_ptr<FileSystem>>& fslist, std::vector<LayerFilesMeta>* layers)
 	{
 		std::vector<LayerFilesMeta> lfms;
 		for (auto fs : fslist)
@@ -258,13 +331,93 @@ namespace nekofs {
 				return std::nullopt;
 			}
 		}
+		if (layers)
+		{
+			*layers = lfms;
+		}
 		return LayerFilesMeta::merge(lfms, baseVersion_);
 	}
+	/*
+	* 在fslist[0, end)中找到最新的filepath，是差异时递归还原它的基础版本。基础版本不在范围内时返回nullptr，由composeDelta合并差异。
+	*/
+	std::shared_ptr<IStream> Merger::openDeltaIStream(const std::vector<std::shared_ptr<FileSystem>>& fslist, const std::vector<LayerFilesMeta>& layers, size_t end, const std::string& filepath)
+	{
+		for (size_t i = end; i > 0; i--)
+		{
+			auto meta = layers[i - 1].getFileMeta(filepath);
+			if (!meta.has_value())
+			{
+				continue;
+			}
+			auto is = fslist[i - 1]->openIStream(filepath);
+			if (!meta->getDeltaBase().has_value())
+			{
+				return is;
+			}
+			for (size_t j = i - 1; j > 0; j--)
+			{
+				auto baseMeta = layers[j - 1].getFileMeta(filepath);
+				if (baseMeta.has_value())
+				{
+					if (baseMeta->getSHA256() != meta->getDeltaBase().value())
+					{
+						return nullptr;
+					}
+					auto base = openDeltaIStream(fslist, layers, j, filepath);
+					if (!base)
+					{
+						return nullptr;
+					}
+					return LayerDeltaIStream::create(base, is);
+				}
+			}
+			return nullptr;
+		}
+		return nullptr;
+	}
+	/*
+	* 最新的filepath是差异而最早的基础版本不在合并范围内时，把各补丁中连续的差异合并成相对于那个版本的一个差异。
+	* 合并后的补丁只能用于已有那个版本的客户端。差异链中出现完整文件或sha256对不上时失败，不能输出基础版本不存在的差异。
+	*/
+	bool Merger::composeDelta(const std::vector<std::shared_ptr<FileSystem>>& fslist, const std::vector<LayerFilesMeta>& layers, const std::string& filepath, std::vector<uint8_t>& delta, std::array<uint32_t, 8>& deltaBase)
+	{
+		std::vector<std::shared_ptr<IStream>> chain;
+		std::optional<std::array<uint32_t, 8>> expected;
+		for (size_t i = layers.size(); i > 0; i--)
+		{
+			auto meta = layers[i - 1].getFileMeta(filepath);
+			if (!meta.has_value())
+			{
+				continue;
+			}
+			if ((expected.has_value() && meta->getSHA256() != expected.value()) || !meta->getDeltaBase().has_value())
+			{
+				logerr(u8"Merger::composeDelta error ! delta base mismatch. filepath = " + filepath);
+				return false;
+			}
+			auto is = fslist[i - 1]->openIStream(filepath);
+			if (!is)
+			{
+				logerr(u8"Merger::composeDelta error ! open delta failed. filepath = " + filepath);
+				return false;
+			}
+			chain.insert(chain.begin(), is);
+			expected = meta->getDeltaBase();
+		}
+		if (chain.empty() || !LayerDelta::compose(chain, delta))
+		{
+			logerr(u8"Merger::composeDelta error ! compose failed. filepath = " + filepath);
+			return false;
+		}
+		deltaBase = expected.value();
+		return true;
+	}
 	std::shared_ptr<IStream> Merger::getIStream(const std::vector<std::shared_ptr<FileSystem>>& fslist, const std::string& filepath)
 	{
-		for (auto fs : fslist)
+		// 后加入的补丁更新，优先使用
+		for (auto it = fslist.rbegin(); it != fslist.rend(); ++it)
 		{
-			auto is = fs->openIStream(filepath);
+			auto is = (*it)->openIStream(filepath);
 			if (is)
 			{
 				return is;
@@ -275,8 +428,10 @@ namespace nekofs {
 	Merger::RawStreamInfo Merger::tryGetIStream(const std::vector<std::shared_ptr<FileSystem>>& fslist, const std::string& filepath)
 	{
 		Merger::RawStreamInfo info;
-		for (auto fs : fslist)
+		// 后加入的补丁更新，优先使用
+		for (auto it = fslist.rbegin(); it != fslist.rend(); ++it)
 		{
+			auto fs = *it;
 			auto ftype = fs->getFileType(filepath);
 			if (ftype == FileType::Regular)
 			{
@@ -284,7 +439,7 @@ namespace nekofs {
 				if (fs->getFSType() == FileSystemType::Nekodata)
 				{
 					std::shared_ptr<NekodataFileSystem> nekodatafs = std::static_pointer_cast<NekodataFileSystem>(fs);
-					auto is = nekodatafs->openRawIStream(filepath);
+					auto is = nekodatafs->openRawIStream(filepath, AccessHint::Sequential);
 					if (is)
 					{
 						info.rawis = is;
@@ -307,4 +462,10 @@ namespace nekofs {
 		jsonBuffer_.push_back(buffer);
 		return buffer;
 	}
+	std::shared_ptr<std::vector<uint8_t>> Merger::newDeltaBuffer()
+	{
+		auto buffer = std::make_shared<std::vector<uint8_t>>();
+		deltaBuffer_.push_back(buffer);
+		return buffer;
+	}
 }
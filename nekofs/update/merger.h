@@ -38,12 +38,15 @@ namespace nekofs {
 
 	private:
 		bool prepare(int64_t& total, const std::vector<std::shared_ptr<FileSystem>>& fslist);
-		void exec(std::shared_ptr<NekodataArchiver> archiver, const std::vector<std::shared_ptr<FileSystem>>& fslist);
-		std::optional<LayerFilesMeta> getLayerFilesMeta(const std::vector<std::shared_ptr<FileSystem>>& fslist);
+		bool exec(std::shared_ptr<NekodataArchiver> archiver, const std::vector<std::shared_ptr<FileSystem>>& fslist);
+		std::optional<LayerFilesMeta> getLayerFilesMeta(const std::vector<std::shared_ptr<FileSystem>>& fslist, std::vector<LayerFilesMeta>* layers = nullptr);
+		std::shared_ptr<IStream> openDeltaIStream(const std::vector<std::shared_ptr<FileSystem>>& fslist, const std::vector<LayerFilesMeta>& layers, size_t end, const std::string& filepath);
+		bool composeDelta(const std::vector<std::shared_ptr<FileSystem>>& fslist, const std::vector<LayerFilesMeta>& layers, const std::string& filepath, std::vector<uint8_t>& delta, std::array<uint32_t, 8>& deltaBase);
 		std::shared_ptr<IStream> getIStream(const std::vector<std::shared_ptr<FileSystem>>& fslist, const std::string& filepath);
 		RawStreamInfo tryGetIStream(const std::vector<std::shared_ptr<FileSystem>>& fslist, const std::string& filepath);
 		void addComplete();
 		std::shared_ptr<JSONStringBuffer> newJsonBuffer();
+		std::shared_ptr<std::vector<uint8_t>> newDeltaBuffer();
 
 	private:
 		std::string resName_;
@@ -53,6 +56,7 @@ namespace nekofs {
 		int64_t complete_ = 0;
 		int64_t total_ = 0;
 		std::vector<std::shared_ptr<JSONStringBuffer>> jsonBuffer_;
+		std::vector<std::shared_ptr<std::vector<uint8_t>>> deltaBuffer_;
 	};
 }
 
@@ -0,0 +1,75 @@
+﻿#include "compact.h"
+#include "common.h"
+#include "cmdparse.h"
+
+#include <nekofs/nekofs.h>
+#include <filesystem>
+#include <iostream>
+
+namespace nekofs_tool {
+	int compact(const std::vector<std::string>& args)
+	{
+		cmd::parser cp;
+		cp.addString("volumesize", '\0', "volume size (max:3PB), default is the same as nekodata", false, "");
+		cp.addPos("outfile", true);
+		cp.addPos("nekodata", true);
+		cp.addHelp();
+		try
+		{
+			cp.parse(args);
+		}
+		catch (const cmd::ParseException&)
+		{
+			std::cerr << cp.useage() << std::endl;
+			std::exit(-1);
+		}
+		catch (const cmd::HelpException&)
+		{
+			std::cout << cp.useage() << std::endl;
+			std::exit(0);
+		}
+		std::string out = cp.getPos(0);
+		std::string nekodata = cp.getPos(1);
+		if (nekodata.empty())
+		{
+			std::cerr << "nekodata.empty()   " << nekodata << std::endl;
+			return -1;
+		}
+		if (out.empty())
+		{
+			std::cerr << "out.empty()   " << out << std::endl;
+			return -1;
+		}
+		int64_t volumeSize = 0;
+		auto vsize = cp.getString("volumesize");
+		if (!vsize.empty())
+		{
+			volumeSize = getVolumeSizeFromString(vsize);
+			if (volumeSize <= 0)
+			{
+				std::cerr << "volumesize error" << vsize << std::endl;
+				return -1;
+			}
+		}
+		nekodata = std::filesystem::absolute(nekodata).lexically_normal().generic_string();
+		if (!std::filesystem::is_regular_file(nekodata))
+		{
+			std::cerr << "!std::filesystem::is_regular_file(" << nekodata << ")" << std::endl;
+			return -1;
+		}
+		nekodata = get_utf8_str(nekodata);
+		auto fpath = std::filesystem::absolute(out).lexically_normal().generic_string();
+		if (std::filesystem::exists(fpath))
+		{
+			std::cerr << "std::filesystem::exists(" << fpath << ")" << std::endl;
+			return -1;
+		}
+		fpath = get_utf8_str(fpath);
+		if (NEKOFS_FALSE == nekofs_tools_compact(nekodata.c_str(), fpath.c_str(), volumeSize))
+		{
+			std::cerr << "nekofs_tools_compact error" << std::endl;
+			return -1;
+		}
+		return 0;
+	}
+}
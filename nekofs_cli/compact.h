@@ -0,0 +1,8 @@
+﻿#pragma once
+#include <vector>
+#include <string>
+
+namespace nekofs_tool
+{
+	int compact(const std::vector<std::string>& args);
+}
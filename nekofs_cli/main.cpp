@@ -4,6 +4,8 @@
 #include "unpack.h"
 #include "mkdiff.h"
 #include "merge.h"
+#include "compact.h"
+#include "warmset.h"
 
 #include <nekofs/nekofs.h>
 #ifdef _WIN32
@@ -21,6 +23,8 @@ constexpr const char* helpmsg = "\n"
 "    unpack\n"
 "    mkdiff\n"
 "    merge\n"
+"    compact\n"
+"    warmset\n"
 "    help\n"
 "\n";
 
@@ -82,6 +86,26 @@ int main(int argc, char** argv)
 		}
 		return nekofs_tool::merge(args);
 	}
+	if (::strcmp("compact", argv[1]) == 0)
+	{
+		std::vector<std::string> args(argc - 1);
+		args[0] = std::string(argv[0]) + " " + std::string(argv[1]);
+		for (int i = 2; i < argc; i++)
+		{
+			args[i - 1] = argv[i];
+		}
+		return nekofs_tool::compact(args);
+	}
+	if (::strcmp("warmset", argv[1]) == 0)
+	{
+		std::vector<std::string> args(argc - 1);
+		args[0] = std::string(argv[0]) + " " + std::string(argv[1]);
+		for (int i = 2; i < argc; i++)
+		{
+			args[i - 1] = argv[i];
+		}
+		return nekofs_tool::warmset(args);
+	}
 	if (::strcmp("help", argv[1]) == 0)
 	{
 		std::cout << "usage: " << argv[0] << " <subcommand> [options] [args]\n" << helpmsg;
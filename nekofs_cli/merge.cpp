@@ -13,6 +13,8 @@ namespace nekofs_tool {
 		cp.addString("volumesize", '\0', "volume size (max:3PB)", false, "1MB");
 		cp.addBool("noverify", '\0', "do not verify nekodata");
 		cp.addBool("dir", 'd', "output is dir");
+		cp.addBool("reusebase", '\0', "reuse volumes of the first patch file, changed files are appended (volumesize is ignored)");
+		cp.addBool("hardlink", '\0', "with --reusebase, hardlink unchanged volumes when reflink is not supported");
 		cp.addPos("filename(.nekodata)", true);
 		cp.addPos("patchfiles...(.nekodata)", true);
 		cp.addHelp();
@@ -81,6 +83,14 @@ namespace nekofs_tool {
 				return -1;
 			}
 		}
+		else if (cp.getBool("reusebase"))
+		{
+			if (NEKOFS_FALSE == nekofs_tools_mergeToNekodataReuseBase(filename.c_str(), &list[0], static_cast<int32_t>(list.size()), cp.getBool("noverify") ? NEKOFS_FALSE : NEKOFS_TRUE, cp.getBool("hardlink") ? NEKOFS_TRUE : NEKOFS_FALSE))
+			{
+				std::cerr << "nekofs_tools_mergeToNekodataReuseBase error" << std::endl;
+				return -1;
+			}
+		}
 		else
 		{
 			if (NEKOFS_FALSE == nekofs_tools_mergeToNekodata(filename.c_str(), volumeSize, &list[0], static_cast<int32_t>(list.size()), cp.getBool("noverify") ? NEKOFS_FALSE : NEKOFS_TRUE))
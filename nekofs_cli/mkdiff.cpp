@@ -11,6 +11,8 @@ namespace nekofs_tool {
 	{
 		cmd::parser cp;
 		cp.addString("volumesize", '\0', "volume size (max:3PB)", false, "1MB");
+		cp.addString("verify", '\0', "all: verify both nekodata, patch: verify only files written to the patch, none: trust files.json", false, "all");
+		cp.addBool("delta", '\0', "store changed large files as block delta against the earlier version when it is much smaller");
 		cp.addPos("filename(.nekodata)", true);
 		cp.addPos("earlierfile(.nekodata)", true);
 		cp.addPos("latestfile(.nekodata)", true);
@@ -54,6 +56,21 @@ namespace nekofs_tool {
 			std::cerr << "volumesize error" << vsize << std::endl;
 			return -1;
 		}
+		auto verifyStr = cp.getString("verify");
+		NekoFSDiffVerify verify = NEKOFS_DIFFVERIFY_ALL;
+		if (verifyStr == "patch")
+		{
+			verify = NEKOFS_DIFFVERIFY_PATCH;
+		}
+		else if (verifyStr == "none")
+		{
+			verify = NEKOFS_DIFFVERIFY_NONE;
+		}
+		else if (verifyStr != "all")
+		{
+			std::cerr << "verify error " << verifyStr << std::endl;
+			return -1;
+		}
 		filename = std::filesystem::absolute(filename).lexically_normal().generic_string();
 		if (std::filesystem::exists(filename))
 		{
@@ -75,7 +92,7 @@ namespace nekofs_tool {
 			return -1;
 		}
 		latestfile = get_utf8_str(latestfile);
-		if (NEKOFS_FALSE == nekofs_tools_mkldiff(earlierfile.c_str(), latestfile.c_str(), filename.c_str(), volumeSize))
+		if (NEKOFS_FALSE == nekofs_tools_mkldiffWithDelta(earlierfile.c_str(), latestfile.c_str(), filename.c_str(), volumeSize, verify, cp.getBool("delta") ? NEKOFS_TRUE : NEKOFS_FALSE))
 		{
 			std::cerr << "nekofs_tools_pack error" << std::endl;
 			return -1;
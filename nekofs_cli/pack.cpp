@@ -6,12 +6,54 @@
 #include <filesystem>
 #include <iostream>
 #include <charconv>
+#include <cstdio>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+extern "C" {
+	// stdout用于输出数据，日志全部写到stderr
+	static void stderr_nekofs_log(NEKOFSLogLevel level, const char* u8str)
+	{
+		if (u8str != nullptr)
+		{
+			switch (level)
+			{
+			case NEKOFS_LOGINFO:
+				std::cerr << "[INFO]  " << u8str << std::endl;
+				break;
+			case NEKOFS_LOGWARN:
+				std::cerr << "[WARN]  " << u8str << std::endl;
+				break;
+			case NEKOFS_LOGERR:
+				std::cerr << "[ERRO]  " << u8str << std::endl;
+				break;
+			default:
+				break;
+			}
+		}
+	}
+	static int32_t stdout_write(void* userdata, const void* buf, int32_t size)
+	{
+		if (std::fwrite(buf, 1, size, stdout) != static_cast<size_t>(size))
+		{
+			return -1;
+		}
+		return size;
+	}
+}
 
 namespace nekofs_tool {
 	int pack(const std::vector<std::string>& args)
 	{
 		cmd::parser cp;
 		cp.addString("volumesize", '\0', "volume size (max:3PB)", false, "1MB");
+		cp.addBool("stdout", '\0', "write single volume nekodata to stdout, outfile is used as temp file prefix");
+		cp.addBool("cdc", '\0', "content-defined chunking, blocks stay the same across versions after insertions");
+		cp.addBool("blockdedup", '\0', "store identical blocks only once (not readable by older versions)");
+		cp.addString("order", '\0', "access order profile, a .nekotrace file or one path per line", false, "");
+		cp.addString("prefix", '\0', "overlay path prefix of this nekodata in the order profile (default: outfile name without extension)", false, "");
 		cp.addPos("outfile", true);
 		cp.addPos("packpath", true);
 		cp.addHelp();
@@ -41,6 +83,27 @@ namespace nekofs_tool {
 			std::cerr << "out.empty()   " << out << std::endl;
 			return -1;
 		}
+		if (cp.getBool("stdout"))
+		{
+			nekofs_SetLogDelegate(stderr_nekofs_log);
+			auto dpath = std::filesystem::absolute(path).lexically_normal().generic_string();
+			if (!std::filesystem::is_directory(dpath))
+			{
+				std::cerr << "!std::filesystem::is_directory(" << dpath << ")" << std::endl;
+				return -1;
+			}
+			dpath = get_utf8_str(dpath);
+			auto tpath = get_utf8_str(std::filesystem::absolute(out).lexically_normal().generic_string());
+#ifdef _WIN32
+			_setmode(_fileno(stdout), _O_BINARY);
+#endif
+			if (NEKOFS_FALSE == nekofs_tools_packToStream(dpath.c_str(), tpath.c_str(), stdout_write, nullptr) || std::fflush(stdout) != 0)
+			{
+				std::cerr << "nekofs_tools_packToStream error" << std::endl;
+				return -1;
+			}
+			return 0;
+		}
 		auto vsize = cp.getString("volumesize");
 		int64_t volumeSize = getVolumeSizeFromString(vsize);
 		if (volumeSize <= 0)
@@ -62,7 +125,19 @@ namespace nekofs_tool {
 			return -1;
 		}
 		fpath = get_utf8_str(fpath);
-		if (NEKOFS_FALSE == nekofs_tools_pack(dpath.c_str(), fpath.c_str(), volumeSize))
+		std::string opath = cp.getString("order");
+		if (!opath.empty())
+		{
+			opath = std::filesystem::absolute(opath).lexically_normal().generic_string();
+			if (!std::filesystem::is_regular_file(opath))
+			{
+				std::cerr << "!std::filesystem::is_regular_file(" << opath << ")" << std::endl;
+				return -1;
+			}
+			opath = get_utf8_str(opath);
+		}
+		std::string oprefix = get_utf8_str(cp.getString("prefix"));
+		if (NEKOFS_FALSE == nekofs_tools_packWithOrderPrefix(dpath.c_str(), fpath.c_str(), volumeSize, cp.getBool("cdc") ? NEKOFS_TRUE : NEKOFS_FALSE, cp.getBool("blockdedup") ? NEKOFS_TRUE : NEKOFS_FALSE, opath.c_str(), oprefix.c_str()))
 		{
 			std::cerr << "nekofs_tools_pack error" << std::endl;
 			return -1;
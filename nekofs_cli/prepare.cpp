@@ -13,6 +13,8 @@ namespace nekofs_tool {
 		cmd::parser cp;
 		cp.addString("verfile", 'v', "version file path", true, "");
 		cp.addInt("offset", '\0', "version offet", false, 0);
+		cp.addString("cache", '\0', "hash cache file, unchanged files (size, mtime, inode) are not hashed again", false, "");
+		cp.addBool("paranoid", '\0', "ignore the hash cache and hash all files");
 		cp.addPos("path", true);
 		cp.addHelp();
 		try
@@ -61,6 +63,16 @@ namespace nekofs_tool {
 		}
 		genpath = get_utf8_str(genpath);
 		versionpath = get_utf8_str(versionpath);
+		if (std::string cachefile = cp.getString("cache"); !cachefile.empty())
+		{
+			auto cachepath = get_utf8_str(std::filesystem::absolute(cachefile).lexically_normal().generic_string());
+			if (NEKOFS_FALSE == nekofs_tools_prepareWithCache(genpath.c_str(), versionpath.c_str(), offset, cachepath.c_str(), cp.getBool("paranoid") ? NEKOFS_TRUE : NEKOFS_FALSE))
+			{
+				std::cerr << "nekofs_tools_prepareWithCache error" << genpath << std::endl;
+				return -1;
+			}
+			return 0;
+		}
 		if (NEKOFS_FALSE == nekofs_tools_prepare(genpath.c_str(), versionpath.c_str(), offset))
 		{
 			std::cerr << "nekofs_tools_prepare error" << genpath << std::endl;
@@ -0,0 +1,64 @@
+﻿#include "warmset.h"
+#include "common.h"
+#include "cmdparse.h"
+
+#include <nekofs/nekofs.h>
+#include <filesystem>
+#include <iostream>
+
+namespace nekofs_tool {
+	int warmset(const std::vector<std::string>& args)
+	{
+		cmd::parser cp;
+		cp.addInt("duration", '\0', "only use accesses in the first N milliseconds, 0 means all", false, 0);
+		cp.addPos("outfile", true);
+		cp.addPos("nekotrace", true);
+		cp.addHelp();
+		try
+		{
+			cp.parse(args);
+		}
+		catch (const cmd::ParseException&)
+		{
+			std::cerr << cp.useage() << std::endl;
+			std::exit(-1);
+		}
+		catch (const cmd::HelpException&)
+		{
+			std::cout << cp.useage() << std::endl;
+			std::exit(0);
+		}
+		std::string out = cp.getPos(0);
+		std::string trace = cp.getPos(1);
+		if (trace.empty())
+		{
+			std::cerr << "trace.empty()   " << trace << std::endl;
+			return -1;
+		}
+		if (out.empty())
+		{
+			std::cerr << "out.empty()   " << out << std::endl;
+			return -1;
+		}
+		const int duration = cp.getInt("duration");
+		if (duration < 0)
+		{
+			std::cerr << "duration error" << duration << std::endl;
+			return -1;
+		}
+		trace = std::filesystem::absolute(trace).lexically_normal().generic_string();
+		if (!std::filesystem::is_regular_file(trace))
+		{
+			std::cerr << "!std::filesystem::is_regular_file(" << trace << ")" << std::endl;
+			return -1;
+		}
+		trace = get_utf8_str(trace);
+		auto fpath = get_utf8_str(std::filesystem::absolute(out).lexically_normal().generic_string());
+		if (NEKOFS_FALSE == nekofs_tools_mkwarmset(trace.c_str(), fpath.c_str(), duration))
+		{
+			std::cerr << "nekofs_tools_mkwarmset error" << std::endl;
+			return -1;
+		}
+		return 0;
+	}
+}
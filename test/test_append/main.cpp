@@ -0,0 +1,153 @@
+﻿#include "../../nekofs/nekodata/nekodataarchiver.h"
+#include "../../nekofs/nekodata/nekodatafilesystem.h"
+#include "../../nekofs/common/env.h"
+#include "../../nekofs/common/utils.h"
+#ifdef _WIN32
+#include "../../nekofs/native_win/nativefilesystem.h"
+#else
+#include "../../nekofs/native_posix/nativefilesystem.h"
+#endif
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <iostream>
+
+using namespace nekofs;
+
+#ifdef _WIN32
+const char* archive_file = u8"D:/test/test_append/pack.nekodata";
+#else
+const char* archive_file = u8"/home/jie/work/test_append/pack.nekodata";
+#endif
+constexpr int64_t volume_size = 2 << 20;
+
+void log111(int32_t level, const char* str)
+{
+	if (level != NEKOFS_LOGINFO)
+	{
+		std::cout << "[ERRO]  " << str << std::endl;
+	}
+}
+
+std::string make_content(size_t size, uint32_t seed)
+{
+	std::string content(size, 0);
+	for (size_t i = 0; i < size; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		content[i] = static_cast<char>(seed >> 16);
+	}
+	return content;
+}
+
+bool check_files(std::shared_ptr<NekodataFileSystem> fs, const std::map<std::string, std::string>& files)
+{
+	if (!fs || !fs->verify() || fs->getAllFiles(std::string()).size() != files.size())
+	{
+		return false;
+	}
+	for (const auto& item : files)
+	{
+		auto is = fs->openIStream(item.first);
+		if (!is || is->getLength() != static_cast<int64_t>(item.second.size()))
+		{
+			return false;
+		}
+		std::string content(item.second.size(), 0);
+		if (istream_read(is, &content[0], static_cast<int32_t>(content.size())) != static_cast<int32_t>(content.size()) || content != item.second)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int main()
+{
+	env::getInstance().setLogDelegate(log111);
+	auto nativefs = env::getInstance().getNativeFileSystem();
+	std::map<std::string, std::string> oldFiles;
+	oldFiles[u8"a.bin"] = make_content(100000, 1);
+	oldFiles[u8"b.bin"] = make_content(3000000, 2);
+	oldFiles[u8"c.bin"] = make_content(1000, 3);
+	// 清理上次运行留下的分卷
+	std::string prefix = std::string(archive_file).substr(0, std::string(archive_file).size() - nekofs_kNekodata_FileExtension.size());
+	for (size_t i = 0; i < 16; i++)
+	{
+		std::string volumePath = i == 0 ? std::string(archive_file) : prefix + u8"." + std::to_string(i) + std::string(nekofs_kNekodata_FileExtension);
+		if (nativefs->getFileType(volumePath) != FileType::None)
+		{
+			nativefs->removeFile(volumePath);
+		}
+	}
+	auto archiver = std::make_shared<NekodataArchiver>(archive_file, volume_size);
+	for (const auto& item : oldFiles)
+	{
+		archiver->addBuffer(item.first, item.second.data(), item.second.size());
+	}
+	if (!archiver->archive())
+	{
+		std::cerr << "!archiver->archive()";
+		return -1;
+	}
+	archiver.reset();
+
+	// 追加后分卷数会变化，所有旧分卷都要替换
+	std::map<std::string, std::string> newFiles = oldFiles;
+	newFiles[u8"a.bin"] = make_content(4500000, 4);
+	newFiles[u8"d.bin"] = make_content(50000, 5);
+	newFiles.erase(u8"c.bin");
+	auto appender = NekodataArchiver::createForAppend(archive_file);
+	if (!appender)
+	{
+		std::cerr << "!NekodataArchiver::createForAppend(archive_file)";
+		return -1;
+	}
+	appender->addBuffer(u8"a.bin", newFiles[u8"a.bin"].data(), newFiles[u8"a.bin"].size());
+	appender->addBuffer(u8"d.bin", newFiles[u8"d.bin"].data(), newFiles[u8"d.bin"].size());
+	appender->removeFile(u8"c.bin");
+
+	// 追加写入的过程中打开nekodata，读到的应该是完整的旧版本
+	std::shared_ptr<NekodataFileSystem> liveFs;
+	bool liveOk = true;
+	bool opened = false;
+	auto callback = [&]() {
+		if (opened)
+		{
+			return;
+		}
+		opened = true;
+		liveFs = NekodataFileSystem::create(nativefs, archive_file);
+		liveOk = check_files(liveFs, oldFiles);
+#ifdef _WIN32
+		// Windows上被打开的分卷无法替换
+		liveFs.reset();
+#endif
+	};
+	if (!appender->archive(callback))
+	{
+		std::cerr << "!appender->archive(callback)";
+		return -1;
+	}
+	appender.reset();
+	if (!opened || !liveOk)
+	{
+		std::cerr << "old files changed during append";
+		return -1;
+	}
+	// 已打开的NekodataFileSystem继续读取旧的数据
+	if (liveFs && !check_files(liveFs, oldFiles))
+	{
+		std::cerr << "old files changed after append";
+		return -1;
+	}
+	liveFs.reset();
+	if (!check_files(NekodataFileSystem::create(nativefs, archive_file), newFiles))
+	{
+		std::cerr << "new files error";
+		return -1;
+	}
+	std::cout << "test_append ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,222 @@
+﻿#include "nekofs/nekofs.h"
+#include "../../nekofs/nekodata/nekodatafilesystem.h"
+#include "../../nekofs/layer/overlayfilesystem.h"
+#include "../../nekofs/layer/layerfilesmeta.h"
+#include "../../nekofs/layer/layerdelta.h"
+#include "../../nekofs/common/env.h"
+#include "../../nekofs/common/utils.h"
+#include "../../nekofs/common/sha256.h"
+#ifdef _WIN32
+#include "../../nekofs/native_win/nativefilesystem.h"
+#else
+#include "../../nekofs/native_posix/nativefilesystem.h"
+#endif
+
+#include <cstdint>
+#include <array>
+#include <optional>
+#include <string>
+#include <vector>
+#include <iostream>
+
+using namespace nekofs;
+
+#ifdef _WIN32
+const char* test_root = u8"D:/test/test_delta";
+#else
+const char* test_root = u8"/home/jie/work/test_delta";
+#endif
+
+constexpr int64_t volume_size = 64 * 1024 * 1024;
+const char* version_json = u8R"({"name":"test_delta","fromVersion":0,"version":1,"branch":"main","versionServers":[],"downloadServers":[]})";
+
+void log111(int32_t level, const char* str)
+{
+	if (level != NEKOFS_LOGINFO)
+	{
+		std::cout << "[ERRO]  " << str << std::endl;
+	}
+}
+
+std::string make_content(size_t size, uint32_t seed)
+{
+	std::string content(size, 0);
+	for (size_t i = 0; i < size; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		content[i] = static_cast<char>(seed >> 16);
+	}
+	return content;
+}
+
+bool write_file(std::shared_ptr<NativeFileSystem> nativefs, const std::string& filepath, const std::string& content)
+{
+	auto os = nativefs->openOStream(filepath);
+	return os && ostream_write(os, content.data(), static_cast<int32_t>(content.size())) == static_cast<int32_t>(content.size());
+}
+
+std::string read_all(std::shared_ptr<IStream> is)
+{
+	std::string content;
+	if (is)
+	{
+		content.resize(static_cast<size_t>(is->getLength()));
+		if (istream_read(is, &content[0], static_cast<int32_t>(content.size())) != static_cast<int32_t>(content.size()))
+		{
+			content.clear();
+		}
+	}
+	return content;
+}
+
+std::array<uint32_t, 8> sha256_of(const std::string& content)
+{
+	sha256sum sum;
+	sum.final(content.data(), content.size());
+	return sum.readHash();
+}
+
+/*
+* a.bin足够大才会保存成差异，b.txt不变。
+*/
+bool make_version(std::shared_ptr<NativeFileSystem> nativefs, const std::string& root, uint32_t version, const std::string& content)
+{
+	std::string dirpath = root + u8"/v" + std::to_string(version);
+	return write_file(nativefs, dirpath + u8"/a.bin", content)
+		&& write_file(nativefs, dirpath + u8"/b.txt", u8"unchanged")
+		&& nekofs_tools_prepare(dirpath.c_str(), (root + u8"/version.json").c_str(), version - 1)
+		&& nekofs_tools_pack(dirpath.c_str(), (dirpath + u8".nekodata").c_str(), volume_size);
+}
+
+/*
+* 按顺序叠加各层后读出a.bin。
+*/
+std::string read_overlay(std::shared_ptr<NativeFileSystem> nativefs, const std::vector<std::string>& layers)
+{
+	auto olfs = std::make_shared<OverlayFileSystem>();
+	for (const auto& layer : layers)
+	{
+		auto fs = NekodataFileSystem::create(nativefs, layer);
+		if (!fs || !olfs->addLayer(fs))
+		{
+			return std::string();
+		}
+	}
+	if (!olfs->refreshFileList() || read_all(olfs->openIStream(u8"b.txt")) != u8"unchanged")
+	{
+		return std::string();
+	}
+	return read_all(olfs->openIStream(u8"a.bin"));
+}
+
+std::optional<std::array<uint32_t, 8>> delta_base(std::shared_ptr<NativeFileSystem> nativefs, const std::string& filepath)
+{
+	auto fs = NekodataFileSystem::create(nativefs, filepath);
+	auto lfm = fs ? LayerFilesMeta::load(fs->openIStream(nekofs_kLayerFiles)) : std::nullopt;
+	auto meta = lfm ? lfm->getFileMeta(u8"a.bin") : std::nullopt;
+	return meta ? meta->getDeltaBase() : std::nullopt;
+}
+
+int main()
+{
+	env::getInstance().setLogDelegate(log111);
+	auto nativefs = env::getInstance().getNativeFileSystem();
+	std::string root = test_root;
+	if (nativefs->getFileType(root) != FileType::None)
+	{
+		nativefs->removeDirectories(root);
+	}
+	// v2在中间插入并删除了一段，v3又覆盖了开头的一段
+	std::string content1 = make_content(2 * 1024 * 1024, 1);
+	std::string content2 = content1.substr(0, 500000) + make_content(1000, 2) + content1.substr(500000, 1000000) + content1.substr(1503000);
+	std::string content3 = content2.substr(0, 100) + make_content(4096, 3) + content2.substr(4196);
+
+	// 直接编码再还原
+	std::vector<uint8_t> delta;
+	if (!LayerDelta::encode(reinterpret_cast<const uint8_t*>(content1.data()), static_cast<int64_t>(content1.size()), sha256_of(content1), reinterpret_cast<const uint8_t*>(content2.data()), static_cast<int64_t>(content2.size()), delta)
+		|| !write_file(nativefs, root + u8"/base.bin", content1)
+		|| !write_file(nativefs, root + u8"/delta.bin", std::string(delta.begin(), delta.end())))
+	{
+		std::cerr << "!LayerDelta::encode";
+		return -1;
+	}
+	if (read_all(LayerDeltaIStream::create(nativefs->openIStream(root + u8"/base.bin"), nativefs->openIStream(root + u8"/delta.bin"))) != content2)
+	{
+		std::cerr << "LayerDeltaIStream content mismatch";
+		return -1;
+	}
+
+	if (!write_file(nativefs, root + u8"/version.json", version_json)
+		|| !make_version(nativefs, root, 1, content1)
+		|| !make_version(nativefs, root, 2, content2)
+		|| !make_version(nativefs, root, 3, content3))
+	{
+		std::cerr << "!make_version";
+		return -1;
+	}
+	std::string v1 = root + u8"/v1.nekodata";
+	std::string patch12 = root + u8"/patch12.nekodata";
+	std::string patch23 = root + u8"/patch23.nekodata";
+	if (!nekofs_tools_mkldiffWithDelta(v1.c_str(), (root + u8"/v2.nekodata").c_str(), patch12.c_str(), volume_size, NEKOFS_DIFFVERIFY_ALL, NEKOFS_TRUE)
+		|| !nekofs_tools_mkldiffWithDelta((root + u8"/v2.nekodata").c_str(), (root + u8"/v3.nekodata").c_str(), patch23.c_str(), volume_size, NEKOFS_DIFFVERIFY_ALL, NEKOFS_TRUE))
+	{
+		std::cerr << "!nekofs_tools_mkldiffWithDelta";
+		return -1;
+	}
+	if (delta_base(nativefs, patch12) != sha256_of(content1) || delta_base(nativefs, patch23) != sha256_of(content2))
+	{
+		std::cerr << "a.bin is not stored as delta";
+		return -1;
+	}
+
+	// 挂载基础版本和差异补丁
+	if (read_overlay(nativefs, { v1, patch12 }) != content2 || read_overlay(nativefs, { v1, patch12, patch23 }) != content3)
+	{
+		std::cerr << "overlay content mismatch";
+		return -1;
+	}
+
+	// 合并范围包含基础版本时还原成完整文件
+	std::string mergedFull = root + u8"/merged_full.nekodata";
+	const char* withBase[] = { v1.c_str(), patch12.c_str() };
+	if (!nekofs_tools_mergeToNekodata(mergedFull.c_str(), volume_size, withBase, 2, NEKOFS_TRUE))
+	{
+		std::cerr << "!nekofs_tools_mergeToNekodata(withBase)";
+		return -1;
+	}
+	auto fullfs = NekodataFileSystem::create(nativefs, mergedFull);
+	if (delta_base(nativefs, mergedFull).has_value() || !fullfs || read_all(fullfs->openIStream(u8"a.bin")) != content2)
+	{
+		std::cerr << "merge with base did not store the full file";
+		return -1;
+	}
+	fullfs.reset();
+
+	// 1->2和2->3合并成相对于v1的一个差异
+	std::string mergedChain = root + u8"/merged_chain.nekodata";
+	const char* chain[] = { patch12.c_str(), patch23.c_str() };
+	if (!nekofs_tools_mergeToNekodata(mergedChain.c_str(), volume_size, chain, 2, NEKOFS_TRUE))
+	{
+		std::cerr << "!nekofs_tools_mergeToNekodata(chain)";
+		return -1;
+	}
+	if (delta_base(nativefs, mergedChain) != sha256_of(content1) || read_overlay(nativefs, { v1, mergedChain }) != content3)
+	{
+		std::cerr << "chained delta merge mismatch";
+		return -1;
+	}
+	std::string mergedDir = root + u8"/merged_dir";
+	if (!nekofs_tools_mergeToDir(mergedDir.c_str(), volume_size, chain, 2, NEKOFS_TRUE))
+	{
+		std::cerr << "!nekofs_tools_mergeToDir(chain)";
+		return -1;
+	}
+	auto deltais = LayerDeltaIStream::create(NekodataFileSystem::create(nativefs, v1)->openIStream(u8"a.bin"), nativefs->openIStream(mergedDir + u8"/a.bin"));
+	if (read_all(deltais) != content3)
+	{
+		std::cerr << "chained delta mergeToDir mismatch";
+		return -1;
+	}
+	std::cout << "test_delta ok" << std::endl;
+	return 0;
+}
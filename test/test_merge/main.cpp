@@ -0,0 +1,132 @@
+﻿#include "nekofs/nekofs.h"
+
+#include <cstring>
+#include <string>
+#include <iostream>
+
+#ifdef _WIN32
+const char* test_root = u8"D:/test/test_merge";
+#else
+const char* test_root = u8"/home/jie/work/test_merge";
+#endif
+
+constexpr int64_t volume_size = 64 * 1024 * 1024;
+const char* version_json = u8R"({"name":"test_merge","fromVersion":0,"version":1,"branch":"main","versionServers":[],"downloadServers":[]})";
+
+extern "C" {
+	void log111(int32_t level, const char* str)
+	{
+		switch (level)
+		{
+		case NEKOFS_LOGWARN:
+			std::cout << "[WARN]  " << str << std::endl;
+			break;
+		case NEKOFS_LOGERR:
+			std::cout << "[ERRO]  " << str << std::endl;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+bool write_file(const std::string& filepath, const std::string& content)
+{
+	auto handle = nekofs_native_OpenOStream(filepath.c_str());
+	if (handle == INVALID_NEKOFSHANDLE)
+	{
+		return false;
+	}
+	bool success = nekofs_ostream_Write(handle, content.data(), static_cast<int32_t>(content.size())) == static_cast<int32_t>(content.size());
+	nekofs_ostream_Close(handle);
+	return success;
+}
+
+std::string read_file(const std::string& filepath)
+{
+	std::string content;
+	auto handle = nekofs_native_OpenIStream(filepath.c_str());
+	if (handle == INVALID_NEKOFSHANDLE)
+	{
+		return content;
+	}
+	content.resize(static_cast<size_t>(nekofs_istream_GetLength(handle)));
+	if (nekofs_istream_Read(handle, &content[0], static_cast<int32_t>(content.size())) != static_cast<int32_t>(content.size()))
+	{
+		content.clear();
+	}
+	nekofs_istream_Close(handle);
+	return content;
+}
+
+/*
+* 生成第version个版本的目录并打包。a.txt每个版本都不同，b.txt不变。
+*/
+bool make_version(const std::string& root, uint32_t version)
+{
+	std::string dirpath = root + u8"/v" + std::to_string(version);
+	return write_file(dirpath + u8"/a.txt", u8"content of version " + std::to_string(version))
+		&& write_file(dirpath + u8"/b.txt", u8"unchanged")
+		&& nekofs_tools_prepare(dirpath.c_str(), (root + u8"/version.json").c_str(), version - 1)
+		&& nekofs_tools_pack(dirpath.c_str(), (dirpath + u8".nekodata").c_str(), volume_size);
+}
+
+int main()
+{
+	nekofs_SetLogDelegate(log111);
+	std::string root = test_root;
+	if (nekofs_native_GetFileType(test_root) != NEKOFS_FT_NONE)
+	{
+		nekofs_native_RemoveDirectory(test_root);
+	}
+	if (!write_file(root + u8"/version.json", version_json))
+	{
+		std::cerr << "!write_file(version.json)";
+		return -1;
+	}
+	for (uint32_t version = 1; version <= 3; version++)
+	{
+		if (!make_version(root, version))
+		{
+			std::cerr << "!make_version " << version;
+			return -1;
+		}
+	}
+	std::string patch12 = root + u8"/patch12.nekodata";
+	std::string patch23 = root + u8"/patch23.nekodata";
+	if (!nekofs_tools_mkldiff((root + u8"/v1.nekodata").c_str(), (root + u8"/v2.nekodata").c_str(), patch12.c_str(), volume_size)
+		|| !nekofs_tools_mkldiff((root + u8"/v2.nekodata").c_str(), (root + u8"/v3.nekodata").c_str(), patch23.c_str(), volume_size))
+	{
+		std::cerr << "!nekofs_tools_mkldiff";
+		return -1;
+	}
+
+	// 两个补丁都改了a.txt，合并结果应该是后一个补丁里的版本
+	const char* patches[] = { patch12.c_str(), patch23.c_str() };
+	std::string mergedDir = root + u8"/merged";
+	if (!nekofs_tools_mergeToDir(mergedDir.c_str(), volume_size, patches, 2, NEKOFS_TRUE))
+	{
+		std::cerr << "!nekofs_tools_mergeToDir";
+		return -1;
+	}
+	if (read_file(mergedDir + u8"/a.txt") != u8"content of version 3")
+	{
+		std::cerr << "mergeToDir took a.txt from an older patch";
+		return -1;
+	}
+	std::string mergedFile = root + u8"/merged.nekodata";
+	std::string unpackDir = root + u8"/unpacked";
+	if (!nekofs_tools_mergeToNekodata(mergedFile.c_str(), volume_size, patches, 2, NEKOFS_TRUE)
+		|| !nekofs_tools_unpack(mergedFile.c_str(), unpackDir.c_str()))
+	{
+		std::cerr << "!nekofs_tools_mergeToNekodata";
+		return -1;
+	}
+	if (read_file(unpackDir + u8"/a.txt") != u8"content of version 3")
+	{
+		std::cerr << "mergeToNekodata took a.txt from an older patch";
+		return -1;
+	}
+	std::cout << "test_merge ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,173 @@
+﻿#include "../../nekofs/nekodata/nekodataarchiver.h"
+#include "../../nekofs/nekodata/nekodatafilesystem.h"
+#include "../../nekofs/common/env.h"
+#include "../../nekofs/common/utils.h"
+#include "../../nekofs/common/lz4.h"
+#ifdef _WIN32
+#include "../../nekofs/native_win/nativefilesystem.h"
+#else
+#include "../../nekofs/native_posix/nativefilesystem.h"
+#endif
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <iostream>
+
+using namespace nekofs;
+
+#ifdef _WIN32
+const char* test_root = u8"D:/test/test_pack";
+#else
+const char* test_root = u8"/home/jie/work/test_pack";
+#endif
+constexpr int64_t volume_size = 1 << 20;
+constexpr size_t block_size = nekofs_kNekoData_LZ4_Buffer_Size;
+
+void log111(int32_t level, const char* str)
+{
+	if (level != NEKOFS_LOGINFO)
+	{
+		std::cout << "[ERRO]  " << str << std::endl;
+	}
+}
+
+std::string make_content(size_t size, uint32_t seed)
+{
+	std::string content(size, 0);
+	for (size_t i = 0; i < size; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		content[i] = static_cast<char>(seed >> 16);
+	}
+	return content;
+}
+
+std::string make_text(size_t size, uint32_t seed)
+{
+	std::string content(size, 0);
+	for (size_t i = 0; i < size; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		content[i] = "abcdefgh"[(seed >> 16) % 3 == 0 ? (seed >> 20) % 8 : i % 8];
+	}
+	return content;
+}
+
+bool check_files(std::shared_ptr<NekodataFileSystem> fs, const std::map<std::string, std::string>& files, size_t archiveNum)
+{
+	if (!fs || !fs->verify() || fs->getAllFiles(std::string()).size() != files.size() + archiveNum)
+	{
+		return false;
+	}
+	for (const auto& item : files)
+	{
+		auto is = fs->openIStream(item.first);
+		if (!is || is->getLength() != static_cast<int64_t>(item.second.size()))
+		{
+			return false;
+		}
+		std::string content(item.second.size(), 0);
+		if (istream_read(is, &content[0], static_cast<int32_t>(content.size())) != static_cast<int32_t>(content.size()) || content != item.second)
+		{
+			return false;
+		}
+		// 从后半段开始读，块要能单独定位
+		if (item.second.size() > block_size)
+		{
+			size_t pos = item.second.size() / 2;
+			std::string tail(item.second.size() - pos, 0);
+			if (is->seek(static_cast<int64_t>(pos), SeekOrigin::Begin) != static_cast<int64_t>(pos)
+				|| istream_read(is, &tail[0], static_cast<int32_t>(tail.size())) != static_cast<int32_t>(tail.size())
+				|| tail != item.second.substr(pos))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/*
+* 打包后重新打开，校验并读取所有文件。返回所有分卷的总大小，失败时返回-1。
+*/
+int64_t pack_and_check(std::shared_ptr<NativeFileSystem> nativefs, const std::string& name, bool contentDefined, bool blockDedup,
+	const std::map<std::string, std::string>& files, const std::map<std::string, std::string>& subFiles)
+{
+	std::string archiveFile = std::string(test_root) + u8"/" + name + std::string(nekofs_kNekodata_FileExtension);
+	auto archiver = std::make_shared<NekodataArchiver>(archiveFile, volume_size);
+	if (contentDefined && !archiver->setContentDefinedChunking())
+	{
+		return -1;
+	}
+	archiver->setBlockDeduplicate(blockDedup);
+	for (const auto& item : files)
+	{
+		archiver->addBuffer(item.first, item.second.data(), item.second.size());
+	}
+	auto sub = archiver->addArchive(u8"sub.nekodata");
+	for (const auto& item : subFiles)
+	{
+		sub->addBuffer(item.first, item.second.data(), item.second.size());
+	}
+	if (!archiver->archive())
+	{
+		return -1;
+	}
+	archiver.reset();
+	sub.reset();
+
+	auto fs = NekodataFileSystem::create(nativefs, archiveFile);
+	if (!check_files(fs, files, 1) || !check_files(NekodataFileSystem::create(fs, u8"sub.nekodata"), subFiles, 0))
+	{
+		return -1;
+	}
+	int64_t total = 0;
+	std::string prefix = archiveFile.substr(0, archiveFile.size() - nekofs_kNekodata_FileExtension.size());
+	for (size_t i = 0; i < fs->getVolumeNum(); i++)
+	{
+		total += nativefs->getSize(i == 0 ? archiveFile : prefix + u8"." + std::to_string(i) + std::string(nekofs_kNekodata_FileExtension));
+	}
+	return total;
+}
+
+int main()
+{
+	env::getInstance().setLogDelegate(log111);
+	auto nativefs = env::getInstance().getNativeFileSystem();
+	if (nativefs->getFileType(test_root) != FileType::None)
+	{
+		nativefs->removeDirectories(test_root);
+	}
+	std::map<std::string, std::string> files;
+	files[u8"a.bin"] = make_content(10 * block_size + 1000, 1);
+	files[u8"b.txt"] = make_text(500000, 2);
+	// c.bin的前几个块和a.bin相同，去重后从第0块起就不是连续的数据
+	files[u8"c.bin"] = files[u8"a.bin"].substr(0, 4 * block_size) + make_content(50000, 3);
+	// d.bin中间的块和a.bin相同
+	files[u8"d.bin"] = make_content(2 * block_size, 4) + files[u8"a.bin"].substr(0, 3 * block_size) + make_text(20000, 5);
+	files[u8"empty"] = std::string();
+	files[u8"small.txt"] = u8"small";
+	std::map<std::string, std::string> subFiles;
+	subFiles[u8"x.bin"] = make_content(3 * block_size, 6);
+	subFiles[u8"y.bin"] = subFiles[u8"x.bin"].substr(0, 2 * block_size) + make_content(1000, 7);
+
+	// 固定大小分块使用旧的目录格式，按内容分块只多记录原始大小，块级去重再记录数据位置
+	int64_t fixedSize = pack_and_check(nativefs, u8"fixed", false, false, files, subFiles);
+	int64_t cdcSize = pack_and_check(nativefs, u8"cdc", true, false, files, subFiles);
+	int64_t dedupSize = pack_and_check(nativefs, u8"dedup", false, true, files, subFiles);
+	int64_t cdcDedupSize = pack_and_check(nativefs, u8"cdc_dedup", true, true, files, subFiles);
+	if (fixedSize < 0 || cdcSize < 0 || dedupSize < 0 || cdcDedupSize < 0)
+	{
+		std::cerr << "pack round trip failed " << fixedSize << " " << cdcSize << " " << dedupSize << " " << cdcDedupSize;
+		return -1;
+	}
+	// 去重省掉c.bin、d.bin和y.bin中共享的块
+	if (dedupSize + static_cast<int64_t>(8 * block_size) > fixedSize || cdcDedupSize >= cdcSize)
+	{
+		std::cerr << "block dedup did not shrink the archive " << fixedSize << " " << dedupSize << " " << cdcSize << " " << cdcDedupSize;
+		return -1;
+	}
+	std::cout << "test_pack ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,129 @@
+﻿#include "nekofs/nekofs.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <string>
+
+/*
+* 对比各个sha256实现的结果和速度。
+*/
+static const char* kernelName(NekoFSSHA256Kernel kernel)
+{
+	switch (kernel)
+	{
+	case NEKOFS_SHA256_SCALAR:
+		return "scalar";
+	case NEKOFS_SHA256_SHANI:
+		return "sha-ni";
+	case NEKOFS_SHA256_ARMV8:
+		return "armv8";
+	default:
+		return "unknown";
+	}
+}
+
+static std::string toHex(const uint32_t result[8])
+{
+	std::stringstream ss;
+	for (size_t i = 0; i < 8; i++)
+	{
+		ss << std::hex << std::setw(8) << std::setfill('0') << result[i];
+	}
+	return ss.str();
+}
+
+int main()
+{
+	// FIPS 180-2 测试向量
+	const char* msg1 = "abc";
+	const char* msg2 = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	const char* hash1 = "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+	const char* hash2 = "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1";
+	const char* hashEmpty = "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+
+	const int64_t size = 256 * 1024 * 1024;
+	std::vector<uint8_t> data(size);
+	std::mt19937 rng(0);
+	for (auto& item : data)
+	{
+		item = static_cast<uint8_t>(rng());
+	}
+
+	auto defaultKernel = nekofs_sha256_GetKernel();
+	std::cout << "default kernel: " << kernelName(defaultKernel) << std::endl;
+
+	int ret = 0;
+	std::string reference;
+	for (NekoFSSHA256Kernel kernel : { NEKOFS_SHA256_SCALAR, NEKOFS_SHA256_SHANI, NEKOFS_SHA256_ARMV8 })
+	{
+		if (NEKOFS_FALSE == nekofs_sha256_SetKernel(kernel))
+		{
+			std::cout << std::setw(8) << kernelName(kernel) << ": not supported" << std::endl;
+			continue;
+		}
+		uint32_t result[8];
+		bool ok = true;
+		ok = ok && nekofs_sha256_sum32(msg1, std::strlen(msg1), result) && toHex(result) == hash1;
+		ok = ok && nekofs_sha256_sum32(msg2, std::strlen(msg2), result) && toHex(result) == hash2;
+		ok = ok && nekofs_sha256_sum32(nullptr, 0, result) && toHex(result) == hashEmpty;
+
+		auto begin = std::chrono::steady_clock::now();
+		nekofs_sha256_sum32(data.data(), size, result);
+		auto end = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(end - begin).count();
+		if (reference.empty())
+		{
+			reference = toHex(result);
+		}
+		ok = ok && reference == toHex(result);
+		std::cout << std::setw(8) << kernelName(kernel) << ": " << std::fixed << std::setprecision(1) << size / seconds / 1024 / 1024 << " MB/s " << (ok ? "ok" : "FAILED") << std::endl;
+		if (!ok)
+		{
+			ret = -1;
+		}
+	}
+	nekofs_sha256_SetKernel(defaultKernel);
+
+	// 多路实现，随机长度的小消息，和单路的结果对比。消息取自前16MB，避免只测到内存带宽
+	const size_t messageNum = 64 * 1024;
+	const int64_t messageRange = 16 * 1024 * 1024;
+	std::vector<const void*> datas(messageNum);
+	std::vector<int64_t> sizes(messageNum);
+	std::vector<uint32_t> expected(messageNum * 8);
+	int64_t totalSize = 0;
+	for (size_t i = 0; i < messageNum; i++)
+	{
+		sizes[i] = static_cast<int64_t>(rng() % 4096);
+		datas[i] = data.data() + rng() % (messageRange - sizes[i]);
+		totalSize += sizes[i];
+		nekofs_sha256_sum32(datas[i], sizes[i], expected.data() + i * 8);
+	}
+	for (NekoFSBool multiBuffer : { NEKOFS_FALSE, NEKOFS_TRUE })
+	{
+		if (NEKOFS_FALSE == nekofs_sha256_SetMultiBuffer(multiBuffer) && multiBuffer != NEKOFS_FALSE)
+		{
+			std::cout << "   batch: multi-buffer not supported" << std::endl;
+			continue;
+		}
+		std::vector<uint32_t> results(messageNum * 8);
+		auto begin = std::chrono::steady_clock::now();
+		bool ok = nekofs_sha256_sumbatch32(datas.data(), sizes.data(), static_cast<int32_t>(messageNum), results.data()) != NEKOFS_FALSE;
+		auto end = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(end - begin).count();
+		ok = ok && results == expected;
+		std::cout << "   batch: " << nekofs_sha256_GetBatchLanes() << " lanes " << std::fixed << std::setprecision(1) << totalSize / seconds / 1024 / 1024 << " MB/s " << (ok ? "ok" : "FAILED") << std::endl;
+		if (!ok)
+		{
+			ret = -1;
+		}
+	}
+	nekofs_sha256_SetMultiBuffer(NEKOFS_TRUE);
+	return ret;
+}